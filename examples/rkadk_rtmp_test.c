@@ -149,6 +149,7 @@ rtmp:
   signal(SIGINT, sigterm_handler);
   char cmd[64];
   printf("\n#Usage: input 'quit' to exit programe!\n"
+         "input 'stats' to print publisher statistics\n"
          "peress any other key to quit\n");
   while (!is_quit) {
     fgets(cmd, sizeof(cmd), stdin);
@@ -170,6 +171,15 @@ rtmp:
         goto rtmp;
 #endif
       }
+    } else if (strstr(cmd, "stats")) {
+      RKADK_RTMP_STATS_S stStats;
+      if (!RKADK_RTMP_GetStats(pHandle, &stStats))
+        RKADK_LOGP("connected: %d, tx: %llu bytes, video: %d, audio: %d, "
+                   "drop: %d, queue: %d, reconnect: %d, bitrate: %d",
+                   stStats.bConnected, stStats.u64TxBytes,
+                   stStats.u32TxVideoFrames, stStats.u32TxAudioFrames,
+                   stStats.u32DropFrames, stStats.u32QueueLen,
+                   stStats.u32ReconnectCnt, stStats.u32Bitrate);
     } else if (strstr(cmd, "480")) {
       stResCfg.enResType = RKADK_RES_480P;
       stResCfg.enStreamType = RKADK_STREAM_TYPE_LIVE;
@@ -32,8 +32,33 @@ typedef enum {
 
 typedef void (*RKADK_AOV_NOTIFY_CALLBACK)(RKADK_AOV_EVENT_E enEvent, void *msg);
 
+/* wake cycle stages, each one ends at its mark and starts at the previous */
+typedef enum {
+  RKADK_AOV_STAGE_CAPTURE = 0, // resume to the frame capture (venc pts)
+  RKADK_AOV_STAGE_ENCODE,      // capture to the encoded stream
+  RKADK_AOV_STAGE_MUX,         // stream to written or cached
+  RKADK_AOV_STAGE_FLUSH,       // cache write out to the sleep request
+  RKADK_AOV_STAGE_BUTT
+} RKADK_AOV_STAGE_E;
+
+/* hardware access of the power manager, replaceable to simulate on a host */
+typedef struct {
+  void *pCtx;
+  int (*pfnSetSuspendTime)(void *pCtx, uint32_t u32Ms);
+  int (*pfnSetCpuOnline)(void *pCtx, bool bOnline); // non boot cpus, NULL: no hotplug
+  int (*pfnEnterSleep)(void *pCtx);                 // returns after resume
+  uint64_t (*pfnGetTimeUs)(void *pCtx);             // CLOCK_MONOTONIC, as the venc pts
+} RKADK_AOV_HAL_S;
+
+typedef struct {
+  uint32_t u32WakeBudgetMs; // wake time target per cycle, 0: measure only
+  uint32_t u32SuspendMaxMs; // suspend time limit when stretched, 0: 4x the set time
+  RKADK_AOV_HAL_S *pstHal;  // NULL: the soc registers and sysfs
+} RKADK_AOV_PM_ATTR_S;
+
 typedef struct {
   RKADK_AOV_NOTIFY_CALLBACK pfnNotifyCallback;
+  RKADK_AOV_PM_ATTR_S stPmAttr;
 } RKADK_AOV_ARG_S;
 
 void RKADK_AOV_WakeupLock();
@@ -45,8 +70,102 @@ int RKADK_AOV_SetSuspendTime(int u32WakeupSuspendTime);
 int RKADK_AOV_DisableNonBootCPUs();
 int RKADK_AOV_EnableNonBootCPUs();
 void RKADK_AOV_Notify(RKADK_AOV_EVENT_E enEvent, void *msg);
+/* u64TimeUs 0: now */
+void RKADK_AOV_MarkStage(RKADK_AOV_STAGE_E enStage, uint64_t u64TimeUs);
 //void RKADK_AOV_DumpPtsToTMP(uint32_t seq, uint64_t pts, int max_dump_pts_count);
 
+/*
+ * Write coalescing for aov lapse record: frames of each wake cycle are kept
+ * in a RAM ring, and written out in one go only when enough bytes are
+ * pending, the oldest one is too old, or a deep sleep is forced. The other
+ * wake cycles go back to sleep without touching the storage.
+ */
+typedef int (*RKADK_AOV_SCHED_WRITE_FN)(void *pCtx, unsigned char *buf, uint32_t size,
+                                        int64_t pts, int isKeyFrame, uint32_t seq);
+/* enters sleep, returns after resume */
+typedef int (*RKADK_AOV_SCHED_SLEEP_FN)(void *pCtx);
+/* ms, must keep counting while suspended */
+typedef uint64_t (*RKADK_AOV_SCHED_CLOCK_FN)(void);
+
+typedef struct {
+  uint32_t u32RingSize;       // RAM for pending frames, bytes
+  uint32_t u32FlushBytes;     // flush at this many pending bytes, 0: 3/4 of the ring
+  uint32_t u32FlushIntervalS; // flush when the oldest pending frame is this old, 0: no limit
+  void *pCtx;
+  RKADK_AOV_SCHED_WRITE_FN pfnWrite;
+  RKADK_AOV_SCHED_SLEEP_FN pfnSleep;
+  RKADK_AOV_SCHED_CLOCK_FN pfnClock; // NULL: CLOCK_BOOTTIME
+} RKADK_AOV_SCHED_ATTR_S;
+
+typedef struct {
+  uint32_t u32WakeCnt;        // wake cycles ended by RKADK_AOV_SCHED_Sleep
+  uint32_t u32WakeLastMs;     // resume to the next sleep request
+  uint32_t u32WakeAvgMs;
+  uint32_t u32WakeMaxMs;
+  uint32_t u32FlushCnt;
+  uint32_t u32FlushLastBytes;
+  uint32_t u32FlushAvgBytes;  // bytes per flush
+  uint32_t u32FlushPerHour;   // since the scheduler was created
+  uint32_t u32PendingBytes;
+  uint32_t u32PendingFrames;
+  uint32_t u32WriteErrCnt;
+} RKADK_AOV_SCHED_STATS_S;
+
+void *RKADK_AOV_SCHED_Create(RKADK_AOV_SCHED_ATTR_S *pstAttr);
+/* pending frames are dropped, flush first to keep them */
+void RKADK_AOV_SCHED_Destroy(void *pSched);
+/* copies the frame, flushes first when the ring can't hold it */
+int RKADK_AOV_SCHED_Push(void *pSched, unsigned char *buf, uint32_t size,
+                         int64_t pts, int isKeyFrame, uint32_t seq);
+/* writes all pending frames through pfnWrite */
+int RKADK_AOV_SCHED_Flush(void *pSched);
+/* ends a wake cycle: flushes if due or bDeep, then calls pfnSleep */
+int RKADK_AOV_SCHED_Sleep(void *pSched, bool bDeep);
+/*
+ * Marks a system resume. pfnSleep only suspends once every stream asked to,
+ * so the other streams start their next wake cycle here. Ignored by a
+ * scheduler with its own pfnClock.
+ */
+void RKADK_AOV_SCHED_Resume(void);
+void RKADK_AOV_SCHED_GetStats(void *pSched, RKADK_AOV_SCHED_STATS_S *pstStats);
+
+/*
+ * Power manager for the aov wake cycles, behind RKADK_AOV_SetSuspendTime,
+ * RKADK_AOV_Disable/EnableNonBootCPUs and RKADK_AOV_EnterSleep. It keeps the
+ * register mapping and the sysfs files open, times each wake cycle by stage,
+ * and while active (non boot cpus disabled) fits the cycles to the wake
+ * budget: the suspend time is stretched when the wake time is over budget,
+ * and the non boot cpus are brought up when that measures shorter wakes.
+ */
+typedef struct {
+  uint32_t u32LastUs;
+  uint32_t u32AvgUs;
+  uint32_t u32MaxUs;
+} RKADK_AOV_PM_TIME_S;
+
+typedef struct {
+  uint32_t u32WakeCnt;
+  RKADK_AOV_PM_TIME_S stWake; // resume to the sleep request
+  RKADK_AOV_PM_TIME_S astStage[RKADK_AOV_STAGE_BUTT];
+  uint32_t u32OverBudgetCnt;
+  uint32_t u32SuspendMs;      // programmed
+  bool bCpuOnline;            // non boot cpus
+  uint32_t u32HotplugCnt;     // cpu switches made by the policy
+  uint32_t au32WakeEwmaUs[2]; // by non boot cpus: [0] offline, [1] online
+} RKADK_AOV_PM_STATS_S;
+
+void *RKADK_AOV_PM_Create(RKADK_AOV_PM_ATTR_S *pstAttr);
+void RKADK_AOV_PM_Destroy(void *pPm);
+/* the nominal suspend time, stretched up to u32SuspendMaxMs when over budget */
+int RKADK_AOV_PM_SetSuspendTime(void *pPm, uint32_t u32Ms);
+/* active: non boot cpus offline and the policy on; inactive: cpus online */
+int RKADK_AOV_PM_SetActive(void *pPm, bool bActive);
+void RKADK_AOV_PM_MarkStage(void *pPm, RKADK_AOV_STAGE_E enStage, uint64_t u64TimeUs);
+/* ends a wake cycle and applies the policy, returns after resume */
+int RKADK_AOV_PM_EnterSleep(void *pPm);
+void RKADK_AOV_PM_GetStats(void *pPm, RKADK_AOV_PM_STATS_S *pstStats);
+int RKADK_AOV_GetPmStats(RKADK_AOV_PM_STATS_S *pstStats);
+
 #ifdef __cplusplus
 }
 #endif
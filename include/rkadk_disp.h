@@ -28,12 +28,23 @@ typedef struct {
   RKADK_RECT_S stVoRect;
 } RKADK_DISP_ATTR_S;
 
+/* counted by the vpss to vo feeder, the unbound preview of RV1106/RV1103B */
+typedef struct {
+  RKADK_U32 u32PresentCnt; // frames queued to vo
+  RKADK_U32 u32DropCnt;    // replaced by a newer frame while vo was busy
+  RKADK_U32 u32SkipCnt;    // decimated to the panel refresh
+  RKADK_U32 u32StaleCnt;   // old geometry after RKADK_DISP_SetAttr
+  RKADK_U32 u32BusyCnt;    // vo submissions refused
+} RKADK_DISP_STATS_S;
+
 RKADK_S32 RKADK_DISP_Init(RKADK_U32 u32CamId);
 
 RKADK_S32 RKADK_DISP_DeInit(RKADK_U32 u32CamId);
 
 RKADK_S32 RKADK_DISP_SetAttr(RKADK_U32 u32CamId, RKADK_DISP_ATTR_S *pstAttr);
 
+RKADK_S32 RKADK_DISP_GetStats(RKADK_U32 u32CamId, RKADK_DISP_STATS_S *pstStats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -43,18 +43,20 @@ extern "C" {
 #define RKADK_LOGI(fmt, ...)  RKADK_TRACE(RKADK_LOG_LEVEL_INFO,    fmt, ##__VA_ARGS__)
 #define RKADK_LOGD(fmt, ...)  RKADK_TRACE(RKADK_LOG_LEVEL_DEBUG,   fmt, ##__VA_ARGS__)
 
+/*
+ * Lines are queued to a writer thread, export rkadk_log_sync=1 to write
+ * from the calling thread. rkadk_log_file also writes to a file.
+ */
 void rkadk_log(int level, const char *fmt,
                   const char *fname, const int row, ...);
 int get_log_level();
 
-#define RKADK_KLOG(format, ...)                                                \
-  do {                                                                         \
-    FILE *fp = fopen("/dev/kmsg", "w");                                        \
-    if (NULL != fp) {                                                          \
-      fprintf(fp, "[RKADK]: " format"\n", ##__VA_ARGS__);                      \
-      fclose(fp);                                                              \
-    }                                                                          \
-  } while (0)
+/* lines dropped because the queue was full */
+unsigned int get_log_drop_cnt();
+
+void rkadk_klog(const char *fmt, ...);
+
+#define RKADK_KLOG(format, ...) rkadk_klog(format, ##__VA_ARGS__)
 
 #ifdef __cplusplus
 }
@@ -88,12 +88,27 @@ typedef void (*RKADK_MEDIA_VENC_DATA_PROC_FUNC)(RKADK_MEDIA_VENC_DATA_S stData,
 typedef void (*RKADK_MEDIA_AENC_DATA_PROC_FUNC)(AUDIO_STREAM_S stFrame,
                                                 RKADK_VOID *pHandle);
 
+typedef struct {
+  RKADK_U64 u64CallCnt;  /* <callback count */
+  RKADK_U32 u32P50Us;    /* <median callback time */
+  RKADK_U32 u32P99Us;    /* <99th percentile callback time */
+  RKADK_U32 u32MaxUs;    /* <max callback time */
+  bool bDeferred;        /* <called from its own thread */
+  RKADK_U32 u32QueueLen; /* <streams waiting in the deferred queue */
+  RKADK_U32 u32DropCnt;  /* <streams dropped by the deferred queue */
+} RKADK_MEDIA_CB_STATS_S;
+
 typedef struct {
   AIISP_CALLBACK_FUNC_S stAiIspCallback;      /* post isp callback function */
   const RK_CHAR        *pModelFilePath;       /* post isp model file path   */
   RK_U32                u32FrameBufCnt;       /* RW; frame buffer cnt    */
 } RKADK_POST_ISP_ATTR_S;
 
+typedef enum {
+  RKADK_MEDIA_HEALTH_FMT_TEXT = 0,
+  RKADK_MEDIA_HEALTH_FMT_JSON,
+} RKADK_MEDIA_HEALTH_FMT_E;
+
 #define RKADK_BUFINFO(fmt, ...)  RKADK_MEDIA_DumpBufinfo(fmt, __FUNCTION__, __LINE__, ##__VA_ARGS__)
 
 RKADK_S32 RKADK_MPI_SYS_Init();
@@ -174,6 +189,20 @@ RKADK_MEDIA_StopGetVencBuffer(RKADK_U32 u32CamId, MPP_CHN_S *pstChn, bool bIsAov
                               RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
                               RKADK_VOID *pHandle);
 
+/*
+ * u32BudgetUs = 0 disables the budget. A callback over budget for several
+ * frames in a row is called from its own thread with a referenced stream,
+ * and stays there until it stops getting buffer.
+ */
+RKADK_S32 RKADK_MEDIA_SetVencCbBudget(MPP_CHN_S *pstChn,
+                                      RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
+                                      RKADK_VOID *pHandle, RKADK_U32 u32BudgetUs);
+
+RKADK_S32 RKADK_MEDIA_GetVencCbStats(MPP_CHN_S *pstChn,
+                                     RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
+                                     RKADK_VOID *pHandle,
+                                     RKADK_MEDIA_CB_STATS_S *pstStats);
+
 RKADK_S32 RKADK_MEDIA_FrameBufMalloc(RKADK_FRAME_ATTR_S *pstFrameAttr);
 
 RKADK_S32 RKADK_MEDIA_FrameFree(RKADK_FRAME_ATTR_S *pstFrameAttr);
@@ -202,6 +231,13 @@ RKADK_S32 RKADK_MEDIA_ToggleVencFlip(RKADK_U32 u32CamId,
                                   RKADK_STREAM_TYPE_E enStrmType,
                                   bool flip);
 
+/*
+ * Writes a snapshot of the used channels, binds and, if bNode, the driver
+ * debug nodes into pBuf. Returns the length, or -1 if u32Size is too small.
+ */
+RKADK_S32 RKADK_MEDIA_GetHealth(RKADK_MEDIA_HEALTH_FMT_E enFmt, bool bNode,
+                                RKADK_CHAR *pBuf, RKADK_U32 u32Size);
+
 void RKADK_MEDIA_DumpBufinfo(const char *fmt, const char *fname, const int row, ...);
 
 RKADK_S32 RKADK_MEDIA_EnablePostIsp(RKADK_U32 u32CamId, RKADK_STREAM_TYPE_E enStrmType,
@@ -77,7 +77,15 @@ typedef struct {
 /* muxer pts callback function */
 typedef RKADK_VOID (*RKADK_MUXER_PTS_CALLBACK_FN)(const RKADK_MUXER_PTS_INFO_S *pstPtsInfo);
 
-/* muxer event callback function */
+/*
+ * muxer event callback function
+ * With the split done ahead, a stream's MuxerRoll thread reports the files
+ * it closes (FILE_END, MANUAL_SPLIT_END) and the failures to open the next
+ * one (ERR_GET_FILENAME, ERR_CREATE_FILE_FAIL); the stream thread reports
+ * the rest. The callback may run on both threads at once and must be
+ * thread safe, and FILE_END of a file may arrive after FILE_BEGIN of the
+ * next one.
+ */
 typedef RKADK_VOID (*RKADK_MUXER_EVENT_CALLBACK_FN)(
     RKADK_MW_PTR pHandle, const RKADK_MUXER_EVENT_INFO_S *pstEventInfo);
 
@@ -192,6 +200,9 @@ typedef int (*RKADK_MOUMNT_SDCARD_FN)(void);
 typedef struct {
   RKADK_ISP_WAKE_UP_PAUSE_FN pfnSingleFrame;
   RKADK_ISP_WAKE_UP_RESUME_FN pfnMultiFrame;
+  RKADK_U32 u32CacheSize;        /* RAM for aov lapse frames across wake cycles, 0: write every frame */
+  RKADK_U32 u32FlushSize;        /* cached bytes that trigger a write out, 0: 3/4 of u32CacheSize */
+  RKADK_U32 u32FlushIntervalSec; /* longest time a frame stays cached, 0: no limit */
 } RKADK_AOV_ATTR_S;
 
 typedef struct {
@@ -231,6 +242,7 @@ typedef struct {
   RKADK_U32 u32StreamCnt;
   RKADK_MW_PTR pMuxerHandle[RKADK_MUXER_STREAM_MAX_CNT];
   RKADK_U64 u64AudioPts;
+  RKADK_MW_PTR pAudioClock;
   RKADK_U32 u32FragKeyFrame;
   int enableFileCache;
   RKADK_AOV_ATTR_S stAovAttr;
@@ -240,6 +252,17 @@ typedef struct {
   RKADK_PIP_ATTR_S stPipAttr[RECORD_FILE_NUM_MAX];
 } RKADK_MUXER_HANDLE_S;
 
+/* file switch of a stream */
+typedef struct {
+  RKADK_U32 u32PreOpenCnt;   /* files opened ahead of the split */
+  RKADK_U32 u32LateOpenCnt;  /* files waited for at the split, the first file included */
+  RKADK_U32 u32MaxWaitUs;    /* longest wait at the split, unit: us */
+  RKADK_U32 u32MaxCloseUs;   /* longest file close, unit: us */
+  RKADK_U32 u32DropFrameCnt; /* video frames dropped for a full cell list */
+  RKADK_U32 u32WriteKBps;    /* card write speed of the latest write back, unit: KB/s */
+  RKADK_U32 u32MaxFlushUs;   /* longest write back, unit: us */
+} RKADK_MUXER_ROLLOVER_STATS_S;
+
 /**
  * @brief create a new muxer
  * @param[in]pstRecAttr : the attribute of muxer
@@ -347,6 +370,35 @@ bool RKADK_MUXER_IsUseVpss(RKADK_MW_PTR pHandle, RKADK_U32 u32VencChn);
 RKADK_S32 RKADK_MUXER_UpdateRes(RKADK_MW_PTR pHandle, RKADK_U32 chnId,
                               RKADK_U32 u32Wdith, RKADK_U32 u32Hieght);
 
+/**
+ * @brief get the file switch stats of a stream
+ * @param[in]pHandle : pointer of muxer
+ * @param[in]chnId : venc channel id of the stream
+ * @return 0 success
+ * @return -1 failure
+ */
+RKADK_S32 RKADK_MUXER_GetRolloverStats(RKADK_MW_PTR pHandle, RKADK_U32 chnId,
+                                       RKADK_MUXER_ROLLOVER_STATS_S *pstStats);
+
+/**
+ * @brief write out the aov lapse frames cached in RAM, call it before forcing
+ * a deep sleep. Not to be called from the RKADK_AOV_ENTER_SLEEP callback.
+ * @param[in]pHandle : pointer of muxer
+ * @return 0 success
+ * @return -1 failure
+ */
+RKADK_S32 RKADK_MUXER_AovFlush(RKADK_MW_PTR pHandle);
+
+/**
+ * @brief get the aov write scheduler stats of a stream
+ * @param[in]pHandle : pointer of muxer
+ * @param[in]chnId : venc channel id of the stream
+ * @return 0 success
+ * @return -1 failure, or no RAM cache
+ */
+RKADK_S32 RKADK_MUXER_GetAovStats(RKADK_MW_PTR pHandle, RKADK_U32 chnId,
+                                  RKADK_AOV_SCHED_STATS_S *pstStats);
+
 #ifdef FILE_CACHE
 void RKADK_MUXER_FsCacheNotify();
 void RKADK_MUXER_FileCacheInit();
@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 #include "rkadk_common.h"
+#include <time.h>
 
 /*| chip name      | encode type support do osd   |
   | -------------  | ---------------------------- |
@@ -69,6 +70,46 @@ RKADK_S32 RKADK_OSD_UpdateDisplayAttr(RKADK_U32 u32OsdId, RKADK_U32 u32CamId,
 
 RKADK_S32 RKADK_OSD_UpdateOsdSize(RKADK_U32 u32OsdId, RKADK_OSD_ATTR_S *pstOsdAttr);
 
+/* 1bpp glyph bitmaps, each row starts at a byte boundary, MSB is the left pixel */
+typedef struct {
+  RKADK_U32 u32Width;
+  RKADK_U32 u32Height;
+  const char *pChars;   /* <characters of the glyphs, in pData order */
+  const RKADK_U8 *pData;
+} RKADK_OSD_FONT_S;
+
+typedef struct {
+  const RKADK_OSD_FONT_S *pstFont; /* <NULL: built-in 8x16 font, covers " -./0123456789:" */
+  RKADK_U32 u32FontSize;           /* <glyph height, integer multiple of the font height */
+  RKADK_FORMAT_E Format;           /* <RKADK_FMT_ARGB8888/ARGB1555/2BPP */
+  RKADK_U32 u32FgColor;            /* <ARGB8888, palette index for 2BPP */
+  RKADK_U32 u32BgColor;            /* <ARGB8888, palette index for 2BPP */
+  RKADK_U32 u32MaxChars;
+} RKADK_OSD_TEXT_ATTR_S;
+
+/*
+ * Text layer rendered from a pre-rasterized glyph atlas, only the changed
+ * character cells are redrawn. One text can update several osd regions,
+ * get the bitmap size for RKADK_OSD_Init by RKADK_OSD_TEXT_GetAttr.
+ */
+RKADK_S32 RKADK_OSD_TEXT_Create(RKADK_OSD_TEXT_ATTR_S *pstAttr,
+                                RKADK_MW_PTR *ppHandle);
+
+RKADK_S32 RKADK_OSD_TEXT_Destroy(RKADK_MW_PTR pHandle);
+
+RKADK_S32 RKADK_OSD_TEXT_GetAttr(RKADK_MW_PTR pHandle,
+                                 RKADK_OSD_ATTR_S *pstOsdAttr);
+
+/* return the number of redrawn cells */
+RKADK_S32 RKADK_OSD_TEXT_SetString(RKADK_MW_PTR pHandle, const char *pStr);
+
+/* strftime format, skipped if time and format are not changed */
+RKADK_S32 RKADK_OSD_TEXT_SetTime(RKADK_MW_PTR pHandle, const char *pFmt,
+                                 time_t time);
+
+/* push the bitmap to the osd region if the text has changed since last push */
+RKADK_S32 RKADK_OSD_TEXT_Update(RKADK_MW_PTR pHandle, RKADK_U32 u32OsdId);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,7 +39,7 @@ typedef RKADK_S32 (*RKADK_REC_REQUEST_FILE_NAMES_FN)(
 /** record task's attribute */
 typedef struct {
   RKADK_S32 s32CamID;                                   /* camera id */
-  RKADK_U32 u32FragKeyFrame;
+  RKADK_U32 u32FragKeyFrame;                            /* mp4 fragments at key frames, cut at the last one on power loss */
   RKADK_REC_REQUEST_FILE_NAMES_FN pfnRequestFileNames;  /* rec callbak */
   RKADK_REC_EVENT_CALLBACK_FN pfnEventCallback;         /* event callbak */
   RKADK_REC_PTS_CALLBACK_FN pfnPtsCallback;             /* pts callbak */
@@ -47,8 +47,17 @@ typedef struct {
   RKADK_POST_ISP_ATTR_S *pstPostIspAttr;
   RKADK_MOUMNT_SDCARD_FN pfnMountSdcard;
   RKADK_PIP_ATTR_S stPipAttr[RECORD_FILE_NUM_MAX];
+  RKADK_U32 u32FileNameDepth;  /* file names requested ahead per stream, 0: default 2, max 16 */
 } RKADK_RECORD_ATTR_S;
 
+/* file name requests at file split, over all streams */
+typedef struct {
+  RKADK_U32 u32RequestCnt;
+  RKADK_U32 u32FallbackCnt;  /* names generated locally, the app callback was late */
+  RKADK_U32 u32LastUs;       /* latest split wait of the streams, unit: us */
+  RKADK_U32 u32MaxUs;
+} RKADK_REC_FILE_NAME_STATS_S;
+
 /****************************************************************************/
 /*                            Interface Definition                          */
 /****************************************************************************/
@@ -145,6 +154,21 @@ RKADK_S32 RKADK_RECORD_ManualSplit(RKADK_MW_PTR pRecorder,
  */
 RKADK_S32 RKADK_RECORD_GetAencChn();
 
+/**
+ * @brief write out the cached aov lapse frames before a forced deep sleep
+ * @return 0 success
+ * @return -1 failure
+ */
+RKADK_S32 RKADK_RECORD_AovFlush(RKADK_MW_PTR pRecorder);
+
+/**
+ * @brief get the file name latency at file split
+ * @return 0 success
+ * @return -1 failure
+ */
+RKADK_S32 RKADK_RECORD_GetFileNameStats(RKADK_MW_PTR pRecorder,
+                                        RKADK_REC_FILE_NAME_STATS_S *pstStats);
+
 /**
  * @brief toggle mirror implemented by VPSS
  * @return 0 success
@@ -23,6 +23,22 @@ extern "C" {
 
 #include "rkadk_common.h"
 
+typedef struct {
+  bool bConnected;            /* <connected to the rtmp server */
+  RKADK_U64 u64TxBytes;       /* <bytes written to the flv muxer */
+  RKADK_U32 u32TxVideoFrames; /* <video frames written to the flv muxer */
+  RKADK_U32 u32TxAudioFrames; /* <audio frames written to the flv muxer */
+  RKADK_U32 u32DropFrames;    /* <frames dropped by congestion or disconnect */
+  RKADK_U32 u32QueueLen;      /* <packets waiting in the send queue */
+  RKADK_U32 u32ReconnectCnt;  /* <successful reconnections */
+  RKADK_U32 u32Bitrate;       /* <current live venc bitrate, unit: bps */
+} RKADK_RTMP_STATS_S;
+
+/*
+ * Frames are published from a send thread. On congestion video is dropped
+ * up to the next key frame and the live venc bitrate is lowered, a lost
+ * connection is retried with exponential backoff.
+ */
 RKADK_S32 RKADK_RTMP_Init(RKADK_U32 u32CamId, const char *path,
                           RKADK_MW_PTR *ppHandle);
 
@@ -30,6 +46,9 @@ RKADK_S32 RKADK_RTMP_DeInit(RKADK_MW_PTR pHandle);
 
 RKADK_S32 RKADK_RTMP_VideoReset(RKADK_MW_PTR pHandle);
 
+RKADK_S32 RKADK_RTMP_GetStats(RKADK_MW_PTR pHandle,
+                              RKADK_RTMP_STATS_S *pstStats);
+
 #ifdef __cplusplus
 }
 #endif
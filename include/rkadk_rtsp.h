@@ -23,9 +23,31 @@ extern "C" {
 
 #include "rkadk_common.h"
 
+typedef struct {
+  RKADK_U64 u64TxBytes;       /* <bytes handed to the rtsp server */
+  RKADK_U32 u32TxVideoFrames; /* <video frames handed to the rtsp server */
+  RKADK_U32 u32TxAudioFrames; /* <audio frames handed to the rtsp server */
+  RKADK_U32 u32DropFrames;    /* <frames dropped by the send queue */
+  RKADK_U32 u32QueueLen;      /* <packets waiting in the send queue */
+} RKADK_RTSP_STATS_S;
+
+/* live stream session, same as RKADK_RTSP_InitStream(RKADK_STREAM_TYPE_LIVE) */
 RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
                           RKADK_MW_PTR *ppHandle);
 
+/*
+ * Sessions with the same port share one rtsp server, enStrmType supports
+ * LIVE, PREVIEW, VIDEO_MAIN and VIDEO_SUB. VIDEO_MAIN/VIDEO_SUB serve the
+ * record venc, so record must be initialized first.
+ */
+RKADK_S32 RKADK_RTSP_InitStream(RKADK_U32 u32CamId,
+                                RKADK_STREAM_TYPE_E enStrmType,
+                                RKADK_U32 port, const char *path,
+                                RKADK_MW_PTR *ppHandle);
+
+RKADK_S32 RKADK_RTSP_GetStats(RKADK_MW_PTR pHandle,
+                              RKADK_RTSP_STATS_S *pstStats);
+
 RKADK_S32 RKADK_RTSP_DeInit(RKADK_MW_PTR pHandle);
 
 RKADK_S32 RKADK_RTSP_Start(RKADK_MW_PTR pHandle);
@@ -49,12 +49,67 @@ typedef struct {
   RKADK_VOID *pMblk;
 } RKADK_UI_FRAME_INFO;
 
+#define RKADK_UI_SURFACE_BUF_MAX 3
+
+typedef struct {
+  RKADK_U32 u32Width;
+  RKADK_U32 u32Height;
+  RKADK_FORMAT_E Format; // rgb, or yuv420sp with an even size
+  RKADK_U32 u32BufCnt;   // 2 or 3, 0: 3
+} RKADK_UI_SURFACE_ATTR_S;
+
+typedef struct {
+  RKADK_U32 u32Index;
+  RKADK_U32 u32Width;
+  RKADK_U32 u32Height;
+  RKADK_U32 u32Stride; // bytes per line, the chroma plane of yuv follows the luma
+  RKADK_VOID *pVirAddr;
+  RKADK_VOID *pMblk;
+} RKADK_UI_BUFFER_S;
+
+typedef struct {
+  RKADK_U32 u32SubmitCnt;
+  RKADK_U32 u32PresentCnt;          // accepted by vo
+  RKADK_U32 u32ReplaceCnt;          // replaced by a newer submit before vo took it
+  RKADK_U32 u32SendFailCnt;
+  RKADK_U32 u32AcquireWaitCnt;      // acquires that waited for a free buffer
+  RKADK_U32 u32SubmitLatencyLastUs; // submit to accepted by vo
+  RKADK_U32 u32SubmitLatencyAvgUs;
+  RKADK_U32 u32SubmitLatencyMaxUs;
+  RKADK_U32 u32FrameIntervalLastUs; // between presents
+  RKADK_U32 u32FrameIntervalAvgUs;
+  RKADK_U32 u32FrameIntervalMaxUs;
+  RKADK_U64 u64CopyBytes;           // dirty regions copied forward
+} RKADK_UI_SURFACE_STATS_S;
+
 RKADK_S32 RKADK_UI_Create(RKADK_UI_ATTR_S *pstUiAttr, RKADK_MW_PTR *ppUi);
 
 RKADK_S32 RKADK_UI_Destroy(RKADK_MW_PTR pUi);
 
 RKADK_S32 RKADK_UI_Update(RKADK_MW_PTR pUi, RKADK_UI_FRAME_INFO *pstUiFrameInfo);
 
+/*
+ * A surface owns its buffers and submits them to vo from its own thread.
+ * The app acquires a back buffer, redraws what changed and submits it
+ * with the dirty rects. An acquired buffer already holds the last
+ * submitted frame: only the regions dirtied since its own content are
+ * copied forward. A buffer replaced on screen is handed out again one
+ * display period later, so the app never draws into the scanned one.
+ */
+RKADK_S32 RKADK_UI_CreateSurface(RKADK_MW_PTR pUi, RKADK_UI_SURFACE_ATTR_S *pstAttr);
+
+RKADK_S32 RKADK_UI_DestroySurface(RKADK_MW_PTR pUi);
+
+/* s32TimeoutMs -1: wait for a free buffer, 0: don't wait */
+RKADK_S32 RKADK_UI_AcquireBuffer(RKADK_MW_PTR pUi, RKADK_UI_BUFFER_S *pstBuffer,
+                                 RKADK_S32 s32TimeoutMs);
+
+/* pstDirtyRect NULL: the whole buffer; replaces a submit vo has not taken */
+RKADK_S32 RKADK_UI_SubmitBuffer(RKADK_MW_PTR pUi, RKADK_UI_BUFFER_S *pstBuffer,
+                                RKADK_RECT_S *pstDirtyRect, RKADK_U32 u32RectCnt);
+
+RKADK_S32 RKADK_UI_GetSurfaceStats(RKADK_MW_PTR pUi, RKADK_UI_SURFACE_STATS_S *pstStats);
+
 #ifdef __cplusplus
 }
 #endif
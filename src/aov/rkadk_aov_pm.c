@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2023 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "rkadk_common.h"
+#include "rkadk_log.h"
+#include "rkadk_aov.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef RV1106_1103
+#define SUSPEND_TIME_REG 0xff300048
+#else
+#define SUSPEND_TIME_REG 0xff3e0048
+#endif
+
+#define SOC_SLEEP_STR "mem"
+#define SOC_SLEEP_PATH "/sys/power/state"
+#define SOC_CPU_ONLINE_PATH "/sys/devices/system/cpu/cpu%d/online"
+#define SOC_NON_BOOT_CPU_CNT 3
+
+/* wake time average weight, 1/8 of each cycle */
+#define AOV_PM_EWMA_SHIFT 3
+/* cycles on a cpu setting before it is judged */
+#define AOV_PM_PROBE_CYCLES 8
+/* cycles after which the other cpu setting is measured again */
+#define AOV_PM_REPROBE_CYCLES 256
+/* default suspend stretch limit, times the set suspend time */
+#define AOV_PM_SUSPEND_MAX_RATIO 4
+/* stretched suspend time changes under 1/16 are not written */
+#define AOV_PM_SUSPEND_STEP_SHIFT 4
+
+typedef struct {
+  int memFd;
+  void *pMap;
+  size_t mapSize;
+  volatile uint32_t *pReg;
+  int cpuFd[SOC_NON_BOOT_CPU_CNT];
+  int sleepFd;
+} AOV_SOC_S;
+
+typedef struct {
+  uint64_t u64SumUs;
+  RKADK_AOV_PM_TIME_S stTime;
+} AOV_PM_TIME_S;
+
+typedef struct {
+  RKADK_AOV_PM_ATTR_S stAttr;
+  RKADK_AOV_HAL_S stHal;
+  AOV_SOC_S stSoc;
+  pthread_mutex_t mutex;
+  bool bActive;
+  bool bSuspendSet;        // u32SuspendMs is programmed
+  uint32_t u32NominalMs;   // from RKADK_AOV_PM_SetSuspendTime
+  uint32_t u32ArmCycles;   // cycles on the current cpu setting
+  bool abArmSeen[2];
+  int64_t as64EwmaUs[2];
+  uint64_t u64WakeUs;      // resume time, 0: not in a cycle
+  uint64_t au64Mark[RKADK_AOV_STAGE_BUTT];
+  AOV_PM_TIME_S stWake;
+  AOV_PM_TIME_S astStage[RKADK_AOV_STAGE_BUTT];
+  RKADK_AOV_PM_STATS_S stStats;
+} AOV_PM_S;
+
+static int RKADK_AOV_SOC_SetSuspendTime(void *pCtx, uint32_t u32Ms) {
+  off_t pageBase;
+  AOV_SOC_S *pstSoc = (AOV_SOC_S *)pCtx;
+
+  if (!pstSoc->pReg) {
+    pstSoc->memFd = open("/dev/mem", O_RDWR | O_SYNC);
+    if (pstSoc->memFd < 0) {
+      RKADK_LOGE("open /dev/mem failed, errno=%d, %s", errno, strerror(errno));
+      return -1;
+    }
+
+    pstSoc->mapSize = getpagesize();
+    pageBase = SUSPEND_TIME_REG & ~(pstSoc->mapSize - 1);
+    pstSoc->pMap = mmap(NULL, pstSoc->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        pstSoc->memFd, pageBase);
+    if (pstSoc->pMap == MAP_FAILED) {
+      RKADK_LOGE("mmap suspend time reg failed, errno=%d, %s", errno, strerror(errno));
+      pstSoc->pMap = NULL;
+      close(pstSoc->memFd);
+      pstSoc->memFd = -1;
+      return -1;
+    }
+
+    pstSoc->pReg = (volatile uint32_t *)((char *)pstSoc->pMap + (SUSPEND_TIME_REG - pageBase));
+  }
+
+#ifdef RV1106_1103
+  *pstSoc->pReg = (uint32_t)((uint64_t)u32Ms * 32768 / 1000);
+#else
+  *pstSoc->pReg = u32Ms * 91;
+#endif
+  return 0;
+}
+
+#ifndef RV1106_1103
+static int RKADK_AOV_SOC_SetCpuOnline(void *pCtx, bool bOnline) {
+  int i, ret = 0;
+  char path[64];
+  const char *value = bOnline ? "1" : "0";
+  AOV_SOC_S *pstSoc = (AOV_SOC_S *)pCtx;
+
+  for (i = 0; i < SOC_NON_BOOT_CPU_CNT; i++) {
+    if (pstSoc->cpuFd[i] < 0) {
+      snprintf(path, sizeof(path), SOC_CPU_ONLINE_PATH, i + 1);
+      pstSoc->cpuFd[i] = open(path, O_WRONLY);
+      if (pstSoc->cpuFd[i] < 0)
+        continue;
+    }
+
+    if (pwrite(pstSoc->cpuFd[i], value, 1, 0) < 0) {
+      RKADK_LOGE("%s cpu %d failed because %s", bOnline ? "enable" : "disable", i + 1,
+                 strerror(errno));
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+#endif
+
+static int RKADK_AOV_SOC_EnterSleep(void *pCtx) {
+  AOV_SOC_S *pstSoc = (AOV_SOC_S *)pCtx;
+
+  if (pstSoc->sleepFd < 0) {
+    pstSoc->sleepFd = open(SOC_SLEEP_PATH, O_WRONLY);
+    if (pstSoc->sleepFd < 0) {
+      RKADK_LOGE("Failed to open %s, errno=%d, %s", SOC_SLEEP_PATH, errno, strerror(errno));
+      return -1;
+    }
+  }
+
+  if (pwrite(pstSoc->sleepFd, SOC_SLEEP_STR, strlen(SOC_SLEEP_STR), 0) < 0) {
+    RKADK_LOGE("Failed to write %s, errno=%d, %s", SOC_SLEEP_STR, errno, strerror(errno));
+    return -1;
+  }
+
+  RKADK_LOGD("echo \"%s\" > %s successfully", SOC_SLEEP_STR, SOC_SLEEP_PATH);
+  return 0;
+}
+
+static uint64_t RKADK_AOV_SOC_GetTimeUs(void *pCtx) {
+  struct timespec ts;
+
+  (void)pCtx;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void RKADK_AOV_SOC_Init(AOV_PM_S *pstPm) {
+  int i;
+  AOV_SOC_S *pstSoc = &pstPm->stSoc;
+
+  pstSoc->memFd = -1;
+  pstSoc->sleepFd = -1;
+  for (i = 0; i < SOC_NON_BOOT_CPU_CNT; i++)
+    pstSoc->cpuFd[i] = -1;
+
+  pstPm->stHal.pCtx = pstSoc;
+  pstPm->stHal.pfnSetSuspendTime = RKADK_AOV_SOC_SetSuspendTime;
+#ifdef RV1106_1103
+  // single core
+  pstPm->stHal.pfnSetCpuOnline = NULL;
+#else
+  pstPm->stHal.pfnSetCpuOnline = RKADK_AOV_SOC_SetCpuOnline;
+#endif
+  pstPm->stHal.pfnEnterSleep = RKADK_AOV_SOC_EnterSleep;
+  pstPm->stHal.pfnGetTimeUs = RKADK_AOV_SOC_GetTimeUs;
+}
+
+static void RKADK_AOV_SOC_Deinit(AOV_SOC_S *pstSoc) {
+  int i;
+
+  if (pstSoc->pMap)
+    munmap(pstSoc->pMap, pstSoc->mapSize);
+  if (pstSoc->memFd >= 0)
+    close(pstSoc->memFd);
+  if (pstSoc->sleepFd >= 0)
+    close(pstSoc->sleepFd);
+  for (i = 0; i < SOC_NON_BOOT_CPU_CNT; i++) {
+    if (pstSoc->cpuFd[i] >= 0)
+      close(pstSoc->cpuFd[i]);
+  }
+}
+
+static uint64_t RKADK_AOV_PM_Now(AOV_PM_S *pstPm) {
+  return pstPm->stHal.pfnGetTimeUs(pstPm->stHal.pCtx);
+}
+
+static void RKADK_AOV_PM_AddTime(AOV_PM_TIME_S *pstTime, uint64_t u64Us, uint32_t u32Cnt) {
+  if (u64Us > UINT32_MAX)
+    u64Us = UINT32_MAX;
+
+  pstTime->u64SumUs += u64Us;
+  pstTime->stTime.u32LastUs = (uint32_t)u64Us;
+  pstTime->stTime.u32AvgUs = (uint32_t)(pstTime->u64SumUs / u32Cnt);
+  if (u64Us > pstTime->stTime.u32MaxUs)
+    pstTime->stTime.u32MaxUs = (uint32_t)u64Us;
+}
+
+static int RKADK_AOV_PM_ApplySuspendTime(AOV_PM_S *pstPm, uint32_t u32Ms) {
+  int ret;
+
+  if (pstPm->bSuspendSet && pstPm->stStats.u32SuspendMs == u32Ms)
+    return 0;
+
+  ret = pstPm->stHal.pfnSetSuspendTime(pstPm->stHal.pCtx, u32Ms);
+  if (ret) {
+    RKADK_LOGD("Failed to set suspend time!");
+    return ret;
+  }
+
+  pstPm->bSuspendSet = true;
+  pstPm->stStats.u32SuspendMs = u32Ms;
+  RKADK_LOGD("wakeup suspend time = %d", u32Ms);
+  return 0;
+}
+
+static int RKADK_AOV_PM_ApplyCpuOnline(AOV_PM_S *pstPm, bool bOnline) {
+  int ret;
+
+  if (!pstPm->stHal.pfnSetCpuOnline || pstPm->stStats.bCpuOnline == bOnline)
+    return 0;
+
+  // a partial failure leaves cores in either state, measure the cycles as asked
+  ret = pstPm->stHal.pfnSetCpuOnline(pstPm->stHal.pCtx, bOnline);
+  pstPm->stStats.bCpuOnline = bOnline;
+  pstPm->u32ArmCycles = 0;
+  pstPm->abArmSeen[bOnline] = false;
+  RKADK_LOGD("non boot cpus %s", bOnline ? "online" : "offline");
+  return ret;
+}
+
+/* suspend time that keeps the wake duty cycle of the budget */
+static uint32_t RKADK_AOV_PM_SuspendTarget(AOV_PM_S *pstPm) {
+  uint64_t u64BudgetUs, u64Ms, u64MaxMs;
+  int64_t s64EwmaUs;
+  bool bOnline = pstPm->stStats.bCpuOnline;
+
+  u64BudgetUs = (uint64_t)pstPm->stAttr.u32WakeBudgetMs * 1000;
+  s64EwmaUs = pstPm->as64EwmaUs[bOnline];
+  if (!pstPm->bActive || !u64BudgetUs)
+    return pstPm->u32NominalMs;
+
+  // just switched cpus, hold the suspend time until the new setting is measured
+  if (!pstPm->abArmSeen[bOnline])
+    return pstPm->bSuspendSet ? pstPm->stStats.u32SuspendMs : pstPm->u32NominalMs;
+
+  if (s64EwmaUs <= (int64_t)u64BudgetUs)
+    return pstPm->u32NominalMs;
+
+  u64MaxMs = pstPm->stAttr.u32SuspendMaxMs;
+  if (!u64MaxMs)
+    u64MaxMs = (uint64_t)pstPm->u32NominalMs * AOV_PM_SUSPEND_MAX_RATIO;
+
+  u64Ms = (uint64_t)pstPm->u32NominalMs * s64EwmaUs / u64BudgetUs;
+  if (u64Ms > u64MaxMs)
+    u64Ms = u64MaxMs;
+  if (u64Ms < pstPm->u32NominalMs)
+    u64Ms = pstPm->u32NominalMs;
+  return (uint32_t)u64Ms;
+}
+
+/* keeps the cpu setting with the shorter wakes, offline unless over budget */
+static void RKADK_AOV_PM_CpuPolicy(AOV_PM_S *pstPm) {
+  int64_t s64BudgetUs;
+  bool bOnline = pstPm->stStats.bCpuOnline;
+  bool bSwitch = false;
+
+  if (!pstPm->stHal.pfnSetCpuOnline || pstPm->u32ArmCycles < AOV_PM_PROBE_CYCLES)
+    return;
+
+  s64BudgetUs = (int64_t)pstPm->stAttr.u32WakeBudgetMs * 1000;
+  if (!bOnline) {
+    if (pstPm->as64EwmaUs[0] > s64BudgetUs &&
+        (!pstPm->abArmSeen[1] || pstPm->as64EwmaUs[1] < pstPm->as64EwmaUs[0] ||
+         pstPm->u32ArmCycles >= AOV_PM_REPROBE_CYCLES))
+      bSwitch = true;
+  } else {
+    if ((pstPm->abArmSeen[0] && pstPm->as64EwmaUs[1] >= pstPm->as64EwmaUs[0]) ||
+        pstPm->u32ArmCycles >= AOV_PM_REPROBE_CYCLES)
+      bSwitch = true;
+  }
+
+  if (bSwitch) {
+    RKADK_LOGI("wake %lldus with cpus %s, %lldus %s, bring cpus %s",
+               (long long)pstPm->as64EwmaUs[bOnline], bOnline ? "online" : "offline",
+               (long long)pstPm->as64EwmaUs[!bOnline], bOnline ? "offline" : "online",
+               bOnline ? "offline" : "online");
+    RKADK_AOV_PM_ApplyCpuOnline(pstPm, !bOnline);
+    pstPm->stStats.u32HotplugCnt++;
+  }
+}
+
+static void RKADK_AOV_PM_EndCycle(AOV_PM_S *pstPm, uint64_t u64EndUs) {
+  int i;
+  uint32_t u32Ms, u32StepMs;
+  uint64_t u64PrevUs, u64WakeUs;
+  bool bOnline = pstPm->stStats.bCpuOnline;
+  RKADK_AOV_PM_STATS_S *pstStats = &pstPm->stStats;
+
+  pstStats->u32WakeCnt++;
+  u64WakeUs = u64EndUs - pstPm->u64WakeUs;
+  RKADK_AOV_PM_AddTime(&pstPm->stWake, u64WakeUs, pstStats->u32WakeCnt);
+
+  // a stage is timed from the previous valid mark, unmarked ones take 0
+  pstPm->au64Mark[RKADK_AOV_STAGE_FLUSH] = u64EndUs;
+  u64PrevUs = pstPm->u64WakeUs;
+  for (i = 0; i < RKADK_AOV_STAGE_BUTT; i++) {
+    if (pstPm->au64Mark[i] < u64PrevUs || pstPm->au64Mark[i] > u64EndUs) {
+      RKADK_AOV_PM_AddTime(&pstPm->astStage[i], 0, pstStats->u32WakeCnt);
+      continue;
+    }
+
+    RKADK_AOV_PM_AddTime(&pstPm->astStage[i], pstPm->au64Mark[i] - u64PrevUs,
+                         pstStats->u32WakeCnt);
+    u64PrevUs = pstPm->au64Mark[i];
+  }
+
+  if (!pstPm->abArmSeen[bOnline]) {
+    pstPm->as64EwmaUs[bOnline] = (int64_t)u64WakeUs;
+    pstPm->abArmSeen[bOnline] = true;
+  } else {
+    pstPm->as64EwmaUs[bOnline] +=
+        ((int64_t)u64WakeUs - pstPm->as64EwmaUs[bOnline]) / (1 << AOV_PM_EWMA_SHIFT);
+  }
+  pstPm->u32ArmCycles++;
+
+  if (pstPm->stAttr.u32WakeBudgetMs &&
+      u64WakeUs > (uint64_t)pstPm->stAttr.u32WakeBudgetMs * 1000)
+    pstStats->u32OverBudgetCnt++;
+
+  if (pstPm->bActive && pstPm->stAttr.u32WakeBudgetMs) {
+    RKADK_AOV_PM_CpuPolicy(pstPm);
+
+    u32Ms = RKADK_AOV_PM_SuspendTarget(pstPm);
+    u32StepMs = pstStats->u32SuspendMs >> AOV_PM_SUSPEND_STEP_SHIFT;
+    if (u32Ms == pstPm->u32NominalMs || u32Ms > pstStats->u32SuspendMs + u32StepMs ||
+        u32Ms + u32StepMs < pstStats->u32SuspendMs)
+      RKADK_AOV_PM_ApplySuspendTime(pstPm, u32Ms);
+  }
+}
+
+void *RKADK_AOV_PM_Create(RKADK_AOV_PM_ATTR_S *pstAttr) {
+  AOV_PM_S *pstPm;
+
+  pstPm = (AOV_PM_S *)calloc(1, sizeof(AOV_PM_S));
+  if (!pstPm) {
+    RKADK_LOGE("malloc aov pm failed");
+    return NULL;
+  }
+
+  if (pstAttr)
+    memcpy(&pstPm->stAttr, pstAttr, sizeof(RKADK_AOV_PM_ATTR_S));
+
+  if (pstPm->stAttr.pstHal) {
+    if (!pstPm->stAttr.pstHal->pfnSetSuspendTime || !pstPm->stAttr.pstHal->pfnEnterSleep ||
+        !pstPm->stAttr.pstHal->pfnGetTimeUs) {
+      RKADK_LOGE("Incomplete aov hal");
+      free(pstPm);
+      return NULL;
+    }
+
+    memcpy(&pstPm->stHal, pstPm->stAttr.pstHal, sizeof(RKADK_AOV_HAL_S));
+    pstPm->stAttr.pstHal = NULL;
+  } else {
+    RKADK_AOV_SOC_Init(pstPm);
+  }
+
+  // cores are up at boot
+  pstPm->stStats.bCpuOnline = true;
+  pthread_mutex_init(&pstPm->mutex, NULL);
+  return pstPm;
+}
+
+void RKADK_AOV_PM_Destroy(void *pPm) {
+  int i;
+  AOV_PM_S *pstPm = (AOV_PM_S *)pPm;
+
+  if (!pstPm)
+    return;
+
+  if (pstPm->stStats.u32WakeCnt) {
+    RKADK_LOGI("aov wake cycles: %d, wake avg: %dus, max: %dus, over budget: %d, "
+               "hotplug: %d", pstPm->stStats.u32WakeCnt, pstPm->stWake.stTime.u32AvgUs,
+               pstPm->stWake.stTime.u32MaxUs, pstPm->stStats.u32OverBudgetCnt,
+               pstPm->stStats.u32HotplugCnt);
+    for (i = 0; i < RKADK_AOV_STAGE_BUTT; i++)
+      RKADK_LOGI("aov stage[%d] avg: %dus, max: %dus", i, pstPm->astStage[i].stTime.u32AvgUs,
+                 pstPm->astStage[i].stTime.u32MaxUs);
+  }
+
+  if (pstPm->stHal.pCtx == &pstPm->stSoc)
+    RKADK_AOV_SOC_Deinit(&pstPm->stSoc);
+
+  pthread_mutex_destroy(&pstPm->mutex);
+  free(pstPm);
+}
+
+int RKADK_AOV_PM_SetSuspendTime(void *pPm, uint32_t u32Ms) {
+  int ret;
+  AOV_PM_S *pstPm = (AOV_PM_S *)pPm;
+
+  RKADK_CHECK_POINTER(pstPm, RKADK_FAILURE);
+
+  pthread_mutex_lock(&pstPm->mutex);
+  pstPm->u32NominalMs = u32Ms;
+  ret = RKADK_AOV_PM_ApplySuspendTime(pstPm, RKADK_AOV_PM_SuspendTarget(pstPm));
+  pthread_mutex_unlock(&pstPm->mutex);
+  return ret;
+}
+
+int RKADK_AOV_PM_SetActive(void *pPm, bool bActive) {
+  int ret;
+  AOV_PM_S *pstPm = (AOV_PM_S *)pPm;
+
+  RKADK_CHECK_POINTER(pstPm, RKADK_FAILURE);
+
+  pthread_mutex_lock(&pstPm->mutex);
+  pstPm->bActive = bActive;
+  ret = RKADK_AOV_PM_ApplyCpuOnline(pstPm, !bActive);
+  if (pstPm->bSuspendSet)
+    RKADK_AOV_PM_ApplySuspendTime(pstPm, RKADK_AOV_PM_SuspendTarget(pstPm));
+
+  // the first cycle starts here, not at the last resume
+  pstPm->u64WakeUs = bActive ? RKADK_AOV_PM_Now(pstPm) : 0;
+  memset(pstPm->au64Mark, 0, sizeof(pstPm->au64Mark));
+  pthread_mutex_unlock(&pstPm->mutex);
+  return ret;
+}
+
+void RKADK_AOV_PM_MarkStage(void *pPm, RKADK_AOV_STAGE_E enStage, uint64_t u64TimeUs) {
+  AOV_PM_S *pstPm = (AOV_PM_S *)pPm;
+
+  if (!pstPm || enStage >= RKADK_AOV_STAGE_BUTT)
+    return;
+
+  if (!u64TimeUs)
+    u64TimeUs = RKADK_AOV_PM_Now(pstPm);
+
+  pthread_mutex_lock(&pstPm->mutex);
+  // capture and encode end with the first frame, mux and flush with the last stream
+  if (pstPm->u64WakeUs &&
+      (!pstPm->au64Mark[enStage] || enStage >= RKADK_AOV_STAGE_MUX))
+    pstPm->au64Mark[enStage] = u64TimeUs;
+  pthread_mutex_unlock(&pstPm->mutex);
+}
+
+int RKADK_AOV_PM_EnterSleep(void *pPm) {
+  int ret;
+  AOV_PM_S *pstPm = (AOV_PM_S *)pPm;
+
+  RKADK_CHECK_POINTER(pstPm, RKADK_FAILURE);
+
+  pthread_mutex_lock(&pstPm->mutex);
+  if (pstPm->u64WakeUs)
+    RKADK_AOV_PM_EndCycle(pstPm, RKADK_AOV_PM_Now(pstPm));
+  pthread_mutex_unlock(&pstPm->mutex);
+
+  ret = pstPm->stHal.pfnEnterSleep(pstPm->stHal.pCtx);
+
+  pthread_mutex_lock(&pstPm->mutex);
+  pstPm->u64WakeUs = RKADK_AOV_PM_Now(pstPm);
+  memset(pstPm->au64Mark, 0, sizeof(pstPm->au64Mark));
+  pthread_mutex_unlock(&pstPm->mutex);
+  return ret;
+}
+
+void RKADK_AOV_PM_GetStats(void *pPm, RKADK_AOV_PM_STATS_S *pstStats) {
+  int i;
+  AOV_PM_S *pstPm = (AOV_PM_S *)pPm;
+
+  if (!pstPm || !pstStats)
+    return;
+
+  pthread_mutex_lock(&pstPm->mutex);
+  memcpy(pstStats, &pstPm->stStats, sizeof(RKADK_AOV_PM_STATS_S));
+  pstStats->stWake = pstPm->stWake.stTime;
+  for (i = 0; i < RKADK_AOV_STAGE_BUTT; i++)
+    pstStats->astStage[i] = pstPm->astStage[i].stTime;
+  for (i = 0; i < 2; i++)
+    pstStats->au32WakeEwmaUs[i] = pstPm->abArmSeen[i] ? (uint32_t)pstPm->as64EwmaUs[i] : 0;
+  pthread_mutex_unlock(&pstPm->mutex);
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "rkadk_common.h"
+#include "rkadk_log.h"
+#include "rkadk_aov.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME CLOCK_MONOTONIC
+#endif
+
+#define AOV_SCHED_ALIGN(x) (((x) + 7) & ~7U)
+
+/* a frame in the ring, followed by its data; u32Size 0 marks a wrap */
+typedef struct {
+  uint32_t u32Size;
+  uint32_t u32Seq;
+  int64_t s64Pts;
+  int32_t isKeyFrame;
+  uint32_t u32Rsv;
+} AOV_SCHED_REC_S;
+
+typedef struct {
+  RKADK_AOV_SCHED_ATTR_S stAttr;
+  unsigned char *pu8Ring;
+  uint32_t u32Head; // next frame to write out
+  uint32_t u32Tail; // next free byte
+  uint64_t u64OldestMs;
+  uint64_t u64CreateMs;
+  uint64_t u64WakeMs;
+  uint64_t u64WakeSumMs;
+  uint64_t u64FlushSumBytes;
+  pthread_mutex_t mutex; // stats, read by other threads
+  RKADK_AOV_SCHED_STATS_S stStats;
+} AOV_SCHED_S;
+
+/* CLOCK_BOOTTIME of the last resume, 0: none */
+static uint64_t g_u64SchedResumeMs = 0;
+
+static uint64_t RKADK_AOV_SCHED_BootMs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t RKADK_AOV_SCHED_Now(AOV_SCHED_S *pstSched) {
+  if (pstSched->stAttr.pfnClock)
+    return pstSched->stAttr.pfnClock();
+
+  return RKADK_AOV_SCHED_BootMs();
+}
+
+void *RKADK_AOV_SCHED_Create(RKADK_AOV_SCHED_ATTR_S *pstAttr) {
+  AOV_SCHED_S *pstSched;
+
+  if (!pstAttr || !pstAttr->pfnWrite || pstAttr->u32RingSize < 2 * sizeof(AOV_SCHED_REC_S)) {
+    RKADK_LOGE("Invalid aov sched attr");
+    return NULL;
+  }
+
+  pstSched = (AOV_SCHED_S *)calloc(1, sizeof(AOV_SCHED_S));
+  if (!pstSched) {
+    RKADK_LOGE("malloc aov sched failed");
+    return NULL;
+  }
+
+  memcpy(&pstSched->stAttr, pstAttr, sizeof(RKADK_AOV_SCHED_ATTR_S));
+  pstSched->stAttr.u32RingSize = pstAttr->u32RingSize & ~7U;
+  if (!pstSched->stAttr.u32FlushBytes || pstSched->stAttr.u32FlushBytes > pstSched->stAttr.u32RingSize)
+    pstSched->stAttr.u32FlushBytes = pstSched->stAttr.u32RingSize / 4 * 3;
+
+  pstSched->pu8Ring = (unsigned char *)malloc(pstSched->stAttr.u32RingSize);
+  if (!pstSched->pu8Ring) {
+    RKADK_LOGE("malloc aov ring[%d] failed", pstSched->stAttr.u32RingSize);
+    free(pstSched);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pstSched->mutex, NULL);
+  pstSched->u64CreateMs = RKADK_AOV_SCHED_Now(pstSched);
+  pstSched->u64WakeMs = pstSched->u64CreateMs;
+  RKADK_LOGI("aov sched ring: %d, flush: %d bytes or %ds", pstSched->stAttr.u32RingSize,
+             pstSched->stAttr.u32FlushBytes, pstSched->stAttr.u32FlushIntervalS);
+  return pstSched;
+}
+
+void RKADK_AOV_SCHED_Destroy(void *pSched) {
+  AOV_SCHED_S *pstSched = (AOV_SCHED_S *)pSched;
+
+  if (!pstSched)
+    return;
+
+  if (pstSched->stStats.u32PendingFrames)
+    RKADK_LOGW("drop %d pending aov frames", pstSched->stStats.u32PendingFrames);
+
+  pthread_mutex_destroy(&pstSched->mutex);
+  free(pstSched->pu8Ring);
+  free(pstSched);
+}
+
+static void RKADK_AOV_SCHED_CountFlush(AOV_SCHED_S *pstSched, uint32_t u32Bytes) {
+  RKADK_AOV_SCHED_STATS_S *pstStats = &pstSched->stStats;
+
+  pstSched->u64FlushSumBytes += u32Bytes;
+  pstStats->u32FlushCnt++;
+  pstStats->u32FlushLastBytes = u32Bytes;
+  pstStats->u32FlushAvgBytes = pstSched->u64FlushSumBytes / pstStats->u32FlushCnt;
+}
+
+int RKADK_AOV_SCHED_Flush(void *pSched) {
+  int ret = 0;
+  uint32_t u32Bytes;
+  AOV_SCHED_REC_S *pstRec;
+  AOV_SCHED_S *pstSched = (AOV_SCHED_S *)pSched;
+
+  RKADK_CHECK_POINTER(pstSched, RKADK_FAILURE);
+
+  if (!pstSched->stStats.u32PendingFrames)
+    return 0;
+
+  u32Bytes = pstSched->stStats.u32PendingBytes;
+  while (pstSched->stStats.u32PendingFrames) {
+    if (pstSched->stAttr.u32RingSize - pstSched->u32Head < sizeof(AOV_SCHED_REC_S))
+      pstSched->u32Head = 0;
+
+    pstRec = (AOV_SCHED_REC_S *)(pstSched->pu8Ring + pstSched->u32Head);
+    if (!pstRec->u32Size) {
+      pstSched->u32Head = 0;
+      continue;
+    }
+
+    if (pstSched->stAttr.pfnWrite(pstSched->stAttr.pCtx, (unsigned char *)(pstRec + 1),
+                                  pstRec->u32Size, pstRec->s64Pts, pstRec->isKeyFrame,
+                                  pstRec->u32Seq)) {
+      pstSched->stStats.u32WriteErrCnt++;
+      ret = -1;
+    }
+
+    pstSched->u32Head += AOV_SCHED_ALIGN(sizeof(AOV_SCHED_REC_S) + pstRec->u32Size);
+    pthread_mutex_lock(&pstSched->mutex);
+    pstSched->stStats.u32PendingFrames--;
+    pstSched->stStats.u32PendingBytes -= pstRec->u32Size;
+    pthread_mutex_unlock(&pstSched->mutex);
+  }
+
+  pstSched->u32Head = pstSched->u32Tail = 0;
+  pthread_mutex_lock(&pstSched->mutex);
+  RKADK_AOV_SCHED_CountFlush(pstSched, u32Bytes);
+  pthread_mutex_unlock(&pstSched->mutex);
+
+  RKADK_LOGD("aov flush %d bytes", u32Bytes);
+  return ret;
+}
+
+/* offset to store u32Len contiguous bytes at, -1 if the ring is too full */
+static int64_t RKADK_AOV_SCHED_Reserve(AOV_SCHED_S *pstSched, uint32_t u32Len) {
+  uint32_t u32Size = pstSched->stAttr.u32RingSize;
+  uint32_t u32Head = pstSched->u32Head, u32Tail = pstSched->u32Tail;
+
+  if (!pstSched->stStats.u32PendingFrames) {
+    pstSched->u32Head = pstSched->u32Tail = 0;
+    return u32Len <= u32Size ? 0 : -1;
+  }
+
+  if (u32Tail > u32Head) {
+    if (u32Size - u32Tail >= u32Len)
+      return u32Tail;
+
+    // wrap, the free space at the start must stay apart from the head
+    if (u32Len >= u32Head)
+      return -1;
+
+    if (u32Size - u32Tail >= sizeof(AOV_SCHED_REC_S))
+      ((AOV_SCHED_REC_S *)(pstSched->pu8Ring + u32Tail))->u32Size = 0;
+    return 0;
+  }
+
+  return u32Head - u32Tail > u32Len ? u32Tail : -1;
+}
+
+int RKADK_AOV_SCHED_Push(void *pSched, unsigned char *buf, uint32_t size,
+                         int64_t pts, int isKeyFrame, uint32_t seq) {
+  int ret;
+  int64_t s64Off;
+  uint32_t u32Len;
+  AOV_SCHED_REC_S *pstRec;
+  AOV_SCHED_S *pstSched = (AOV_SCHED_S *)pSched;
+
+  RKADK_CHECK_POINTER(pstSched, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(buf, RKADK_FAILURE);
+
+  if (!size)
+    return 0;
+
+  u32Len = AOV_SCHED_ALIGN(sizeof(AOV_SCHED_REC_S) + size);
+  s64Off = RKADK_AOV_SCHED_Reserve(pstSched, u32Len);
+  if (s64Off < 0) {
+    RKADK_AOV_SCHED_Flush(pstSched);
+    s64Off = RKADK_AOV_SCHED_Reserve(pstSched, u32Len);
+  }
+
+  if (s64Off < 0) {
+    // larger than the ring, straight through
+    ret = pstSched->stAttr.pfnWrite(pstSched->stAttr.pCtx, buf, size, pts, isKeyFrame, seq);
+    pthread_mutex_lock(&pstSched->mutex);
+    if (ret)
+      pstSched->stStats.u32WriteErrCnt++;
+    RKADK_AOV_SCHED_CountFlush(pstSched, size);
+    pthread_mutex_unlock(&pstSched->mutex);
+    return ret;
+  }
+
+  pstRec = (AOV_SCHED_REC_S *)(pstSched->pu8Ring + s64Off);
+  pstRec->u32Size = size;
+  pstRec->u32Seq = seq;
+  pstRec->s64Pts = pts;
+  pstRec->isKeyFrame = isKeyFrame;
+  pstRec->u32Rsv = 0;
+  memcpy(pstRec + 1, buf, size);
+  pstSched->u32Tail = s64Off + u32Len;
+
+  pthread_mutex_lock(&pstSched->mutex);
+  if (!pstSched->stStats.u32PendingFrames)
+    pstSched->u64OldestMs = RKADK_AOV_SCHED_Now(pstSched);
+  pstSched->stStats.u32PendingFrames++;
+  pstSched->stStats.u32PendingBytes += size;
+  pthread_mutex_unlock(&pstSched->mutex);
+  return 0;
+}
+
+int RKADK_AOV_SCHED_Sleep(void *pSched, bool bDeep) {
+  int ret = 0;
+  bool bFlush;
+  uint32_t u32WakeMs;
+  uint64_t u64Now, u64ResumeMs;
+  RKADK_AOV_SCHED_STATS_S *pstStats;
+  AOV_SCHED_S *pstSched = (AOV_SCHED_S *)pSched;
+
+  RKADK_CHECK_POINTER(pstSched, RKADK_FAILURE);
+  pstStats = &pstSched->stStats;
+
+  u64Now = RKADK_AOV_SCHED_Now(pstSched);
+  bFlush = bDeep || pstStats->u32PendingBytes >= pstSched->stAttr.u32FlushBytes;
+  if (!bFlush && pstSched->stAttr.u32FlushIntervalS && pstStats->u32PendingFrames)
+    bFlush = u64Now - pstSched->u64OldestMs >= pstSched->stAttr.u32FlushIntervalS * 1000ULL;
+
+  if (bFlush)
+    ret = RKADK_AOV_SCHED_Flush(pstSched);
+
+  // a suspend requested by another stream ended the previous cycle
+  if (!pstSched->stAttr.pfnClock) {
+    u64ResumeMs = __atomic_load_n(&g_u64SchedResumeMs, __ATOMIC_ACQUIRE);
+    if (u64ResumeMs > pstSched->u64WakeMs)
+      pstSched->u64WakeMs = u64ResumeMs;
+  }
+
+  u64Now = RKADK_AOV_SCHED_Now(pstSched);
+  u32WakeMs = u64Now - pstSched->u64WakeMs;
+  pthread_mutex_lock(&pstSched->mutex);
+  pstSched->u64WakeSumMs += u32WakeMs;
+  pstStats->u32WakeCnt++;
+  pstStats->u32WakeLastMs = u32WakeMs;
+  pstStats->u32WakeAvgMs = pstSched->u64WakeSumMs / pstStats->u32WakeCnt;
+  if (u32WakeMs > pstStats->u32WakeMaxMs)
+    pstStats->u32WakeMaxMs = u32WakeMs;
+  pthread_mutex_unlock(&pstSched->mutex);
+
+  if (pstSched->stAttr.pfnSleep && pstSched->stAttr.pfnSleep(pstSched->stAttr.pCtx))
+    ret = -1;
+
+  // the next wake cycle starts at resume, or at RKADK_AOV_SCHED_Resume
+  pstSched->u64WakeMs = RKADK_AOV_SCHED_Now(pstSched);
+  return ret;
+}
+
+void RKADK_AOV_SCHED_Resume(void) {
+  __atomic_store_n(&g_u64SchedResumeMs, RKADK_AOV_SCHED_BootMs(), __ATOMIC_RELEASE);
+}
+
+void RKADK_AOV_SCHED_GetStats(void *pSched, RKADK_AOV_SCHED_STATS_S *pstStats) {
+  uint64_t u64ElapsedMs;
+  AOV_SCHED_S *pstSched = (AOV_SCHED_S *)pSched;
+
+  if (!pstSched || !pstStats)
+    return;
+
+  u64ElapsedMs = RKADK_AOV_SCHED_Now(pstSched) - pstSched->u64CreateMs;
+  pthread_mutex_lock(&pstSched->mutex);
+  memcpy(pstStats, &pstSched->stStats, sizeof(RKADK_AOV_SCHED_STATS_S));
+  pthread_mutex_unlock(&pstSched->mutex);
+
+  if (u64ElapsedMs)
+    pstStats->u32FlushPerHour = pstStats->u32FlushCnt * 3600000ULL / u64ElapsedMs;
+}
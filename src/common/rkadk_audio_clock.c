@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "rkadk_audio_clock.h"
+#include "rkadk_log.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* periods are kept in us << 16 */
+#define AUDIO_CLOCK_Q 16
+
+/*
+ * The period is the mean capture interval over at least this many frames
+ * and this long, learning restarts when a frame is off by half a period.
+ */
+#define AUDIO_CLOCK_LEARN_FRAMES 16
+#define AUDIO_CLOCK_LEARN_US 1000000
+
+/*
+ * Loop gains as shifts of the per frame error: proportional 1/64, integral
+ * 1/8192, damping ~0.7 and a time constant of ~90 frames (2s for 1024
+ * samples at 48k).
+ */
+#define AUDIO_CLOCK_KP_SHIFT 6
+#define AUDIO_CLOCK_KI_SHIFT 13
+
+/* steered period error limit, 1/32 of the period */
+#define AUDIO_CLOCK_FREQ_SHIFT 5
+/* per frame phase correction limit, 1/256 of the period */
+#define AUDIO_CLOCK_PHASE_SHIFT 8
+/* drift beyond this is a gap or a reference jump, not clock drift */
+#define AUDIO_CLOCK_RESYNC_US 300000
+
+typedef struct {
+  pthread_mutex_t mutex;
+  bool bLocked;
+  uint32_t u32LearnCnt;   // frames since learning started
+  int64_t s64LearnFirstUs;
+  int64_t s64LearnLastUs;
+  int64_t s64PeriodQ;  // frame period learned at lock
+  int64_t s64FreqQ;    // steered period error
+  int64_t s64PtsQ;     // pts of the next frame
+  int64_t s64RebaseUs; // added to the reference after a backward jump
+  RKADK_AUDIO_CLOCK_STATS_S stStats;
+} RKADK_AUDIO_CLOCK_S;
+
+static int64_t RKADK_AUDIO_CLOCK_GetUs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t RKADK_AUDIO_CLOCK_Clamp(int64_t val, int64_t limit) {
+  if (val > limit)
+    return limit;
+  if (val < -limit)
+    return -limit;
+  return val;
+}
+
+static void RKADK_AUDIO_CLOCK_Unlock(RKADK_AUDIO_CLOCK_S *pstClock) {
+  pstClock->bLocked = false;
+  pstClock->u32LearnCnt = 0;
+  pstClock->s64PeriodQ = 0;
+  pstClock->s64FreqQ = 0;
+  pstClock->s64RebaseUs = 0;
+  memset(&pstClock->stStats, 0, sizeof(RKADK_AUDIO_CLOCK_STATS_S));
+}
+
+/* mutex must be held, locks once the period is known */
+static void RKADK_AUDIO_CLOCK_Learn(RKADK_AUDIO_CLOCK_S *pstClock, int64_t s64RefUs) {
+  int64_t s64SpanUs, s64AvgUs, s64DeltaUs;
+
+  if (pstClock->u32LearnCnt >= 2) {
+    s64SpanUs = pstClock->s64LearnLastUs - pstClock->s64LearnFirstUs;
+    s64AvgUs = s64SpanUs / (pstClock->u32LearnCnt - 1);
+    s64DeltaUs = s64RefUs - pstClock->s64LearnLastUs;
+    // a lost frame, a stall or a reference jump, start over from here
+    if (llabs(s64DeltaUs - s64AvgUs) > s64AvgUs / 2)
+      pstClock->u32LearnCnt = 0;
+  } else if (pstClock->u32LearnCnt == 1 &&
+             (s64RefUs <= pstClock->s64LearnLastUs ||
+              s64RefUs - pstClock->s64LearnLastUs > AUDIO_CLOCK_RESYNC_US)) {
+    pstClock->u32LearnCnt = 0;
+  }
+
+  if (!pstClock->u32LearnCnt)
+    pstClock->s64LearnFirstUs = s64RefUs;
+  pstClock->s64LearnLastUs = s64RefUs;
+  pstClock->u32LearnCnt++;
+
+  s64SpanUs = s64RefUs - pstClock->s64LearnFirstUs;
+  if (pstClock->u32LearnCnt < AUDIO_CLOCK_LEARN_FRAMES || s64SpanUs < AUDIO_CLOCK_LEARN_US)
+    return;
+
+  pstClock->s64PeriodQ = s64SpanUs * (1 << AUDIO_CLOCK_Q) / (pstClock->u32LearnCnt - 1);
+  pstClock->s64PtsQ = s64RefUs * (1 << AUDIO_CLOCK_Q) + pstClock->s64PeriodQ;
+  pstClock->stStats.u32PeriodUs = (uint32_t)(pstClock->s64PeriodQ >> AUDIO_CLOCK_Q);
+  pstClock->bLocked = true;
+  RKADK_LOGI("audio clock locked, period: %dus over %d frames",
+             pstClock->stStats.u32PeriodUs, pstClock->u32LearnCnt);
+}
+
+void *RKADK_AUDIO_CLOCK_Create(void) {
+  RKADK_AUDIO_CLOCK_S *pstClock;
+
+  pstClock = (RKADK_AUDIO_CLOCK_S *)calloc(1, sizeof(RKADK_AUDIO_CLOCK_S));
+  if (!pstClock) {
+    RKADK_LOGE("malloc audio clock failed");
+    return NULL;
+  }
+
+  pthread_mutex_init(&pstClock->mutex, NULL);
+  return pstClock;
+}
+
+void RKADK_AUDIO_CLOCK_Destroy(void *pClock) {
+  RKADK_AUDIO_CLOCK_S *pstClock = (RKADK_AUDIO_CLOCK_S *)pClock;
+
+  if (!pstClock)
+    return;
+
+  pthread_mutex_destroy(&pstClock->mutex);
+  free(pstClock);
+}
+
+void RKADK_AUDIO_CLOCK_Reset(void *pClock) {
+  RKADK_AUDIO_CLOCK_S *pstClock = (RKADK_AUDIO_CLOCK_S *)pClock;
+
+  if (!pstClock)
+    return;
+
+  pthread_mutex_lock(&pstClock->mutex);
+  if (pstClock->bLocked)
+    RKADK_LOGI("audio clock reset, frames: %llu, period: %dus, drift: %dus, "
+               "max drift: %dus, rate: %dppm, resync: %d",
+               (unsigned long long)pstClock->stStats.u64FrameCnt,
+               pstClock->stStats.u32PeriodUs, pstClock->stStats.s32DriftUs,
+               pstClock->stStats.s32MaxDriftUs, pstClock->stStats.s32RatePpm,
+               pstClock->stStats.u32ResyncCnt);
+
+  RKADK_AUDIO_CLOCK_Unlock(pstClock);
+  pthread_mutex_unlock(&pstClock->mutex);
+}
+
+uint64_t RKADK_AUDIO_CLOCK_Stamp(void *pClock, uint64_t u64CaptureUs) {
+  int64_t s64RefUs, s64PtsUs, s64DriftUs, s64StepQ;
+  RKADK_AUDIO_CLOCK_STATS_S *pstStats;
+  RKADK_AUDIO_CLOCK_S *pstClock = (RKADK_AUDIO_CLOCK_S *)pClock;
+
+  if (!pstClock)
+    return u64CaptureUs;
+
+  s64RefUs = u64CaptureUs ? (int64_t)u64CaptureUs : RKADK_AUDIO_CLOCK_GetUs();
+
+  pthread_mutex_lock(&pstClock->mutex);
+  if (!pstClock->bLocked) {
+    // the frame that locks is stamped raw too, the clock starts after it
+    RKADK_AUDIO_CLOCK_Learn(pstClock, s64RefUs);
+    pthread_mutex_unlock(&pstClock->mutex);
+    return (uint64_t)s64RefUs;
+  }
+
+  pstStats = &pstClock->stStats;
+  s64RefUs += pstClock->s64RebaseUs;
+  s64PtsUs = pstClock->s64PtsQ >> AUDIO_CLOCK_Q;
+  s64DriftUs = s64RefUs - s64PtsUs;
+
+  if (s64DriftUs > AUDIO_CLOCK_RESYNC_US) {
+    // frames were lost, leave the gap in the track to stay in sync with video
+    RKADK_LOGW("audio gap %lldus, resync", (long long)s64DriftUs);
+    pstClock->s64PtsQ = s64RefUs * (1 << AUDIO_CLOCK_Q);
+    s64PtsUs = s64RefUs;
+    s64DriftUs = 0;
+    pstStats->u32ResyncCnt++;
+  } else if (s64DriftUs < -AUDIO_CLOCK_RESYNC_US) {
+    // the reference stepped back, follow it from here without rewinding pts
+    RKADK_LOGW("audio reference stepped back %lldus, rebase", (long long)-s64DriftUs);
+    pstClock->s64RebaseUs -= s64DriftUs;
+    s64DriftUs = 0;
+    pstStats->u32ResyncCnt++;
+  }
+
+  pstClock->s64FreqQ += s64DriftUs * (1 << AUDIO_CLOCK_Q) / (1 << AUDIO_CLOCK_KI_SHIFT);
+  pstClock->s64FreqQ = RKADK_AUDIO_CLOCK_Clamp(pstClock->s64FreqQ,
+                                               pstClock->s64PeriodQ >> AUDIO_CLOCK_FREQ_SHIFT);
+
+  s64StepQ = RKADK_AUDIO_CLOCK_Clamp(s64DriftUs * (1 << AUDIO_CLOCK_Q) / (1 << AUDIO_CLOCK_KP_SHIFT),
+                                     pstClock->s64PeriodQ >> AUDIO_CLOCK_PHASE_SHIFT);
+  pstClock->s64PtsQ += pstClock->s64PeriodQ + pstClock->s64FreqQ + s64StepQ;
+
+  pstStats->u64FrameCnt++;
+  pstStats->s32DriftUs = (int32_t)s64DriftUs;
+  if (llabs(s64DriftUs) > pstStats->s32MaxDriftUs)
+    pstStats->s32MaxDriftUs = (int32_t)llabs(s64DriftUs);
+  pstStats->s32RatePpm = (int32_t)(pstClock->s64FreqQ * 1000000 / pstClock->s64PeriodQ);
+  pthread_mutex_unlock(&pstClock->mutex);
+
+  return (uint64_t)s64PtsUs;
+}
+
+void RKADK_AUDIO_CLOCK_GetStats(void *pClock, RKADK_AUDIO_CLOCK_STATS_S *pstStats) {
+  RKADK_AUDIO_CLOCK_S *pstClock = (RKADK_AUDIO_CLOCK_S *)pClock;
+
+  if (!pstClock || !pstStats)
+    return;
+
+  pthread_mutex_lock(&pstClock->mutex);
+  memcpy(pstStats, &pstClock->stStats, sizeof(RKADK_AUDIO_CLOCK_STATS_S));
+  pthread_mutex_unlock(&pstClock->mutex);
+}
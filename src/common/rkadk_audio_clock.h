@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef __RKADK_AUDIO_CLOCK_H__
+#define __RKADK_AUDIO_CLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t u64FrameCnt;  // frames stamped since the last anchor
+  int32_t s32DriftUs;    // reference - pts of the last frame
+  int32_t s32MaxDriftUs; // largest |drift| since the last anchor
+  uint32_t u32PeriodUs;  // frame period learned at lock, 0 before
+  int32_t s32RatePpm;    // steered frame period error against u32PeriodUs
+  uint32_t u32ResyncCnt; // gaps or reference jumps over the resync limit
+} RKADK_AUDIO_CLOCK_STATS_S;
+
+/*
+ * Audio pts recovery. The pts of each frame is the lock point plus the
+ * frames counted since, each one frame period long. The period is learned
+ * from the capture timestamps (CLOCK_MONOTONIC, the callback time when a
+ * frame has none) rather than from the audio config, as the encoder decides
+ * the frame size, then steered by a second order loop against them, so
+ * jitter is filtered out and a sample clock drift is absorbed without pts
+ * jumps. Until the period is learned the capture timestamps pass through.
+ */
+void *RKADK_AUDIO_CLOCK_Create(void);
+
+void RKADK_AUDIO_CLOCK_Destroy(void *pClock);
+
+/*
+ * Learns the period again from the next frame, may be called while another
+ * thread is stamping frames.
+ */
+void RKADK_AUDIO_CLOCK_Reset(void *pClock);
+
+/* Returns the pts (us) of a frame captured at u64CaptureUs, 0 if unknown */
+uint64_t RKADK_AUDIO_CLOCK_Stamp(void *pClock, uint64_t u64CaptureUs);
+
+void RKADK_AUDIO_CLOCK_GetStats(void *pClock, RKADK_AUDIO_CLOCK_STATS_S *pstStats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,14 +1,78 @@
 /* Copyright (c) Rockchip Electronics Co. Ltd. */
 
 #include "rkadk_log.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+/* one formatted line per record, longer lines are truncated */
+#define RKADK_LOG_LINE_LEN 256
+
+/* must be a power of 2 */
+#define RKADK_LOG_RING_CNT 256
+
+/* rate limit per callsite: at most RKADK_LOG_SITE_BURST lines per second */
+#define RKADK_LOG_SITE_CNT 256
+#define RKADK_LOG_SITE_BURST 10
+
+/* the writer flushes when the batch is full or the ring is empty */
+#define RKADK_LOG_BATCH_LEN 4096
+
+#ifndef OS_RTT
+#define RKADK_LOG_CLOCK CLOCK_MONOTONIC_COARSE
+#define RKADK_LOG_CLOEXEC O_CLOEXEC
+#else
+#define RKADK_LOG_CLOCK CLOCK_REALTIME
+#define RKADK_LOG_CLOEXEC 0
+#endif
+
+typedef struct {
+    unsigned int seq;
+    unsigned int len;
+    char line[RKADK_LOG_LINE_LEN];
+} RKADK_LOG_RECORD_S;
+
+typedef struct {
+    const char *fname;
+    int row;
+    unsigned int sec;
+    unsigned int cnt;
+    unsigned int suppressed;
+} RKADK_LOG_SITE_S;
+
+typedef struct {
+    bool bAsync;
+    bool bExit;
+    int fileFd;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int dropCnt;
+    unsigned int dropTotal;
+    unsigned int sleeping;
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    RKADK_LOG_RECORD_S ring[RKADK_LOG_RING_CNT];
+    RKADK_LOG_SITE_S site[RKADK_LOG_SITE_CNT];
+} RKADK_LOG_CTX_S;
+
 static int m_rkadk_log_level = RKADK_LOG_LEVEL_WARN;
 static int m_rkadk_log_cnt = 0;
+#ifndef OS_RTT
+static int m_rkadk_kmsg_fd = -1;
+#endif
+static pthread_once_t m_rkadk_log_once = PTHREAD_ONCE_INIT;
+static RKADK_LOG_CTX_S m_rkadk_log_ctx = {
+    .fileFd = -1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
 
 int get_log_level() {
     if (m_rkadk_log_cnt == 0) {
@@ -21,14 +85,221 @@ int get_log_level() {
     return m_rkadk_log_level;
 }
 
+unsigned int get_log_drop_cnt() {
+    return __atomic_load_n(&m_rkadk_log_ctx.dropTotal, __ATOMIC_RELAXED);
+}
+
+static void rkadk_log_write_all(const char *buf, int len) {
+    RKADK_LOG_CTX_S *ctx = &m_rkadk_log_ctx;
+
+    if (write(STDOUT_FILENO, buf, len) < 0) {
+        // nothing else to report the failure to
+    }
+
+    if (ctx->fileFd >= 0 && write(ctx->fileFd, buf, len) < 0) {
+        close(ctx->fileFd);
+        ctx->fileFd = -1;
+    }
+}
+
+#ifndef OS_RTT
+static bool rkadk_log_pop(char *batch, int *len) {
+    RKADK_LOG_CTX_S *ctx = &m_rkadk_log_ctx;
+    RKADK_LOG_RECORD_S *rec = &ctx->ring[ctx->tail & (RKADK_LOG_RING_CNT - 1)];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != ctx->tail + 1)
+        return false;
+
+    if (*len + rec->len > RKADK_LOG_BATCH_LEN) {
+        rkadk_log_write_all(batch, *len);
+        *len = 0;
+    }
+
+    memcpy(batch + *len, rec->line, rec->len);
+    *len += rec->len;
+
+    __atomic_store_n(&rec->seq, ctx->tail + RKADK_LOG_RING_CNT, __ATOMIC_RELEASE);
+    ctx->tail++;
+    return true;
+}
+
+static void rkadk_log_drain(char *batch) {
+    int len = 0;
+    unsigned int drop;
+
+    while (rkadk_log_pop(batch, &len))
+        ;
+
+    drop = __atomic_exchange_n(&m_rkadk_log_ctx.dropCnt, 0, __ATOMIC_RELAXED);
+    if (drop && len + RKADK_LOG_LINE_LEN <= RKADK_LOG_BATCH_LEN)
+        len += snprintf(batch + len, RKADK_LOG_LINE_LEN,
+                        "[%s_W] %u log lines dropped, ring full\n", MODULE_TAG, drop);
+
+    if (len)
+        rkadk_log_write_all(batch, len);
+}
+
+static void *rkadk_log_writer(void *arg) {
+    RKADK_LOG_CTX_S *ctx = &m_rkadk_log_ctx;
+    RKADK_LOG_RECORD_S *rec;
+    char batch[RKADK_LOG_BATCH_LEN];
+
+    while (1) {
+        rkadk_log_drain(batch);
+
+        pthread_mutex_lock(&ctx->mutex);
+        __atomic_store_n(&ctx->sleeping, 1, __ATOMIC_SEQ_CST);
+        rec = &ctx->ring[ctx->tail & (RKADK_LOG_RING_CNT - 1)];
+        if (__atomic_load_n(&rec->seq, __ATOMIC_SEQ_CST) != ctx->tail + 1) {
+            if (ctx->bExit) {
+                pthread_mutex_unlock(&ctx->mutex);
+                break;
+            }
+
+            pthread_cond_wait(&ctx->cond, &ctx->mutex);
+        }
+        __atomic_store_n(&ctx->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&ctx->mutex);
+    }
+
+    rkadk_log_drain(batch);
+    return NULL;
+}
+
+static void rkadk_log_exit() {
+    RKADK_LOG_CTX_S *ctx = &m_rkadk_log_ctx;
+
+    if (!ctx->bAsync)
+        return;
+
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->bExit = true;
+    pthread_cond_signal(&ctx->cond);
+    pthread_mutex_unlock(&ctx->mutex);
+
+    pthread_join(ctx->tid, NULL);
+    ctx->bAsync = false;
+}
+#endif
+
+static void rkadk_log_init() {
+    int i;
+    RKADK_LOG_CTX_S *ctx = &m_rkadk_log_ctx;
+
+    for (i = 0; i < RKADK_LOG_RING_CNT; i++)
+        ctx->ring[i].seq = i;
+
+    if (getenv("rkadk_log_file"))
+        ctx->fileFd = open(getenv("rkadk_log_file"),
+                           O_WRONLY | O_CREAT | O_APPEND | RKADK_LOG_CLOEXEC, 0644);
+
+#ifndef OS_RTT
+    // rkadk_log_sync=1 writes from the calling thread, e.g. to debug a crash
+    if (getenv("rkadk_log_sync") && atoi(getenv("rkadk_log_sync")))
+        return;
+
+    if (pthread_create(&ctx->tid, NULL, rkadk_log_writer, NULL))
+        return;
+
+    ctx->bAsync = true;
+    atexit(rkadk_log_exit);
+#endif
+}
+
+static void rkadk_log_push(const char *line, int len) {
+    int dif;
+    unsigned int pos;
+    RKADK_LOG_RECORD_S *rec;
+    RKADK_LOG_CTX_S *ctx = &m_rkadk_log_ctx;
+
+    if (!ctx->bAsync) {
+        rkadk_log_write_all(line, len);
+        return;
+    }
+
+    pos = __atomic_load_n(&ctx->head, __ATOMIC_RELAXED);
+    while (1) {
+        rec = &ctx->ring[pos & (RKADK_LOG_RING_CNT - 1)];
+        dif = (int)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&ctx->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            __atomic_fetch_add(&ctx->dropCnt, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ctx->dropTotal, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ctx->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(rec->line, line, len);
+    rec->len = len;
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ctx->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ctx->mutex);
+        pthread_cond_signal(&ctx->cond);
+        pthread_mutex_unlock(&ctx->mutex);
+    }
+}
+
+/*
+ * Returns false if the line is over the callsite burst. The count of
+ * suppressed lines is reported when the callsite logs again.
+ */
+static bool rkadk_log_site_check(const char *fname, const int row,
+                                 unsigned int *suppressed) {
+    unsigned int idx, sec;
+    struct timespec ts;
+    RKADK_LOG_SITE_S *site;
+
+    idx = ((unsigned long)fname >> 3) ^ (row * 0x9E3779B1);
+    site = &m_rkadk_log_ctx.site[(idx ^ (idx >> 16)) & (RKADK_LOG_SITE_CNT - 1)];
+
+    clock_gettime(RKADK_LOG_CLOCK, &ts);
+    sec = ts.tv_sec;
+
+    // a hash collision only shares the burst, races lose a count at most
+    if (__atomic_load_n(&site->fname, __ATOMIC_RELAXED) != fname ||
+        __atomic_load_n(&site->row, __ATOMIC_RELAXED) != row) {
+        __atomic_store_n(&site->fname, fname, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->row, row, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->sec, sec, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->cnt, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_load_n(&site->sec, __ATOMIC_RELAXED) != sec) {
+        __atomic_store_n(&site->sec, sec, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->cnt, 0, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_add_fetch(&site->cnt, 1, __ATOMIC_RELAXED) > RKADK_LOG_SITE_BURST) {
+        __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    return true;
+}
+
 static void _rkadk_log(int level, const char *fmt, const char *fname,
                              const int row, va_list args) {
-    char line[256];
+    char line[RKADK_LOG_LINE_LEN];
     char tag = ' ';
+    int len = 0;
+    unsigned int suppressed = 0;
 
     if (level > get_log_level())
         return;
 
+    pthread_once(&m_rkadk_log_once, rkadk_log_init);
+
+    if (level != RKADK_LOG_LEVEL_PRINT && !rkadk_log_site_check(fname, row, &suppressed))
+        return;
+
     switch(level) {
       case RKADK_LOG_LEVEL_PRINT:
         tag = 'P';
@@ -51,8 +322,22 @@ static void _rkadk_log(int level, const char *fmt, const char *fname,
         break;
     }
 
-    snprintf(line, sizeof(line), "[%s_%c] {%-25.25s:%03d} %s\n", MODULE_TAG, tag, fname, row, fmt);
-    vfprintf(stdout, line, args);
+    if (suppressed) {
+        len = snprintf(line, sizeof(line), "[%s_%c] {%-25.25s:%03d} %u similar lines suppressed\n",
+                       MODULE_TAG, tag, fname, row, suppressed);
+        rkadk_log_push(line, len < (int)sizeof(line) ? len : (int)sizeof(line) - 1);
+    }
+
+    len = snprintf(line, sizeof(line), "[%s_%c] {%-25.25s:%03d} ", MODULE_TAG, tag, fname, row);
+    if (len < (int)sizeof(line) - 1)
+        len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
+
+    // keep the line break of a truncated line
+    if (len > (int)sizeof(line) - 2)
+        len = sizeof(line) - 2;
+    line[len++] = '\n';
+
+    rkadk_log_push(line, len);
 }
 
 void rkadk_log(int level, const char *fmt,
@@ -62,3 +347,46 @@ void rkadk_log(int level, const char *fmt,
     _rkadk_log(level, fmt, fname, row, args);
     va_end(args);
 }
+
+/*
+ * Written synchronously, the kmsg timestamp marks the event. RT-Thread has
+ * no kmsg, the line goes to the log output instead.
+ */
+void rkadk_klog(const char *fmt, ...) {
+    char line[RKADK_LOG_LINE_LEN];
+    int len;
+    va_list args;
+
+#ifndef OS_RTT
+    int fd = __atomic_load_n(&m_rkadk_kmsg_fd, __ATOMIC_ACQUIRE);
+    if (fd < 0) {
+        fd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int expected = -1;
+        if (!__atomic_compare_exchange_n(&m_rkadk_kmsg_fd, &expected, fd, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            close(fd);
+            fd = expected;
+        }
+    }
+#endif
+
+    len = snprintf(line, sizeof(line), "[%s]: ", MODULE_TAG);
+    va_start(args, fmt);
+    len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
+    va_end(args);
+
+    if (len > (int)sizeof(line) - 2)
+        len = sizeof(line) - 2;
+    line[len++] = '\n';
+
+#ifndef OS_RTT
+    if (write(fd, line, len) < 0) {
+        // kmsg is best effort
+    }
+#else
+    rkadk_log_write_all(line, len);
+#endif
+}
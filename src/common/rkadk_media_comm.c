@@ -19,11 +19,21 @@
 #include "rkadk_param.h"
 #include "rkadk_log.h"
 #include "rkadk_version.h"
+#include "rkadk_media_graph.h"
+#include "rkadk_signal.h"
+#include "rkadk_thread.h"
+#include "rkadk_trace.h"
+#include "linux_list.h"
+#ifndef OS_RTT
+#include "cjson/cJSON.h"
+#endif
 #include <assert.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "rkadk_hal.h"
 #include <unistd.h>
 
@@ -34,30 +44,89 @@ typedef struct {
   MPP_CHN_S stDestChn;
 } RKADK_BIND_INFO_S;
 
+/* the largest info table, every table fits in one index */
+#define RKADK_MEDIA_INDEX_SLOT_CNT RKADK_MEDIA_VENC_MAX_CNT
+#define RKADK_MEDIA_INDEX_HASH_CNT 64
+#define RKADK_MEDIA_INDEX_MAP_CNT ((RKADK_MEDIA_INDEX_SLOT_CNT + 31) / 32)
+
+#if RKADK_MEDIA_INDEX_HASH_CNT < RKADK_MEDIA_INDEX_SLOT_CNT
+#error "RKADK_MEDIA_INDEX_HASH_CNT is too small"
+#endif
+
+/*
+ * Lookup index of an info table: used slots are chained by key hash,
+ * free slots are kept in a bitmap.
+ */
 typedef struct {
-  bool bUsed;
-  RKADK_VOID *pHandle;
-  RKADK_MEDIA_AENC_DATA_PROC_FUNC cbList;
-} RKADK_GET_AENC_CB_ATTR_S;
+  RKADK_S16 s16Head[RKADK_MEDIA_INDEX_HASH_CNT];
+  RKADK_S16 s16Next[RKADK_MEDIA_INDEX_SLOT_CNT];
+  RKADK_U32 u32FreeMap[RKADK_MEDIA_INDEX_MAP_CNT];
+} RKADK_MEDIA_INDEX_S;
+
+/* callback time histogram, 4 buckets per power of 2 us, up to about 0.5s */
+#define RKADK_MEDIA_CB_HIST_CNT 72
+
+/* a callback over budget this many frames in a row is moved to its own thread */
+#define RKADK_MEDIA_CB_OVER_BUDGET_CNT 3
+#define RKADK_MEDIA_CB_DEFER_QUEUE_MAX 16
+
+typedef struct {
+  struct list_head mark;
+  RKADK_MEDIA_VENC_DATA_S stData;
+  VENC_PACK_S stPack;
+} RKADK_MEDIA_DEFER_PKT_S;
 
 typedef struct {
-  bool bUsed;
   RKADK_VOID *pHandle;
-  RKADK_MEDIA_VENC_DATA_PROC_FUNC cbList;
-} RKADK_GET_VENC_CB_ATTR_S;
+  RKADK_MEDIA_AENC_DATA_PROC_FUNC pfnAencCb;
+  RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnVencCb;
+  RK_CODEC_ID_E enCodecType;
+  RKADK_U32 u32BudgetUs;
+  RKADK_U32 u32OverCnt;
+  bool bDeferred;
+  bool bDropToIdr;
+  RKADK_U64 u64CallCnt;
+  RKADK_U32 u32MaxUs;
+  RKADK_U32 u32Hist[RKADK_MEDIA_CB_HIST_CNT];
+  RKADK_U32 u32PktCnt;
+  RKADK_U32 u32DropCnt;
+  struct list_head stPktList;
+  pthread_mutex_t mutex;
+  void *pSignal;
+  void *pThread;
+} RKADK_GET_MB_CB_S;
+
+/*
+ * Subscriber snapshot of a get mb thread. A published snapshot is never
+ * modified, (un)subscribe publishes a new one and frees the old one after
+ * the get mb thread leaves its callback loop.
+ */
+typedef struct RKADK_GET_MB_SUBS {
+  struct RKADK_GET_MB_SUBS *pNext;
+  RKADK_GET_MB_CB_S *pstRemoved; // freed together with the snapshot
+  RKADK_U32 u32Ver;
+  RKADK_S32 s32Cnt;
+  RKADK_GET_MB_CB_S *pstCb[RKADK_MEDIA_VENC_MAX_CNT];
+} RKADK_GET_MB_SUBS_S;
+
+typedef struct {
+  RKADK_GET_MB_SUBS_S *pSubs;
+  RKADK_GET_MB_SUBS_S *pRetired; // retired from the callbacks, freed by the get mb thread
+  RKADK_U32 u32Seq; // odd while the get mb thread calls the callbacks
+} RKADK_GET_MB_RCU_S;
 
 typedef struct {
   bool bGetBuffer;
   RKADK_S32 s32GetCnt;
   pthread_t tid;
-  RKADK_GET_AENC_CB_ATTR_S cb[RKADK_MEDIA_AENC_MAX_CNT];
+  RKADK_GET_MB_RCU_S stRcu;
 } RKADK_GET_AENC_MB_ATTR_S;
 
 typedef struct {
   bool bGetBuffer;
   RKADK_S32 s32GetCnt;
   pthread_t tid;
-  RKADK_GET_VENC_CB_ATTR_S cb[RKADK_MEDIA_VENC_MAX_CNT];
+  RKADK_GET_MB_RCU_S stRcu;
   RKADK_S64 s64RecentPts;
   RKADK_U64 u64TimeoutCnt; //Continuous timeout count
 } RKADK_GET_VENC_MB_ATTR_S;
@@ -92,6 +161,16 @@ typedef struct {
   RKADK_BIND_INFO_S stViVencInfo[RKADK_VI_VENC_MAX_BIND_CNT];
   RKADK_BIND_INFO_S stViVpssInfo[RKADK_VI_VPSS_MAX_BIND_CNT];
   RKADK_BIND_INFO_S stVpssVencInfo[RKADK_VPSS_VENC_MAX_BIND_CNT];
+  RKADK_MEDIA_INDEX_S stAiIdx;
+  RKADK_MEDIA_INDEX_S stAencIdx;
+  RKADK_MEDIA_INDEX_S stViIdx;
+  RKADK_MEDIA_INDEX_S stVencIdx;
+  RKADK_MEDIA_INDEX_S stVpssIdx;
+  RKADK_MEDIA_INDEX_S stVoIdx;
+  RKADK_MEDIA_INDEX_S stAiAencIdx;
+  RKADK_MEDIA_INDEX_S stViVencIdx;
+  RKADK_MEDIA_INDEX_S stViVpssIdx;
+  RKADK_MEDIA_INDEX_S stVpssVencIdx;
 } RKADK_MEDIA_CONTEXT_S;
 
 struct RKADK_FORMAT_MAP {
@@ -129,8 +208,32 @@ static RKADK_MEDIA_CONTEXT_S g_stMediaCtx;
 static int g_bVpssGrpInitCnt[VPSS_MAX_GRP_NUM] = {0};
 static int g_bVoLayerDevInitCnt[VO_MAX_LAYER_NUM][VO_MAX_DEV_NUM] = {0};
 
+/* driver nodes are read directly, at most RKADK_MEDIA_NODE_BUF_LEN bytes each */
+#define RKADK_MEDIA_NODE_BUF_LEN 4096
+
+static int RKADK_MEDIA_ReadNode(const char *path, char *pBuf, int size) {
+  int fd, len = 0, ret;
+
+  pBuf[0] = '\0';
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  while (len < size - 1) {
+    ret = read(fd, pBuf + len, size - 1 - len);
+    if (ret <= 0)
+      break;
+    len += ret;
+  }
+
+  pBuf[len] = '\0';
+  close(fd);
+  return len;
+}
+
 void RKADK_MEDIA_DumpBufinfo(const char *fmt, const char *fname, const int row, ...) {
   char line[256];
+  char *pBuf;
 
   if (!g_dumpBufinfo)
     return;
@@ -141,11 +244,90 @@ void RKADK_MEDIA_DumpBufinfo(const char *fmt, const char *fname, const int row,
   vfprintf(stdout, line, args);
   va_end(args);
 
+  pBuf = (char *)malloc(RKADK_MEDIA_NODE_BUF_LEN);
+  if (!pBuf)
+    return;
+
 #if defined(RV1106_1103) || defined(RV1103B)
-  system("cat /proc/rk_dma_heap/dma_heap_info");
+  RKADK_MEDIA_ReadNode("/proc/rk_dma_heap/dma_heap_info", pBuf, RKADK_MEDIA_NODE_BUF_LEN);
 #else
-  system("cat /sys/kernel/debug/dma_buf/bufinfo");
+  RKADK_MEDIA_ReadNode("/sys/kernel/debug/dma_buf/bufinfo", pBuf, RKADK_MEDIA_NODE_BUF_LEN);
 #endif
+  fputs(pBuf, stdout);
+  free(pBuf);
+}
+
+static void RKADK_MEDIA_IndexInit(RKADK_MEDIA_INDEX_S *pstIndex, int count) {
+  int i;
+
+  memset(pstIndex, 0, sizeof(RKADK_MEDIA_INDEX_S));
+  memset(pstIndex->s16Head, -1, sizeof(pstIndex->s16Head));
+  memset(pstIndex->s16Next, -1, sizeof(pstIndex->s16Next));
+  for (i = 0; i < count; i++)
+    pstIndex->u32FreeMap[i / 32] |= 1U << (i % 32);
+}
+
+static RKADK_U32 RKADK_MEDIA_IndexHash(RKADK_U32 u32Key) {
+  u32Key *= 0x9E3779B1;
+  return u32Key >> (32 - __builtin_ctz(RKADK_MEDIA_INDEX_HASH_CNT));
+}
+
+static void RKADK_MEDIA_IndexLink(RKADK_MEDIA_INDEX_S *pstIndex, int i,
+                                  RKADK_U32 u32Hash) {
+  if (!(pstIndex->u32FreeMap[i / 32] & (1U << (i % 32))))
+    return;
+
+  pstIndex->s16Next[i] = pstIndex->s16Head[u32Hash];
+  pstIndex->s16Head[u32Hash] = i;
+  pstIndex->u32FreeMap[i / 32] &= ~(1U << (i % 32));
+}
+
+static void RKADK_MEDIA_IndexUnlink(RKADK_MEDIA_INDEX_S *pstIndex, int i,
+                                    RKADK_U32 u32Hash) {
+  RKADK_S16 *ps16Link = &pstIndex->s16Head[u32Hash];
+
+  if (pstIndex->u32FreeMap[i / 32] & (1U << (i % 32)))
+    return;
+
+  while (*ps16Link >= 0) {
+    if (*ps16Link == i) {
+      *ps16Link = pstIndex->s16Next[i];
+      break;
+    }
+    ps16Link = &pstIndex->s16Next[(int)*ps16Link];
+  }
+
+  pstIndex->s16Next[i] = -1;
+  pstIndex->u32FreeMap[i / 32] |= 1U << (i % 32);
+}
+
+static RKADK_U32 RKADK_MEDIA_ChnHash(RKADK_S32 s32DevId, RKADK_S32 s32ChnId) {
+  return RKADK_MEDIA_IndexHash(((RKADK_U32)s32DevId << 16) ^ (RKADK_U32)s32ChnId);
+}
+
+static RKADK_U32 RKADK_BIND_ChnHash(const MPP_CHN_S *pstSrcChn,
+                                    const MPP_CHN_S *pstDestChn) {
+  RKADK_U32 u32Key;
+
+  u32Key = ((RKADK_U32)pstSrcChn->enModId << 24) ^ ((RKADK_U32)pstSrcChn->s32DevId << 16) ^
+           ((RKADK_U32)pstSrcChn->s32ChnId << 8) ^ (RKADK_U32)pstDestChn->enModId;
+  u32Key = u32Key * 0x85EBCA6B ^ ((RKADK_U32)pstDestChn->s32DevId << 16) ^
+           (RKADK_U32)pstDestChn->s32ChnId;
+  return RKADK_MEDIA_IndexHash(u32Key);
+}
+
+// the key of stInfo[i] must be set before
+static void RKADK_MEDIA_IndexAdd(RKADK_MEDIA_INDEX_S *pstIndex,
+                                 RKADK_MEDIA_INFO_S *pstInfo, int i) {
+  RKADK_MEDIA_IndexLink(pstIndex, i,
+                        RKADK_MEDIA_ChnHash(pstInfo[i].s32DevId, pstInfo[i].s32ChnId));
+}
+
+// the key of stInfo[i] must be cleared after
+static void RKADK_MEDIA_IndexDel(RKADK_MEDIA_INDEX_S *pstIndex,
+                                 RKADK_MEDIA_INFO_S *pstInfo, int i) {
+  RKADK_MEDIA_IndexUnlink(pstIndex, i,
+                          RKADK_MEDIA_ChnHash(pstInfo[i].s32DevId, pstInfo[i].s32ChnId));
 }
 
 static int RKADK_MEDIA_CtxInit() {
@@ -159,6 +341,17 @@ static int RKADK_MEDIA_CtxInit() {
 
   g_stMediaCtx.dumpDebugInfo = getenv("rkadk_dump_debug_info") && atoi(getenv("rkadk_dump_debug_info"));
 
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stAiIdx, RKADK_MEDIA_AI_MAX_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stAencIdx, RKADK_MEDIA_AENC_MAX_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stViIdx, RKADK_MEDIA_VI_MAX_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stVencIdx, RKADK_MEDIA_VENC_MAX_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stVpssIdx, RKADK_MEDIA_VPSS_MAX_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stVoIdx, RKADK_MEDIA_VO_MAX_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stAiAencIdx, RKADK_AI_AENC_MAX_BIND_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stViVencIdx, RKADK_VI_VENC_MAX_BIND_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stViVpssIdx, RKADK_VI_VPSS_MAX_BIND_CNT);
+  RKADK_MEDIA_IndexInit(&g_stMediaCtx.stVpssVencIdx, RKADK_VPSS_VENC_MAX_BIND_CNT);
+
   ret = pthread_mutex_init(&g_stMediaCtx.aiMutex, NULL);
   ret |= pthread_mutex_init(&g_stMediaCtx.aencMutex, NULL);
   ret |= pthread_mutex_init(&g_stMediaCtx.viMutex, NULL);
@@ -404,29 +597,31 @@ static RKADK_U32 RKADK_MPI_VPSS_DestroyGrp(RKADK_S32 s32VpssGrp) {
 #endif
 }
 
-static RKADK_U32 RKADK_MEDIA_FindUsableIdx(RKADK_MEDIA_INFO_S *pstInfo,
-                                           int count, const char *mode) {
-  for (int i = 0; i < count; i++) {
-    if (!pstInfo[i].bUsed) {
-      RKADK_LOGD("%s: find usable index[%d]", mode, i);
-      return i;
+// the slot is taken by RKADK_MEDIA_IndexAdd
+static RKADK_S32 RKADK_MEDIA_FindUsableIdx(RKADK_MEDIA_INDEX_S *pstIndex,
+                                           const char *mode) {
+  int i;
+
+  for (i = 0; i < RKADK_MEDIA_INDEX_MAP_CNT; i++) {
+    if (pstIndex->u32FreeMap[i]) {
+      RKADK_LOGD("%s: find usable index[%d]", mode,
+                 i * 32 + __builtin_ctz(pstIndex->u32FreeMap[i]));
+      return i * 32 + __builtin_ctz(pstIndex->u32FreeMap[i]);
     }
   }
 
   return -1;
 }
 
-static RKADK_S32 RKADK_MEDIA_GetIdx(RKADK_MEDIA_INFO_S *pstInfo, int count,
+static RKADK_S32 RKADK_MEDIA_GetIdx(RKADK_MEDIA_INFO_S *pstInfo,
+                                    RKADK_MEDIA_INDEX_S *pstIndex,
                                     RKADK_S32 s32DevId, RKADK_S32 s32ChnId,
                                     const char *mode) {
-  bool bMatch = false;
-
-  for (int i = 0; i < count; i++) {
-    if (!pstInfo[i].bUsed)
-      continue;
+  int i;
 
-    bMatch = ((pstInfo[i].s32ChnId == s32ChnId) && (pstInfo[i].s32DevId == s32DevId));
-    if (bMatch) {
+  i = pstIndex->s16Head[RKADK_MEDIA_ChnHash(s32DevId, s32ChnId)];
+  for (; i >= 0; i = pstIndex->s16Next[i]) {
+    if ((pstInfo[i].s32ChnId == s32ChnId) && (pstInfo[i].s32DevId == s32DevId)) {
       RKADK_LOGD("%s: find matched index[%d] s32DevId[%d] ChnId[%d]", mode, i,
                  s32DevId, s32ChnId);
       return i;
@@ -461,10 +656,17 @@ RKADK_S32 RKADK_MPI_SYS_Init() {
   return 0;
 }
 
+#ifndef OS_RTT
+static void RKADK_MEDIA_HealthDeInit();
+#endif
+
 RKADK_S32 RKADK_MPI_SYS_Exit() {
   int ret;
 
   if (g_bSysInit) {
+#ifndef OS_RTT
+    RKADK_MEDIA_HealthDeInit();
+#endif
     RKADK_MEDIA_CtxDeInit();
     RK_MPI_VO_CloseFd();
 
@@ -553,11 +755,10 @@ RKADK_S32  RKADK_MPI_AI_Init(AUDIO_DEV aiDevId, RKADK_S32 s32AiChnId,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.aiMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAiInfo, RKADK_MEDIA_AI_MAX_CNT, aiDevId,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAiInfo, &g_stMediaCtx.stAiIdx, aiDevId,
                          s32AiChnId, "AI_INIT");
   if (i < 0) {
-    i = RKADK_MEDIA_FindUsableIdx(g_stMediaCtx.stAiInfo, RKADK_MEDIA_AI_MAX_CNT,
-                                  "AI_INIT");
+    i = RKADK_MEDIA_FindUsableIdx(&g_stMediaCtx.stAiIdx, "AI_INIT");
     if (i < 0) {
       RKADK_LOGE("not find usable index");
       goto exit;
@@ -627,6 +828,7 @@ RKADK_S32  RKADK_MPI_AI_Init(AUDIO_DEV aiDevId, RKADK_S32 s32AiChnId,
     g_stMediaCtx.stAiInfo[i].bUsed = true;
     g_stMediaCtx.stAiInfo[i].s32ChnId = s32AiChnId;
     g_stMediaCtx.stAiInfo[i].s32DevId = aiDevId;
+    RKADK_MEDIA_IndexAdd(&g_stMediaCtx.stAiIdx, g_stMediaCtx.stAiInfo, i);
   }
 
   g_stMediaCtx.stAiInfo[i].s32InitCnt++;
@@ -664,7 +866,7 @@ RKADK_S32 RKADK_MPI_AI_DeInit(AUDIO_DEV aiDevId, RKADK_S32 s32AiChnId,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.aiMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAiInfo, RKADK_MEDIA_AI_MAX_CNT, aiDevId,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAiInfo, &g_stMediaCtx.stAiIdx, aiDevId,
                          s32AiChnId, "AI_DEINIT");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32AiChnId[%d]", i, s32AiChnId);
@@ -699,6 +901,7 @@ RKADK_S32 RKADK_MPI_AI_DeInit(AUDIO_DEV aiDevId, RKADK_S32 s32AiChnId,
       RKADK_LOGE("Ai[%d] disable failed[%x]", aiDevId, ret);
       return RK_FAILURE;
     }
+    RKADK_MEDIA_IndexDel(&g_stMediaCtx.stAiIdx, g_stMediaCtx.stAiInfo, i);
     g_stMediaCtx.stAiInfo[i].bUsed = false;
     g_stMediaCtx.stAiInfo[i].s32ChnId = -1;
     g_stMediaCtx.stAiInfo[i].s32DevId = -1;
@@ -723,11 +926,10 @@ RKADK_S32 RKADK_MPI_AENC_Init(RKADK_S32 s32AencChnId,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.aencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, RKADK_MEDIA_AENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, &g_stMediaCtx.stAencIdx, 0,
                          s32AencChnId, "AENC_INIT");
   if (i < 0) {
-    i = RKADK_MEDIA_FindUsableIdx(g_stMediaCtx.stAencInfo,
-                                  RKADK_MEDIA_AENC_MAX_CNT, "AENC_INIT");
+    i = RKADK_MEDIA_FindUsableIdx(&g_stMediaCtx.stAencIdx, "AENC_INIT");
     if (i < 0) {
       RKADK_LOGE("not find usable index");
       goto exit;
@@ -753,6 +955,7 @@ RKADK_S32 RKADK_MPI_AENC_Init(RKADK_S32 s32AencChnId,
     g_stMediaCtx.stAencInfo[i].s32DevId = 0;
     g_stMediaCtx.stAencInfo[i].s32ChnId = s32AencChnId;
     g_stMediaCtx.stAencInfo[i].enCodecType = pstAencChnAttr->enType;
+    RKADK_MEDIA_IndexAdd(&g_stMediaCtx.stAencIdx, g_stMediaCtx.stAencInfo, i);
   }
 
   g_stMediaCtx.stAencInfo[i].s32InitCnt++;
@@ -772,7 +975,7 @@ RKADK_S32 RKADK_MPI_AENC_DeInit(RKADK_S32 s32AencChnId) {
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.aencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, RKADK_MEDIA_AENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, &g_stMediaCtx.stAencIdx, 0,
                          s32AencChnId, "AENC_DEINIT");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32AencChnId[%d]", i, s32AencChnId);
@@ -791,6 +994,7 @@ RKADK_S32 RKADK_MPI_AENC_DeInit(RKADK_S32 s32AencChnId) {
       goto exit;
     }
 
+    RKADK_MEDIA_IndexDel(&g_stMediaCtx.stAencIdx, g_stMediaCtx.stAencInfo, i);
     g_stMediaCtx.stAencInfo[i].bUsed = false;
     g_stMediaCtx.stAencInfo[i].s32DevId = -1;
     g_stMediaCtx.stAencInfo[i].s32ChnId = -1;
@@ -828,11 +1032,10 @@ RKADK_S32 RKADK_MPI_VI_Init(RKADK_U32 u32CamId, RKADK_S32 s32ViChnId,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.viMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stViInfo, RKADK_MEDIA_VI_MAX_CNT,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stViInfo, &g_stMediaCtx.stViIdx,
                          u32CamId, s32ViChnId, "VI_INIT");
   if (i < 0) {
-    i = RKADK_MEDIA_FindUsableIdx(g_stMediaCtx.stViInfo, RKADK_MEDIA_VI_MAX_CNT,
-                                  "VI_INIT");
+    i = RKADK_MEDIA_FindUsableIdx(&g_stMediaCtx.stViIdx, "VI_INIT");
     if (i < 0) {
       RKADK_LOGE("not find usable index");
       goto exit;
@@ -904,6 +1107,7 @@ RKADK_S32 RKADK_MPI_VI_Init(RKADK_U32 u32CamId, RKADK_S32 s32ViChnId,
     g_stMediaCtx.stViInfo[i].bUsed = true;
     g_stMediaCtx.stViInfo[i].s32ChnId = s32ViChnId;
     g_stMediaCtx.stViInfo[i].s32DevId = u32CamId;
+    RKADK_MEDIA_IndexAdd(&g_stMediaCtx.stViIdx, g_stMediaCtx.stViInfo, i);
   }
 
   g_stMediaCtx.stViInfo[i].s32InitCnt++;
@@ -923,7 +1127,7 @@ RKADK_S32 RKADK_MPI_VI_DeInit(RKADK_U32 u32CamId, RKADK_S32 s32ViChnId) {
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.viMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stViInfo, RKADK_MEDIA_VI_MAX_CNT,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stViInfo, &g_stMediaCtx.stViIdx,
                          u32CamId, s32ViChnId, "VI_DEINIT");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, s32ViChnId);
@@ -959,6 +1163,7 @@ RKADK_S32 RKADK_MPI_VI_DeInit(RKADK_U32 u32CamId, RKADK_S32 s32ViChnId) {
       }
     }
 
+    RKADK_MEDIA_IndexDel(&g_stMediaCtx.stViIdx, g_stMediaCtx.stViInfo, i);
     g_stMediaCtx.stViInfo[i].bUsed = false;
     g_stMediaCtx.stViInfo[i].s32ChnId = -1;
     g_stMediaCtx.stViInfo[i].s32DevId = -1;
@@ -1012,11 +1217,10 @@ RKADK_S32 RKADK_MPI_VENC_Init(RKADK_U32 u32CamId, RKADK_S32 s32ChnId,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, RKADK_MEDIA_VENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
                          s32ChnId, "VENC_INIT");
   if (i < 0) {
-    i = RKADK_MEDIA_FindUsableIdx(g_stMediaCtx.stVencInfo,
-                                  RKADK_MEDIA_VENC_MAX_CNT, "VENC_INIT");
+    i = RKADK_MEDIA_FindUsableIdx(&g_stMediaCtx.stVencIdx, "VENC_INIT");
     if (i < 0) {
       RKADK_LOGE("not find usable index");
       goto exit;
@@ -1064,6 +1268,7 @@ RKADK_S32 RKADK_MPI_VENC_Init(RKADK_U32 u32CamId, RKADK_S32 s32ChnId,
     g_stMediaCtx.stVencInfo[i].s32DevId = 0;
     g_stMediaCtx.stVencInfo[i].s32ChnId = s32ChnId;
     g_stMediaCtx.stVencInfo[i].enCodecType = pstVencChnAttr->stVencAttr.enType;
+    RKADK_MEDIA_IndexAdd(&g_stMediaCtx.stVencIdx, g_stMediaCtx.stVencInfo, i);
   }
 
   g_stMediaCtx.stVencInfo[i].s32InitCnt++;
@@ -1083,7 +1288,7 @@ RKADK_S32 RKADK_MPI_VENC_DeInit(RKADK_S32 s32ChnId) {
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, RKADK_MEDIA_VENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
                          s32ChnId, "VENC_DEINIT");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, s32ChnId);
@@ -1108,6 +1313,7 @@ RKADK_S32 RKADK_MPI_VENC_DeInit(RKADK_S32 s32ChnId) {
       goto exit;
     }
 
+    RKADK_MEDIA_IndexDel(&g_stMediaCtx.stVencIdx, g_stMediaCtx.stVencInfo, i);
     g_stMediaCtx.stVencInfo[i].bUsed = false;
     g_stMediaCtx.stVencInfo[i].bReset = false;
     g_stMediaCtx.stVencInfo[i].s32DevId = -1;
@@ -1137,11 +1343,10 @@ RKADK_S32 RKADK_MPI_VPSS_Init(RKADK_S32 s32VpssGrp, RKADK_S32 s32VpssChn,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vpssMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVpssInfo, RKADK_MEDIA_VPSS_MAX_CNT,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVpssInfo, &g_stMediaCtx.stVpssIdx,
                          s32VpssGrp, s32VpssChn, "VPSS_INIT");
   if (i < 0) {
-    i = RKADK_MEDIA_FindUsableIdx(g_stMediaCtx.stVpssInfo, RKADK_MEDIA_VPSS_MAX_CNT,
-                                  "VPSS_INIT");
+    i = RKADK_MEDIA_FindUsableIdx(&g_stMediaCtx.stVpssIdx, "VPSS_INIT");
     if (i < 0) {
       RKADK_LOGE("not find usable index");
       goto exit;
@@ -1170,6 +1375,7 @@ RKADK_S32 RKADK_MPI_VPSS_Init(RKADK_S32 s32VpssGrp, RKADK_S32 s32VpssChn,
     g_stMediaCtx.stVpssInfo[i].bUsed = true;
     g_stMediaCtx.stVpssInfo[i].s32DevId = s32VpssGrp;
     g_stMediaCtx.stVpssInfo[i].s32ChnId = s32VpssChn;
+    RKADK_MEDIA_IndexAdd(&g_stMediaCtx.stVpssIdx, g_stMediaCtx.stVpssInfo, i);
   }
 
   g_stMediaCtx.stVpssInfo[i].s32InitCnt++;
@@ -1191,7 +1397,7 @@ RKADK_S32 RKADK_MPI_VPSS_DeInit(RKADK_S32 s32VpssGrp, RKADK_S32 s32VpssChn) {
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vpssMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVpssInfo, RKADK_MEDIA_VPSS_MAX_CNT,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVpssInfo, &g_stMediaCtx.stVpssIdx,
                          s32VpssGrp, s32VpssChn, "VPSS_DEINIT");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32VpssGrp[%d] s32ChnId[%d]", i, s32VpssGrp, s32VpssChn);
@@ -1216,6 +1422,7 @@ RKADK_S32 RKADK_MPI_VPSS_DeInit(RKADK_S32 s32VpssGrp, RKADK_S32 s32VpssChn) {
       goto exit;
     }
 
+    RKADK_MEDIA_IndexDel(&g_stMediaCtx.stVpssIdx, g_stMediaCtx.stVpssInfo, i);
     g_stMediaCtx.stVpssInfo[i].bUsed = false;
     g_stMediaCtx.stVpssInfo[i].s32ChnId = -1;
     g_stMediaCtx.stVpssInfo[i].s32DevId = -1;
@@ -1287,11 +1494,10 @@ RKADK_S32 RKADK_MPI_VO_Init(RKADK_S32 s32VoLay, RKADK_S32 s32VoDev, RKADK_S32 s3
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.voMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVoInfo, RKADK_MEDIA_VO_MAX_CNT,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVoInfo, &g_stMediaCtx.stVoIdx,
                          s32VoDev, s32VoChn, "VO_INIT");
   if (i < 0) {
-    i = RKADK_MEDIA_FindUsableIdx(g_stMediaCtx.stVoInfo, RKADK_MEDIA_VO_MAX_CNT,
-                                  "VO_INIT");
+    i = RKADK_MEDIA_FindUsableIdx(&g_stMediaCtx.stVoIdx, "VO_INIT");
     if (i < 0) {
       RKADK_LOGE("not find usable index");
       goto exit;
@@ -1324,6 +1530,7 @@ RKADK_S32 RKADK_MPI_VO_Init(RKADK_S32 s32VoLay, RKADK_S32 s32VoDev, RKADK_S32 s3
     g_stMediaCtx.stVoInfo[i].bUsed = true;
     g_stMediaCtx.stVoInfo[i].s32DevId = s32VoDev;
     g_stMediaCtx.stVoInfo[i].s32ChnId = s32VoChn;
+    RKADK_MEDIA_IndexAdd(&g_stMediaCtx.stVoIdx, g_stMediaCtx.stVoInfo, i);
   }
 
   g_stMediaCtx.stVoInfo[i].s32InitCnt++;
@@ -1343,7 +1550,7 @@ RKADK_S32 RKADK_MPI_VO_DeInit(RKADK_S32 s32VoLay, RKADK_S32 s32VoDev, RKADK_S32
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.voMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVoInfo, RKADK_MEDIA_VO_MAX_CNT,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVoInfo, &g_stMediaCtx.stVoIdx,
                          s32VoDev, s32VoChn, "VO_DEINIT");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d, %d]", i, s32VoDev, s32VoChn);
@@ -1369,6 +1576,7 @@ RKADK_S32 RKADK_MPI_VO_DeInit(RKADK_S32 s32VoLay, RKADK_S32 s32VoDev, RKADK_S32
       goto exit;
     }
 
+    RKADK_MEDIA_IndexDel(&g_stMediaCtx.stVoIdx, g_stMediaCtx.stVoInfo, i);
     g_stMediaCtx.stVoInfo[i].bUsed = false;
     g_stMediaCtx.stVoInfo[i].s32ChnId = -1;
     g_stMediaCtx.stVoInfo[i].s32DevId = -1;
@@ -1385,9 +1593,652 @@ exit:
 }
 
 #ifndef OS_RTT
+static RKADK_U64 RKADK_MEDIA_GetTimeUs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (RKADK_U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* at most one timeout dump per interval */
+#define RKADK_MEDIA_HEALTH_INTERVAL_US (5 * 1000000)
+
+static const char *g_pcHealthNode[] = {
+#if defined(RV1106_1103) || defined(RV1103B)
+    "/proc/rkisp-vir0",
+    "/dev/mpi/vsys",
+    "/proc/vcodec/enc/venc_info",
+#else
+    // dumpsys is a separate binary, only the isp node is read directly
+    "/proc/rkispp0",
+#endif
+};
+
+#define RKADK_MEDIA_HEALTH_NODE_CNT (sizeof(g_pcHealthNode) / sizeof(g_pcHealthNode[0]))
+
+typedef struct {
+  MOD_ID_E enModId;
+  RKADK_S32 s32DevId;
+  RKADK_S32 s32ChnId;
+  RKADK_S32 s32InitCnt;
+  RKADK_S32 s32GetCnt;
+  RKADK_S64 s64RecentPts;
+  RKADK_U64 u64TimeoutCnt;
+} RKADK_MEDIA_HEALTH_CHN_S;
+
+typedef struct {
+  RKADK_U32 u32ChnCnt;
+  RKADK_U32 u32BindCnt;
+  RKADK_MEDIA_HEALTH_CHN_S stChn[RKADK_MEDIA_AI_MAX_CNT + RKADK_MEDIA_AENC_MAX_CNT +
+                                 RKADK_MEDIA_VI_MAX_CNT + RKADK_MEDIA_VENC_MAX_CNT +
+                                 RKADK_MEDIA_VPSS_MAX_CNT + RKADK_MEDIA_VO_MAX_CNT];
+  RKADK_BIND_INFO_S stBind[RKADK_AI_AENC_MAX_BIND_CNT + RKADK_VI_VENC_MAX_BIND_CNT +
+                           RKADK_VI_VPSS_MAX_BIND_CNT + RKADK_VPSS_VENC_MAX_BIND_CNT];
+  char cNode[RKADK_MEDIA_HEALTH_NODE_CNT][RKADK_MEDIA_NODE_BUF_LEN];
+} RKADK_MEDIA_HEALTH_S;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  void *pThread;
+  bool bRequest;
+  RKADK_U64 u64LastUs;
+} RKADK_MEDIA_HEALTH_CTX_S;
+
+static RKADK_MEDIA_HEALTH_CTX_S g_stHealthCtx = {PTHREAD_MUTEX_INITIALIZER, NULL,
+                                                  false, 0};
+
+static void RKADK_MEDIA_HealthAddChn(RKADK_MEDIA_HEALTH_S *pstHealth, MOD_ID_E enModId,
+                                     RKADK_MEDIA_INFO_S *pstInfo, int count,
+                                     pthread_mutex_t *pMutex) {
+  RKADK_MEDIA_HEALTH_CHN_S *pstChn;
+
+  RKADK_MUTEX_LOCK(*pMutex);
+  for (int i = 0; i < count; i++) {
+    if (!pstInfo[i].bUsed)
+      continue;
+
+    pstChn = &pstHealth->stChn[pstHealth->u32ChnCnt++];
+    pstChn->enModId = enModId;
+    pstChn->s32DevId = pstInfo[i].s32DevId;
+    pstChn->s32ChnId = pstInfo[i].s32ChnId;
+    pstChn->s32InitCnt = pstInfo[i].s32InitCnt;
+    if (enModId == RK_ID_AENC) {
+      pstChn->s32GetCnt = pstInfo[i].stGetAencMBAttr.s32GetCnt;
+    } else if (enModId == RK_ID_VENC) {
+      pstChn->s32GetCnt = pstInfo[i].stGetVencMBAttr.s32GetCnt;
+      pstChn->s64RecentPts = pstInfo[i].stGetVencMBAttr.s64RecentPts;
+      pstChn->u64TimeoutCnt = pstInfo[i].stGetVencMBAttr.u64TimeoutCnt;
+    }
+  }
+  RKADK_MUTEX_UNLOCK(*pMutex);
+}
+
+static void RKADK_MEDIA_HealthAddBind(RKADK_MEDIA_HEALTH_S *pstHealth,
+                                      RKADK_BIND_INFO_S *pstInfo, int count) {
+  for (int i = 0; i < count; i++) {
+    if (pstInfo[i].bUsed)
+      pstHealth->stBind[pstHealth->u32BindCnt++] = pstInfo[i];
+  }
+}
+
+static void RKADK_MEDIA_HealthCollect(RKADK_MEDIA_HEALTH_S *pstHealth, bool bNode) {
+  memset(pstHealth, 0, sizeof(RKADK_MEDIA_HEALTH_S));
+
+  RKADK_MEDIA_HealthAddChn(pstHealth, RK_ID_AI, g_stMediaCtx.stAiInfo,
+                           RKADK_MEDIA_AI_MAX_CNT, &g_stMediaCtx.aiMutex);
+  RKADK_MEDIA_HealthAddChn(pstHealth, RK_ID_AENC, g_stMediaCtx.stAencInfo,
+                           RKADK_MEDIA_AENC_MAX_CNT, &g_stMediaCtx.aencMutex);
+  RKADK_MEDIA_HealthAddChn(pstHealth, RK_ID_VI, g_stMediaCtx.stViInfo,
+                           RKADK_MEDIA_VI_MAX_CNT, &g_stMediaCtx.viMutex);
+  RKADK_MEDIA_HealthAddChn(pstHealth, RK_ID_VENC, g_stMediaCtx.stVencInfo,
+                           RKADK_MEDIA_VENC_MAX_CNT, &g_stMediaCtx.vencMutex);
+  RKADK_MEDIA_HealthAddChn(pstHealth, RK_ID_VPSS, g_stMediaCtx.stVpssInfo,
+                           RKADK_MEDIA_VPSS_MAX_CNT, &g_stMediaCtx.vpssMutex);
+  RKADK_MEDIA_HealthAddChn(pstHealth, RK_ID_VO, g_stMediaCtx.stVoInfo,
+                           RKADK_MEDIA_VO_MAX_CNT, &g_stMediaCtx.voMutex);
+
+  RKADK_MUTEX_LOCK(g_stMediaCtx.bindMutex);
+  RKADK_MEDIA_HealthAddBind(pstHealth, g_stMediaCtx.stAiAencInfo, RKADK_AI_AENC_MAX_BIND_CNT);
+  RKADK_MEDIA_HealthAddBind(pstHealth, g_stMediaCtx.stViVencInfo, RKADK_VI_VENC_MAX_BIND_CNT);
+  RKADK_MEDIA_HealthAddBind(pstHealth, g_stMediaCtx.stViVpssInfo, RKADK_VI_VPSS_MAX_BIND_CNT);
+  RKADK_MEDIA_HealthAddBind(pstHealth, g_stMediaCtx.stVpssVencInfo, RKADK_VPSS_VENC_MAX_BIND_CNT);
+  RKADK_MUTEX_UNLOCK(g_stMediaCtx.bindMutex);
+
+  for (RKADK_U32 i = 0; bNode && i < RKADK_MEDIA_HEALTH_NODE_CNT; i++)
+    RKADK_MEDIA_ReadNode(g_pcHealthNode[i], pstHealth->cNode[i], RKADK_MEDIA_NODE_BUF_LEN);
+}
+
+static int RKADK_MEDIA_HealthText(RKADK_MEDIA_HEALTH_S *pstHealth, bool bNode,
+                                  char *pBuf, int size) {
+  int len = 0;
+  RKADK_MEDIA_HEALTH_CHN_S *pstChn;
+  RKADK_BIND_INFO_S *pstBind;
+
+#define RKADK_HEALTH_PRINT(fmt, ...)                                           \
+  do {                                                                         \
+    if (len < size)                                                            \
+      len += snprintf(pBuf + len, size - len, fmt, ##__VA_ARGS__);             \
+  } while (0)
+
+  for (RKADK_U32 i = 0; i < pstHealth->u32ChnCnt; i++) {
+    pstChn = &pstHealth->stChn[i];
+    RKADK_HEALTH_PRINT("chn mod[%d] dev[%d] chn[%d] init[%d] get[%d] pts[%lld] timeout[%llu]\n",
+                       pstChn->enModId, pstChn->s32DevId, pstChn->s32ChnId,
+                       pstChn->s32InitCnt, pstChn->s32GetCnt,
+                       (long long)pstChn->s64RecentPts,
+                       (unsigned long long)pstChn->u64TimeoutCnt);
+  }
+
+  for (RKADK_U32 i = 0; i < pstHealth->u32BindCnt; i++) {
+    pstBind = &pstHealth->stBind[i];
+    RKADK_HEALTH_PRINT("bind src[%d, %d, %d] dest[%d, %d, %d] cnt[%d]\n",
+                       pstBind->stSrcChn.enModId, pstBind->stSrcChn.s32DevId,
+                       pstBind->stSrcChn.s32ChnId, pstBind->stDestChn.enModId,
+                       pstBind->stDestChn.s32DevId, pstBind->stDestChn.s32ChnId,
+                       pstBind->s32BindCnt);
+  }
+
+  for (RKADK_U32 i = 0; bNode && i < RKADK_MEDIA_HEALTH_NODE_CNT; i++)
+    RKADK_HEALTH_PRINT("---- %s ----\n%s\n", g_pcHealthNode[i], pstHealth->cNode[i]);
+
+#undef RKADK_HEALTH_PRINT
+
+  // truncated
+  if (len >= size)
+    return -1;
+
+  return len;
+}
+
+static int RKADK_MEDIA_HealthJson(RKADK_MEDIA_HEALTH_S *pstHealth, bool bNode,
+                                  char *pBuf, int size) {
+  int len;
+  char *pJson;
+  cJSON *root, *array, *item;
+  RKADK_MEDIA_HEALTH_CHN_S *pstChn;
+  RKADK_BIND_INFO_S *pstBind;
+
+  root = cJSON_CreateObject();
+  if (!root)
+    return -1;
+
+  cJSON_AddItemToObject(root, "chn", array = cJSON_CreateArray());
+  for (RKADK_U32 i = 0; i < pstHealth->u32ChnCnt; i++) {
+    pstChn = &pstHealth->stChn[i];
+    cJSON_AddItemToArray(array, item = cJSON_CreateObject());
+    cJSON_AddNumberToObject(item, "mod", pstChn->enModId);
+    cJSON_AddNumberToObject(item, "dev", pstChn->s32DevId);
+    cJSON_AddNumberToObject(item, "chn", pstChn->s32ChnId);
+    cJSON_AddNumberToObject(item, "init_cnt", pstChn->s32InitCnt);
+    cJSON_AddNumberToObject(item, "get_cnt", pstChn->s32GetCnt);
+    cJSON_AddNumberToObject(item, "recent_pts", pstChn->s64RecentPts);
+    cJSON_AddNumberToObject(item, "timeout_cnt", pstChn->u64TimeoutCnt);
+  }
+
+  cJSON_AddItemToObject(root, "bind", array = cJSON_CreateArray());
+  for (RKADK_U32 i = 0; i < pstHealth->u32BindCnt; i++) {
+    pstBind = &pstHealth->stBind[i];
+    cJSON_AddItemToArray(array, item = cJSON_CreateObject());
+    cJSON_AddNumberToObject(item, "src_mod", pstBind->stSrcChn.enModId);
+    cJSON_AddNumberToObject(item, "src_dev", pstBind->stSrcChn.s32DevId);
+    cJSON_AddNumberToObject(item, "src_chn", pstBind->stSrcChn.s32ChnId);
+    cJSON_AddNumberToObject(item, "dest_mod", pstBind->stDestChn.enModId);
+    cJSON_AddNumberToObject(item, "dest_dev", pstBind->stDestChn.s32DevId);
+    cJSON_AddNumberToObject(item, "dest_chn", pstBind->stDestChn.s32ChnId);
+    cJSON_AddNumberToObject(item, "bind_cnt", pstBind->s32BindCnt);
+  }
+
+  if (bNode) {
+    cJSON_AddItemToObject(root, "node", item = cJSON_CreateObject());
+    for (RKADK_U32 i = 0; i < RKADK_MEDIA_HEALTH_NODE_CNT; i++)
+      cJSON_AddStringToObject(item, g_pcHealthNode[i], pstHealth->cNode[i]);
+  }
+
+  pJson = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  if (!pJson)
+    return -1;
+
+  len = strlen(pJson);
+  if (len >= size) {
+    free(pJson);
+    return -1;
+  }
+
+  memcpy(pBuf, pJson, len + 1);
+  free(pJson);
+  return len;
+}
+
+RKADK_S32 RKADK_MEDIA_GetHealth(RKADK_MEDIA_HEALTH_FMT_E enFmt, bool bNode,
+                                RKADK_CHAR *pBuf, RKADK_U32 u32Size) {
+  int ret;
+  RKADK_MEDIA_HEALTH_S *pstHealth;
+
+  RKADK_CHECK_POINTER(pBuf, RKADK_FAILURE);
+
+  if (!g_bSysInit) {
+    RKADK_LOGE("System is not initialized");
+    return -1;
+  }
+
+  pstHealth = (RKADK_MEDIA_HEALTH_S *)malloc(sizeof(RKADK_MEDIA_HEALTH_S));
+  if (!pstHealth) {
+    RKADK_LOGE("malloc health snapshot failed");
+    return -1;
+  }
+
+  RKADK_MEDIA_HealthCollect(pstHealth, bNode);
+  if (enFmt == RKADK_MEDIA_HEALTH_FMT_JSON)
+    ret = RKADK_MEDIA_HealthJson(pstHealth, bNode, pBuf, u32Size);
+  else
+    ret = RKADK_MEDIA_HealthText(pstHealth, bNode, pBuf, u32Size);
+
+  free(pstHealth);
+  if (ret < 0)
+    RKADK_LOGE("health snapshot is larger than %d", u32Size);
+
+  return ret;
+}
+
+static bool RKADK_MEDIA_HealthProc(void *params) {
+  bool bRequest;
+  char *pBuf;
+  int size = RKADK_MEDIA_HEALTH_NODE_CNT * RKADK_MEDIA_NODE_BUF_LEN + 16 * 1024;
+
+  RKADK_THREAD_Wait(-1);
+
+  RKADK_MUTEX_LOCK(g_stHealthCtx.mutex);
+  bRequest = g_stHealthCtx.bRequest;
+  g_stHealthCtx.bRequest = false;
+  RKADK_MUTEX_UNLOCK(g_stHealthCtx.mutex);
+
+  if (!bRequest)
+    return true;
+
+  pBuf = (char *)malloc(size);
+  if (!pBuf)
+    return true;
+
+  if (RKADK_MEDIA_GetHealth(RKADK_MEDIA_HEALTH_FMT_TEXT, true, pBuf, size) >= 0)
+    fputs(pBuf, stdout);
+
+  free(pBuf);
+  return true;
+}
+
+/* called from the hot thread, the snapshot is produced by the health thread */
+static void RKADK_MEDIA_HealthRequest() {
+  RKADK_U64 u64NowUs = RKADK_MEDIA_GetTimeUs();
+
+  RKADK_MUTEX_LOCK(g_stHealthCtx.mutex);
+  if (g_stHealthCtx.u64LastUs &&
+      u64NowUs - g_stHealthCtx.u64LastUs < RKADK_MEDIA_HEALTH_INTERVAL_US)
+    goto exit;
+
+  if (!g_stHealthCtx.pThread) {
+    g_stHealthCtx.pThread = RKADK_THREAD_Create(RKADK_MEDIA_HealthProc, NULL, "MediaHealth");
+    if (!g_stHealthCtx.pThread) {
+      RKADK_LOGE("create health thread failed");
+      goto exit;
+    }
+  }
+
+  g_stHealthCtx.u64LastUs = u64NowUs;
+  g_stHealthCtx.bRequest = true;
+  RKADK_THREAD_Wake(g_stHealthCtx.pThread);
+
+exit:
+  RKADK_MUTEX_UNLOCK(g_stHealthCtx.mutex);
+}
+
+static void RKADK_MEDIA_HealthDeInit() {
+  void *pThread;
+
+  RKADK_MUTEX_LOCK(g_stHealthCtx.mutex);
+  pThread = g_stHealthCtx.pThread;
+  g_stHealthCtx.pThread = NULL;
+  g_stHealthCtx.bRequest = false;
+  g_stHealthCtx.u64LastUs = 0;
+  RKADK_MUTEX_UNLOCK(g_stHealthCtx.mutex);
+
+  // the health thread takes the mutex once woken, join it unlocked
+  if (pThread)
+    RKADK_THREAD_Destory(pThread);
+}
+
+static RKADK_U32 RKADK_MEDIA_CbHistIdx(RKADK_U32 u32Us) {
+  RKADK_U32 n, u32Idx;
+
+  if (u32Us < 4)
+    return u32Us;
+
+  n = 31 - __builtin_clz(u32Us);
+  u32Idx = (n - 1) * 4 + ((u32Us >> (n - 2)) & 3);
+  return u32Idx < RKADK_MEDIA_CB_HIST_CNT ? u32Idx : RKADK_MEDIA_CB_HIST_CNT - 1;
+}
+
+// the largest time of the bucket
+static RKADK_U32 RKADK_MEDIA_CbHistValue(RKADK_U32 u32Idx) {
+  RKADK_U32 n;
+
+  if (u32Idx < 4)
+    return u32Idx;
+
+  n = u32Idx / 4 + 1;
+  return ((4 + u32Idx % 4 + 1) << (n - 2)) - 1;
+}
+
+static RKADK_U32 RKADK_MEDIA_CbPercentile(RKADK_U32 *pu32Hist, RKADK_U64 u64Total,
+                                          RKADK_U32 u32Percent) {
+  RKADK_U32 i;
+  RKADK_U64 u64Cnt = 0, u64Target;
+
+  if (!u64Total)
+    return 0;
+
+  u64Target = (u64Total * u32Percent + 99) / 100;
+  for (i = 0; i < RKADK_MEDIA_CB_HIST_CNT; i++) {
+    u64Cnt += pu32Hist[i];
+    if (u64Cnt >= u64Target)
+      break;
+  }
+
+  return RKADK_MEDIA_CbHistValue(i < RKADK_MEDIA_CB_HIST_CNT ? i : i - 1);
+}
+
+static void RKADK_MEDIA_CbRecord(RKADK_GET_MB_CB_S *pstCb, RKADK_U32 u32Us) {
+  __atomic_fetch_add(&pstCb->u32Hist[RKADK_MEDIA_CbHistIdx(u32Us)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&pstCb->u64CallCnt, 1, __ATOMIC_RELAXED);
+  if (u32Us > __atomic_load_n(&pstCb->u32MaxUs, __ATOMIC_RELAXED))
+    __atomic_store_n(&pstCb->u32MaxUs, u32Us, __ATOMIC_RELAXED);
+}
+
+static bool RKADK_MEDIA_IsVencKeyFrame(RK_CODEC_ID_E enCodecType,
+                                       VENC_PACK_S *pstPack) {
+  switch (enCodecType) {
+  case RK_VIDEO_ID_AVC:
+    return RKADK_MEDIA_CheckIdrFrame(RKADK_CODEC_TYPE_H264, pstPack->DataType);
+  case RK_VIDEO_ID_HEVC:
+    return RKADK_MEDIA_CheckIdrFrame(RKADK_CODEC_TYPE_H265, pstPack->DataType);
+  default:
+    return true;
+  }
+}
+
+static void RKADK_MEDIA_DeferPktFree(RKADK_MEDIA_DEFER_PKT_S *pstPkt) {
+  int ret;
+
+  list_del_init(&pstPkt->mark);
+  ret = RK_MPI_MB_ReleaseMB(pstPkt->stPack.pMbBlk);
+  if (ret != RK_SUCCESS)
+    RKADK_LOGE("RK_MPI_MB_ReleaseMB failed[%x]", ret);
+
+  free(pstPkt);
+}
+
+/*
+ * The stream is referenced and queued, the get mb thread releases the
+ * venc stream without waiting for the slow consumer.
+ */
+static void RKADK_MEDIA_DeferPush(RKADK_GET_MB_CB_S *pstCb,
+                                  RKADK_MEDIA_VENC_DATA_S *pstData) {
+  RKADK_MEDIA_DEFER_PKT_S *pstPkt;
+  bool bKeyFrame = RKADK_MEDIA_IsVencKeyFrame(pstCb->enCodecType,
+                                              pstData->stFrame.pstPack);
+
+  RKADK_MUTEX_LOCK(pstCb->mutex);
+  if (bKeyFrame)
+    pstCb->bDropToIdr = false;
+
+  // queue full, skip to the next key frame to keep the stream decodable
+  if (!pstCb->bDropToIdr && pstCb->u32PktCnt >= RKADK_MEDIA_CB_DEFER_QUEUE_MAX)
+    pstCb->bDropToIdr = true;
+
+  if (pstCb->bDropToIdr)
+    goto drop;
+
+  pstPkt = (RKADK_MEDIA_DEFER_PKT_S *)malloc(sizeof(RKADK_MEDIA_DEFER_PKT_S));
+  if (!pstPkt) {
+    RKADK_LOGE("malloc defer packet failed");
+    pstCb->bDropToIdr = true;
+    goto drop;
+  }
+
+  INIT_LIST_HEAD(&pstPkt->mark);
+  pstPkt->stData = *pstData;
+  pstPkt->stPack = *pstData->stFrame.pstPack;
+  pstPkt->stData.stFrame.pstPack = &pstPkt->stPack;
+  RK_MPI_MB_AddUserCnt(pstPkt->stPack.pMbBlk);
+
+  list_add_tail(&pstPkt->mark, &pstCb->stPktList);
+  pstCb->u32PktCnt++;
+  RKADK_MUTEX_UNLOCK(pstCb->mutex);
+
+  RKADK_SIGNAL_Give(pstCb->pSignal);
+  return;
+
+drop:
+  pstCb->u32DropCnt++;
+  RKADK_MUTEX_UNLOCK(pstCb->mutex);
+}
+
+static bool RKADK_MEDIA_DeferProc(void *params) {
+  RKADK_U64 u64Start;
+  RKADK_MEDIA_DEFER_PKT_S *pstPkt = NULL;
+  RKADK_GET_MB_CB_S *pstCb = (RKADK_GET_MB_CB_S *)params;
+
+  RKADK_MUTEX_LOCK(pstCb->mutex);
+  if (!list_empty(&pstCb->stPktList)) {
+    pstPkt = list_first_entry(&pstCb->stPktList, RKADK_MEDIA_DEFER_PKT_S, mark);
+    list_del_init(&pstPkt->mark);
+    pstCb->u32PktCnt--;
+  }
+  RKADK_MUTEX_UNLOCK(pstCb->mutex);
+
+  if (!pstPkt) {
+    RKADK_SIGNAL_Wait(pstCb->pSignal, 100);
+    return true;
+  }
+
+  u64Start = RKADK_MEDIA_GetTimeUs();
+  pstCb->pfnVencCb(pstPkt->stData, pstCb->pHandle);
+  RKADK_MEDIA_CbRecord(pstCb, RKADK_MEDIA_GetTimeUs() - u64Start);
+
+  RKADK_MEDIA_DeferPktFree(pstPkt);
+  return true;
+}
+
+static void RKADK_MEDIA_VencCbCall(RKADK_GET_MB_CB_S *pstCb,
+                                   RKADK_MEDIA_VENC_DATA_S *pstData) {
+  RKADK_U32 u32Us, u32BudgetUs;
+  RKADK_U64 u64Start;
+
+  if (__atomic_load_n(&pstCb->bDeferred, __ATOMIC_ACQUIRE)) {
+    RKADK_MEDIA_DeferPush(pstCb, pstData);
+    return;
+  }
+
+  u64Start = RKADK_MEDIA_GetTimeUs();
+  pstCb->pfnVencCb(*pstData, pstCb->pHandle);
+  u32Us = RKADK_MEDIA_GetTimeUs() - u64Start;
+  RKADK_MEDIA_CbRecord(pstCb, u32Us);
+
+  u32BudgetUs = __atomic_load_n(&pstCb->u32BudgetUs, __ATOMIC_ACQUIRE);
+  if (!u32BudgetUs || u32Us <= u32BudgetUs) {
+    pstCb->u32OverCnt = 0;
+    return;
+  }
+
+  if (++pstCb->u32OverCnt >= RKADK_MEDIA_CB_OVER_BUDGET_CNT) {
+    RKADK_LOGW("venc[%d] cb[%p] took %dus > budget %dus, move to deferred path",
+               pstData->u32ChnId, pstCb->pHandle, u32Us, u32BudgetUs);
+    __atomic_store_n(&pstCb->bDeferred, true, __ATOMIC_RELEASE);
+  }
+}
+
+static RKADK_GET_MB_CB_S *RKADK_MEDIA_CbCreate(RKADK_GET_MB_CB_S *pstKey) {
+  RKADK_GET_MB_CB_S *pstCb;
+
+  pstCb = (RKADK_GET_MB_CB_S *)malloc(sizeof(RKADK_GET_MB_CB_S));
+  if (!pstCb) {
+    RKADK_LOGE("malloc cb failed");
+    return NULL;
+  }
+
+  memset(pstCb, 0, sizeof(RKADK_GET_MB_CB_S));
+  pstCb->pHandle = pstKey->pHandle;
+  pstCb->pfnAencCb = pstKey->pfnAencCb;
+  pstCb->pfnVencCb = pstKey->pfnVencCb;
+  pstCb->enCodecType = pstKey->enCodecType;
+  INIT_LIST_HEAD(&pstCb->stPktList);
+  pthread_mutex_init(&pstCb->mutex, NULL);
+  return pstCb;
+}
+
+static void RKADK_MEDIA_CbDestroy(RKADK_GET_MB_CB_S *pstCb) {
+  RKADK_MEDIA_DEFER_PKT_S *pstPkt = NULL, *pstPkt_n = NULL;
+
+  if (pstCb->pThread) {
+    RKADK_THREAD_SetExit(pstCb->pThread);
+    RKADK_SIGNAL_Give(pstCb->pSignal);
+    RKADK_THREAD_Destory(pstCb->pThread);
+  }
+
+  if (pstCb->pSignal)
+    RKADK_SIGNAL_Destroy(pstCb->pSignal);
+
+  list_for_each_entry_safe(pstPkt, pstPkt_n, &pstCb->stPktList, mark) {
+    RKADK_MEDIA_DeferPktFree(pstPkt);
+  }
+
+  pthread_mutex_destroy(&pstCb->mutex);
+  free(pstCb);
+}
+
+static void RKADK_MEDIA_SubsFree(RKADK_GET_MB_SUBS_S *pstSubs) {
+  RKADK_GET_MB_SUBS_S *pstNext;
+
+  while (pstSubs) {
+    pstNext = pstSubs->pNext;
+    if (pstSubs->pstRemoved)
+      RKADK_MEDIA_CbDestroy(pstSubs->pstRemoved);
+    free(pstSubs);
+    pstSubs = pstNext;
+  }
+}
+
+static RKADK_GET_MB_SUBS_S *RKADK_MEDIA_SubsEnter(RKADK_GET_MB_RCU_S *pstRcu) {
+  __atomic_add_fetch(&pstRcu->u32Seq, 1, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&pstRcu->pSubs, __ATOMIC_SEQ_CST);
+}
+
+static void RKADK_MEDIA_SubsExit(RKADK_GET_MB_RCU_S *pstRcu) {
+  __atomic_add_fetch(&pstRcu->u32Seq, 1, __ATOMIC_RELEASE);
+  RKADK_MEDIA_SubsFree(__atomic_exchange_n(&pstRcu->pRetired, NULL, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Must be called without the module mutex: the removed callback's defer
+ * thread is joined here, and a callback may itself take the module mutex.
+ */
+static void RKADK_MEDIA_SubsRetire(RKADK_GET_MB_RCU_S *pstRcu, pthread_t tid,
+                                   RKADK_GET_MB_SUBS_S *pstSubs) {
+  RKADK_U32 u32Seq;
+  struct timespec stStart, stEnd;
+
+  if (!pstSubs)
+    return;
+
+  // called from a callback, the get mb thread frees it after the loop
+  if (tid && pthread_equal(tid, pthread_self())) {
+    pstSubs->pNext = __atomic_load_n(&pstRcu->pRetired, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pstRcu->pRetired, &pstSubs->pNext, pstSubs,
+                                        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    return;
+  }
+
+  // wait for the get mb thread to leave the callbacks using the old snapshot
+  u32Seq = __atomic_load_n(&pstRcu->u32Seq, __ATOMIC_SEQ_CST);
+  if (u32Seq & 1) {
+    clock_gettime(CLOCK_MONOTONIC, &stStart);
+    while (__atomic_load_n(&pstRcu->u32Seq, __ATOMIC_ACQUIRE) == u32Seq)
+      usleep(100);
+    clock_gettime(CLOCK_MONOTONIC, &stEnd);
+    RKADK_LOGD("subscriber ver[%d] grace period: %lld us", pstSubs->u32Ver,
+               (long long)(stEnd.tv_sec - stStart.tv_sec) * 1000000 +
+               (stEnd.tv_nsec - stStart.tv_nsec) / 1000);
+  }
+
+  pstSubs->pNext = NULL;
+  RKADK_MEDIA_SubsFree(pstSubs);
+}
+
+// module mutex must be held, *ppstOld is retired after it is released
+static int RKADK_MEDIA_SubsUpdate(RKADK_GET_MB_RCU_S *pstRcu,
+                                  RKADK_GET_MB_CB_S *pstCb, bool bAdd,
+                                  int s32MaxCnt, RKADK_GET_MB_SUBS_S **ppstOld) {
+  int i, j = 0;
+  bool bFound = false;
+  RKADK_GET_MB_SUBS_S *pstOld = pstRcu->pSubs;
+  RKADK_GET_MB_SUBS_S *pstNew;
+
+  pstNew = (RKADK_GET_MB_SUBS_S *)malloc(sizeof(RKADK_GET_MB_SUBS_S));
+  if (!pstNew) {
+    RKADK_LOGE("malloc subscriber snapshot failed");
+    return -1;
+  }
+  memset(pstNew, 0, sizeof(RKADK_GET_MB_SUBS_S));
+  pstNew->u32Ver = pstOld ? pstOld->u32Ver + 1 : 1;
+
+  for (i = 0; pstOld && i < pstOld->s32Cnt; i++) {
+    if (!bAdd && !pstOld->pstRemoved && pstOld->pstCb[i]->pHandle == pstCb->pHandle &&
+        pstOld->pstCb[i]->pfnAencCb == pstCb->pfnAencCb &&
+        pstOld->pstCb[i]->pfnVencCb == pstCb->pfnVencCb) {
+      // freed after the grace period with the old snapshot
+      pstOld->pstRemoved = pstOld->pstCb[i];
+      bFound = true;
+      continue;
+    }
+
+    pstNew->pstCb[j++] = pstOld->pstCb[i];
+  }
+
+  if (bAdd) {
+    if (j >= s32MaxCnt) {
+      RKADK_LOGE("not find usable cb index");
+      free(pstNew);
+      return -1;
+    }
+
+    pstNew->pstCb[j] = RKADK_MEDIA_CbCreate(pstCb);
+    if (!pstNew->pstCb[j]) {
+      free(pstNew);
+      return -1;
+    }
+    j++;
+  } else if (!bFound) {
+    RKADK_LOGE("not find matched cb");
+    free(pstNew);
+    return -1;
+  }
+
+  pstNew->s32Cnt = j;
+  if (!pstNew->s32Cnt) {
+    free(pstNew);
+    pstNew = NULL;
+  }
+
+  __atomic_store_n(&pstRcu->pSubs, pstNew, __ATOMIC_SEQ_CST);
+  *ppstOld = pstOld;
+  return 0;
+}
+
 static void *RKADK_MEDIA_GetAencMb(void *params) {
   int ret;
   AUDIO_STREAM_S stFrame;
+  RKADK_GET_MB_SUBS_S *pstSubs;
 
   RKADK_MEDIA_INFO_S *pstMediaInfo = (RKADK_MEDIA_INFO_S *)params;
   if (!pstMediaInfo) {
@@ -1398,10 +2249,10 @@ static void *RKADK_MEDIA_GetAencMb(void *params) {
   while (pstMediaInfo->stGetAencMBAttr.bGetBuffer) {
     ret = RK_MPI_AENC_GetStream(pstMediaInfo->s32ChnId, &stFrame, 1200);
     if (ret == RK_SUCCESS) {
-      for (int i = 0; i < RKADK_MEDIA_AENC_MAX_CNT; i++) {
-        if (pstMediaInfo->stGetAencMBAttr.cb[i].bUsed && pstMediaInfo->stGetAencMBAttr.cb[i].cbList)
-          pstMediaInfo->stGetAencMBAttr.cb[i].cbList(stFrame, pstMediaInfo->stGetAencMBAttr.cb[i].pHandle);
-      }
+      pstSubs = RKADK_MEDIA_SubsEnter(&pstMediaInfo->stGetAencMBAttr.stRcu);
+      for (int i = 0; pstSubs && i < pstSubs->s32Cnt; i++)
+        pstSubs->pstCb[i]->pfnAencCb(stFrame, pstSubs->pstCb[i]->pHandle);
+      RKADK_MEDIA_SubsExit(&pstMediaInfo->stGetAencMBAttr.stRcu);
 
       ret = RK_MPI_AENC_ReleaseStream(pstMediaInfo->s32ChnId, &stFrame);
       if (ret)
@@ -1419,12 +2270,15 @@ RKADK_S32 RKADK_MEDIA_GetAencBuffer(MPP_CHN_S *pstChn,
   int ret = -1;
   char name[RKADK_THREAD_NAME_LEN];
   RKADK_S32 i;
-  int j;
+  RKADK_GET_MB_CB_S stCb;
   RKADK_MEDIA_INFO_S *pstMediaInfo;
+  RKADK_GET_MB_RCU_S *pstRcu = NULL;
+  RKADK_GET_MB_SUBS_S *pstOld = NULL;
+  pthread_t tid = 0;
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.aencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, RKADK_MEDIA_AENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, &g_stMediaCtx.stAencIdx, 0,
                          pstChn->s32ChnId, "AENC_GET_MB");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, pstChn->s32ChnId);
@@ -1437,21 +2291,19 @@ RKADK_S32 RKADK_MEDIA_GetAencBuffer(MPP_CHN_S *pstChn,
     goto exit;
   }
 
-  for (j = 0; j < RKADK_MEDIA_AENC_MAX_CNT; j++) {
-    if (!pstMediaInfo->stGetAencMBAttr.cb[j].bUsed)
-      break;
-  }
-
-  if (j == RKADK_MEDIA_AENC_MAX_CNT) {
-    RKADK_LOGE("not find usable aenc cb index");
+  memset(&stCb, 0, sizeof(RKADK_GET_MB_CB_S));
+  stCb.pHandle = pHandle;
+  stCb.pfnAencCb = pfnDataCB;
+  pstRcu = &pstMediaInfo->stGetAencMBAttr.stRcu;
+  tid = pstMediaInfo->stGetAencMBAttr.tid;
+  if (RKADK_MEDIA_SubsUpdate(pstRcu, &stCb, true, RKADK_MEDIA_AENC_MAX_CNT,
+                             &pstOld)) {
+    RKADK_LOGE("add aenc cb failed");
     goto exit;
   }
 
-  pstMediaInfo->stGetAencMBAttr.cb[j].cbList = pfnDataCB;
-  pstMediaInfo->stGetAencMBAttr.cb[j].pHandle = pHandle;
-  pstMediaInfo->stGetAencMBAttr.cb[j].bUsed = true;
   pstMediaInfo->stGetAencMBAttr.s32GetCnt++;
-  RKADK_LOGD("find usable stAencInfo[%d] cb[%d] s32GetCnt[%d]", i, j, pstMediaInfo->stGetAencMBAttr.s32GetCnt);
+  RKADK_LOGD("add stAencInfo[%d] cb s32GetCnt[%d]", i, pstMediaInfo->stGetAencMBAttr.s32GetCnt);
 
   if (pstMediaInfo->stGetAencMBAttr.bGetBuffer) {
     RKADK_LOGE("Get aencChnId[%d] MB thread has been created, s32GetCnt[%d]",
@@ -1473,6 +2325,7 @@ RKADK_S32 RKADK_MEDIA_GetAencBuffer(MPP_CHN_S *pstChn,
 
 exit:
   RKADK_MUTEX_UNLOCK(g_stMediaCtx.aencMutex);
+  RKADK_MEDIA_SubsRetire(pstRcu, tid, pstOld);
   return ret;
 }
 
@@ -1481,11 +2334,15 @@ RKADK_MEDIA_StopGetAencBuffer(MPP_CHN_S *pstChn,
                               RKADK_MEDIA_AENC_DATA_PROC_FUNC pfnDataCB,
                               RKADK_VOID *pHandle) {
   int i, ret = 0;
+  RKADK_GET_MB_CB_S stCb;
   RKADK_MEDIA_INFO_S *pstMediaInfo;
+  RKADK_GET_MB_RCU_S *pstRcu = NULL;
+  RKADK_GET_MB_SUBS_S *pstOld = NULL, *pstRetired = NULL;
+  pthread_t tid = 0;
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.aencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, RKADK_MEDIA_AENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stAencInfo, &g_stMediaCtx.stAencIdx, 0,
                          pstChn->s32ChnId, "AENC_GET_MB");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, pstChn->s32ChnId);
@@ -1500,17 +2357,16 @@ RKADK_MEDIA_StopGetAencBuffer(MPP_CHN_S *pstChn,
     goto exit;
   }
 
-  for (int j = 0; j < RKADK_MEDIA_AENC_MAX_CNT; j++) {
-    if (pstMediaInfo->stGetAencMBAttr.cb[j].bUsed
-        && pstMediaInfo->stGetAencMBAttr.cb[j].cbList == pfnDataCB
-        && pstMediaInfo->stGetAencMBAttr.cb[j].pHandle == pHandle) {
-      RKADK_LOGD("remove stAencInfo[%d] cb[%d] cbList s32GetCnt[%d]", i, j, pstMediaInfo->stGetAencMBAttr.s32GetCnt);
-      pstMediaInfo->stGetAencMBAttr.cb[j].cbList = NULL;
-      pstMediaInfo->stGetAencMBAttr.cb[j].pHandle = NULL;
-      pstMediaInfo->stGetAencMBAttr.cb[j].bUsed = false;
-      pstMediaInfo->stGetAencMBAttr.s32GetCnt--;
-      break;
-    }
+  // the callback is not called any more once removed
+  memset(&stCb, 0, sizeof(RKADK_GET_MB_CB_S));
+  stCb.pHandle = pHandle;
+  stCb.pfnAencCb = pfnDataCB;
+  pstRcu = &pstMediaInfo->stGetAencMBAttr.stRcu;
+  tid = pstMediaInfo->stGetAencMBAttr.tid;
+  if (!RKADK_MEDIA_SubsUpdate(pstRcu, &stCb, false, RKADK_MEDIA_AENC_MAX_CNT,
+                              &pstOld)) {
+    pstMediaInfo->stGetAencMBAttr.s32GetCnt--;
+    RKADK_LOGD("remove stAencInfo[%d] cb s32GetCnt[%d]", i, pstMediaInfo->stGetAencMBAttr.s32GetCnt);
   }
 
   if (!pstMediaInfo->stGetAencMBAttr.s32GetCnt) {
@@ -1523,11 +2379,15 @@ RKADK_MEDIA_StopGetAencBuffer(MPP_CHN_S *pstChn,
       else
         RKADK_LOGI("Exit get aenc mb thread ok");
       pstMediaInfo->stGetAencMBAttr.tid = 0;
+      pstRetired = __atomic_exchange_n(&pstRcu->pRetired, NULL, __ATOMIC_ACQUIRE);
     }
   }
 
 exit:
   RKADK_MUTEX_UNLOCK(g_stMediaCtx.aencMutex);
+  // the removed callbacks are destroyed out of the lock
+  RKADK_MEDIA_SubsRetire(pstRcu, tid, pstOld);
+  RKADK_MEDIA_SubsFree(pstRetired);
   return ret;
 }
 
@@ -1535,6 +2395,7 @@ static void *RKADK_MEDIA_GetVencMb(void *params) {
   int ret;
   RKADK_MEDIA_VENC_DATA_S stData;
   VENC_PACK_S stPack;
+  RKADK_GET_MB_SUBS_S *pstSubs;
 
   RKADK_MEDIA_INFO_S *pstMediaInfo = (RKADK_MEDIA_INFO_S *)params;
   if (!pstMediaInfo) {
@@ -1550,36 +2411,28 @@ static void *RKADK_MEDIA_GetVencMb(void *params) {
     ret = RK_MPI_VENC_GetStream(pstMediaInfo->s32ChnId, &stData.stFrame, 2000);
 
     if (ret == RK_SUCCESS) {
-      for (int i = 0; i < RKADK_MEDIA_VENC_MAX_CNT; i++) {
-        if (pstMediaInfo->stGetVencMBAttr.cb[i].bUsed && pstMediaInfo->stGetVencMBAttr.cb[i].cbList)
-          pstMediaInfo->stGetVencMBAttr.cb[i].cbList(stData, pstMediaInfo->stGetVencMBAttr.cb[i].pHandle);
-      }
+      RKADK_TRACE_EVT(RKADK_TRACE_EVT_VENC_GET, stData.u32ChnId,
+                      stData.stFrame.u32Seq, stData.stFrame.pstPack->u64PTS);
+      pstSubs = RKADK_MEDIA_SubsEnter(&pstMediaInfo->stGetVencMBAttr.stRcu);
+      for (int i = 0; pstSubs && i < pstSubs->s32Cnt; i++)
+        RKADK_MEDIA_VencCbCall(pstSubs->pstCb[i], &stData);
+      RKADK_MEDIA_SubsExit(&pstMediaInfo->stGetVencMBAttr.stRcu);
 
       pstMediaInfo->stGetVencMBAttr.s64RecentPts = stData.stFrame.pstPack->u64PTS;
       pstMediaInfo->stGetVencMBAttr.u64TimeoutCnt = 0;
       ret = RK_MPI_VENC_ReleaseStream(pstMediaInfo->s32ChnId, &stData.stFrame);
       if (ret)
         RKADK_LOGE("RK_MPI_VENC_ReleaseStream[%d] failed[%x]", pstMediaInfo->s32ChnId, ret);
+      RKADK_TRACE_EVT(RKADK_TRACE_EVT_VENC_RELEASE, stData.u32ChnId,
+                      stData.stFrame.u32Seq, stData.stFrame.pstPack->u64PTS);
     } else {
       if (!pstMediaInfo->bReset) {
         RKADK_LOGE("RK_MPI_VENC_GetStream chn[%d] timeout[%x]", pstMediaInfo->s32ChnId, ret);
         pstMediaInfo->stGetVencMBAttr.u64TimeoutCnt++;
 
         //dump video info
-        if (g_stMediaCtx.dumpDebugInfo) {
-#if defined(RV1106_1103) || defined(RV1103B)
-          system("cat proc/rkisp-vir0 | grep frame");
-          system("cat /dev/mpi/vsys");
-          system("cat /proc/vcodec/enc/venc_info");
-
-#else
-          system("cat proc/rkispp0 | grep frame");
-          system("dumpsys sys");
-          system("dumpsys vi");
-          system("dumpsys vpss");
-          system("dumpsys venc");
-#endif
-        }
+        if (g_stMediaCtx.dumpDebugInfo)
+          RKADK_MEDIA_HealthRequest();
       }
     }
   }
@@ -1593,13 +2446,16 @@ RKADK_S32 RKADK_MEDIA_GetVencBuffer(MPP_CHN_S *pstChn,
                                     RKADK_VOID *pHandle) {
   int ret = -1;
   RKADK_S32 i;
-  int j;
+  RKADK_GET_MB_CB_S stCb;
   char name[RKADK_THREAD_NAME_LEN];
   RKADK_MEDIA_INFO_S *pstMediaInfo;
+  RKADK_GET_MB_RCU_S *pstRcu = NULL;
+  RKADK_GET_MB_SUBS_S *pstOld = NULL;
+  pthread_t tid = 0;
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, RKADK_MEDIA_VENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
                          pstChn->s32ChnId, "VENC_GET_MB");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, pstChn->s32ChnId);
@@ -1612,21 +2468,20 @@ RKADK_S32 RKADK_MEDIA_GetVencBuffer(MPP_CHN_S *pstChn,
     goto exit;
   }
 
-  for (j = 0; j < RKADK_MEDIA_VENC_MAX_CNT; j++) {
-    if (!pstMediaInfo->stGetVencMBAttr.cb[j].bUsed)
-      break;
-  }
-
-  if (j == RKADK_MEDIA_VENC_MAX_CNT) {
-    RKADK_LOGE("not find usable venc cb index");
+  memset(&stCb, 0, sizeof(RKADK_GET_MB_CB_S));
+  stCb.pHandle = pHandle;
+  stCb.pfnVencCb = pfnDataCB;
+  stCb.enCodecType = pstMediaInfo->enCodecType;
+  pstRcu = &pstMediaInfo->stGetVencMBAttr.stRcu;
+  tid = pstMediaInfo->stGetVencMBAttr.tid;
+  if (RKADK_MEDIA_SubsUpdate(pstRcu, &stCb, true, RKADK_MEDIA_VENC_MAX_CNT,
+                             &pstOld)) {
+    RKADK_LOGE("add venc cb failed");
     goto exit;
   }
 
-  pstMediaInfo->stGetVencMBAttr.cb[j].cbList = pfnDataCB;
-  pstMediaInfo->stGetVencMBAttr.cb[j].pHandle = pHandle;
-  pstMediaInfo->stGetVencMBAttr.cb[j].bUsed = true;
   pstMediaInfo->stGetVencMBAttr.s32GetCnt++;
-  RKADK_LOGD("find usable stVencInfo[%d] cb[%d] s32GetCnt[%d]", i, j, pstMediaInfo->stGetVencMBAttr.s32GetCnt);
+  RKADK_LOGD("add stVencInfo[%d] cb s32GetCnt[%d]", i, pstMediaInfo->stGetVencMBAttr.s32GetCnt);
 
   if (pstMediaInfo->stGetVencMBAttr.bGetBuffer) {
     RKADK_LOGE("Get vencChnId[%d] MB thread has been created, s32GetCnt[%d]",
@@ -1647,6 +2502,7 @@ RKADK_S32 RKADK_MEDIA_GetVencBuffer(MPP_CHN_S *pstChn,
 
 exit:
   RKADK_MUTEX_UNLOCK(g_stMediaCtx.vencMutex);
+  RKADK_MEDIA_SubsRetire(pstRcu, tid, pstOld);
   return ret;
 }
 
@@ -1655,11 +2511,15 @@ RKADK_MEDIA_StopGetVencBuffer(RKADK_U32 u32CamId, MPP_CHN_S *pstChn, bool bIsAov
                               RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
                               RKADK_VOID *pHandle) {
   int i, ret = 0;
+  RKADK_GET_MB_CB_S stCb;
   RKADK_MEDIA_INFO_S *pstMediaInfo;
+  RKADK_GET_MB_RCU_S *pstRcu = NULL;
+  RKADK_GET_MB_SUBS_S *pstOld = NULL, *pstRetired = NULL;
+  pthread_t tid = 0;
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, RKADK_MEDIA_VENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
                          pstChn->s32ChnId, "VENC_GET_MB");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, pstChn->s32ChnId);
@@ -1674,17 +2534,16 @@ RKADK_MEDIA_StopGetVencBuffer(RKADK_U32 u32CamId, MPP_CHN_S *pstChn, bool bIsAov
     goto exit;
   }
 
-  for (int j = 0; j < RKADK_MEDIA_VENC_MAX_CNT; j++) {
-    if (pstMediaInfo->stGetVencMBAttr.cb[j].bUsed
-        && pstMediaInfo->stGetVencMBAttr.cb[j].cbList == pfnDataCB
-        && pstMediaInfo->stGetVencMBAttr.cb[j].pHandle == pHandle) {
-      RKADK_LOGD("remove stVencInfo[%d] cb[%d] cbList s32GetCnt[%d]", i, j, pstMediaInfo->stGetVencMBAttr.s32GetCnt);
-      pstMediaInfo->stGetVencMBAttr.cb[j].cbList = NULL;
-      pstMediaInfo->stGetVencMBAttr.cb[j].pHandle = NULL;
-      pstMediaInfo->stGetVencMBAttr.cb[j].bUsed = false;
-      pstMediaInfo->stGetVencMBAttr.s32GetCnt--;
-      break;
-    }
+  // the callback is not called any more once removed
+  memset(&stCb, 0, sizeof(RKADK_GET_MB_CB_S));
+  stCb.pHandle = pHandle;
+  stCb.pfnVencCb = pfnDataCB;
+  pstRcu = &pstMediaInfo->stGetVencMBAttr.stRcu;
+  tid = pstMediaInfo->stGetVencMBAttr.tid;
+  if (!RKADK_MEDIA_SubsUpdate(pstRcu, &stCb, false, RKADK_MEDIA_VENC_MAX_CNT,
+                              &pstOld)) {
+    pstMediaInfo->stGetVencMBAttr.s32GetCnt--;
+    RKADK_LOGD("remove stVencInfo[%d] cb s32GetCnt[%d]", i, pstMediaInfo->stGetVencMBAttr.s32GetCnt);
   }
 
   if (!pstMediaInfo->stGetVencMBAttr.s32GetCnt) {
@@ -1700,37 +2559,150 @@ RKADK_MEDIA_StopGetVencBuffer(RKADK_U32 u32CamId, MPP_CHN_S *pstChn, bool bIsAov
       else
         RKADK_LOGI("ChnId[%d] exit get venc mb thread ok", pstMediaInfo->s32ChnId);
       pstMediaInfo->stGetVencMBAttr.tid = 0;
+      pstRetired = __atomic_exchange_n(&pstRcu->pRetired, NULL, __ATOMIC_ACQUIRE);
     }
   }
 
 exit:
   RKADK_MUTEX_UNLOCK(g_stMediaCtx.vencMutex);
+  // the removed callbacks are destroyed out of the lock
+  RKADK_MEDIA_SubsRetire(pstRcu, tid, pstOld);
+  RKADK_MEDIA_SubsFree(pstRetired);
   return ret;
 }
-#endif
 
-static RKADK_U32 RKADK_BIND_FindUsableIdx(RKADK_BIND_INFO_S *pstInfo,
-                                          int count) {
-  for (int i = 0; i < count; i++) {
-    if (!pstInfo[i].bUsed) {
-      RKADK_LOGD("find usable index[%d]", i);
-      return i;
+// must be called with vencMutex locked
+static RKADK_GET_MB_CB_S *
+RKADK_MEDIA_FindVencCb(MPP_CHN_S *pstChn, RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
+                       RKADK_VOID *pHandle) {
+  int i;
+  RKADK_GET_MB_SUBS_S *pstSubs;
+
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
+                         pstChn->s32ChnId, "VENC_GET_MB");
+  if (i < 0) {
+    RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, pstChn->s32ChnId);
+    return NULL;
+  }
+
+  // snapshots are only replaced under vencMutex
+  pstSubs = __atomic_load_n(&g_stMediaCtx.stVencInfo[i].stGetVencMBAttr.stRcu.pSubs,
+                            __ATOMIC_ACQUIRE);
+  for (i = 0; pstSubs && i < pstSubs->s32Cnt; i++) {
+    if (pstSubs->pstCb[i]->pHandle == pHandle &&
+        pstSubs->pstCb[i]->pfnVencCb == pfnDataCB)
+      return pstSubs->pstCb[i];
+  }
+
+  RKADK_LOGE("venc[%d] cb[%p] not found", pstChn->s32ChnId, pHandle);
+  return NULL;
+}
+
+RKADK_S32 RKADK_MEDIA_SetVencCbBudget(MPP_CHN_S *pstChn,
+                                      RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
+                                      RKADK_VOID *pHandle, RKADK_U32 u32BudgetUs) {
+  int ret = 0;
+  char name[RKADK_THREAD_NAME_LEN];
+  RKADK_GET_MB_CB_S *pstCb;
+
+  RKADK_CHECK_POINTER(pstChn, RKADK_FAILURE);
+
+  RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
+  pstCb = RKADK_MEDIA_FindVencCb(pstChn, pfnDataCB, pHandle);
+  if (!pstCb) {
+    ret = -1;
+    goto exit;
+  }
+
+  // the deferred thread must be ready before the get mb thread may use it
+  if (u32BudgetUs && !pstCb->pThread) {
+    if (!pstCb->pSignal) {
+      pstCb->pSignal = RKADK_SIGNAL_Create(0, 1);
+      if (!pstCb->pSignal) {
+        RKADK_LOGE("create signal failed");
+        ret = -1;
+        goto exit;
+      }
+    }
+
+    snprintf(name, RKADK_THREAD_NAME_LEN, "VencCb%d", pstChn->s32ChnId);
+    pstCb->pThread = RKADK_THREAD_Create(RKADK_MEDIA_DeferProc, pstCb, name);
+    if (!pstCb->pThread) {
+      RKADK_LOGE("create deferred thread failed");
+      ret = -1;
+      goto exit;
     }
   }
 
+  __atomic_store_n(&pstCb->u32BudgetUs, u32BudgetUs, __ATOMIC_RELEASE);
+
+exit:
+  RKADK_MUTEX_UNLOCK(g_stMediaCtx.vencMutex);
+  return ret;
+}
+
+RKADK_S32 RKADK_MEDIA_GetVencCbStats(MPP_CHN_S *pstChn,
+                                     RKADK_MEDIA_VENC_DATA_PROC_FUNC pfnDataCB,
+                                     RKADK_VOID *pHandle,
+                                     RKADK_MEDIA_CB_STATS_S *pstStats) {
+  int i;
+  RKADK_U64 u64Total = 0;
+  RKADK_U32 u32Hist[RKADK_MEDIA_CB_HIST_CNT];
+  RKADK_GET_MB_CB_S *pstCb;
+
+  RKADK_CHECK_POINTER(pstChn, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+
+  RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
+  pstCb = RKADK_MEDIA_FindVencCb(pstChn, pfnDataCB, pHandle);
+  if (!pstCb) {
+    RKADK_MUTEX_UNLOCK(g_stMediaCtx.vencMutex);
+    return -1;
+  }
+
+  for (i = 0; i < RKADK_MEDIA_CB_HIST_CNT; i++) {
+    u32Hist[i] = __atomic_load_n(&pstCb->u32Hist[i], __ATOMIC_RELAXED);
+    u64Total += u32Hist[i];
+  }
+
+  memset(pstStats, 0, sizeof(RKADK_MEDIA_CB_STATS_S));
+  pstStats->u64CallCnt = __atomic_load_n(&pstCb->u64CallCnt, __ATOMIC_RELAXED);
+  pstStats->u32P50Us = RKADK_MEDIA_CbPercentile(u32Hist, u64Total, 50);
+  pstStats->u32P99Us = RKADK_MEDIA_CbPercentile(u32Hist, u64Total, 99);
+  pstStats->u32MaxUs = __atomic_load_n(&pstCb->u32MaxUs, __ATOMIC_RELAXED);
+  pstStats->bDeferred = __atomic_load_n(&pstCb->bDeferred, __ATOMIC_ACQUIRE);
+
+  RKADK_MUTEX_LOCK(pstCb->mutex);
+  pstStats->u32QueueLen = pstCb->u32PktCnt;
+  pstStats->u32DropCnt = pstCb->u32DropCnt;
+  RKADK_MUTEX_UNLOCK(pstCb->mutex);
+
+  RKADK_MUTEX_UNLOCK(g_stMediaCtx.vencMutex);
+  return 0;
+}
+#else
+RKADK_S32 RKADK_MEDIA_GetHealth(RKADK_MEDIA_HEALTH_FMT_E enFmt, bool bNode,
+                                RKADK_CHAR *pBuf, RKADK_U32 u32Size) {
+  RKADK_LOGE("health snapshot is unsupported");
   return -1;
 }
+#endif
+
+static RKADK_S32 RKADK_BIND_FindUsableIdx(RKADK_MEDIA_INDEX_S *pstIndex) {
+  return RKADK_MEDIA_FindUsableIdx(pstIndex, "BIND");
+}
 
-static RKADK_S32 RKADK_BIND_GetIdx(RKADK_BIND_INFO_S *pstInfo, int count,
+static RKADK_S32 RKADK_BIND_GetIdx(RKADK_BIND_INFO_S *pstInfo,
+                                   RKADK_MEDIA_INDEX_S *pstIndex,
                                    const MPP_CHN_S *pstSrcChn,
                                    const MPP_CHN_S *pstDestChn) {
+  int i;
+
   RKADK_CHECK_POINTER(pstSrcChn, RKADK_FAILURE);
   RKADK_CHECK_POINTER(pstDestChn, RKADK_FAILURE);
 
-  for (int i = 0; i < count; i++) {
-    if (!pstInfo[i].bUsed)
-      continue;
-
+  i = pstIndex->s16Head[RKADK_BIND_ChnHash(pstSrcChn, pstDestChn)];
+  for (; i >= 0; i = pstIndex->s16Next[i]) {
     if (pstInfo[i].stSrcChn.s32ChnId == pstSrcChn->s32ChnId &&
         pstInfo[i].stSrcChn.enModId == pstSrcChn->enModId &&
         pstInfo[i].stSrcChn.s32DevId == pstSrcChn->s32DevId &&
@@ -1748,28 +2720,34 @@ static RKADK_S32 RKADK_BIND_GetIdx(RKADK_BIND_INFO_S *pstInfo, int count,
 
 static RKADK_S32 RKADK_MEDIA_GetBindInfo(const MPP_CHN_S *pstSrcChn,
                                          const MPP_CHN_S *pstDestChn,
-                                         RKADK_BIND_INFO_S **pstInfo) {
+                                         RKADK_BIND_INFO_S **pstInfo,
+                                         RKADK_MEDIA_INDEX_S **pstIndex) {
   RKADK_S32 s32BindCount = -1;
 
   if (pstSrcChn->enModId == RK_ID_AI && pstDestChn->enModId == RK_ID_AENC) {
     s32BindCount = RKADK_AI_AENC_MAX_BIND_CNT;
     *pstInfo = g_stMediaCtx.stAiAencInfo;
+    *pstIndex = &g_stMediaCtx.stAiAencIdx;
   } else if (pstSrcChn->enModId == RK_ID_VI &&
              pstDestChn->enModId == RK_ID_VENC) {
     s32BindCount = RKADK_VI_VENC_MAX_BIND_CNT;
     *pstInfo = g_stMediaCtx.stViVencInfo;
+    *pstIndex = &g_stMediaCtx.stViVencIdx;
   } else if (pstSrcChn->enModId == RK_ID_VI &&
              pstDestChn->enModId == RK_ID_VPSS) {
     s32BindCount = RKADK_VI_VPSS_MAX_BIND_CNT;
     *pstInfo = g_stMediaCtx.stViVpssInfo;
+    *pstIndex = &g_stMediaCtx.stViVpssIdx;
   } else if (pstSrcChn->enModId == RK_ID_VPSS &&
              pstDestChn->enModId == RK_ID_VENC) {
     s32BindCount = RKADK_VPSS_VENC_MAX_BIND_CNT;
     *pstInfo = g_stMediaCtx.stVpssVencInfo;
+    *pstIndex = &g_stMediaCtx.stVpssVencIdx;
   } else if (pstSrcChn->enModId == RK_ID_VPSS &&
              pstDestChn->enModId == RK_ID_VO) {
     s32BindCount = RKADK_VPSS_VENC_MAX_BIND_CNT;
     *pstInfo = g_stMediaCtx.stVpssVencInfo;
+    *pstIndex = &g_stMediaCtx.stVpssVencIdx;
   } else {
     RKADK_LOGE("Nonsupport: src enModId: %d, dest enModId: %d",
                pstSrcChn->enModId, pstDestChn->enModId);
@@ -1783,11 +2761,12 @@ RKADK_S32 RKADK_MPI_SYS_Bind(const MPP_CHN_S *pstSrcChn,
   int ret = -1, count;
   RKADK_S32 i;
   RKADK_BIND_INFO_S *pstInfo = NULL;
+  RKADK_MEDIA_INDEX_S *pstIndex = NULL;
 
   RKADK_CHECK_POINTER(pstSrcChn, RKADK_FAILURE);
   RKADK_CHECK_POINTER(pstDestChn, RKADK_FAILURE);
 
-  count = RKADK_MEDIA_GetBindInfo(pstSrcChn, pstDestChn, &pstInfo);
+  count = RKADK_MEDIA_GetBindInfo(pstSrcChn, pstDestChn, &pstInfo, &pstIndex);
   if (count < 0) {
     RKADK_LOGE("RKADK_MEDIA_GetBindInfo failed");
     return -1;
@@ -1795,9 +2774,9 @@ RKADK_S32 RKADK_MPI_SYS_Bind(const MPP_CHN_S *pstSrcChn,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.bindMutex);
 
-  i = RKADK_BIND_GetIdx(pstInfo, count, pstSrcChn, pstDestChn);
+  i = RKADK_BIND_GetIdx(pstInfo, pstIndex, pstSrcChn, pstDestChn);
   if (i < 0) {
-    i = RKADK_BIND_FindUsableIdx(pstInfo, count);
+    i = RKADK_BIND_FindUsableIdx(pstIndex);
     if (i < 0) {
       RKADK_LOGE("not find usable index, src chn[%d], dst chn[%d]",
                   pstSrcChn->s32ChnId, pstDestChn->s32ChnId);
@@ -1818,6 +2797,7 @@ RKADK_S32 RKADK_MPI_SYS_Bind(const MPP_CHN_S *pstSrcChn,
     pstInfo[i].bUsed = true;
     memcpy(&pstInfo[i].stSrcChn, pstSrcChn, sizeof(MPP_CHN_S));
     memcpy(&pstInfo[i].stDestChn, pstDestChn, sizeof(MPP_CHN_S));
+    RKADK_MEDIA_IndexLink(pstIndex, i, RKADK_BIND_ChnHash(pstSrcChn, pstDestChn));
   }
 
   pstInfo[i].s32BindCnt++;
@@ -1837,11 +2817,12 @@ RKADK_S32 RKADK_MPI_SYS_UnBind(const MPP_CHN_S *pstSrcChn,
   int ret = -1, count;
   RKADK_S32 i;
   RKADK_BIND_INFO_S *pstInfo = NULL;
+  RKADK_MEDIA_INDEX_S *pstIndex = NULL;
 
   RKADK_CHECK_POINTER(pstSrcChn, RKADK_FAILURE);
   RKADK_CHECK_POINTER(pstDestChn, RKADK_FAILURE);
 
-  count = RKADK_MEDIA_GetBindInfo(pstSrcChn, pstDestChn, &pstInfo);
+  count = RKADK_MEDIA_GetBindInfo(pstSrcChn, pstDestChn, &pstInfo, &pstIndex);
   if (count < 0) {
     RKADK_LOGE("RKADK_MEDIA_GetBindInfo failed");
     return -1;
@@ -1849,7 +2830,7 @@ RKADK_S32 RKADK_MPI_SYS_UnBind(const MPP_CHN_S *pstSrcChn,
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.bindMutex);
 
-  i = RKADK_BIND_GetIdx(pstInfo, count, pstSrcChn, pstDestChn);
+  i = RKADK_BIND_GetIdx(pstInfo, pstIndex, pstSrcChn, pstDestChn);
   if (i < 0) {
     RKADK_MUTEX_UNLOCK(g_stMediaCtx.bindMutex);
     RKADK_LOGE("not find matched index[%d] src[%d, %d, %d], dest[%d, %d, %d]", i,
@@ -1874,6 +2855,7 @@ RKADK_S32 RKADK_MPI_SYS_UnBind(const MPP_CHN_S *pstSrcChn,
       goto exit;
     }
 
+    RKADK_MEDIA_IndexUnlink(pstIndex, i, RKADK_BIND_ChnHash(pstSrcChn, pstDestChn));
     pstInfo[i].bUsed = false;
     memset(&pstInfo[i].stSrcChn, 0, sizeof(MPP_CHN_S));
     memset(&pstInfo[i].stDestChn, 0, sizeof(MPP_CHN_S));
@@ -2430,15 +3412,9 @@ RKADK_S32 RKADK_MEDIA_QueryVencStatus(RKADK_U32 u32CamId, RKADK_STREAM_TYPE_E en
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
 
-  for (i = 0; i < RKADK_MEDIA_VENC_MAX_CNT; i++) {
-    if (!g_stMediaCtx.stVencInfo[i].bUsed)
-      continue;
-
-    if (g_stMediaCtx.stVencInfo[i].s32ChnId == s32ChnId)
-      break;
-  }
-
-  if (i == RKADK_MEDIA_VENC_MAX_CNT) {
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
+                         s32ChnId, "VENC_STATUS");
+  if (i < 0) {
     RKADK_LOGE("not find matched u32CamId[%d] s32ChnId[%d]", u32CamId, s32ChnId);
     ret = 0;
     goto exit;
@@ -2673,7 +3649,7 @@ RKADK_S32 RKADK_MEDIA_SetVencState(RKADK_U32 u32CamId, RKADK_S32 s32ChnId, bool
 
   RKADK_MUTEX_LOCK(g_stMediaCtx.vencMutex);
 
-  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, RKADK_MEDIA_VENC_MAX_CNT, 0,
+  i = RKADK_MEDIA_GetIdx(g_stMediaCtx.stVencInfo, &g_stMediaCtx.stVencIdx, 0,
                          s32ChnId, "VENC_STATE");
   if (i < 0) {
     RKADK_LOGE("not find matched index[%d] s32ChnId[%d]", i, s32ChnId);
@@ -2821,80 +3797,76 @@ int RKADK_MEDIA_VideoReset(RKADK_U32 u32CamId, RKADK_PRAAM_VI_ATTR_S vi_attr, RK
   VENC_CHN_ATTR_S stVencAttr;
   VI_CHN_ATTR_S stViAttr;
   VPSS_CHN_ATTR_S stVpssAttr;
+  RKADK_GRAPH_NODE_S stSrcNode, stVencNode;
+  RKADK_GRAPH_S stCurGraph, stNewGraph;
 
   memset(&stSrcChn, 0, sizeof(MPP_CHN_S));
   memset(&stDstChn, 0, sizeof(MPP_CHN_S));
-  memset(&stVencAttr, 0, sizeof(VENC_CHN_ATTR_S));
-  memset(&stViAttr, 0, sizeof(VI_CHN_ATTR_S));
-  memset(&stVpssAttr, 0, sizeof(VPSS_CHN_ATTR_S));
+  memset(&stSrcNode, 0, sizeof(RKADK_GRAPH_NODE_S));
+  memset(&stVencNode, 0, sizeof(RKADK_GRAPH_NODE_S));
+  memset(&stCurGraph, 0, sizeof(RKADK_GRAPH_S));
 
   bUseVpss = RKADK_MEDIA_VideoIsUseVpss(u32CamId, false, NULL, vi_attr, attribute);
   RKADK_MEDIA_ResetVideoChn(u32CamId, vi_attr.u32ViChn, bUseVpss, attribute, &stSrcChn, &stDstChn);
 
+  stSrcNode.stChn = stSrcChn;
+  stSrcNode.u32CamId = u32CamId;
   if (bUseVpss) {
-    ret = RK_MPI_VPSS_GetChnAttr(stSrcChn.s32DevId, stSrcChn.s32ChnId, &stVpssAttr);
+    ret = RK_MPI_VPSS_GetChnAttr(stSrcChn.s32DevId, stSrcChn.s32ChnId,
+                                 &stSrcNode.unAttr.stVpssAttr.stChnAttr);
     if (ret) {
       RKADK_LOGE("Preview get vpss grp[%d] chn[%d] attr failed[%x]", stSrcChn.s32DevId, stSrcChn.s32ChnId, ret);
       return -1;
     }
   } else {
-    ret = RK_MPI_VI_GetChnAttr(u32CamId, stSrcChn.s32ChnId, &stViAttr);
+    ret = RK_MPI_VI_GetChnAttr(u32CamId, stSrcChn.s32ChnId, &stSrcNode.unAttr.stViAttr);
     if (ret != RK_SUCCESS) {
       RKADK_LOGE("RK_MPI_VI_GetChnAttr[%d] failed [%x]", stSrcChn.s32ChnId, ret);
       return -1;
     }
   }
 
-  ret = RK_MPI_VENC_GetChnAttr(attribute.venc_chn, &stVencAttr);
+  stVencNode.stChn = stDstChn;
+  stVencNode.u32CamId = u32CamId;
+  ret = RK_MPI_VENC_GetChnAttr(attribute.venc_chn, &stVencNode.unAttr.stVencAttr);
   if (ret != RK_SUCCESS) {
     RKADK_LOGE("RK_MPI_VENC_GetChnAttr[%d] failed [%x]", attribute.venc_chn, ret);
     return -1;
   }
 
-  bChangeResolution = RKADK_MEDIA_CompareResolution(&stVencAttr, attribute.width, attribute.height);
-
-  ret = RKADK_MEDIA_ResetVideoAttr(u32CamId, attribute, &stVencAttr, &stViAttr, &stVpssAttr);
+  ret = RKADK_GRAPH_AddNode(&stCurGraph, &stSrcNode);
+  ret |= RKADK_GRAPH_AddNode(&stCurGraph, &stVencNode);
+  ret |= RKADK_GRAPH_AddEdge(&stCurGraph, &stSrcChn, &stDstChn);
   if (ret) {
-    RKADK_LOGE("RKADK_STREAM_ResetVideoAttr[%d, %d] failed", u32CamId, attribute.venc_chn);
+    RKADK_LOGE("Camid[%d] build venc[%d] graph failed", u32CamId, stDstChn.s32ChnId);
     return -1;
   }
 
-  ret = RK_MPI_SYS_UnBind(&stSrcChn, &stDstChn);
-  if (ret != RK_SUCCESS) {
-    RKADK_LOGE("Camid[%d] Stream Src[%d] UnBind VENC [%d] failed: %x",
-                u32CamId, stSrcChn.s32ChnId, stDstChn.s32ChnId, ret);
-    return -1;
-  }
+  bChangeResolution = RKADK_MEDIA_CompareResolution(&stVencNode.unAttr.stVencAttr,
+                                                    attribute.width, attribute.height);
 
-  ret = RK_MPI_VENC_SetChnAttr(stDstChn.s32ChnId, &stVencAttr);
-  if (ret != RK_SUCCESS) {
-    RKADK_LOGE("Camid[%d] Stream set venc[%d] attr failed: %x",
-                u32CamId, stDstChn.s32ChnId, ret);
+  stVencAttr = stVencNode.unAttr.stVencAttr;
+  stViAttr = stSrcNode.unAttr.stViAttr;
+  stVpssAttr = stSrcNode.unAttr.stVpssAttr.stChnAttr;
+  ret = RKADK_MEDIA_ResetVideoAttr(u32CamId, attribute, &stVencAttr, &stViAttr, &stVpssAttr);
+  if (ret) {
+    RKADK_LOGE("RKADK_STREAM_ResetVideoAttr[%d, %d] failed", u32CamId, attribute.venc_chn);
     return -1;
   }
 
+  // only the changed channels are set, the source is detached if needed
+  memcpy(&stNewGraph, &stCurGraph, sizeof(RKADK_GRAPH_S));
+  stNewGraph.stNode[1].unAttr.stVencAttr = stVencAttr;
   if (bChangeResolution) {
-    if (bUseVpss) {
-      ret = RK_MPI_VPSS_SetChnAttr(stSrcChn.s32DevId, stSrcChn.s32ChnId, &stVpssAttr);
-      if (ret != RK_SUCCESS) {
-        RKADK_LOGE("Camid[%d] Stream set vpss grp[%d] chn[%d] attr falied[%x]",
-                    u32CamId, stSrcChn.s32DevId, stSrcChn.s32ChnId, ret);
-        return -1;
-      }
-    } else {
-      ret = RK_MPI_VI_SetChnAttr(u32CamId, stSrcChn.s32ChnId, &stViAttr);
-      if (ret != RK_SUCCESS) {
-        RKADK_LOGE("Camid[%d] Stream RK_MPI_VI_SetChnAttr(%d) failed: %x",
-                    u32CamId, stSrcChn.s32ChnId, ret);
-        return -1;
-      }
-    }
+    if (bUseVpss)
+      stNewGraph.stNode[0].unAttr.stVpssAttr.stChnAttr = stVpssAttr;
+    else
+      stNewGraph.stNode[0].unAttr.stViAttr = stViAttr;
   }
 
-  ret = RK_MPI_SYS_Bind(&stSrcChn, &stDstChn);
-  if(ret != RK_SUCCESS) {
-    RKADK_LOGE("Camid[%d] Stream Src Bind VENC [%d, %d] failed[%x]",
-                u32CamId, stSrcChn.s32ChnId, stDstChn.s32ChnId, ret);
+  ret = RKADK_GRAPH_Apply(&stCurGraph, &stNewGraph);
+  if (ret) {
+    RKADK_LOGE("Camid[%d] Stream reset venc[%d] failed", u32CamId, stDstChn.s32ChnId);
     return -1;
   }
 
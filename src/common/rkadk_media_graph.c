@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "rkadk_media_graph.h"
+#include "rkadk_log.h"
+#include <string.h>
+
+typedef enum {
+  RKADK_GRAPH_CHANGE_KEEP = 0,
+  RKADK_GRAPH_CHANGE_LIVE,    // attr set while bound
+  RKADK_GRAPH_CHANGE_SET,     // attr set while detached
+  RKADK_GRAPH_CHANGE_REBUILD, // deinit and init again
+  RKADK_GRAPH_CHANGE_ADD,
+  RKADK_GRAPH_CHANGE_REMOVE,
+} RKADK_GRAPH_CHANGE_E;
+
+typedef struct {
+  RKADK_S32 s32Depth;
+  RKADK_S32 s32Peer; // index of the same node in the other graph
+  RKADK_GRAPH_CHANGE_E enChange;
+} RKADK_GRAPH_NODE_STATE_S;
+
+static bool RKADK_GRAPH_ChnEqual(const MPP_CHN_S *pstChn1,
+                                 const MPP_CHN_S *pstChn2) {
+  return pstChn1->enModId == pstChn2->enModId &&
+         pstChn1->s32DevId == pstChn2->s32DevId &&
+         pstChn1->s32ChnId == pstChn2->s32ChnId;
+}
+
+static RKADK_S32 RKADK_GRAPH_FindNode(const RKADK_GRAPH_S *pstGraph,
+                                      const MPP_CHN_S *pstChn) {
+  for (RKADK_U32 i = 0; i < pstGraph->u32NodeCnt; i++) {
+    if (RKADK_GRAPH_ChnEqual(&pstGraph->stNode[i].stChn, pstChn))
+      return i;
+  }
+
+  return -1;
+}
+
+static RKADK_S32 RKADK_GRAPH_FindEdge(const RKADK_GRAPH_S *pstGraph,
+                                      const RKADK_GRAPH_EDGE_S *pstEdge) {
+  for (RKADK_U32 i = 0; i < pstGraph->u32EdgeCnt; i++) {
+    if (RKADK_GRAPH_ChnEqual(&pstGraph->stEdge[i].stSrcChn, &pstEdge->stSrcChn) &&
+        RKADK_GRAPH_ChnEqual(&pstGraph->stEdge[i].stDestChn, &pstEdge->stDestChn))
+      return i;
+  }
+
+  return -1;
+}
+
+RKADK_S32 RKADK_GRAPH_AddNode(RKADK_GRAPH_S *pstGraph,
+                              RKADK_GRAPH_NODE_S *pstNode) {
+  RKADK_CHECK_POINTER(pstGraph, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstNode, RKADK_FAILURE);
+
+  if (pstNode->stChn.enModId != RK_ID_VI && pstNode->stChn.enModId != RK_ID_VPSS &&
+      pstNode->stChn.enModId != RK_ID_VENC) {
+    RKADK_LOGE("Nonsupport node enModId: %d", pstNode->stChn.enModId);
+    return -1;
+  }
+
+  if (RKADK_GRAPH_FindNode(pstGraph, &pstNode->stChn) >= 0) {
+    RKADK_LOGE("node[%d, %d, %d] already exists", pstNode->stChn.enModId,
+               pstNode->stChn.s32DevId, pstNode->stChn.s32ChnId);
+    return -1;
+  }
+
+  if (pstGraph->u32NodeCnt >= RKADK_GRAPH_NODE_MAX_CNT) {
+    RKADK_LOGE("node count over %d", RKADK_GRAPH_NODE_MAX_CNT);
+    return -1;
+  }
+
+  memcpy(&pstGraph->stNode[pstGraph->u32NodeCnt], pstNode, sizeof(RKADK_GRAPH_NODE_S));
+  pstGraph->u32NodeCnt++;
+  return 0;
+}
+
+RKADK_S32 RKADK_GRAPH_AddEdge(RKADK_GRAPH_S *pstGraph,
+                              const MPP_CHN_S *pstSrcChn,
+                              const MPP_CHN_S *pstDestChn) {
+  RKADK_GRAPH_EDGE_S stEdge;
+
+  RKADK_CHECK_POINTER(pstGraph, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstSrcChn, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstDestChn, RKADK_FAILURE);
+
+  if (RKADK_GRAPH_FindNode(pstGraph, pstSrcChn) < 0 ||
+      RKADK_GRAPH_FindNode(pstGraph, pstDestChn) < 0) {
+    RKADK_LOGE("src[%d, %d, %d] or dest[%d, %d, %d] is not a node",
+               pstSrcChn->enModId, pstSrcChn->s32DevId, pstSrcChn->s32ChnId,
+               pstDestChn->enModId, pstDestChn->s32DevId, pstDestChn->s32ChnId);
+    return -1;
+  }
+
+  stEdge.stSrcChn = *pstSrcChn;
+  stEdge.stDestChn = *pstDestChn;
+  if (RKADK_GRAPH_FindEdge(pstGraph, &stEdge) >= 0)
+    return 0;
+
+  if (pstGraph->u32EdgeCnt >= RKADK_GRAPH_EDGE_MAX_CNT) {
+    RKADK_LOGE("edge count over %d", RKADK_GRAPH_EDGE_MAX_CNT);
+    return -1;
+  }
+
+  pstGraph->stEdge[pstGraph->u32EdgeCnt++] = stEdge;
+  return 0;
+}
+
+// longest path from a source node, fails on a cycle
+static RKADK_S32 RKADK_GRAPH_Depth(const RKADK_GRAPH_S *pstGraph,
+                                   RKADK_GRAPH_NODE_STATE_S *pstState,
+                                   RKADK_S32 *ps32MaxDepth) {
+  RKADK_U32 i, u32Round;
+  RKADK_S32 s32Src, s32Dest;
+  bool bChange = true;
+
+  *ps32MaxDepth = 0;
+  for (i = 0; i < pstGraph->u32NodeCnt; i++)
+    pstState[i].s32Depth = 0;
+
+  for (u32Round = 0; bChange && u32Round <= pstGraph->u32NodeCnt; u32Round++) {
+    bChange = false;
+    for (i = 0; i < pstGraph->u32EdgeCnt; i++) {
+      s32Src = RKADK_GRAPH_FindNode(pstGraph, &pstGraph->stEdge[i].stSrcChn);
+      s32Dest = RKADK_GRAPH_FindNode(pstGraph, &pstGraph->stEdge[i].stDestChn);
+      if (s32Src < 0 || s32Dest < 0)
+        return -1;
+
+      if (pstState[s32Dest].s32Depth < pstState[s32Src].s32Depth + 1) {
+        pstState[s32Dest].s32Depth = pstState[s32Src].s32Depth + 1;
+        if (pstState[s32Dest].s32Depth > *ps32MaxDepth)
+          *ps32MaxDepth = pstState[s32Dest].s32Depth;
+        bChange = true;
+      }
+    }
+  }
+
+  if (bChange) {
+    RKADK_LOGE("graph has a cycle");
+    return -1;
+  }
+
+  return 0;
+}
+
+static RKADK_GRAPH_CHANGE_E RKADK_GRAPH_NodeChange(const RKADK_GRAPH_NODE_S *pstCur,
+                                                   const RKADK_GRAPH_NODE_S *pstNew) {
+  if (pstCur->u32CamId != pstNew->u32CamId)
+    return RKADK_GRAPH_CHANGE_REBUILD;
+
+  switch (pstNew->stChn.enModId) {
+  case RK_ID_VI:
+    if (memcmp(&pstCur->unAttr.stViAttr, &pstNew->unAttr.stViAttr, sizeof(VI_CHN_ATTR_S)))
+      return RKADK_GRAPH_CHANGE_SET;
+    break;
+
+  case RK_ID_VPSS:
+    if (memcmp(&pstCur->unAttr.stVpssAttr.stGrpAttr, &pstNew->unAttr.stVpssAttr.stGrpAttr,
+               sizeof(VPSS_GRP_ATTR_S)))
+      return RKADK_GRAPH_CHANGE_REBUILD;
+
+    if (memcmp(&pstCur->unAttr.stVpssAttr.stChnAttr, &pstNew->unAttr.stVpssAttr.stChnAttr,
+               sizeof(VPSS_CHN_ATTR_S)))
+      return RKADK_GRAPH_CHANGE_SET;
+    break;
+
+  case RK_ID_VENC:
+    if (memcmp(&pstCur->unAttr.stVencAttr.stVencAttr, &pstNew->unAttr.stVencAttr.stVencAttr,
+               sizeof(VENC_ATTR_S))) {
+#if defined(RV1106_1103) || defined(RV1103B)
+      return RKADK_GRAPH_CHANGE_SET;
+#else
+      // rv1126/1109 nonsupport dynamic setting resolution and codec type
+      return RKADK_GRAPH_CHANGE_REBUILD;
+#endif
+    }
+
+    // rate control and gop are changed while streaming
+    if (memcmp(&pstCur->unAttr.stVencAttr, &pstNew->unAttr.stVencAttr,
+               sizeof(VENC_CHN_ATTR_S)))
+      return RKADK_GRAPH_CHANGE_LIVE;
+    break;
+
+  default:
+    break;
+  }
+
+  return RKADK_GRAPH_CHANGE_KEEP;
+}
+
+static RKADK_S32 RKADK_GRAPH_PushOp(RKADK_GRAPH_OP_S *pstOps, RKADK_U32 *pu32Cnt,
+                                    RKADK_U32 u32MaxCnt, RKADK_GRAPH_OP_TYPE_E enType,
+                                    RKADK_S32 s32Node,
+                                    const RKADK_GRAPH_EDGE_S *pstEdge) {
+  if (*pu32Cnt >= u32MaxCnt) {
+    RKADK_LOGE("op count over %d", u32MaxCnt);
+    return -1;
+  }
+
+  memset(&pstOps[*pu32Cnt], 0, sizeof(RKADK_GRAPH_OP_S));
+  pstOps[*pu32Cnt].enType = enType;
+  pstOps[*pu32Cnt].s32Node = s32Node;
+  if (pstEdge)
+    pstOps[*pu32Cnt].stEdge = *pstEdge;
+  (*pu32Cnt)++;
+  return 0;
+}
+
+static bool RKADK_GRAPH_IsGone(RKADK_GRAPH_CHANGE_E enChange) {
+  return enChange == RKADK_GRAPH_CHANGE_REMOVE || enChange == RKADK_GRAPH_CHANGE_REBUILD;
+}
+
+RKADK_S32 RKADK_GRAPH_Plan(const RKADK_GRAPH_S *pstCur,
+                           const RKADK_GRAPH_S *pstNew,
+                           RKADK_GRAPH_OP_S *pstOps, RKADK_U32 u32MaxCnt) {
+  RKADK_U32 i, u32Cnt = 0;
+  RKADK_S32 d, s32Src, s32Dest, s32CurMax, s32NewMax;
+  RKADK_GRAPH_OP_TYPE_E enType;
+  RKADK_GRAPH_NODE_STATE_S stCur[RKADK_GRAPH_NODE_MAX_CNT];
+  RKADK_GRAPH_NODE_STATE_S stNew[RKADK_GRAPH_NODE_MAX_CNT];
+
+  RKADK_CHECK_POINTER(pstCur, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstNew, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstOps, RKADK_FAILURE);
+
+  if (RKADK_GRAPH_Depth(pstCur, stCur, &s32CurMax) ||
+      RKADK_GRAPH_Depth(pstNew, stNew, &s32NewMax))
+    return -1;
+
+  for (i = 0; i < pstCur->u32NodeCnt; i++) {
+    stCur[i].s32Peer = RKADK_GRAPH_FindNode(pstNew, &pstCur->stNode[i].stChn);
+    if (stCur[i].s32Peer < 0)
+      stCur[i].enChange = RKADK_GRAPH_CHANGE_REMOVE;
+    else
+      stCur[i].enChange = RKADK_GRAPH_NodeChange(&pstCur->stNode[i],
+                                                 &pstNew->stNode[stCur[i].s32Peer]);
+  }
+
+  for (i = 0; i < pstNew->u32NodeCnt; i++) {
+    stNew[i].s32Peer = RKADK_GRAPH_FindNode(pstCur, &pstNew->stNode[i].stChn);
+    if (stNew[i].s32Peer < 0)
+      stNew[i].enChange = RKADK_GRAPH_CHANGE_ADD;
+    else
+      stNew[i].enChange = stCur[stNew[i].s32Peer].enChange;
+  }
+
+  // unbind downstream first
+  for (d = s32CurMax; d > 0; d--) {
+    for (i = 0; i < pstCur->u32EdgeCnt; i++) {
+      s32Src = RKADK_GRAPH_FindNode(pstCur, &pstCur->stEdge[i].stSrcChn);
+      s32Dest = RKADK_GRAPH_FindNode(pstCur, &pstCur->stEdge[i].stDestChn);
+      if (stCur[s32Dest].s32Depth != d)
+        continue;
+
+      if (RKADK_GRAPH_FindEdge(pstNew, &pstCur->stEdge[i]) < 0 ||
+          RKADK_GRAPH_IsGone(stCur[s32Src].enChange) ||
+          RKADK_GRAPH_IsGone(stCur[s32Dest].enChange))
+        enType = RKADK_GRAPH_OP_UNBIND;
+      else if (stCur[s32Src].enChange == RKADK_GRAPH_CHANGE_SET ||
+               stCur[s32Dest].enChange == RKADK_GRAPH_CHANGE_SET)
+        enType = RKADK_GRAPH_OP_DETACH;
+      else
+        continue;
+
+      if (RKADK_GRAPH_PushOp(pstOps, &u32Cnt, u32MaxCnt, enType, -1, &pstCur->stEdge[i]))
+        return -1;
+    }
+  }
+
+  for (d = s32CurMax; d >= 0; d--) {
+    for (i = 0; i < pstCur->u32NodeCnt; i++) {
+      if (stCur[i].s32Depth != d || !RKADK_GRAPH_IsGone(stCur[i].enChange))
+        continue;
+
+      if (RKADK_GRAPH_PushOp(pstOps, &u32Cnt, u32MaxCnt, RKADK_GRAPH_OP_DEINIT, i, NULL))
+        return -1;
+    }
+  }
+
+  // init upstream first
+  for (d = 0; d <= s32NewMax; d++) {
+    for (i = 0; i < pstNew->u32NodeCnt; i++) {
+      if (stNew[i].s32Depth != d)
+        continue;
+
+      if (stNew[i].enChange == RKADK_GRAPH_CHANGE_LIVE ||
+          stNew[i].enChange == RKADK_GRAPH_CHANGE_SET)
+        enType = RKADK_GRAPH_OP_SET_ATTR;
+      else if (stNew[i].enChange == RKADK_GRAPH_CHANGE_ADD ||
+               stNew[i].enChange == RKADK_GRAPH_CHANGE_REBUILD)
+        enType = RKADK_GRAPH_OP_INIT;
+      else
+        continue;
+
+      if (RKADK_GRAPH_PushOp(pstOps, &u32Cnt, u32MaxCnt, enType, i, NULL))
+        return -1;
+    }
+  }
+
+  for (d = 1; d <= s32NewMax; d++) {
+    for (i = 0; i < pstNew->u32EdgeCnt; i++) {
+      s32Src = RKADK_GRAPH_FindNode(pstNew, &pstNew->stEdge[i].stSrcChn);
+      s32Dest = RKADK_GRAPH_FindNode(pstNew, &pstNew->stEdge[i].stDestChn);
+      if (stNew[s32Dest].s32Depth != d)
+        continue;
+
+      if (RKADK_GRAPH_FindEdge(pstCur, &pstNew->stEdge[i]) < 0 ||
+          RKADK_GRAPH_IsGone(stNew[s32Src].enChange) ||
+          RKADK_GRAPH_IsGone(stNew[s32Dest].enChange) ||
+          stNew[s32Src].enChange == RKADK_GRAPH_CHANGE_ADD ||
+          stNew[s32Dest].enChange == RKADK_GRAPH_CHANGE_ADD)
+        enType = RKADK_GRAPH_OP_BIND;
+      else if (stNew[s32Src].enChange == RKADK_GRAPH_CHANGE_SET ||
+               stNew[s32Dest].enChange == RKADK_GRAPH_CHANGE_SET)
+        enType = RKADK_GRAPH_OP_ATTACH;
+      else
+        continue;
+
+      if (RKADK_GRAPH_PushOp(pstOps, &u32Cnt, u32MaxCnt, enType, -1, &pstNew->stEdge[i]))
+        return -1;
+    }
+  }
+
+  return u32Cnt;
+}
+
+static RKADK_S32 RKADK_GRAPH_InitNode(const RKADK_GRAPH_NODE_S *pstNode) {
+  RKADK_GRAPH_NODE_S stNode = *pstNode;
+
+  switch (stNode.stChn.enModId) {
+  case RK_ID_VI:
+    return RKADK_MPI_VI_Init(stNode.u32CamId, stNode.stChn.s32ChnId,
+                             &stNode.unAttr.stViAttr);
+  case RK_ID_VPSS:
+    return RKADK_MPI_VPSS_Init(stNode.stChn.s32DevId, stNode.stChn.s32ChnId,
+                               &stNode.unAttr.stVpssAttr.stGrpAttr,
+                               &stNode.unAttr.stVpssAttr.stChnAttr);
+  case RK_ID_VENC:
+    return RKADK_MPI_VENC_Init(stNode.u32CamId, stNode.stChn.s32ChnId,
+                               &stNode.unAttr.stVencAttr);
+  default:
+    return -1;
+  }
+}
+
+static RKADK_S32 RKADK_GRAPH_DeInitNode(const RKADK_GRAPH_NODE_S *pstNode) {
+  switch (pstNode->stChn.enModId) {
+  case RK_ID_VI:
+    return RKADK_MPI_VI_DeInit(pstNode->u32CamId, pstNode->stChn.s32ChnId);
+  case RK_ID_VPSS:
+    return RKADK_MPI_VPSS_DeInit(pstNode->stChn.s32DevId, pstNode->stChn.s32ChnId);
+  case RK_ID_VENC:
+    return RKADK_MPI_VENC_DeInit(pstNode->stChn.s32ChnId);
+  default:
+    return -1;
+  }
+}
+
+static RKADK_S32 RKADK_GRAPH_SetNodeAttr(const RKADK_GRAPH_NODE_S *pstNode) {
+  RKADK_GRAPH_NODE_S stNode = *pstNode;
+
+  switch (stNode.stChn.enModId) {
+  case RK_ID_VI:
+    return RK_MPI_VI_SetChnAttr(stNode.u32CamId, stNode.stChn.s32ChnId,
+                                &stNode.unAttr.stViAttr);
+  case RK_ID_VPSS:
+    return RK_MPI_VPSS_SetChnAttr(stNode.stChn.s32DevId, stNode.stChn.s32ChnId,
+                                  &stNode.unAttr.stVpssAttr.stChnAttr);
+  case RK_ID_VENC:
+    return RK_MPI_VENC_SetChnAttr(stNode.stChn.s32ChnId, &stNode.unAttr.stVencAttr);
+  default:
+    return -1;
+  }
+}
+
+RKADK_S32 RKADK_GRAPH_Apply(const RKADK_GRAPH_S *pstCur,
+                            const RKADK_GRAPH_S *pstNew) {
+  int ret = 0;
+  RKADK_S32 i, s32Cnt;
+  const RKADK_GRAPH_NODE_S *pstNode;
+  RKADK_GRAPH_OP_S stOps[RKADK_GRAPH_OP_MAX_CNT];
+
+  s32Cnt = RKADK_GRAPH_Plan(pstCur, pstNew, stOps, RKADK_GRAPH_OP_MAX_CNT);
+  if (s32Cnt < 0) {
+    RKADK_LOGE("RKADK_GRAPH_Plan failed");
+    return -1;
+  }
+
+  for (i = 0; i < s32Cnt; i++) {
+    pstNode = NULL;
+    if (stOps[i].enType == RKADK_GRAPH_OP_DEINIT)
+      pstNode = &pstCur->stNode[stOps[i].s32Node];
+    else if (stOps[i].s32Node >= 0)
+      pstNode = &pstNew->stNode[stOps[i].s32Node];
+
+    switch (stOps[i].enType) {
+    case RKADK_GRAPH_OP_UNBIND:
+      ret = RKADK_MPI_SYS_UnBind(&stOps[i].stEdge.stSrcChn, &stOps[i].stEdge.stDestChn);
+      break;
+    case RKADK_GRAPH_OP_DETACH:
+      // keep the bind count, the edge is attached again
+      ret = RK_MPI_SYS_UnBind(&stOps[i].stEdge.stSrcChn, &stOps[i].stEdge.stDestChn);
+      break;
+    case RKADK_GRAPH_OP_DEINIT:
+      ret = RKADK_GRAPH_DeInitNode(pstNode);
+      break;
+    case RKADK_GRAPH_OP_SET_ATTR:
+      ret = RKADK_GRAPH_SetNodeAttr(pstNode);
+      break;
+    case RKADK_GRAPH_OP_INIT:
+      ret = RKADK_GRAPH_InitNode(pstNode);
+      break;
+    case RKADK_GRAPH_OP_ATTACH:
+      ret = RK_MPI_SYS_Bind(&stOps[i].stEdge.stSrcChn, &stOps[i].stEdge.stDestChn);
+      break;
+    case RKADK_GRAPH_OP_BIND:
+      ret = RKADK_MPI_SYS_Bind(&stOps[i].stEdge.stSrcChn, &stOps[i].stEdge.stDestChn);
+      break;
+    default:
+      ret = -1;
+      break;
+    }
+
+    if (ret) {
+      if (pstNode)
+        RKADK_LOGE("op[%d] type[%d] node[%d, %d, %d] failed[%x]", i, stOps[i].enType,
+                   pstNode->stChn.enModId, pstNode->stChn.s32DevId,
+                   pstNode->stChn.s32ChnId, ret);
+      else
+        RKADK_LOGE("op[%d] type[%d] src[%d, %d, %d] dest[%d, %d, %d] failed[%x]", i,
+                   stOps[i].enType, stOps[i].stEdge.stSrcChn.enModId,
+                   stOps[i].stEdge.stSrcChn.s32DevId, stOps[i].stEdge.stSrcChn.s32ChnId,
+                   stOps[i].stEdge.stDestChn.enModId, stOps[i].stEdge.stDestChn.s32DevId,
+                   stOps[i].stEdge.stDestChn.s32ChnId, ret);
+      return -1;
+    }
+  }
+
+  RKADK_LOGD("graph applied, op count[%d]", s32Cnt);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef __RKADK_MEDIA_GRAPH_H__
+#define __RKADK_MEDIA_GRAPH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "rkadk_media_comm.h"
+
+#define RKADK_GRAPH_NODE_MAX_CNT 16
+#define RKADK_GRAPH_EDGE_MAX_CNT 16
+#define RKADK_GRAPH_OP_MAX_CNT \
+  (4 * RKADK_GRAPH_NODE_MAX_CNT + 3 * RKADK_GRAPH_EDGE_MAX_CNT)
+
+/*
+ * A node is a VI, VPSS or VENC channel, stChn is its key. An edge is a
+ * bind between two nodes of the same graph.
+ */
+typedef struct {
+  MPP_CHN_S stChn;
+  RKADK_U32 u32CamId;
+  union {
+    VI_CHN_ATTR_S stViAttr;
+    struct {
+      VPSS_GRP_ATTR_S stGrpAttr;
+      VPSS_CHN_ATTR_S stChnAttr;
+    } stVpssAttr;
+    VENC_CHN_ATTR_S stVencAttr;
+  } unAttr;
+} RKADK_GRAPH_NODE_S;
+
+typedef struct {
+  MPP_CHN_S stSrcChn;
+  MPP_CHN_S stDestChn;
+} RKADK_GRAPH_EDGE_S;
+
+/* attributes must be memset before filled, nodes are compared with memcmp */
+typedef struct {
+  RKADK_U32 u32NodeCnt;
+  RKADK_U32 u32EdgeCnt;
+  RKADK_GRAPH_NODE_S stNode[RKADK_GRAPH_NODE_MAX_CNT];
+  RKADK_GRAPH_EDGE_S stEdge[RKADK_GRAPH_EDGE_MAX_CNT];
+} RKADK_GRAPH_S;
+
+typedef enum {
+  RKADK_GRAPH_OP_UNBIND = 0, // remove the bind
+  RKADK_GRAPH_OP_DETACH,     // unbind for a while, RKADK_GRAPH_OP_ATTACH later
+  RKADK_GRAPH_OP_DEINIT,
+  RKADK_GRAPH_OP_SET_ATTR,
+  RKADK_GRAPH_OP_INIT,
+  RKADK_GRAPH_OP_ATTACH,
+  RKADK_GRAPH_OP_BIND,
+  RKADK_GRAPH_OP_BUTT
+} RKADK_GRAPH_OP_TYPE_E;
+
+/* s32Node indexes the desired graph, except DEINIT which indexes the current one */
+typedef struct {
+  RKADK_GRAPH_OP_TYPE_E enType;
+  RKADK_S32 s32Node;
+  RKADK_GRAPH_EDGE_S stEdge;
+} RKADK_GRAPH_OP_S;
+
+RKADK_S32 RKADK_GRAPH_AddNode(RKADK_GRAPH_S *pstGraph,
+                              RKADK_GRAPH_NODE_S *pstNode);
+
+RKADK_S32 RKADK_GRAPH_AddEdge(RKADK_GRAPH_S *pstGraph,
+                              const MPP_CHN_S *pstSrcChn,
+                              const MPP_CHN_S *pstDestChn);
+
+/*
+ * Computes the operations turning pstCur into pstNew, without touching
+ * the hardware. Nodes and edges present in both graphs with the same
+ * attributes are left alone. Returns the operation count or -1.
+ */
+RKADK_S32 RKADK_GRAPH_Plan(const RKADK_GRAPH_S *pstCur,
+                           const RKADK_GRAPH_S *pstNew,
+                           RKADK_GRAPH_OP_S *pstOps, RKADK_U32 u32MaxCnt);
+
+/*
+ * Plans and applies the operations. Nodes of pstCur must have been
+ * initialized by RKADK_MPI_*_Init, new nodes are initialized the same way.
+ */
+RKADK_S32 RKADK_GRAPH_Apply(const RKADK_GRAPH_S *pstCur,
+                            const RKADK_GRAPH_S *pstNew);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
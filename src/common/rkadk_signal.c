@@ -14,74 +14,297 @@
  *  limitations under the License.
  */
 #include "rkadk_signal.h"
+#include "linux_list.h"
+
+#ifndef OS_RTT
+#define RKADK_SIGNAL_CLOCK CLOCK_MONOTONIC
+#else
+#define RKADK_SIGNAL_CLOCK CLOCK_REALTIME
+#endif
+
+/* one per RKADK_SIGNAL_WaitAny call, linked to every signal it waits on */
+typedef struct _RKADK_SIGNAL_WAITER_S RKADK_SIGNAL_WAITER_S;
+
+typedef struct {
+  struct list_head mark;
+  RKADK_SIGNAL_WAITER_S *pstWaiter;
+} RKADK_SIGNAL_LINK_S;
+
+struct _RKADK_SIGNAL_WAITER_S {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool bFired;
+  RKADK_SIGNAL_LINK_S stLink[RKADK_SIGNAL_WAIT_ANY_MAX];
+};
 
 typedef struct {
-  sem_t sem;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int val;
   int max_val;
+  int waiter_cnt;
+  struct list_head stAnyList;
+  uint64_t u64GiveNs;
+  uint64_t u64LatSumUs;
+  RKADK_SIGNAL_STATS_S stStats;
 } RKADK_SIGNAL_S;
 
+static void RKADK_SIGNAL_CondInit(pthread_cond_t *pCond) {
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+#ifndef OS_RTT
+  pthread_condattr_setclock(&attr, RKADK_SIGNAL_CLOCK);
+#endif
+  pthread_cond_init(pCond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+static uint64_t RKADK_SIGNAL_GetNs(void) {
+  struct timespec ts;
+
+  clock_gettime(RKADK_SIGNAL_CLOCK, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void RKADK_SIGNAL_GetDeadline(struct timespec *tv, int timeout) {
+  clock_gettime(RKADK_SIGNAL_CLOCK, tv);
+
+  tv->tv_nsec += (long)(timeout % 1000) * 1000000;
+  if (tv->tv_nsec >= 1000000000) {
+    tv->tv_sec += 1;
+    tv->tv_nsec -= 1000000000;
+  }
+  tv->tv_sec += timeout / 1000;
+}
+
+// mutex must be held, bWaited: the caller blocked before taking it
+static void RKADK_SIGNAL_Take(RKADK_SIGNAL_S *h, bool bWaited) {
+  uint32_t u32LatUs;
+
+  h->val--;
+  if (!bWaited)
+    return;
+
+  u32LatUs = (uint32_t)((RKADK_SIGNAL_GetNs() - h->u64GiveNs) / 1000);
+  h->stStats.u64WakeCnt++;
+  h->u64LatSumUs += u32LatUs;
+  if (u32LatUs > h->stStats.u32LatMaxUs)
+    h->stStats.u32LatMaxUs = u32LatUs;
+}
+
 void *RKADK_SIGNAL_Create(int defval, int maxval) {
   RKADK_SIGNAL_S *h = (RKADK_SIGNAL_S *)malloc(sizeof(RKADK_SIGNAL_S));
 
   if (h == NULL) {
     return NULL;
   }
-  if (sem_init(&(h->sem), 0, defval) ==
-      -1) { /* 初始化信号量失败,失败原因见error */
-    perror("sem_init: ");
-    free(h);
-    h = NULL;
-  } else
-    h->max_val = maxval;
+
+  memset(h, 0, sizeof(RKADK_SIGNAL_S));
+  h->val = defval;
+  h->max_val = maxval;
+  INIT_LIST_HEAD(&h->stAnyList);
+  pthread_mutex_init(&h->mutex, NULL);
+  RKADK_SIGNAL_CondInit(&h->cond);
   return h;
 }
 
 void RKADK_SIGNAL_Destroy(void *sem) {
-  if (sem == NULL) {
+  RKADK_SIGNAL_S *h = (RKADK_SIGNAL_S *)sem;
+
+  if (h == NULL) {
     return;
   }
 
-  sem_destroy((sem_t *)sem);
-  free(sem);
+  pthread_cond_destroy(&h->cond);
+  pthread_mutex_destroy(&h->mutex);
+  free(h);
 }
 
 int RKADK_SIGNAL_Wait(void *sem, int timeout) {
+  int ret = 0;
+  bool bWaited = false;
   struct timespec tv;
+  RKADK_SIGNAL_S *h = (RKADK_SIGNAL_S *)sem;
 
-  if (sem == NULL) {
+  if (h == NULL) {
     return 0;
   }
 
-  if (timeout < 0) { /* 需要判断返回值,因为如果信号量被destroy了也会返回的 */
-    return sem_wait((sem_t *)sem) == 0 ? 0 : -1;
+  /* 截止时间基于单调时钟, 不受系统时间调整影响 */
+  if (timeout >= 0)
+    RKADK_SIGNAL_GetDeadline(&tv, timeout);
+
+  pthread_mutex_lock(&h->mutex);
+  h->waiter_cnt++;
+  while (h->val <= 0 && !ret) {
+    bWaited = true;
+    if (timeout < 0)
+      ret = pthread_cond_wait(&h->cond, &h->mutex);
+    else
+      ret = pthread_cond_timedwait(&h->cond, &h->mutex, &tv);
+  }
+  h->waiter_cnt--;
+
+  if (h->val > 0) {
+    RKADK_SIGNAL_Take(h, bWaited);
+    ret = 0;
   } else {
-    clock_gettime(CLOCK_REALTIME, &tv);
+    h->stStats.u64TimeoutCnt++;
+    ret = -1;
+  }
+  pthread_mutex_unlock(&h->mutex);
 
-    tv.tv_nsec += (timeout % 1000) * 1000000;
-    if (tv.tv_nsec >= 1000000000) {
-      tv.tv_sec += 1;
-      tv.tv_nsec -= 1000000000;
-    }
-    tv.tv_sec += timeout / 1000;
-    if (sem_timedwait((sem_t *)sem, (const struct timespec *)&tv)) {
-      return -1;
+  return ret;
+}
+
+void RKADK_SIGNAL_Give(void *sem) {
+  bool bWake = false;
+  RKADK_SIGNAL_LINK_S *pstLink;
+  RKADK_SIGNAL_S *h = (RKADK_SIGNAL_S *)sem;
+
+  if (h == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&h->mutex);
+  h->stStats.u64GiveCnt++;
+  if (h->val < h->max_val) {
+    h->val++;
+    h->u64GiveNs = RKADK_SIGNAL_GetNs();
+    bWake = h->waiter_cnt > 0;
+
+    list_for_each_entry(pstLink, &h->stAnyList, mark) {
+      pthread_mutex_lock(&pstLink->pstWaiter->mutex);
+      pstLink->pstWaiter->bFired = true;
+      pthread_cond_signal(&pstLink->pstWaiter->cond);
+      pthread_mutex_unlock(&pstLink->pstWaiter->mutex);
     }
-    return 0;
   }
+
+  if (bWake)
+    pthread_cond_signal(&h->cond);
+  pthread_mutex_unlock(&h->mutex);
 }
 
-void RKADK_SIGNAL_Give(void *sem) {
-  int val;
+void RKADK_SIGNAL_Reset(void *sem) {
+  RKADK_SIGNAL_S *h = (RKADK_SIGNAL_S *)sem;
 
-  if (sem == NULL) {
+  if (h == NULL) {
     return;
   }
 
-  sem_getvalue((sem_t *)sem, &val);
+  pthread_mutex_lock(&h->mutex);
+  h->val = 0;
+  pthread_mutex_unlock(&h->mutex);
+}
+
+// takes the first available signal, -1 if none
+static int RKADK_SIGNAL_TryAny(RKADK_SIGNAL_S **h, int cnt, bool bWaited) {
+  for (int i = 0; i < cnt; i++) {
+    pthread_mutex_lock(&h[i]->mutex);
+    if (h[i]->val > 0) {
+      RKADK_SIGNAL_Take(h[i], bWaited);
+      pthread_mutex_unlock(&h[i]->mutex);
+      return i;
+    }
+    pthread_mutex_unlock(&h[i]->mutex);
+  }
+
+  return -1;
+}
+
+static void RKADK_SIGNAL_Unlink(RKADK_SIGNAL_S **h, RKADK_SIGNAL_WAITER_S *pstWaiter,
+                                int cnt) {
+  for (int i = 0; i < cnt; i++) {
+    pthread_mutex_lock(&h[i]->mutex);
+    list_del(&pstWaiter->stLink[i].mark);
+    pthread_mutex_unlock(&h[i]->mutex);
+  }
+}
+
+int RKADK_SIGNAL_WaitAny(void **sems, int cnt, int timeout) {
+  int i, ret = 0, idx;
+  struct timespec tv;
+  RKADK_SIGNAL_WAITER_S stWaiter;
+  RKADK_SIGNAL_S **h = (RKADK_SIGNAL_S **)sems;
+
+  if (h == NULL || cnt <= 0 || cnt > RKADK_SIGNAL_WAIT_ANY_MAX) {
+    return -1;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    if (h[i] == NULL) {
+      return -1;
+    }
+  }
+
+  idx = RKADK_SIGNAL_TryAny(h, cnt, false);
+  if (idx >= 0 || timeout == 0) {
+    return idx;
+  }
+
+  if (timeout > 0)
+    RKADK_SIGNAL_GetDeadline(&tv, timeout);
+
+  memset(&stWaiter, 0, sizeof(stWaiter));
+  pthread_mutex_init(&stWaiter.mutex, NULL);
+  RKADK_SIGNAL_CondInit(&stWaiter.cond);
+
+  while (idx < 0 && !ret) {
+    // link first so that a give between the check and the wait is not lost
+    stWaiter.bFired = false;
+    for (i = 0; i < cnt; i++) {
+      stWaiter.stLink[i].pstWaiter = &stWaiter;
+      pthread_mutex_lock(&h[i]->mutex);
+      list_add_tail(&stWaiter.stLink[i].mark, &h[i]->stAnyList);
+      pthread_mutex_unlock(&h[i]->mutex);
+    }
+
+    idx = RKADK_SIGNAL_TryAny(h, cnt, true);
+    if (idx < 0) {
+      pthread_mutex_lock(&stWaiter.mutex);
+      while (!stWaiter.bFired && !ret) {
+        if (timeout < 0)
+          ret = pthread_cond_wait(&stWaiter.cond, &stWaiter.mutex);
+        else
+          ret = pthread_cond_timedwait(&stWaiter.cond, &stWaiter.mutex, &tv);
+      }
+      pthread_mutex_unlock(&stWaiter.mutex);
+    }
+
+    RKADK_SIGNAL_Unlink(h, &stWaiter, cnt);
 
-  if (val < ((RKADK_SIGNAL_S *)sem)->max_val) {
-    sem_post((sem_t *)sem);
+    // another waiter may have taken the fired signal, then wait again
+    if (idx < 0)
+      idx = RKADK_SIGNAL_TryAny(h, cnt, true);
   }
+
+  if (idx < 0) {
+    for (i = 0; i < cnt; i++) {
+      pthread_mutex_lock(&h[i]->mutex);
+      h[i]->stStats.u64TimeoutCnt++;
+      pthread_mutex_unlock(&h[i]->mutex);
+    }
+  }
+
+  pthread_cond_destroy(&stWaiter.cond);
+  pthread_mutex_destroy(&stWaiter.mutex);
+  return idx;
 }
 
-void RKADK_SIGNAL_Reset(void *sem) { RKADK_SIGNAL_Give(sem); }
\ No newline at end of file
+int RKADK_SIGNAL_GetStats(void *sem, RKADK_SIGNAL_STATS_S *pstStats) {
+  RKADK_SIGNAL_S *h = (RKADK_SIGNAL_S *)sem;
+
+  if (h == NULL || pstStats == NULL) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&h->mutex);
+  memcpy(pstStats, &h->stStats, sizeof(RKADK_SIGNAL_STATS_S));
+  if (h->stStats.u64WakeCnt)
+    pstStats->u32LatAvgUs = (uint32_t)(h->u64LatSumUs / h->stStats.u64WakeCnt);
+  pthread_mutex_unlock(&h->mutex);
+
+  return 0;
+}
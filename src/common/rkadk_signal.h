@@ -35,6 +35,17 @@ extern "C" {
 #include <time.h>
 #include <unistd.h>
 
+/* RKADK_SIGNAL_WaitAny 最多等待的信号量个数 */
+#define RKADK_SIGNAL_WAIT_ANY_MAX 8
+
+typedef struct {
+  uint64_t u64GiveCnt;    // 释放次数
+  uint64_t u64WakeCnt;    // 阻塞后被唤醒的次数
+  uint64_t u64TimeoutCnt; // 超时次数
+  uint32_t u32LatAvgUs;   // 从释放到阻塞者返回的平均延时(us)
+  uint32_t u32LatMaxUs;   // 最大唤醒延时(us)
+} RKADK_SIGNAL_STATS_S;
+
 /**
  * @brief 创建信号量
  *
@@ -70,12 +81,33 @@ int RKADK_SIGNAL_Wait(void *sem, int timeout);
 void RKADK_SIGNAL_Give(void *sem);
 
 /**
- * @brief 重置信号量
+ * @brief 重置信号量, 清除未被等待的释放
  *
  * @param signal 信号量句柄
  */
 void RKADK_SIGNAL_Reset(void *sem);
 
+/**
+ * @brief 等待多个信号量中的任意一个
+ *
+ * @param sems 信号量句柄数组
+ * @param cnt 信号量个数, 不超过RKADK_SIGNAL_WAIT_ANY_MAX
+ * @param timeout -1表示无限等待;其他值表示等待的时间(ms)
+ *
+ * @return 成功,返回获得的信号量下标, 多个可用时取下标最小的; 否则,返回-1
+ */
+int RKADK_SIGNAL_WaitAny(void **sems, int cnt, int timeout);
+
+/**
+ * @brief 获取信号量统计信息
+ *
+ * @param signal 信号量句柄
+ * @param pstStats 统计信息
+ *
+ * @return 成功,返回0; 否则,返回-1
+ */
+int RKADK_SIGNAL_GetStats(void *sem, RKADK_SIGNAL_STATS_S *pstStats);
+
 #ifdef __cplusplus
 }
 #endif
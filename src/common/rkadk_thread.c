@@ -16,20 +16,38 @@
 
 #include "rkadk_thread.h"
 #include "rkadk_log.h"
+#include <errno.h>
 #include <string.h>
 
+#ifndef OS_RTT
+#define RKADK_THREAD_CLOCK CLOCK_MONOTONIC
+#else
+#define RKADK_THREAD_CLOCK CLOCK_REALTIME
+#endif
+
 typedef struct {
   RKADK_THREAD_PROC_FN func;
   void *param;
   pthread_t tid;
   int exit_flag;
+  bool wake;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
 } RKADK_THREAD_HANDLE_S;
 
+static pthread_once_t g_threadKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t g_threadKey;
+
+static void RKADK_THREAD_KeyInit(void) {
+  pthread_key_create(&g_threadKey, NULL);
+}
+
 static void *RKADK_THREAD_Proc(void *params) {
   char name[40];
   RKADK_THREAD_HANDLE_S *pstThread = (RKADK_THREAD_HANDLE_S *)params;
 
-  while (!pstThread->exit_flag) {
+  pthread_setspecific(g_threadKey, pstThread);
+  while (!__atomic_load_n(&pstThread->exit_flag, __ATOMIC_ACQUIRE)) {
     pstThread->func(pstThread->param);
   }
 
@@ -43,10 +61,66 @@ static void *RKADK_THREAD_Proc(void *params) {
   return NULL;
 }
 
-void *RKADK_THREAD_Create(RKADK_THREAD_PROC_FN func, void *param, char *name) {
+static int RKADK_THREAD_InitAttr(pthread_attr_t *pstPthreadAttr,
+                                 const RKADK_THREAD_ATTR_S *pstAttr,
+                                 bool bSched) {
+  struct sched_param stParam;
+
+  pthread_attr_init(pstPthreadAttr);
+  if (!pstAttr)
+    return 0;
+
+  if (pstAttr->stack_size &&
+      pthread_attr_setstacksize(pstPthreadAttr, pstAttr->stack_size))
+    RKADK_LOGW("Invalid stack size %zu, use default", pstAttr->stack_size);
+
+  if (!bSched || pstAttr->policy == SCHED_OTHER)
+    return 0;
+
+  memset(&stParam, 0, sizeof(stParam));
+  stParam.sched_priority = pstAttr->priority;
+  if (pthread_attr_setinheritsched(pstPthreadAttr, PTHREAD_EXPLICIT_SCHED) ||
+      pthread_attr_setschedpolicy(pstPthreadAttr, pstAttr->policy) ||
+      pthread_attr_setschedparam(pstPthreadAttr, &stParam)) {
+    RKADK_LOGW("Invalid sched policy %d priority %d", pstAttr->policy,
+               pstAttr->priority);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void RKADK_THREAD_SetAffinity(RKADK_THREAD_HANDLE_S *pstThread,
+                                     const RKADK_THREAD_ATTR_S *pstAttr) {
+#ifndef OS_RTT
+  cpu_set_t cpuset;
+
+  if (!pstAttr || !pstAttr->cpu_mask)
+    return;
+
+  CPU_ZERO(&cpuset);
+  for (int i = 0; i < 32; i++) {
+    if (pstAttr->cpu_mask & (1U << i))
+      CPU_SET(i, &cpuset);
+  }
+
+  if (pthread_setaffinity_np(pstThread->tid, sizeof(cpuset), &cpuset))
+    RKADK_LOGW("Set cpu mask 0x%x failed", pstAttr->cpu_mask);
+#else
+  if (pstAttr && pstAttr->cpu_mask)
+    RKADK_LOGW("cpu affinity is not supported");
+#endif
+}
+
+void *RKADK_THREAD_CreateEx(RKADK_THREAD_PROC_FN func, void *param, char *name,
+                            const RKADK_THREAD_ATTR_S *pstAttr) {
   int ret;
+  pthread_attr_t stPthreadAttr;
+  pthread_condattr_t stCondAttr;
   RKADK_THREAD_HANDLE_S *pstThread = NULL;
 
+  pthread_once(&g_threadKeyOnce, RKADK_THREAD_KeyInit);
+
   pstThread = (RKADK_THREAD_HANDLE_S *)malloc(sizeof(RKADK_THREAD_HANDLE_S));
   if (!pstThread) {
     RKADK_LOGE("malloc pstThread failed");
@@ -56,14 +130,38 @@ void *RKADK_THREAD_Create(RKADK_THREAD_PROC_FN func, void *param, char *name) {
 
   pstThread->func = func;
   pstThread->param = param;
+  pthread_mutex_init(&pstThread->mutex, NULL);
+  pthread_condattr_init(&stCondAttr);
+#ifndef OS_RTT
+  pthread_condattr_setclock(&stCondAttr, RKADK_THREAD_CLOCK);
+#endif
+  pthread_cond_init(&pstThread->cond, &stCondAttr);
+  pthread_condattr_destroy(&stCondAttr);
+
+  ret = RKADK_THREAD_InitAttr(&stPthreadAttr, pstAttr, true);
+  if (!ret)
+    ret = pthread_create(&pstThread->tid, &stPthreadAttr, RKADK_THREAD_Proc, pstThread);
+  pthread_attr_destroy(&stPthreadAttr);
+
+  // realtime policies need CAP_SYS_NICE, fall back to the default policy
+  if (ret && pstAttr && pstAttr->policy != SCHED_OTHER) {
+    RKADK_LOGW("Create thread with policy %d failed %d, use default",
+               pstAttr->policy, ret);
+    RKADK_THREAD_InitAttr(&stPthreadAttr, pstAttr, false);
+    ret = pthread_create(&pstThread->tid, &stPthreadAttr, RKADK_THREAD_Proc, pstThread);
+    pthread_attr_destroy(&stPthreadAttr);
+  }
 
-  ret = pthread_create(&pstThread->tid, NULL, RKADK_THREAD_Proc, pstThread);
   if (ret) {
     RKADK_LOGE("Create thread failed %d", ret);
+    pthread_cond_destroy(&pstThread->cond);
+    pthread_mutex_destroy(&pstThread->mutex);
     free(pstThread);
     return NULL;
   }
 
+  RKADK_THREAD_SetAffinity(pstThread, pstAttr);
+
   if (name) {
 #ifndef OS_RTT
     pthread_setname_np(pstThread->tid, name);
@@ -75,6 +173,10 @@ void *RKADK_THREAD_Create(RKADK_THREAD_PROC_FN func, void *param, char *name) {
   return (void *)pstThread;
 }
 
+void *RKADK_THREAD_Create(RKADK_THREAD_PROC_FN func, void *param, char *name) {
+  return RKADK_THREAD_CreateEx(func, param, name, NULL);
+}
+
 int RKADK_THREAD_Destory(void *handle) {
   int ret = 0;
   RKADK_THREAD_HANDLE_S *pstThread;
@@ -87,12 +189,14 @@ int RKADK_THREAD_Destory(void *handle) {
   pstThread = (RKADK_THREAD_HANDLE_S *)handle;
 
   do {
-    pstThread->exit_flag = 1;
+    RKADK_THREAD_SetExit(handle);
     ret = pthread_join(pstThread->tid, NULL);
     if (ret)
       RKADK_LOGE("Exit thread failed!");
   } while (0);
 
+  pthread_cond_destroy(&pstThread->cond);
+  pthread_mutex_destroy(&pstThread->mutex);
   free(pstThread);
   RKADK_LOGI("Exit thread success!");
   return ret;
@@ -107,6 +211,81 @@ int RKADK_THREAD_SetExit(void *handle) {
     return 0;
   }
   pstThread = (RKADK_THREAD_HANDLE_S *)handle;
-  pstThread->exit_flag = 1;
+
+  pthread_mutex_lock(&pstThread->mutex);
+  __atomic_store_n(&pstThread->exit_flag, 1, __ATOMIC_RELEASE);
+  pthread_cond_signal(&pstThread->cond);
+  pthread_mutex_unlock(&pstThread->mutex);
+  return ret;
+}
+
+int RKADK_THREAD_Wake(void *handle) {
+  RKADK_THREAD_HANDLE_S *pstThread;
+
+  if (!handle)
+    return -1;
+  pstThread = (RKADK_THREAD_HANDLE_S *)handle;
+
+  pthread_mutex_lock(&pstThread->mutex);
+  pstThread->wake = true;
+  pthread_cond_signal(&pstThread->cond);
+  pthread_mutex_unlock(&pstThread->mutex);
+  return 0;
+}
+
+void RKADK_THREAD_GetDeadline(struct timespec *pstDeadline, int timeout) {
+  clock_gettime(RKADK_THREAD_CLOCK, pstDeadline);
+  pstDeadline->tv_sec += timeout / 1000;
+  pstDeadline->tv_nsec += (long)(timeout % 1000) * 1000000;
+  if (pstDeadline->tv_nsec >= 1000000000) {
+    pstDeadline->tv_sec++;
+    pstDeadline->tv_nsec -= 1000000000;
+  }
+}
+
+int RKADK_THREAD_WaitUntil(const struct timespec *pstDeadline) {
+  int ret = 0;
+  RKADK_THREAD_HANDLE_S *pstThread;
+
+  pthread_once(&g_threadKeyOnce, RKADK_THREAD_KeyInit);
+  pstThread = (RKADK_THREAD_HANDLE_S *)pthread_getspecific(g_threadKey);
+  if (!pstThread) {
+    RKADK_LOGE("Not called from a RKADK_THREAD");
+    return -1;
+  }
+
+  pthread_mutex_lock(&pstThread->mutex);
+  while (!pstThread->wake && !pstThread->exit_flag && !ret) {
+    if (pstDeadline)
+      ret = pthread_cond_timedwait(&pstThread->cond, &pstThread->mutex, pstDeadline);
+    else
+      ret = pthread_cond_wait(&pstThread->cond, &pstThread->mutex);
+  }
+
+  if (pstThread->wake || pstThread->exit_flag)
+    ret = 0;
+  pstThread->wake = false;
+  pthread_mutex_unlock(&pstThread->mutex);
   return ret;
 }
+
+int RKADK_THREAD_Wait(int timeout) {
+  struct timespec stDeadline;
+
+  if (timeout < 0)
+    return RKADK_THREAD_WaitUntil(NULL);
+
+  RKADK_THREAD_GetDeadline(&stDeadline, timeout);
+  return RKADK_THREAD_WaitUntil(&stDeadline);
+}
+
+bool RKADK_THREAD_IsExit(void) {
+  RKADK_THREAD_HANDLE_S *pstThread;
+
+  pthread_once(&g_threadKeyOnce, RKADK_THREAD_KeyInit);
+  pstThread = (RKADK_THREAD_HANDLE_S *)pthread_getspecific(g_threadKey);
+  if (!pstThread)
+    return false;
+
+  return __atomic_load_n(&pstThread->exit_flag, __ATOMIC_ACQUIRE) != 0;
+}
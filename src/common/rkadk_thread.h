@@ -22,17 +22,49 @@ extern "C" {
 #endif
 
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <time.h>
 
 typedef bool (*RKADK_THREAD_PROC_FN)(void *param);
 
+typedef struct {
+  int policy;            // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+  int priority;          // SCHED_FIFO and SCHED_RR only
+  unsigned int cpu_mask; // bit n for cpu n, 0: any cpu
+  size_t stack_size;     // 0: default
+} RKADK_THREAD_ATTR_S;
+
 void *RKADK_THREAD_Create(RKADK_THREAD_PROC_FN func, void *param, char *name);
 
+/* pstAttr may be NULL, unsupported attributes are logged and ignored */
+void *RKADK_THREAD_CreateEx(RKADK_THREAD_PROC_FN func, void *param, char *name,
+                            const RKADK_THREAD_ATTR_S *pstAttr);
+
+/* sets the exit flag, wakes the thread and joins it */
 int RKADK_THREAD_Destory(void *handle);
 
+/* sets the exit flag and wakes the thread, RKADK_THREAD_Destory joins it */
 int RKADK_THREAD_SetExit(void *handle);
 
+/* wakes the next or current RKADK_THREAD_Wait of the thread, wakes are not counted */
+int RKADK_THREAD_Wake(void *handle);
+
+/*
+ * Called from the thread func only. Returns 0 when woken or asked to exit,
+ * ETIMEDOUT on timeout. timeout: -1 means forever, unit: ms.
+ */
+int RKADK_THREAD_Wait(int timeout);
+
+/* same as RKADK_THREAD_Wait with a deadline from RKADK_THREAD_GetDeadline */
+int RKADK_THREAD_WaitUntil(const struct timespec *pstDeadline);
+
+void RKADK_THREAD_GetDeadline(struct timespec *pstDeadline, int timeout);
+
+/* called from the thread func, lets long running funcs leave early */
+bool RKADK_THREAD_IsExit(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "rkadk_trace.h"
+
+#ifdef RKADK_TRACE_ENABLE
+
+#include "rkadk_log.h"
+#include "linux_list.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef OS_RTT
+#include <sys/syscall.h>
+#endif
+
+/* records kept per thread, must be a power of 2 */
+#define RKADK_TRACE_REC_CNT 4096
+/* buffers of exited threads are recycled beyond this count */
+#define RKADK_TRACE_BUF_MAX 32
+
+#define RKADK_TRACE_MAGIC 0x52544b52 // "RKTR"
+#define RKADK_TRACE_VERSION 1
+
+typedef struct {
+  uint32_t u32Magic;
+  uint32_t u32Version;
+  uint32_t u32BufCnt;
+  uint32_t u32RecSize;
+} RKADK_TRACE_FILE_HDR_S;
+
+typedef struct {
+  uint32_t u32Tid;
+  uint32_t u32RecCnt;
+  char name[16];
+} RKADK_TRACE_BUF_HDR_S;
+
+typedef struct {
+  struct list_head mark;
+  pthread_t thread;
+  uint32_t u32Tid;
+  bool bExited;
+  char name[16];
+  uint32_t u32Head; // records ever written, the writer is the owner thread
+  RKADK_TRACE_REC_S stRec[RKADK_TRACE_REC_CNT];
+} RKADK_TRACE_BUF_S;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_key_t key;
+  struct list_head stBufList;
+  uint32_t u32BufCnt;
+} RKADK_TRACE_CTX_S;
+
+static RKADK_TRACE_CTX_S g_stTraceCtx = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .stBufList = LIST_HEAD_INIT(g_stTraceCtx.stBufList),
+};
+
+static pthread_once_t g_traceOnce = PTHREAD_ONCE_INIT;
+static __thread RKADK_TRACE_BUF_S *g_pstTraceBuf = NULL;
+
+static void RKADK_TRACE_Detach(void *arg) {
+  RKADK_TRACE_BUF_S *pstBuf = (RKADK_TRACE_BUF_S *)arg;
+
+  pthread_mutex_lock(&g_stTraceCtx.mutex);
+#ifndef OS_RTT
+  pthread_getname_np(pstBuf->thread, pstBuf->name, sizeof(pstBuf->name));
+#endif
+  pstBuf->bExited = true;
+  pthread_mutex_unlock(&g_stTraceCtx.mutex);
+}
+
+static void RKADK_TRACE_AtExit(void) {
+  char *pcPath = getenv("rkadk_trace_dump");
+
+  if (pcPath)
+    RKADK_TRACE_Dump(pcPath);
+}
+
+static void RKADK_TRACE_Init(void) {
+  pthread_key_create(&g_stTraceCtx.key, RKADK_TRACE_Detach);
+  if (getenv("rkadk_trace_dump"))
+    atexit(RKADK_TRACE_AtExit);
+}
+
+static RKADK_TRACE_BUF_S *RKADK_TRACE_Attach(void) {
+  RKADK_TRACE_BUF_S *pstBuf = NULL, *pstTmp;
+
+  pthread_once(&g_traceOnce, RKADK_TRACE_Init);
+
+  pthread_mutex_lock(&g_stTraceCtx.mutex);
+  if (g_stTraceCtx.u32BufCnt >= RKADK_TRACE_BUF_MAX) {
+    list_for_each_entry(pstTmp, &g_stTraceCtx.stBufList, mark) {
+      if (pstTmp->bExited) {
+        pstBuf = pstTmp;
+        break;
+      }
+    }
+
+    if (!pstBuf) {
+      pthread_mutex_unlock(&g_stTraceCtx.mutex);
+      return NULL;
+    }
+    list_del(&pstBuf->mark);
+  } else {
+    pstBuf = (RKADK_TRACE_BUF_S *)malloc(sizeof(RKADK_TRACE_BUF_S));
+    if (!pstBuf) {
+      pthread_mutex_unlock(&g_stTraceCtx.mutex);
+      return NULL;
+    }
+    g_stTraceCtx.u32BufCnt++;
+  }
+
+  memset(pstBuf, 0, sizeof(RKADK_TRACE_BUF_S));
+  pstBuf->thread = pthread_self();
+#ifndef OS_RTT
+  pstBuf->u32Tid = (uint32_t)syscall(SYS_gettid);
+#else
+  pstBuf->u32Tid = g_stTraceCtx.u32BufCnt;
+#endif
+  list_add_tail(&pstBuf->mark, &g_stTraceCtx.stBufList);
+  pthread_mutex_unlock(&g_stTraceCtx.mutex);
+
+  pthread_setspecific(g_stTraceCtx.key, pstBuf);
+  return pstBuf;
+}
+
+void RKADK_TRACE_Record(uint16_t u16Id, uint16_t u16Chn, uint32_t u32Seq,
+                        uint64_t u64Pts) {
+  struct timespec ts;
+  uint32_t u32Head;
+  RKADK_TRACE_REC_S *pstRec;
+  RKADK_TRACE_BUF_S *pstBuf = g_pstTraceBuf;
+
+  if (!pstBuf) {
+    pstBuf = RKADK_TRACE_Attach();
+    if (!pstBuf)
+      return;
+    g_pstTraceBuf = pstBuf;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  u32Head = pstBuf->u32Head;
+  pstRec = &pstBuf->stRec[u32Head & (RKADK_TRACE_REC_CNT - 1)];
+  pstRec->u64TimeNs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  pstRec->u64Pts = u64Pts;
+  pstRec->u32Seq = u32Seq;
+  pstRec->u16Id = u16Id;
+  pstRec->u16Chn = u16Chn;
+  __atomic_store_n(&pstBuf->u32Head, u32Head + 1, __ATOMIC_RELEASE);
+}
+
+int RKADK_TRACE_Dump(const char *pcPath) {
+  FILE *fp;
+  uint32_t u32Head, u32Start, u32Cnt;
+  RKADK_TRACE_FILE_HDR_S stFileHdr;
+  RKADK_TRACE_BUF_HDR_S stBufHdr;
+  RKADK_TRACE_BUF_S *pstBuf;
+  int ret = 0;
+
+  if (!pcPath)
+    return -1;
+
+  fp = fopen(pcPath, "wb");
+  if (!fp) {
+    RKADK_LOGE("open %s failed", pcPath);
+    return -1;
+  }
+
+  pthread_mutex_lock(&g_stTraceCtx.mutex);
+  memset(&stFileHdr, 0, sizeof(stFileHdr));
+  stFileHdr.u32Magic = RKADK_TRACE_MAGIC;
+  stFileHdr.u32Version = RKADK_TRACE_VERSION;
+  stFileHdr.u32BufCnt = g_stTraceCtx.u32BufCnt;
+  stFileHdr.u32RecSize = sizeof(RKADK_TRACE_REC_S);
+  if (fwrite(&stFileHdr, sizeof(stFileHdr), 1, fp) != 1)
+    ret = -1;
+
+  list_for_each_entry(pstBuf, &g_stTraceCtx.stBufList, mark) {
+    if (ret)
+      break;
+
+    u32Head = __atomic_load_n(&pstBuf->u32Head, __ATOMIC_ACQUIRE);
+    u32Cnt = u32Head < RKADK_TRACE_REC_CNT ? u32Head : RKADK_TRACE_REC_CNT;
+    u32Start = (u32Head - u32Cnt) & (RKADK_TRACE_REC_CNT - 1);
+
+    memset(&stBufHdr, 0, sizeof(stBufHdr));
+    stBufHdr.u32Tid = pstBuf->u32Tid;
+    stBufHdr.u32RecCnt = u32Cnt;
+#ifndef OS_RTT
+    if (!pstBuf->bExited)
+      pthread_getname_np(pstBuf->thread, pstBuf->name, sizeof(pstBuf->name));
+#endif
+    memcpy(stBufHdr.name, pstBuf->name, sizeof(stBufHdr.name));
+
+    // oldest first, the ring may wrap once
+    if (fwrite(&stBufHdr, sizeof(stBufHdr), 1, fp) != 1) {
+      ret = -1;
+    } else if (u32Start + u32Cnt <= RKADK_TRACE_REC_CNT) {
+      if (fwrite(&pstBuf->stRec[u32Start], sizeof(RKADK_TRACE_REC_S), u32Cnt, fp) != u32Cnt)
+        ret = -1;
+    } else {
+      uint32_t u32Tail = RKADK_TRACE_REC_CNT - u32Start;
+
+      if (fwrite(&pstBuf->stRec[u32Start], sizeof(RKADK_TRACE_REC_S), u32Tail, fp) != u32Tail ||
+          fwrite(&pstBuf->stRec[0], sizeof(RKADK_TRACE_REC_S), u32Cnt - u32Tail, fp) != u32Cnt - u32Tail)
+        ret = -1;
+    }
+  }
+  pthread_mutex_unlock(&g_stTraceCtx.mutex);
+
+  fclose(fp);
+  if (ret)
+    RKADK_LOGE("write %s failed", pcPath);
+  else
+    RKADK_LOGI("trace dumped to %s", pcPath);
+
+  return ret;
+}
+
+#endif
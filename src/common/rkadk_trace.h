@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef __RKADK_TRACE_H__
+#define __RKADK_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Frame path trace points. The ids are part of the dump format, append new
+ * ones before RKADK_TRACE_EVT_BUTT and keep tools/rkadk_trace2json.py in sync.
+ */
+typedef enum {
+  RKADK_TRACE_EVT_VENC_GET = 0,       // RK_MPI_VENC_GetStream returned a packet
+  RKADK_TRACE_EVT_VENC_RELEASE,       // consumers done, packet released
+  RKADK_TRACE_EVT_MUXER_QUEUE,        // packet queued to the muxer thread
+  RKADK_TRACE_EVT_MUXER_WRITE_BEGIN,  // rkmuxer_write_video_frame enter
+  RKADK_TRACE_EVT_MUXER_WRITE_END,    // rkmuxer_write_video_frame return
+  RKADK_TRACE_EVT_RTSP_QUEUE,         // packet queued to the rtsp thread
+  RKADK_TRACE_EVT_RTSP_SEND,          // rtsp_tx_video done
+  RKADK_TRACE_EVT_VDEC_GET,           // RK_MPI_VDEC_GetFrame returned a frame
+  RKADK_TRACE_EVT_VO_SEND,            // frame sent to vo
+  RKADK_TRACE_EVT_BUTT
+} RKADK_TRACE_EVT_E;
+
+/* 24 bytes, little endian, written as is to the dump */
+typedef struct {
+  uint64_t u64TimeNs; // CLOCK_MONOTONIC
+  uint64_t u64Pts;
+  uint32_t u32Seq;
+  uint16_t u16Id;
+  uint16_t u16Chn;
+} RKADK_TRACE_REC_S;
+
+#ifdef RKADK_TRACE_ENABLE
+
+void RKADK_TRACE_Record(uint16_t u16Id, uint16_t u16Chn, uint32_t u32Seq,
+                        uint64_t u64Pts);
+
+/*
+ * Writes the buffers of all threads to pcPath. Threads keep recording
+ * while dumping, a record being overwritten at that time may be torn.
+ * If the "rkadk_trace_dump" environment variable is set, the buffers are
+ * also dumped to that path at exit.
+ */
+int RKADK_TRACE_Dump(const char *pcPath);
+
+#define RKADK_TRACE_EVT(id, chn, seq, pts)                                     \
+  RKADK_TRACE_Record((uint16_t)(id), (uint16_t)(chn), (uint32_t)(seq),         \
+                     (uint64_t)(pts))
+
+#else
+
+#define RKADK_TRACE_EVT(id, chn, seq, pts)                                     \
+  do {                                                                         \
+  } while (0)
+
+static inline int RKADK_TRACE_Dump(const char *pcPath) {
+  (void)pcPath;
+  return -1;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
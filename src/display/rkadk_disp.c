@@ -22,16 +22,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#define DISP_VPSS_TIMEOUT_MS 1000
+/* vpss wait while a frame waits for vo, the vo retry period */
+#define DISP_RETRY_MS 5
+/* frames of the old size skipped at most after RKADK_DISP_SetAttr */
+#define DISP_STALE_FRAME_MAX 8
 
 typedef struct {
   bool bInit;
   RKADK_U32 u32CamId;
   bool bSendBuffer;
   pthread_t tid; //send frame to vo thread
+  pthread_mutex_t voMutex; // held by RKADK_DISP_SetAttr while vo is reconfigured
+  RKADK_U32 u32AttrGen;    // bumped by RKADK_DISP_SetAttr
+  RKADK_U32 u32Width;      // vpss output size set by RKADK_DISP_SetAttr, 0: any
+  RKADK_U32 u32Height;
+  RKADK_DISP_STATS_S stStats;
 } RKADK_DISP_HANDLE_S;
 
 static RKADK_DISP_HANDLE_S stDispHandle = {
-    .bInit = false, .u32CamId = 0, .bSendBuffer = false, .tid= 0};
+    .bInit = false, .u32CamId = 0, .bSendBuffer = false, .tid= 0,
+    .voMutex = PTHREAD_MUTEX_INITIALIZER};
 
 static int RKADK_DISP_CreateVo(RKADK_U32 VoLayer, RKADK_U32 VoDev,
                                RKADK_PARAM_DISP_CFG_S *pstDispCfg) {
@@ -223,9 +234,49 @@ static bool RKADK_DISP_CheckRect(RKADK_RECT_S stRect,
   return true;
 }
 
+static void RKADK_DISP_ReleaseFrame(RKADK_PARAM_DISP_CFG_S *pstDispCfg,
+                                    VIDEO_FRAME_INFO_S *pstFrame) {
+  int s32Ret;
+
+  s32Ret = RK_MPI_VPSS_ReleaseChnFrame(pstDispCfg->vpss_grp, pstDispCfg->vpss_chn, pstFrame);
+  if (s32Ret != RK_SUCCESS)
+    RKADK_LOGE("RK_MPI_VPSS_ReleaseChnFrame failed[%x]", s32Ret);
+}
+
+/* never waits for vo, a refused frame is retried or replaced by the next one */
+static bool RKADK_DISP_SendFrame(RKADK_DISP_HANDLE_S *pstDispHandle,
+                                 RKADK_PARAM_DISP_CFG_S *pstDispCfg,
+                                 VIDEO_FRAME_INFO_S *pstFrame) {
+  int s32Ret;
+
+  // vo is being reconfigured
+  if (pthread_mutex_trylock(&pstDispHandle->voMutex))
+    return false;
+
+  s32Ret = RK_MPI_VO_SendFrame(pstDispCfg->vo_layer, pstDispCfg->vo_chn, pstFrame, 0);
+  pthread_mutex_unlock(&pstDispHandle->voMutex);
+  if (s32Ret != RK_SUCCESS) {
+    if (pstDispHandle->stStats.u32BusyCnt % 100 == 0)
+      RKADK_LOGD("RK_MPI_VO_SendFrame refused[%x], busy cnt: %d", s32Ret,
+                 pstDispHandle->stStats.u32BusyCnt);
+    pstDispHandle->stStats.u32BusyCnt++;
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Feeds vo without ever holding vpss back: frames are taken as soon as they
+ * come, thinned to the panel refresh, and only the latest one waits for vo.
+ * Frames are passed by their mb, vo takes its own reference.
+ */
 static void *RKADK_DISP_GetVpssMb(void *arg) {
   int s32Ret;
-  VIDEO_FRAME_INFO_S stVideoFrame;
+  bool bPending = false, bSkip;
+  RKADK_U32 u32Gen, u32Stale = 0, u32PeriodUs = 0;
+  RKADK_U64 u64Pts, u64NextPts = 0;
+  VIDEO_FRAME_INFO_S stVideoFrame, stPendingFrame;
 
   RKADK_DISP_HANDLE_S *pstDispHandle = (RKADK_DISP_HANDLE_S *)arg;
   if (!pstDispHandle) {
@@ -239,23 +290,75 @@ static void *RKADK_DISP_GetVpssMb(void *arg) {
     return NULL;
   }
 
+  if (pstDispCfg->frame_rate > 0)
+    u32PeriodUs = 1000000 / pstDispCfg->frame_rate;
+  u32Gen = __atomic_load_n(&pstDispHandle->u32AttrGen, __ATOMIC_ACQUIRE);
+
   while (pstDispHandle->bSendBuffer) {
-    s32Ret = RK_MPI_VPSS_GetChnFrame(pstDispCfg->vpss_grp, pstDispCfg->vpss_chn,
-                                      &stVideoFrame, 1000);
+    s32Ret = RK_MPI_VPSS_GetChnFrame(pstDispCfg->vpss_grp, pstDispCfg->vpss_chn, &stVideoFrame,
+                                     bPending ? DISP_RETRY_MS : DISP_VPSS_TIMEOUT_MS);
     if (s32Ret == RK_SUCCESS) {
-      s32Ret = RK_MPI_VO_SendFrame(pstDispCfg->vo_layer, pstDispCfg->vo_chn, &stVideoFrame, -1);
-      if (s32Ret != RK_SUCCESS)
-        RKADK_LOGE("RK_MPI_VO_SendFrame failed[%x]", s32Ret);
-
-      s32Ret = RK_MPI_VPSS_ReleaseChnFrame(pstDispCfg->vpss_grp, pstDispCfg->vpss_chn, &stVideoFrame);
-      if (s32Ret != RK_SUCCESS)
-        RKADK_LOGE("RK_MPI_VPSS_ReleaseChnFrame failed[%x]", s32Ret);
-    } else {
+      if (u32Gen != __atomic_load_n(&pstDispHandle->u32AttrGen, __ATOMIC_ACQUIRE)) {
+        u32Gen = __atomic_load_n(&pstDispHandle->u32AttrGen, __ATOMIC_ACQUIRE);
+        u32Stale = DISP_STALE_FRAME_MAX;
+        u64NextPts = 0;
+        if (bPending) {
+          RKADK_DISP_ReleaseFrame(pstDispCfg, &stPendingFrame);
+          pstDispHandle->stStats.u32StaleCnt++;
+          bPending = false;
+        }
+      }
+
+      // vpss may still hold frames cropped before the new attr
+      if (u32Stale && pstDispHandle->u32Width &&
+          (stVideoFrame.stVFrame.u32Width != pstDispHandle->u32Width ||
+           stVideoFrame.stVFrame.u32Height != pstDispHandle->u32Height)) {
+        RKADK_DISP_ReleaseFrame(pstDispCfg, &stVideoFrame);
+        pstDispHandle->stStats.u32StaleCnt++;
+        u32Stale--;
+      } else {
+        u32Stale = 0;
+
+        // a pts far behind the schedule is a reset, take it
+        u64Pts = stVideoFrame.stVFrame.u64PTS;
+        bSkip = u32PeriodUs && u64Pts + u32PeriodUs / 4 < u64NextPts &&
+                u64NextPts < u64Pts + 2 * u32PeriodUs;
+        if (bSkip) {
+          RKADK_DISP_ReleaseFrame(pstDispCfg, &stVideoFrame);
+          pstDispHandle->stStats.u32SkipCnt++;
+        } else {
+          if (u64NextPts + u32PeriodUs > u64Pts && u64NextPts < u64Pts + 2 * u32PeriodUs)
+            u64NextPts += u32PeriodUs;
+          else
+            u64NextPts = u64Pts + u32PeriodUs;
+
+          if (bPending) {
+            RKADK_DISP_ReleaseFrame(pstDispCfg, &stPendingFrame);
+            pstDispHandle->stStats.u32DropCnt++;
+          }
+          memcpy(&stPendingFrame, &stVideoFrame, sizeof(VIDEO_FRAME_INFO_S));
+          bPending = true;
+        }
+      }
+    } else if (!bPending) {
       RKADK_LOGE("RK_MPI_VPSS_GetChnFrame[%d, %d] timeout[%x]",
                 pstDispCfg->vpss_grp, pstDispCfg->vpss_chn, s32Ret);
     }
+
+    if (bPending && RKADK_DISP_SendFrame(pstDispHandle, pstDispCfg, &stPendingFrame)) {
+      RKADK_DISP_ReleaseFrame(pstDispCfg, &stPendingFrame);
+      pstDispHandle->stStats.u32PresentCnt++;
+      bPending = false;
+    }
   }
 
+  if (bPending)
+    RKADK_DISP_ReleaseFrame(pstDispCfg, &stPendingFrame);
+
+  RKADK_LOGI("Display present: %d, drop: %d, skip: %d, stale: %d, vo busy: %d",
+             pstDispHandle->stStats.u32PresentCnt, pstDispHandle->stStats.u32DropCnt,
+             pstDispHandle->stStats.u32SkipCnt, pstDispHandle->stStats.u32StaleCnt,
+             pstDispHandle->stStats.u32BusyCnt);
   RKADK_LOGD("Exit!");
   return NULL;
 }
@@ -304,6 +407,9 @@ RKADK_S32 RKADK_DISP_Init(RKADK_U32 u32CamId) {
   }
 
   stDispHandle.u32CamId = u32CamId;
+  stDispHandle.u32Width = 0;
+  stDispHandle.u32Height = 0;
+  memset(&stDispHandle.stStats, 0, sizeof(RKADK_DISP_STATS_S));
 #if defined(RV1106_1103) || defined(RV1103B)
   char name[RKADK_THREAD_NAME_LEN];
   stDispHandle.bSendBuffer = true;
@@ -425,25 +531,13 @@ RKADK_S32 RKADK_DISP_DeInit(RKADK_U32 u32CamId) {
   return 0;
 }
 
-RKADK_S32 RKADK_DISP_SetAttr(RKADK_U32 u32CamId, RKADK_DISP_ATTR_S *pstAttr) {
+static RKADK_S32 RKADK_DISP_Reconfig(RKADK_PARAM_DISP_CFG_S *pstDispCfg,
+                                     RKADK_DISP_ATTR_S *pstAttr) {
   int ret;
   VO_CHN_ATTR_S stVoChnAttr;
   VPSS_CHN_ATTR_S stVpssChnAttr;
   VPSS_CROP_INFO_S stVpssCropInfo;
 
-  RKADK_CHECK_CAMERAID(u32CamId, RKADK_FAILURE);
-  RKADK_CHECK_POINTER(pstAttr, RKADK_FAILURE);
-
-  RKADK_PARAM_DISP_CFG_S *pstDispCfg = RKADK_PARAM_GetDispCfg(u32CamId);
-  if (!pstDispCfg) {
-    RKADK_LOGE("RKADK_PARAM_GetDispCfg[%d] failed", u32CamId);
-    return -1;
-  }
-
-  if ((!RKADK_DISP_CheckRect(pstAttr->stVpssCropRect, pstDispCfg, true) ||
-      !RKADK_DISP_CheckRect(pstAttr->stVoRect, pstDispCfg, false)))
-    return -1;
-
   ret = RK_MPI_VO_PauseChn(pstDispCfg->vo_layer, pstDispCfg->vo_chn);
   if (ret) {
     RKADK_LOGE("Pause vo [layer: %d, chn: %d] failed!, ret: %x",
@@ -521,6 +615,35 @@ RKADK_S32 RKADK_DISP_SetAttr(RKADK_U32 u32CamId, RKADK_DISP_ATTR_S *pstAttr) {
     return ret;
   }
 
+  return 0;
+}
+
+RKADK_S32 RKADK_DISP_SetAttr(RKADK_U32 u32CamId, RKADK_DISP_ATTR_S *pstAttr) {
+  int ret;
+
+  RKADK_CHECK_CAMERAID(u32CamId, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstAttr, RKADK_FAILURE);
+
+  RKADK_PARAM_DISP_CFG_S *pstDispCfg = RKADK_PARAM_GetDispCfg(u32CamId);
+  if (!pstDispCfg) {
+    RKADK_LOGE("RKADK_PARAM_GetDispCfg[%d] failed", u32CamId);
+    return -1;
+  }
+
+  if ((!RKADK_DISP_CheckRect(pstAttr->stVpssCropRect, pstDispCfg, true) ||
+      !RKADK_DISP_CheckRect(pstAttr->stVoRect, pstDispCfg, false)))
+    return -1;
+
+  // the feeder keeps running, it skips vo and drops the old size frames meanwhile
+  pthread_mutex_lock(&stDispHandle.voMutex);
+  ret = RKADK_DISP_Reconfig(pstDispCfg, pstAttr);
+  stDispHandle.u32Width = ret ? 0 : pstAttr->stVpssCropRect.u32Width;
+  stDispHandle.u32Height = ret ? 0 : pstAttr->stVpssCropRect.u32Height;
+  __atomic_add_fetch(&stDispHandle.u32AttrGen, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&stDispHandle.voMutex);
+  if (ret)
+    return ret;
+
   RKADK_LOGD("Set attr vpss rect: [%d, %d, %d, %d], vo rect: [%d, %d, %d, %d]",
               pstAttr->stVpssCropRect.u32X, pstAttr->stVpssCropRect.u32Y,
               pstAttr->stVpssCropRect.u32Width, pstAttr->stVpssCropRect.u32Height,
@@ -529,3 +652,16 @@ RKADK_S32 RKADK_DISP_SetAttr(RKADK_U32 u32CamId, RKADK_DISP_ATTR_S *pstAttr) {
 
   return 0;
 }
+
+RKADK_S32 RKADK_DISP_GetStats(RKADK_U32 u32CamId, RKADK_DISP_STATS_S *pstStats) {
+  RKADK_CHECK_CAMERAID(u32CamId, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+
+  if (!stDispHandle.bInit || stDispHandle.u32CamId != u32CamId) {
+    RKADK_LOGE("Disp u32CamId[%d] not initialized", u32CamId);
+    return -1;
+  }
+
+  memcpy(pstStats, &stDispHandle.stStats, sizeof(RKADK_DISP_STATS_S));
+  return 0;
+}
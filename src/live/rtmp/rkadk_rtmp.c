@@ -20,18 +20,72 @@
 #include "rkadk_media_comm.h"
 #include "rkadk_param.h"
 #include "rkadk_audio_encoder.h"
+#include "rkadk_signal.h"
+#include "rkadk_thread.h"
+#include "linux_list.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+/* queued packets hold venc stream buffers, limit to a part of the buffer count */
+#define RKADK_RTMP_PKT_QUEUE_MAX 64
+
+/* send thread wait interval when no packet arrives, unit: ms */
+#define RKADK_RTMP_WAIT_INTERVAL 100
+
+/* reconnect backoff, doubled on each failure, unit: ms */
+#define RKADK_RTMP_RETRY_MIN 500
+#define RKADK_RTMP_RETRY_MAX 16000
+
+/* bitrate adaptation, unit: ms */
+#define RKADK_RTMP_BITRATE_DOWN_INTERVAL 1000
+#define RKADK_RTMP_BITRATE_UP_INTERVAL 5000
+
+typedef struct {
+  struct list_head mark;
+  MB_BLK pMbBlk;
+  RKADK_U32 u32Offset;
+  RKADK_U32 u32Len;
+  RKADK_U64 u64Pts;
+  bool bVideo;
+  bool bKeyFrame;
+} RKADK_RTMP_PKT_S;
 
 typedef struct {
   bool bVencChnMux;
+  bool bConnected;
+  bool bDropToIdr;
   RKADK_U32 u32CamId;
   RKADK_U32 u32MuxerId;
+  RKADK_U32 u32VencChn;
+  RKADK_U32 u32PktCnt;
+  RKADK_U32 u32PktMax;
+  RKADK_U32 u32DropCnt;
+  RKADK_U32 u32TxVideoCnt;
+  RKADK_U32 u32TxAudioCnt;
+  RKADK_U32 u32ReconnectCnt;
+  RKADK_U32 u32Bitrate;
+  RKADK_U32 u32RetryInterval;
+  RKADK_U64 u64TxBytes;
+  RKADK_U64 u64RetryTime;
+  RKADK_U64 u64BitrateTime;
+  char path[RKADK_PATH_LEN];
   VideoParam stVideo;
   AudioParam stAudio;
+  struct list_head stPktList;
+  pthread_mutex_t mutex;
+  void *pSignal;
+  void *pThread;
 } RKADK_RTMP_HANDLE_S;
 
+static RKADK_U64 RKADK_RTMP_GetTimeMs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (RKADK_U64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static void RKADK_RTMP_AudioSetChn(MPP_CHN_S *pstAiChn, MPP_CHN_S *pstAencChn) {
   pstAiChn->enModId = RK_ID_AI;
   pstAiChn->s32DevId = 0;
@@ -489,20 +543,384 @@ static RKADK_S32 RKADK_RTMP_InitMuxer(RKADK_U32 u32CamId, char *path,
   return 0;
 }
 
+static void RKADK_RTMP_PktFree(RKADK_RTMP_PKT_S *pstPkt) {
+  int ret;
+
+  list_del_init(&pstPkt->mark);
+  if (pstPkt->pMbBlk) {
+    ret = RK_MPI_MB_ReleaseMB(pstPkt->pMbBlk);
+    if (ret != RK_SUCCESS)
+      RKADK_LOGE("RK_MPI_MB_ReleaseMB failed[%x]", ret);
+  }
+
+  free(pstPkt);
+}
+
+// mutex must be held
+static void RKADK_RTMP_PktFlush(RKADK_RTMP_HANDLE_S *pHandle, bool bVideoOnly) {
+  RKADK_RTMP_PKT_S *pstPkt = NULL, *pstPkt_n = NULL;
+
+  list_for_each_entry_safe(pstPkt, pstPkt_n, &pHandle->stPktList, mark) {
+    if (bVideoOnly && !pstPkt->bVideo)
+      continue;
+
+    RKADK_RTMP_PktFree(pstPkt);
+    pHandle->u32PktCnt--;
+    pHandle->u32DropCnt++;
+  }
+
+  pHandle->bDropToIdr = true;
+}
+
+static int RKADK_RTMP_PktPush(RKADK_RTMP_HANDLE_S *pHandle, MB_BLK pMbBlk,
+                              RKADK_U32 u32Offset, RKADK_U32 u32Len,
+                              RKADK_U64 u64Pts, bool bVideo, bool bKeyFrame) {
+  RKADK_RTMP_PKT_S *pstPkt;
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  // the send thread is reconnecting, nothing to send to
+  if (!pHandle->bConnected)
+    goto drop;
+
+  // the network falls behind, skip video up to the next key frame
+  if (pHandle->u32PktCnt >= pHandle->u32PktMax) {
+    RKADK_LOGW("Rtmp[%d] send queue full, drop to next key frame, dropped: %d",
+               pHandle->u32CamId, pHandle->u32DropCnt);
+    RKADK_RTMP_PktFlush(pHandle, true);
+  }
+
+  if (bVideo) {
+    if (bKeyFrame)
+      pHandle->bDropToIdr = false;
+    else if (pHandle->bDropToIdr)
+      goto drop;
+  }
+
+  if (pHandle->u32PktCnt >= pHandle->u32PktMax)
+    goto drop;
+
+  pstPkt = (RKADK_RTMP_PKT_S *)malloc(sizeof(RKADK_RTMP_PKT_S));
+  if (!pstPkt) {
+    RKADK_LOGE("malloc rtmp packet failed");
+    goto drop;
+  }
+
+  INIT_LIST_HEAD(&pstPkt->mark);
+  pstPkt->pMbBlk = pMbBlk;
+  pstPkt->u32Offset = u32Offset;
+  pstPkt->u32Len = u32Len;
+  pstPkt->u64Pts = u64Pts;
+  pstPkt->bVideo = bVideo;
+  pstPkt->bKeyFrame = bKeyFrame;
+  RK_MPI_MB_AddUserCnt(pMbBlk);
+
+  list_add_tail(&pstPkt->mark, &pHandle->stPktList);
+  pHandle->u32PktCnt++;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  RKADK_SIGNAL_Give(pHandle->pSignal);
+  return 0;
+
+drop:
+  pHandle->u32DropCnt++;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+  return -1;
+}
+
+static RKADK_RTMP_PKT_S *RKADK_RTMP_PktPop(RKADK_RTMP_HANDLE_S *pHandle,
+                                           RKADK_U32 *pu32PktCnt) {
+  RKADK_RTMP_PKT_S *pstPkt = NULL;
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  if (!list_empty(&pHandle->stPktList)) {
+    pstPkt = list_first_entry(&pHandle->stPktList, RKADK_RTMP_PKT_S, mark);
+    list_del_init(&pstPkt->mark);
+    pHandle->u32PktCnt--;
+  }
+  *pu32PktCnt = pHandle->u32PktCnt;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  return pstPkt;
+}
+
+static int RKADK_RTMP_TxPkt(RKADK_RTMP_HANDLE_S *pHandle,
+                            RKADK_RTMP_PKT_S *pstPkt) {
+  int ret;
+  RKADK_U8 *data;
+
+  data = (RKADK_U8 *)RK_MPI_MB_Handle2VirAddr(pstPkt->pMbBlk);
+  if (!data) {
+    RKADK_LOGE("RK_MPI_MB_Handle2VirAddr failed");
+    return 0;
+  }
+
+  data += pstPkt->u32Offset;
+  if (pstPkt->bVideo)
+    ret = rkmuxer_write_video_frame(pHandle->u32MuxerId, data, pstPkt->u32Len,
+                                    pstPkt->u64Pts, pstPkt->bKeyFrame);
+  else
+    ret = rkmuxer_write_audio_frame(pHandle->u32MuxerId, data, pstPkt->u32Len,
+                                    pstPkt->u64Pts);
+  if (ret < 0)
+    return ret;
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  if (pstPkt->bVideo)
+    pHandle->u32TxVideoCnt++;
+  else
+    pHandle->u32TxAudioCnt++;
+  pHandle->u64TxBytes += pstPkt->u32Len;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+  return 0;
+}
+
+static void RKADK_RTMP_Disconnect(RKADK_RTMP_HANDLE_S *pHandle) {
+  RKADK_LOGW("Rtmp[%d, %s] disconnected", pHandle->u32CamId, pHandle->path);
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  pHandle->bConnected = false;
+  RKADK_RTMP_PktFlush(pHandle, false);
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  rkmuxer_deinit(pHandle->u32MuxerId);
+  pHandle->u32RetryInterval = RKADK_RTMP_RETRY_MIN;
+  pHandle->u64RetryTime = RKADK_RTMP_GetTimeMs() + pHandle->u32RetryInterval;
+}
+
+static void RKADK_RTMP_Reconnect(RKADK_RTMP_HANDLE_S *pHandle) {
+  int ret;
+
+  if (RKADK_RTMP_GetTimeMs() < pHandle->u64RetryTime)
+    return;
+
+  ret = rkmuxer_init(pHandle->u32MuxerId, (char *)"flv", pHandle->path,
+                     &pHandle->stVideo, &pHandle->stAudio);
+  if (ret) {
+    pHandle->u32RetryInterval *= 2;
+    if (pHandle->u32RetryInterval > RKADK_RTMP_RETRY_MAX)
+      pHandle->u32RetryInterval = RKADK_RTMP_RETRY_MAX;
+
+    RKADK_LOGW("Rtmp[%d, %s] reconnect failed[%d], retry after %dms",
+               pHandle->u32CamId, pHandle->path, ret,
+               pHandle->u32RetryInterval);
+    pHandle->u64RetryTime = RKADK_RTMP_GetTimeMs() + pHandle->u32RetryInterval;
+    return;
+  }
+
+  // flv stream must restart from a key frame
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  pHandle->bConnected = true;
+  pHandle->bDropToIdr = true;
+  pHandle->u32ReconnectCnt++;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  ret = RK_MPI_VENC_RequestIDR(pHandle->u32VencChn, RK_FALSE);
+  if (ret != RK_SUCCESS)
+    RKADK_LOGW("RK_MPI_VENC_RequestIDR venc[%d] failed[%x]",
+               pHandle->u32VencChn, ret);
+
+  RKADK_LOGI("Rtmp[%d, %s] reconnected", pHandle->u32CamId, pHandle->path);
+}
+
+static int RKADK_RTMP_SetBitrate(RKADK_RTMP_HANDLE_S *pHandle,
+                                 RKADK_U32 u32Bitrate) {
+  int ret;
+  RKADK_U32 u32DstFrameRate;
+  VENC_CHN_ATTR_S stVencChnAttr;
+  RKADK_PARAM_SENSOR_CFG_S *pstSensorCfg = NULL;
+  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg = NULL;
+
+  pstSensorCfg = RKADK_PARAM_GetSensorCfg(pHandle->u32CamId);
+  pstLiveCfg = RKADK_PARAM_GetStreamCfg(pHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
+  if (!pstSensorCfg || !pstLiveCfg) {
+    RKADK_LOGE("Get sensor or live param failed");
+    return -1;
+  }
+
+  ret = RK_MPI_VENC_GetChnAttr(pHandle->u32VencChn, &stVencChnAttr);
+  if (ret != RK_SUCCESS) {
+    RKADK_LOGE("RK_MPI_VENC_GetChnAttr venc[%d] failed[%x]",
+               pHandle->u32VencChn, ret);
+    return -1;
+  }
+
+  u32DstFrameRate = pstLiveCfg->attribute.framerate;
+  if (u32DstFrameRate > pstSensorCfg->framerate)
+    u32DstFrameRate = pstSensorCfg->framerate;
+
+  ret = RKADK_MEDIA_SetRcAttr(&stVencChnAttr.stRcAttr, pstLiveCfg->attribute.gop,
+                              u32Bitrate, pstSensorCfg->framerate,
+                              u32DstFrameRate);
+  if (ret) {
+    RKADK_LOGE("RKADK_MEDIA_SetRcAttr failed");
+    return -1;
+  }
+
+  ret = RK_MPI_VENC_SetChnAttr(pHandle->u32VencChn, &stVencChnAttr);
+  if (ret != RK_SUCCESS) {
+    RKADK_LOGE("RK_MPI_VENC_SetChnAttr venc[%d] failed[%x]",
+               pHandle->u32VencChn, ret);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Lower the live venc bitrate while the send queue keeps growing and restore
+ * it step by step once the queue drains. The shared venc of record/preview
+ * is left alone.
+ */
+static void RKADK_RTMP_AdjustBitrate(RKADK_RTMP_HANDLE_S *pHandle,
+                                     RKADK_U32 u32PktCnt) {
+  RKADK_U32 u32Bitrate, u32CfgBitrate;
+  RKADK_U64 u64Now, u64Elapsed;
+  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg = NULL;
+
+  if (pHandle->bVencChnMux)
+    return;
+
+  pstLiveCfg = RKADK_PARAM_GetStreamCfg(pHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
+  if (!pstLiveCfg)
+    return;
+
+  u32CfgBitrate = pstLiveCfg->attribute.bitrate;
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  u32Bitrate = pHandle->u32Bitrate ? pHandle->u32Bitrate : u32CfgBitrate;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  u64Now = RKADK_RTMP_GetTimeMs();
+  u64Elapsed = u64Now - pHandle->u64BitrateTime;
+  if (u32PktCnt >= pHandle->u32PktMax / 2) {
+    if (u64Elapsed < RKADK_RTMP_BITRATE_DOWN_INTERVAL ||
+        u32Bitrate <= u32CfgBitrate / 4)
+      return;
+
+    u32Bitrate = u32Bitrate * 3 / 4;
+    if (u32Bitrate < u32CfgBitrate / 4)
+      u32Bitrate = u32CfgBitrate / 4;
+  } else if (u32PktCnt <= pHandle->u32PktMax / 8) {
+    if (u64Elapsed < RKADK_RTMP_BITRATE_UP_INTERVAL || u32Bitrate >= u32CfgBitrate)
+      return;
+
+    u32Bitrate += u32CfgBitrate / 8;
+    if (u32Bitrate > u32CfgBitrate)
+      u32Bitrate = u32CfgBitrate;
+  } else {
+    return;
+  }
+
+  pHandle->u64BitrateTime = u64Now;
+  if (RKADK_RTMP_SetBitrate(pHandle, u32Bitrate))
+    return;
+
+  RKADK_LOGI("Rtmp[%d] queue: %d, venc[%d] bitrate: %d", pHandle->u32CamId,
+             u32PktCnt, pHandle->u32VencChn, u32Bitrate);
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  pHandle->u32Bitrate = u32Bitrate;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+}
+
+static bool RKADK_RTMP_SendProc(void *params) {
+  RKADK_U32 u32PktCnt = 0;
+  RKADK_RTMP_PKT_S *pstPkt;
+  RKADK_RTMP_HANDLE_S *pHandle = (RKADK_RTMP_HANDLE_S *)params;
+
+  if (!pHandle->bConnected) {
+    RKADK_RTMP_Reconnect(pHandle);
+    if (!pHandle->bConnected) {
+      RKADK_SIGNAL_Wait(pHandle->pSignal, RKADK_RTMP_RETRY_MIN);
+      return true;
+    }
+  }
+
+  pstPkt = RKADK_RTMP_PktPop(pHandle, &u32PktCnt);
+  if (!pstPkt) {
+    RKADK_RTMP_AdjustBitrate(pHandle, 0);
+    RKADK_SIGNAL_Wait(pHandle->pSignal, RKADK_RTMP_WAIT_INTERVAL);
+    return true;
+  }
+
+  if (RKADK_RTMP_TxPkt(pHandle, pstPkt)) {
+    RKADK_RTMP_PktFree(pstPkt);
+    RKADK_RTMP_Disconnect(pHandle);
+    return true;
+  }
+
+  RKADK_RTMP_PktFree(pstPkt);
+  RKADK_RTMP_AdjustBitrate(pHandle, u32PktCnt);
+  return true;
+}
+
+static int RKADK_RTMP_InitSender(RKADK_RTMP_HANDLE_S *pHandle) {
+  RKADK_U32 u32BufCnt;
+  char name[RKADK_THREAD_NAME_LEN];
+
+  u32BufCnt = RKADK_PARAM_GetStreamBufCnt(pHandle->u32CamId, false);
+  pHandle->u32PktMax = u32BufCnt / 4;
+  if (pHandle->u32PktMax > RKADK_RTMP_PKT_QUEUE_MAX)
+    pHandle->u32PktMax = RKADK_RTMP_PKT_QUEUE_MAX;
+  else if (pHandle->u32PktMax < 2)
+    pHandle->u32PktMax = 2;
+
+  INIT_LIST_HEAD(&pHandle->stPktList);
+  pthread_mutex_init(&pHandle->mutex, NULL);
+  pHandle->bDropToIdr = true;
+  pHandle->u64BitrateTime = RKADK_RTMP_GetTimeMs();
+
+  pHandle->pSignal = RKADK_SIGNAL_Create(0, 1);
+  if (!pHandle->pSignal) {
+    RKADK_LOGE("RKADK_SIGNAL_Create failed");
+    goto failed;
+  }
+
+  snprintf(name, sizeof(name), "RtmpSend_%d", pHandle->u32CamId);
+  pHandle->pThread = RKADK_THREAD_Create(RKADK_RTMP_SendProc, pHandle, name);
+  if (!pHandle->pThread) {
+    RKADK_LOGE("RKADK_THREAD_Create failed");
+    RKADK_SIGNAL_Destroy(pHandle->pSignal);
+    pHandle->pSignal = NULL;
+    goto failed;
+  }
+
+  return 0;
+
+failed:
+  pthread_mutex_destroy(&pHandle->mutex);
+  return -1;
+}
+
+static void RKADK_RTMP_DeInitSender(RKADK_RTMP_HANDLE_S *pHandle) {
+  if (pHandle->pThread) {
+    RKADK_THREAD_SetExit(pHandle->pThread);
+    RKADK_SIGNAL_Give(pHandle->pSignal);
+    RKADK_THREAD_Destory(pHandle->pThread);
+    pHandle->pThread = NULL;
+  }
+
+  if (pHandle->pSignal) {
+    RKADK_SIGNAL_Destroy(pHandle->pSignal);
+    pHandle->pSignal = NULL;
+  }
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  RKADK_RTMP_PktFlush(pHandle, false);
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+  pthread_mutex_destroy(&pHandle->mutex);
+}
+
 static void RKADK_RTMP_AencOutCb(AUDIO_STREAM_S stFrame,
                                  RKADK_VOID *pHandle) {
   int headerSize = 7;
   RKADK_CHECK_POINTER_N(pHandle);
   RKADK_RTMP_HANDLE_S *pstHandle = (RKADK_RTMP_HANDLE_S *)pHandle;
-  RKADK_U8 *data;
-  if (!pstHandle) {
-    RKADK_LOGE("Can't find rtmp handle");
+
+  if (stFrame.u32Len <= (RKADK_U32)headerSize)
     return;
-  }
 
-  data = (RKADK_U8 *)RK_MPI_MB_Handle2VirAddr(stFrame.pMbBlk);
-  rkmuxer_write_audio_frame(pstHandle->u32MuxerId, data + headerSize,
-                            stFrame.u32Len - headerSize, stFrame.u64TimeStamp);
+  RKADK_RTMP_PktPush(pstHandle, stFrame.pMbBlk, headerSize,
+                     stFrame.u32Len - headerSize, stFrame.u64TimeStamp,
+                     false, false);
 }
 
 static int RKADK_RTMP_AencGetData(RKADK_U32 u32CamId,
@@ -522,27 +940,18 @@ static int RKADK_RTMP_AencGetData(RKADK_U32 u32CamId,
 
 static void RKADK_RTMP_VencOutCb(RKADK_MEDIA_VENC_DATA_S stData,
                                  RKADK_VOID *pHandle) {
+  bool bKeyFrame;
   RKADK_CHECK_POINTER_N(pHandle);
   RKADK_RTMP_HANDLE_S *pstHandle = (RKADK_RTMP_HANDLE_S *)pHandle;
-  RKADK_U8 *data;
-  if (!pstHandle) {
-    RKADK_LOGE("Can't find rtmp handle");
-    return;
-  }
 
-  data = (RKADK_U8 *)RK_MPI_MB_Handle2VirAddr(stData.stFrame.pstPack->pMbBlk);
-  if ((stData.stFrame.pstPack->DataType.enH264EType == H264E_NALU_ISLICE ||
+  bKeyFrame = (stData.stFrame.pstPack->DataType.enH264EType == H264E_NALU_ISLICE ||
     stData.stFrame.pstPack->DataType.enH264EType == H264E_NALU_IDRSLICE) ||
     (stData.stFrame.pstPack->DataType.enH265EType == H265E_NALU_ISLICE ||
-    stData.stFrame.pstPack->DataType.enH265EType == H265E_NALU_IDRSLICE)) {
-    rkmuxer_write_video_frame(pstHandle->u32MuxerId, data,
-                              stData.stFrame.pstPack->u32Len,
-                              stData.stFrame.pstPack->u64PTS, 1);
-  } else {
-    rkmuxer_write_video_frame(pstHandle->u32MuxerId, data,
-                              stData.stFrame.pstPack->u32Len,
-                              stData.stFrame.pstPack->u64PTS, 0);
-  }
+    stData.stFrame.pstPack->DataType.enH265EType == H265E_NALU_IDRSLICE);
+
+  RKADK_RTMP_PktPush(pstHandle, stData.stFrame.pstPack->pMbBlk, 0,
+                     stData.stFrame.pstPack->u32Len,
+                     stData.stFrame.pstPack->u64PTS, true, bKeyFrame);
 }
 
 static int RKADK_RTMP_VencGetData(RKADK_U32 u32CamId,
@@ -582,6 +991,11 @@ RKADK_S32 RKADK_RTMP_Init(RKADK_U32 u32CamId, const char *path,
   RKADK_CHECK_CAMERAID(u32CamId, RKADK_FAILURE);
   RKADK_CHECK_POINTER(path, RKADK_FAILURE);
 
+  if (strlen(path) >= RKADK_PATH_LEN) {
+    RKADK_LOGE("Invalid rtmp path len: %zu", strlen(path));
+    return -1;
+  }
+
   RKADK_LOGI("Rtmp[%d, %s] Init Start...", u32CamId, path);
   RKADK_BUFINFO("enter rtmp[%d]", u32CamId);
 
@@ -621,16 +1035,19 @@ RKADK_S32 RKADK_RTMP_Init(RKADK_U32 u32CamId, const char *path,
   }
   memset(pHandle, 0, sizeof(RKADK_RTMP_HANDLE_S));
   pHandle->u32CamId = u32CamId;
+  strcpy(pHandle->path, path);
 
   // Create Muxer
-  ret = RKADK_RTMP_InitMuxer(u32CamId, (char *)path, pstLiveCfg, pstAudioParam, pHandle);
+  ret = RKADK_RTMP_InitMuxer(u32CamId, pHandle->path, pstLiveCfg, pstAudioParam, pHandle);
   if (ret) {
     RKADK_LOGE("RKADK_RTMP_InitMuxer failed");
     free(pHandle);
     return ret;
   }
+  pHandle->bConnected = true;
 
   RKADK_RTMP_SetVideoChn(pstLiveCfg, u32CamId, &stViChn, &stVencChn, &stSrcVpssChn, &stDstVpssChn);
+  pHandle->u32VencChn = stVencChn.s32ChnId;
   enType = RKADK_PARAM_VencChnMux(u32CamId, stVencChn.s32ChnId);
   if (enType != RKADK_STREAM_TYPE_BUTT && enType != RKADK_STREAM_TYPE_LIVE) {
     switch (enType) {
@@ -650,10 +1067,21 @@ RKADK_S32 RKADK_RTMP_Init(RKADK_U32 u32CamId, const char *path,
     }
     pHandle->bVencChnMux = true;
   }
+  ret = RKADK_RTMP_InitSender(pHandle);
+  if (ret) {
+    RKADK_LOGE("RKADK_RTMP_InitSender failed");
+    rkmuxer_deinit(pHandle->u32MuxerId);
+    free(pHandle);
+    return ret;
+  }
+
   ret = RKADK_RTMP_EnableVideo(u32CamId, stViChn, stVencChn, stSrcVpssChn,
                                pstLiveCfg, bUseVpss, u32VpssBufCnt);
   if (ret) {
     RKADK_LOGE("RKADK_RTMP_EnableVideo failed[%d]", ret);
+    RKADK_RTMP_DeInitSender(pHandle);
+    if (pHandle->bConnected)
+      rkmuxer_deinit(pHandle->u32MuxerId);
     free(pHandle);
     return ret;
   }
@@ -664,6 +1092,9 @@ RKADK_S32 RKADK_RTMP_Init(RKADK_U32 u32CamId, const char *path,
     if (ret) {
       RKADK_LOGE("RKADK_RTMP_EnableAudio failed[%d]", ret);
       RKADK_RTMP_DisableVideo(u32CamId, stViChn, stVencChn, stSrcVpssChn, pstLiveCfg, bUseVpss);
+      RKADK_RTMP_DeInitSender(pHandle);
+      if (pHandle->bConnected)
+        rkmuxer_deinit(pHandle->u32MuxerId);
       free(pHandle);
       return ret;
     }
@@ -732,13 +1163,21 @@ unbind:
   }
 
 failed:
+  RKADK_MEDIA_StopGetVencBuffer(u32CamId, &stVencChn, false, RKADK_RTMP_VencOutCb, pHandle);
+  if (bEnableAudio)
+    RKADK_MEDIA_StopGetAencBuffer(&stAencChn, RKADK_RTMP_AencOutCb, pHandle);
+
   RKADK_RTMP_DisableVideo(u32CamId, stViChn, stVencChn, stSrcVpssChn, pstLiveCfg, bUseVpss);
 
   if (bEnableAudio)
     RKADK_RTMP_DisableAudio(stAiChn, stAencChn, pstAudioParam);
 
-  if (pHandle)
+  if (pHandle) {
+    RKADK_RTMP_DeInitSender(pHandle);
+    if (pHandle->bConnected)
+      rkmuxer_deinit(pHandle->u32MuxerId);
     free(pHandle);
+  }
 
   RKADK_LOGE("failed");
   return ret;
@@ -820,8 +1259,10 @@ RKADK_S32 RKADK_RTMP_DeInit(RKADK_MW_PTR pHandle) {
     }
   }
 
-  // Destroy MUXER
-  rkmuxer_deinit(pstHandle->u32MuxerId);
+  // Stop send thread before destroy MUXER
+  RKADK_RTMP_DeInitSender(pstHandle);
+  if (pstHandle->bConnected)
+    rkmuxer_deinit(pstHandle->u32MuxerId);
 
   // Disable Video
   ret = RKADK_RTMP_DisableVideo(pstHandle->u32CamId, stViChn, stVencChn,
@@ -868,5 +1309,39 @@ RKADK_S32 RKADK_RTMP_VideoReset(RKADK_MW_PTR pHandle) {
     return -1;
   }
 
-  return RKADK_MEDIA_VideoReset(pstHandle->u32CamId, pstLiveCfg->vi_attr, pstLiveCfg->attribute);
+  ret = RKADK_MEDIA_VideoReset(pstHandle->u32CamId, pstLiveCfg->vi_attr, pstLiveCfg->attribute);
+
+  // venc restarts with the configured bitrate
+  RKADK_MUTEX_LOCK(pstHandle->mutex);
+  pstHandle->u32Bitrate = 0;
+  RKADK_MUTEX_UNLOCK(pstHandle->mutex);
+  return ret;
+}
+
+RKADK_S32 RKADK_RTMP_GetStats(RKADK_MW_PTR pHandle,
+                              RKADK_RTMP_STATS_S *pstStats) {
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+  RKADK_RTMP_HANDLE_S *pstHandle = (RKADK_RTMP_HANDLE_S *)pHandle;
+  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg = NULL;
+
+  pstLiveCfg = RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
+  if (!pstLiveCfg) {
+    RKADK_LOGE("RKADK_PARAM_GetStreamCfg failed");
+    return -1;
+  }
+
+  RKADK_MUTEX_LOCK(pstHandle->mutex);
+  pstStats->bConnected = pstHandle->bConnected;
+  pstStats->u64TxBytes = pstHandle->u64TxBytes;
+  pstStats->u32TxVideoFrames = pstHandle->u32TxVideoCnt;
+  pstStats->u32TxAudioFrames = pstHandle->u32TxAudioCnt;
+  pstStats->u32DropFrames = pstHandle->u32DropCnt;
+  pstStats->u32QueueLen = pstHandle->u32PktCnt;
+  pstStats->u32ReconnectCnt = pstHandle->u32ReconnectCnt;
+  pstStats->u32Bitrate = pstHandle->u32Bitrate ? pstHandle->u32Bitrate
+                                               : pstLiveCfg->attribute.bitrate;
+  RKADK_MUTEX_UNLOCK(pstHandle->mutex);
+
+  return 0;
 }
\ No newline at end of file
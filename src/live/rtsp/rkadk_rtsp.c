@@ -19,23 +19,77 @@
 #include "rkadk_media_comm.h"
 #include "rkadk_audio_encoder.h"
 #include "rkadk_param.h"
+#include "rkadk_signal.h"
+#include "rkadk_thread.h"
+#include "rkadk_trace.h"
+#include "linux_list.h"
 #include "rtsp_demo.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+ * Packets carry a copy of the stream data, so the venc stream buffers are
+ * returned right away. The queue is still limited to a part of the venc
+ * buffer count, the gop cache holds one configured gop.
+ */
+#define RKADK_RTSP_PKT_QUEUE_MAX 64
+#define RKADK_RTSP_GOP_CACHE_MAX 150
+
+/* rtsp_do_event interval when no packet arrives, unit: ms */
+#define RKADK_RTSP_EVENT_INTERVAL 20
+
+typedef struct {
+  struct list_head mark;
+  RKADK_U8 *pu8Data;
+  RKADK_U32 u32Len;
+  RKADK_U64 u64Pts;
+  bool bVideo;
+  bool bKeyFrame;
+} RKADK_RTSP_PKT_S;
+
+typedef struct {
+  struct list_head mark;
+  RKADK_U32 port;
+  RKADK_U32 u32RefCnt;
+  rtsp_demo_handle stRtspHandle;
+  struct list_head stSessionList;
+  pthread_mutex_t mutex;
+  void *pThread;
+} RKADK_RTSP_SERVER_S;
+
 typedef struct {
+  struct list_head mark;
   bool start;
+  bool bTxStart;
   bool bRequestIDR;
   bool bWaitIDR;
   bool bVencChnMux;
   bool bFirstKeyFrame;
+  bool bDropToIdr;
   RKADK_U32 u32CamId;
-  rtsp_demo_handle stRtspHandle;
+  RKADK_STREAM_TYPE_E enStrmType;
+  RKADK_U32 u32VencChn;
+  RKADK_U32 u32PktCnt;
+  RKADK_U32 u32PktMax;
+  RKADK_U32 u32GopCnt;
+  RKADK_U32 u32GopMax;
+  RKADK_U32 u32DropCnt;
+  RKADK_U32 u32TxVideoCnt;
+  RKADK_U32 u32TxAudioCnt;
+  RKADK_U64 u64TxBytes;
+  char path[RKADK_PATH_LEN];
+  RKADK_RTSP_SERVER_S *pstServer;
   rtsp_session_handle stRtspSession;
   pthread_mutex_t mutex;
+  struct list_head stPktList;
+  struct list_head stGopList;
 } RKADK_RTSP_HANDLE_S;
 
+/* rtsp servers shared by the sessions on the same port */
+static struct list_head g_stRtspServerList = LIST_HEAD_INIT(g_stRtspServerList);
+static pthread_mutex_t g_rtspServerMutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void RKADK_RTSP_SetVideoChn(RKADK_PARAM_STREAM_CFG_S *pstLiveCfg, RKADK_U32 u32CamId,
                                    MPP_CHN_S *pstViChn, MPP_CHN_S *pstVencChn,
                                    MPP_CHN_S *pstSrcVpssChn, MPP_CHN_S *pstDstVpssChn) {
@@ -67,6 +121,7 @@ static void RKADK_RTSP_AudioSetChn(MPP_CHN_S *pstAiChn, MPP_CHN_S *pstAencChn) {
 }
 
 static int RKADK_RTSP_SetVencAttr(RKADK_U32 u32CamId,
+                                  RKADK_STREAM_TYPE_E enStrmType,
                                   RKADK_PARAM_STREAM_CFG_S *pstLiveCfg,
                                   VENC_CHN_ATTR_S *pstVencAttr) {
   int ret;
@@ -93,7 +148,7 @@ static int RKADK_RTSP_SetVencAttr(RKADK_U32 u32CamId,
     u32DstFrameRateNum = pstSensorCfg->framerate;
 
     stFps.u32Framerate = pstSensorCfg->framerate;
-    stFps.enStreamType = RKADK_STREAM_TYPE_LIVE;
+    stFps.enStreamType = enStrmType;
     RKADK_PARAM_SetCamParam(u32CamId, RKADK_PARAM_TYPE_FPS, &stFps);
   }
 
@@ -121,9 +176,409 @@ static int RKADK_RTSP_SetVencAttr(RKADK_U32 u32CamId,
   return 0;
 }
 
-static RKADK_S32 RKADK_RTSP_InitService(RKADK_CODEC_TYPE_E enCodecType,
-                                        RKADK_U32 port, const char *path,
-                                        RKADK_RTSP_HANDLE_S *pHandle) {
+static RKADK_PARAM_VENC_ATTR_S *
+RKADK_RTSP_GetVencAttr(RKADK_U32 u32CamId, RKADK_STREAM_TYPE_E enStrmType) {
+  RKADK_PARAM_STREAM_CFG_S *pstStreamCfg = NULL;
+  RKADK_PARAM_REC_CFG_S *pstRecCfg = NULL;
+
+  switch (enStrmType) {
+  case RKADK_STREAM_TYPE_LIVE:
+  case RKADK_STREAM_TYPE_PREVIEW:
+    pstStreamCfg = RKADK_PARAM_GetStreamCfg(u32CamId, enStrmType);
+    if (!pstStreamCfg) {
+      RKADK_LOGE("RKADK_PARAM_GetStreamCfg[%d] failed", enStrmType);
+      return NULL;
+    }
+    return &pstStreamCfg->attribute;
+
+  case RKADK_STREAM_TYPE_VIDEO_MAIN:
+  case RKADK_STREAM_TYPE_VIDEO_SUB:
+    pstRecCfg = RKADK_PARAM_GetRecCfg(u32CamId);
+    if (!pstRecCfg) {
+      RKADK_LOGE("RKADK_PARAM_GetRecCfg failed");
+      return NULL;
+    }
+
+    if (enStrmType == RKADK_STREAM_TYPE_VIDEO_MAIN)
+      return &pstRecCfg->attribute[0];
+
+    if (pstRecCfg->file_num < 2) {
+      RKADK_LOGE("Record sub stream isn't configured, file_num: %d",
+                 pstRecCfg->file_num);
+      return NULL;
+    }
+    return &pstRecCfg->attribute[1];
+
+  default:
+    RKADK_LOGE("Unsupport enStrmType: %d", enStrmType);
+    return NULL;
+  }
+}
+
+static bool RKADK_RTSP_IsRecStream(RKADK_STREAM_TYPE_E enStrmType) {
+  return enStrmType == RKADK_STREAM_TYPE_VIDEO_MAIN ||
+         enStrmType == RKADK_STREAM_TYPE_VIDEO_SUB;
+}
+
+static RKADK_S32 RKADK_RTSP_RequestIDR(RKADK_U32 u32CamId, RKADK_U32 u32ChnId) {
+  int ret = 0;
+
+  RKADK_STREAM_TYPE_E enType = RKADK_PARAM_VencChnMux(u32CamId, u32ChnId);
+  if (enType == RKADK_STREAM_TYPE_VIDEO_MAIN ||
+      enType == RKADK_STREAM_TYPE_VIDEO_SUB) {
+    int i;
+    RKADK_PARAM_REC_CFG_S *pstRecCfg = RKADK_PARAM_GetRecCfg(u32CamId);
+    if (!pstRecCfg) {
+      RKADK_LOGE("RKADK_PARAM_GetRecCfg failed");
+      return false;
+    }
+
+    for (i = 0; i < (int)pstRecCfg->file_num; i++) {
+      RKADK_LOGI("chn mux, venc_chn[%d] request IDR",
+                 pstRecCfg->attribute[i].venc_chn);
+      ret |= RK_MPI_VENC_RequestIDR(pstRecCfg->attribute[i].venc_chn, RK_FALSE);
+    }
+  } else {
+    ret = RK_MPI_VENC_RequestIDR(u32ChnId, RK_FALSE);
+  }
+
+  return ret;
+}
+
+static void RKADK_RTSP_PktFree(RKADK_RTSP_PKT_S *pstPkt) {
+  list_del_init(&pstPkt->mark);
+  free(pstPkt);
+}
+
+static void RKADK_RTSP_ListRelease(struct list_head *head) {
+  RKADK_RTSP_PKT_S *pstPkt = NULL, *pstPkt_n = NULL;
+
+  list_for_each_entry_safe(pstPkt, pstPkt_n, head, mark) {
+    RKADK_RTSP_PktFree(pstPkt);
+  }
+}
+
+// mutex must be held
+static void RKADK_RTSP_DropVideo(RKADK_RTSP_HANDLE_S *pHandle) {
+  RKADK_RTSP_PKT_S *pstPkt = NULL, *pstPkt_n = NULL;
+
+  list_for_each_entry_safe(pstPkt, pstPkt_n, &pHandle->stPktList, mark) {
+    if (!pstPkt->bVideo)
+      continue;
+
+    RKADK_RTSP_PktFree(pstPkt);
+    pHandle->u32PktCnt--;
+    pHandle->u32DropCnt++;
+  }
+
+  pHandle->bDropToIdr = true;
+}
+
+static int RKADK_RTSP_PktPush(RKADK_RTSP_HANDLE_S *pHandle, MB_BLK pMbBlk,
+                              RKADK_U32 u32Len, RKADK_U64 u64Pts, bool bVideo,
+                              bool bKeyFrame) {
+  RKADK_RTSP_PKT_S *pstPkt;
+  RKADK_RTSP_SERVER_S *pstServer;
+  void *pData;
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  // the session is being released, nothing may be queued or cached
+  pstServer = pHandle->pstServer;
+  if (!pstServer)
+    goto drop;
+
+  // the service thread falls behind, skip video up to the next key frame
+  if (pHandle->u32PktCnt >= pHandle->u32PktMax) {
+    RKADK_LOGW("Rtsp[%d] packet queue full, drop to next key frame, dropped: %d",
+               pHandle->u32CamId, pHandle->u32DropCnt);
+    RKADK_RTSP_DropVideo(pHandle);
+  }
+
+  if (bVideo) {
+    if (bKeyFrame)
+      pHandle->bDropToIdr = false;
+    else if (pHandle->bDropToIdr)
+      goto drop;
+  }
+
+  if (pHandle->u32PktCnt >= pHandle->u32PktMax)
+    goto drop;
+
+  pData = RK_MPI_MB_Handle2VirAddr(pMbBlk);
+  if (!pData) {
+    RKADK_LOGE("RK_MPI_MB_Handle2VirAddr failed");
+    goto drop;
+  }
+
+  // copy the stream data, the venc buffer returns with the callback
+  pstPkt = (RKADK_RTSP_PKT_S *)malloc(sizeof(RKADK_RTSP_PKT_S) + u32Len);
+  if (!pstPkt) {
+    RKADK_LOGE("malloc rtsp packet[%d] failed", u32Len);
+    goto drop;
+  }
+
+  INIT_LIST_HEAD(&pstPkt->mark);
+  pstPkt->pu8Data = (RKADK_U8 *)(pstPkt + 1);
+  pstPkt->u32Len = u32Len;
+  pstPkt->u64Pts = u64Pts;
+  pstPkt->bVideo = bVideo;
+  pstPkt->bKeyFrame = bKeyFrame;
+  memcpy(pstPkt->pu8Data, pData, u32Len);
+
+  list_add_tail(&pstPkt->mark, &pHandle->stPktList);
+  pHandle->u32PktCnt++;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  RKADK_THREAD_Wake(pstServer->pThread);
+  return 0;
+
+drop:
+  pHandle->u32DropCnt++;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+  return -1;
+}
+
+static RKADK_RTSP_PKT_S *RKADK_RTSP_PktPop(RKADK_RTSP_HANDLE_S *pHandle,
+                                           bool *pbStart) {
+  RKADK_RTSP_PKT_S *pstPkt = NULL;
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  *pbStart = pHandle->start;
+  if (!list_empty(&pHandle->stPktList)) {
+    pstPkt = list_first_entry(&pHandle->stPktList, RKADK_RTSP_PKT_S, mark);
+    list_del_init(&pstPkt->mark);
+    pHandle->u32PktCnt--;
+  }
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  return pstPkt;
+}
+
+static void RKADK_RTSP_TxVideo(RKADK_RTSP_HANDLE_S *pHandle,
+                               RKADK_RTSP_PKT_S *pstPkt) {
+  if (!pHandle->bWaitIDR) {
+    if (!pstPkt->bKeyFrame) {
+      if (!pHandle->bRequestIDR) {
+        RKADK_LOGD("requst idr frame");
+        RKADK_RTSP_RequestIDR(pHandle->u32CamId, pHandle->u32VencChn);
+        pHandle->bRequestIDR = true;
+      } else {
+        RKADK_LOGD("wait first idr frame");
+      }
+
+      return;
+    }
+
+    pHandle->bWaitIDR = true;
+    if (pHandle->bFirstKeyFrame) {
+      RKADK_KLOG("Rtsp first key frame pts: %lld", pstPkt->u64Pts);
+      pHandle->bFirstKeyFrame = false;
+    }
+  }
+
+  rtsp_tx_video(pHandle->stRtspSession, pstPkt->pu8Data, pstPkt->u32Len,
+                pstPkt->u64Pts);
+  // packets carry no seq, the pts matches the queue event
+  RKADK_TRACE_EVT(RKADK_TRACE_EVT_RTSP_SEND, pHandle->u32VencChn, 0, pstPkt->u64Pts);
+  pHandle->u32TxVideoCnt++;
+  pHandle->u64TxBytes += pstPkt->u32Len;
+}
+
+static void RKADK_RTSP_ProcVideo(RKADK_RTSP_HANDLE_S *pHandle,
+                                 RKADK_RTSP_PKT_S *pstPkt) {
+  bool bCached = false;
+
+  // keep the frames since the last key frame
+  if (pstPkt->bKeyFrame) {
+    RKADK_RTSP_ListRelease(&pHandle->stGopList);
+    pHandle->u32GopCnt = 0;
+  }
+
+  if (pstPkt->bKeyFrame || !list_empty(&pHandle->stGopList)) {
+    if (pHandle->u32GopCnt < pHandle->u32GopMax) {
+      list_add_tail(&pstPkt->mark, &pHandle->stGopList);
+      pHandle->u32GopCnt++;
+      bCached = true;
+    } else {
+      // longer than the configured gop, wait for the next key frame
+      RKADK_LOGD("Rtsp[%d] gop exceeds cache[%d]", pHandle->u32CamId,
+                 pHandle->u32GopMax);
+      RKADK_RTSP_ListRelease(&pHandle->stGopList);
+      pHandle->u32GopCnt = 0;
+    }
+  }
+
+  if (pHandle->bTxStart)
+    RKADK_RTSP_TxVideo(pHandle, pstPkt);
+
+  if (!bCached)
+    RKADK_RTSP_PktFree(pstPkt);
+}
+
+static void RKADK_RTSP_SetTxStart(RKADK_RTSP_HANDLE_S *pHandle, bool bStart) {
+  RKADK_RTSP_PKT_S *pstPkt = NULL;
+
+  if (pHandle->bTxStart == bStart)
+    return;
+
+  pHandle->bTxStart = bStart;
+  if (!bStart) {
+    // venc stops receiving frames, the cached gop will be stale
+    if (!pHandle->bVencChnMux) {
+      RKADK_RTSP_ListRelease(&pHandle->stGopList);
+      pHandle->u32GopCnt = 0;
+    }
+    return;
+  }
+
+  pHandle->bRequestIDR = false;
+  pHandle->bWaitIDR = false;
+
+  // replay the cached gop, the client needn't wait for a new idr
+  if (!list_empty(&pHandle->stGopList)) {
+    RKADK_LOGI("Rtsp[%d] replay gop cache, frames: %d", pHandle->u32CamId,
+               pHandle->u32GopCnt);
+    list_for_each_entry(pstPkt, &pHandle->stGopList, mark) {
+      RKADK_RTSP_TxVideo(pHandle, pstPkt);
+    }
+  }
+}
+
+// server mutex must be held
+static void RKADK_RTSP_SessionProc(RKADK_RTSP_HANDLE_S *pHandle) {
+  bool bStart;
+  RKADK_RTSP_PKT_S *pstPkt = NULL;
+
+  while (1) {
+    pstPkt = RKADK_RTSP_PktPop(pHandle, &bStart);
+    RKADK_RTSP_SetTxStart(pHandle, bStart);
+    if (!pstPkt)
+      break;
+
+    if (pstPkt->bVideo) {
+      RKADK_RTSP_ProcVideo(pHandle, pstPkt);
+    } else {
+      if (pHandle->bTxStart) {
+        rtsp_tx_audio(pHandle->stRtspSession, pstPkt->pu8Data,
+                      pstPkt->u32Len, pstPkt->u64Pts);
+        pHandle->u32TxAudioCnt++;
+        pHandle->u64TxBytes += pstPkt->u32Len;
+      }
+      RKADK_RTSP_PktFree(pstPkt);
+    }
+  }
+}
+
+static bool RKADK_RTSP_ServerProc(void *params) {
+  RKADK_RTSP_HANDLE_S *pHandle = NULL;
+  RKADK_RTSP_SERVER_S *pstServer = (RKADK_RTSP_SERVER_S *)params;
+
+  if (!pstServer) {
+    RKADK_LOGE("Invalid param");
+    return false;
+  }
+
+  RKADK_THREAD_Wait(RKADK_RTSP_EVENT_INTERVAL);
+
+  RKADK_MUTEX_LOCK(pstServer->mutex);
+  list_for_each_entry(pHandle, &pstServer->stSessionList, mark) {
+    RKADK_RTSP_SessionProc(pHandle);
+  }
+
+  rtsp_do_event(pstServer->stRtspHandle);
+  RKADK_MUTEX_UNLOCK(pstServer->mutex);
+  return true;
+}
+
+// g_rtspServerMutex must be held
+static RKADK_RTSP_SERVER_S *RKADK_RTSP_ServerCreate(RKADK_U32 port) {
+  char name[RKADK_THREAD_NAME_LEN];
+  RKADK_RTSP_SERVER_S *pstServer = NULL;
+
+  pstServer = (RKADK_RTSP_SERVER_S *)malloc(sizeof(RKADK_RTSP_SERVER_S));
+  if (!pstServer) {
+    RKADK_LOGE("malloc rtsp server failed");
+    return NULL;
+  }
+  memset(pstServer, 0, sizeof(RKADK_RTSP_SERVER_S));
+  INIT_LIST_HEAD(&pstServer->mark);
+  INIT_LIST_HEAD(&pstServer->stSessionList);
+  pstServer->port = port;
+
+  pstServer->stRtspHandle = create_rtsp_demo(port);
+  if (!pstServer->stRtspHandle) {
+    RKADK_LOGE("create_rtsp_demo[%d] failed", port);
+    free(pstServer);
+    return NULL;
+  }
+
+  if (pthread_mutex_init(&pstServer->mutex, NULL)) {
+    RKADK_LOGE("mutex init failed");
+    goto failed;
+  }
+
+  snprintf(name, sizeof(name), "Rtsp_%d", port);
+  pstServer->pThread = RKADK_THREAD_Create(RKADK_RTSP_ServerProc, pstServer, name);
+  if (!pstServer->pThread) {
+    RKADK_LOGE("RKADK_THREAD_Create failed");
+    pthread_mutex_destroy(&pstServer->mutex);
+    goto failed;
+  }
+
+  list_add_tail(&pstServer->mark, &g_stRtspServerList);
+  RKADK_LOGI("Create rtsp server[%d]", port);
+  return pstServer;
+
+failed:
+  rtsp_del_demo(pstServer->stRtspHandle);
+  free(pstServer);
+  return NULL;
+}
+
+static RKADK_RTSP_SERVER_S *RKADK_RTSP_ServerGet(RKADK_U32 port) {
+  RKADK_RTSP_SERVER_S *pstServer = NULL, *pstTmp = NULL;
+
+  RKADK_MUTEX_LOCK(g_rtspServerMutex);
+  list_for_each_entry(pstTmp, &g_stRtspServerList, mark) {
+    if (pstTmp->port == port) {
+      pstServer = pstTmp;
+      break;
+    }
+  }
+
+  if (!pstServer)
+    pstServer = RKADK_RTSP_ServerCreate(port);
+
+  if (pstServer)
+    pstServer->u32RefCnt++;
+  RKADK_MUTEX_UNLOCK(g_rtspServerMutex);
+
+  return pstServer;
+}
+
+static void RKADK_RTSP_ServerPut(RKADK_RTSP_SERVER_S *pstServer) {
+  RKADK_MUTEX_LOCK(g_rtspServerMutex);
+  if (pstServer->u32RefCnt > 0)
+    pstServer->u32RefCnt--;
+
+  if (pstServer->u32RefCnt > 0) {
+    RKADK_MUTEX_UNLOCK(g_rtspServerMutex);
+    return;
+  }
+
+  list_del_init(&pstServer->mark);
+  RKADK_MUTEX_UNLOCK(g_rtspServerMutex);
+
+  RKADK_THREAD_Destory(pstServer->pThread);
+  pthread_mutex_destroy(&pstServer->mutex);
+
+  rtsp_del_demo(pstServer->stRtspHandle);
+  RKADK_LOGI("Destroy rtsp server[%d]", pstServer->port);
+  free(pstServer);
+}
+
+static RKADK_S32 RKADK_RTSP_SetSession(RKADK_CODEC_TYPE_E enCodecType,
+                                       RKADK_RTSP_HANDLE_S *pHandle) {
   int ret = 0;
   RKADK_PARAM_AUDIO_CFG_S *pstAudioCfg = RKADK_PARAM_GetAudioCfg();
 
@@ -132,8 +587,6 @@ static RKADK_S32 RKADK_RTSP_InitService(RKADK_CODEC_TYPE_E enCodecType,
     return -1;
   }
 
-  pHandle->stRtspHandle = create_rtsp_demo(port);
-  pHandle->stRtspSession = rtsp_new_session(pHandle->stRtspHandle, path);
   if (enCodecType == RKADK_CODEC_TYPE_H264) {
     ret = rtsp_set_video(pHandle->stRtspSession, RTSP_CODEC_ID_VIDEO_H264, NULL, 0);
     if (ret) {
@@ -186,44 +639,107 @@ static RKADK_S32 RKADK_RTSP_InitService(RKADK_CODEC_TYPE_E enCodecType,
   return 0;
 }
 
-static void RKADK_RTSP_DeInitService(RKADK_RTSP_HANDLE_S *pHandle) {
-  if (pHandle->stRtspSession)
-    rtsp_del_session(pHandle->stRtspSession);
+static RKADK_S32 RKADK_RTSP_InitService(RKADK_PARAM_VENC_ATTR_S *pstVencAttr,
+                                        RKADK_U32 port, const char *path,
+                                        RKADK_RTSP_HANDLE_S *pHandle) {
+  int ret;
+  RKADK_RTSP_HANDLE_S *pstTmp = NULL;
+  RKADK_RTSP_SERVER_S *pstServer = NULL;
+  RKADK_U32 u32BufCnt = RKADK_PARAM_GetStreamBufCnt(pHandle->u32CamId, false);
+
+  pHandle->u32PktMax = u32BufCnt / 4;
+  if (pHandle->u32PktMax > RKADK_RTSP_PKT_QUEUE_MAX)
+    pHandle->u32PktMax = RKADK_RTSP_PKT_QUEUE_MAX;
+  else if (pHandle->u32PktMax < 2)
+    pHandle->u32PktMax = 2;
+
+  // a key frame and the frames up to the next one
+  pHandle->u32GopMax = pstVencAttr->gop + 1;
+  if (pHandle->u32GopMax > RKADK_RTSP_GOP_CACHE_MAX)
+    pHandle->u32GopMax = RKADK_RTSP_GOP_CACHE_MAX;
+
+  INIT_LIST_HEAD(&pHandle->mark);
+  INIT_LIST_HEAD(&pHandle->stPktList);
+  INIT_LIST_HEAD(&pHandle->stGopList);
+  strncpy(pHandle->path, path, RKADK_PATH_LEN - 1);
 
-  if (pHandle->stRtspHandle)
-    rtsp_del_demo(pHandle->stRtspHandle);
-}
+  ret = pthread_mutex_init(&pHandle->mutex, NULL);
+  if (ret) {
+    RKADK_LOGE("mutex init failed[%d]", ret);
+    return -1;
+  }
 
-static RKADK_S32 RKADK_RTSP_RequestIDR(RKADK_U32 u32CamId, RKADK_U32 u32ChnId) {
-  int ret = 0;
+  pstServer = RKADK_RTSP_ServerGet(port);
+  if (!pstServer) {
+    RKADK_LOGE("RKADK_RTSP_ServerGet[%d] failed", port);
+    pthread_mutex_destroy(&pHandle->mutex);
+    return -1;
+  }
 
-  RKADK_STREAM_TYPE_E enType = RKADK_PARAM_VencChnMux(u32CamId, u32ChnId);
-  if (enType == RKADK_STREAM_TYPE_VIDEO_MAIN ||
-      enType == RKADK_STREAM_TYPE_VIDEO_SUB) {
-    int i;
-    RKADK_PARAM_REC_CFG_S *pstRecCfg = RKADK_PARAM_GetRecCfg(u32CamId);
-    if (!pstRecCfg) {
-      RKADK_LOGE("RKADK_PARAM_GetRecCfg failed");
-      return false;
+  RKADK_MUTEX_LOCK(pstServer->mutex);
+  list_for_each_entry(pstTmp, &pstServer->stSessionList, mark) {
+    if (!strcmp(pstTmp->path, pHandle->path)) {
+      RKADK_LOGE("Rtsp[%d] path[%s] already exists", port, path);
+      goto failed;
     }
+  }
 
-    for (i = 0; i < (int)pstRecCfg->file_num; i++) {
-      RKADK_LOGI("chn mux, venc_chn[%d] request IDR",
-                 pstRecCfg->attribute[i].venc_chn);
-      ret |= RK_MPI_VENC_RequestIDR(pstRecCfg->attribute[i].venc_chn, RK_FALSE);
-    }
-  } else {
-    ret = RK_MPI_VENC_RequestIDR(u32ChnId, RK_FALSE);
+  pHandle->stRtspSession = rtsp_new_session(pstServer->stRtspHandle, path);
+  if (!pHandle->stRtspSession) {
+    RKADK_LOGE("rtsp_new_session[%s] failed", path);
+    goto failed;
   }
 
-  return ret;
+  if (RKADK_RTSP_SetSession(pstVencAttr->codec_type, pHandle)) {
+    rtsp_del_session(pHandle->stRtspSession);
+    pHandle->stRtspSession = NULL;
+    goto failed;
+  }
+
+  pHandle->pstServer = pstServer;
+  list_add_tail(&pHandle->mark, &pstServer->stSessionList);
+  RKADK_MUTEX_UNLOCK(pstServer->mutex);
+  return 0;
+
+failed:
+  RKADK_MUTEX_UNLOCK(pstServer->mutex);
+  RKADK_RTSP_ServerPut(pstServer);
+  pthread_mutex_destroy(&pHandle->mutex);
+  return -1;
+}
+
+static void RKADK_RTSP_DeInitService(RKADK_RTSP_HANDLE_S *pHandle) {
+  RKADK_RTSP_SERVER_S *pstServer = pHandle->pstServer;
+
+  if (!pstServer)
+    return;
+
+  // the server thread doesn't touch the session after it is removed
+  RKADK_MUTEX_LOCK(pstServer->mutex);
+  list_del_init(&pHandle->mark);
+  if (pHandle->stRtspSession)
+    rtsp_del_session(pHandle->stRtspSession);
+  pHandle->stRtspSession = NULL;
+  RKADK_MUTEX_UNLOCK(pstServer->mutex);
+
+  RKADK_MUTEX_LOCK(pHandle->mutex);
+  pHandle->pstServer = NULL;
+  RKADK_RTSP_ListRelease(&pHandle->stPktList);
+  pHandle->u32PktCnt = 0;
+  RKADK_MUTEX_UNLOCK(pHandle->mutex);
+
+  RKADK_RTSP_ListRelease(&pHandle->stGopList);
+  pHandle->u32GopCnt = 0;
+
+  RKADK_RTSP_ServerPut(pstServer);
+  pthread_mutex_destroy(&pHandle->mutex);
 }
 
 static void RKADK_RTSP_VencOutCb(RKADK_MEDIA_VENC_DATA_S mb, RKADK_VOID *handle) {
   RKADK_MEDIA_VENC_DATA_S stData = mb;
-  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg;
+  RKADK_PARAM_VENC_ATTR_S *pstVencAttr;
   RKADK_RTSP_HANDLE_S *pHandle = (RKADK_RTSP_HANDLE_S *)handle;
-  RKADK_VOID *data;
+  bool bKeyFrame;
 
   if (!pHandle) {
     RKADK_LOGE("Can't find rtsp handle");
@@ -231,51 +747,27 @@ static void RKADK_RTSP_VencOutCb(RKADK_MEDIA_VENC_DATA_S mb, RKADK_VOID *handle)
     return;
   }
 
-  pstLiveCfg = RKADK_PARAM_GetStreamCfg(pHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
-  if (!pstLiveCfg) {
-    RKADK_LOGE("Live RKADK_PARAM_GetStreamCfg Live failed");
+  pstVencAttr = RKADK_RTSP_GetVencAttr(pHandle->u32CamId, pHandle->enStrmType);
+  if (!pstVencAttr)
     return;
-  }
 
-  if (!pHandle->start)
+  // keep feeding the gop cache while stopped when venc is multiplexed
+  if (!pHandle->start && !pHandle->bVencChnMux)
     return;
 
-  if (!pHandle->bWaitIDR) {
-    if (!RKADK_MEDIA_CheckIdrFrame(pstLiveCfg->attribute.codec_type,
-                                   stData.stFrame.pstPack->DataType)) {
-      if (!pHandle->bRequestIDR) {
-        RKADK_LOGD("requst idr frame");
-        RKADK_RTSP_RequestIDR(pHandle->u32CamId, pstLiveCfg->attribute.venc_chn);
-        pHandle->bRequestIDR = true;
-      } else {
-        RKADK_LOGD("wait first idr frame");
-      }
-
-      return;
-    }
-
-    pHandle->bWaitIDR = true;
-    if (pHandle->bFirstKeyFrame) {
-      RKADK_KLOG("Rtsp first key frame pts: %lld", stData.stFrame.pstPack->u64PTS);
-      pHandle->bFirstKeyFrame = false;
-    }
-  }
-
-  data = RK_MPI_MB_Handle2VirAddr(stData.stFrame.pstPack->pMbBlk);
-  if (pHandle->stRtspHandle && pHandle->stRtspSession) {
-    RKADK_MUTEX_LOCK(pHandle->mutex);
-    rtsp_tx_video(pHandle->stRtspSession, (uint8_t *)data,
-                  stData.stFrame.pstPack->u32Len, stData.stFrame.pstPack->u64PTS);
-    rtsp_do_event(pHandle->stRtspHandle);
-    RKADK_MUTEX_UNLOCK(pHandle->mutex);
-  }
+  bKeyFrame = RKADK_MEDIA_CheckIdrFrame(pstVencAttr->codec_type,
+                                        stData.stFrame.pstPack->DataType);
+  RKADK_RTSP_PktPush(pHandle, stData.stFrame.pstPack->pMbBlk,
+                     stData.stFrame.pstPack->u32Len,
+                     stData.stFrame.pstPack->u64PTS, true, bKeyFrame);
+  RKADK_TRACE_EVT(RKADK_TRACE_EVT_RTSP_QUEUE, stData.u32ChnId,
+                  stData.stFrame.u32Seq, stData.stFrame.pstPack->u64PTS);
 }
 
 static void RKADK_RTSP_AencOutCb(AUDIO_STREAM_S stFrame,
                                  RKADK_VOID *pHandle) {
   RKADK_CHECK_POINTER_N(pHandle);
   RKADK_RTSP_HANDLE_S *pstHandle = (RKADK_RTSP_HANDLE_S *)pHandle;
-  RKADK_U8 *data;
   if (!pstHandle) {
     RKADK_LOGE("Can't find rtsp handle");
     return;
@@ -284,14 +776,8 @@ static void RKADK_RTSP_AencOutCb(AUDIO_STREAM_S stFrame,
   if (!pstHandle->start)
     return;
 
-  data = (RKADK_U8 *)RK_MPI_MB_Handle2VirAddr(stFrame.pMbBlk);
-  if (pstHandle->stRtspHandle && pstHandle->stRtspSession) {
-    RKADK_MUTEX_LOCK(pstHandle->mutex);
-    rtsp_tx_audio(pstHandle->stRtspSession, (uint8_t *)data,
-                  stFrame.u32Len, stFrame.u64TimeStamp);
-    rtsp_do_event(pstHandle->stRtspHandle);
-    RKADK_MUTEX_UNLOCK(pstHandle->mutex);
-  }
+  RKADK_RTSP_PktPush(pstHandle, stFrame.pMbBlk, stFrame.u32Len,
+                     stFrame.u64TimeStamp, false, false);
 }
 
 static RKADK_S32 RKADK_RTSP_VencGetData(RKADK_U32 u32CamId,
@@ -439,8 +925,32 @@ static RKADK_S32 RKADK_RTSP_DisableAudio(MPP_CHN_S stAiChn, MPP_CHN_S stAencChn,
   return 0;
 }
 
+static RKADK_S32 RKADK_RTSP_RecStreamGetData(RKADK_RTSP_HANDLE_S *pHandle) {
+  int ret;
+  MPP_CHN_S stVencChn;
+
+  // the record venc is created and started by record
+  stVencChn.enModId = RK_ID_VENC;
+  stVencChn.s32DevId = 0;
+  stVencChn.s32ChnId = pHandle->u32VencChn;
+  ret = RKADK_MEDIA_GetVencBuffer(&stVencChn, RKADK_RTSP_VencOutCb,
+                                  (RKADK_VOID *)pHandle);
+  if (ret)
+    RKADK_LOGE("RKADK_MEDIA_GetVencBuffer failed = %d", ret);
+
+  return ret;
+}
+
 RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
                           RKADK_MW_PTR *ppHandle) {
+  return RKADK_RTSP_InitStream(u32CamId, RKADK_STREAM_TYPE_LIVE, port, path,
+                               ppHandle);
+}
+
+RKADK_S32 RKADK_RTSP_InitStream(RKADK_U32 u32CamId,
+                                RKADK_STREAM_TYPE_E enStrmType,
+                                RKADK_U32 port, const char *path,
+                                RKADK_MW_PTR *ppHandle) {
   int ret = 0;
   bool bSysInit = false;
   bool bUseVpss = false;
@@ -451,11 +961,13 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
   VPSS_GRP_ATTR_S stGrpAttr;
   VPSS_CHN_ATTR_S stChnAttr;
   RKADK_RTSP_HANDLE_S *pHandle;
+  RKADK_PARAM_VENC_ATTR_S *pstVencAttr;
+  bool bRecStream = RKADK_RTSP_IsRecStream(enStrmType);
 
   RKADK_CHECK_CAMERAID(u32CamId, RKADK_FAILURE);
   RKADK_CHECK_POINTER(path, RKADK_FAILURE);
 
-  RKADK_LOGI("Rtsp[%d, %d, %s] Init Start...", u32CamId, port, path);
+  RKADK_LOGI("Rtsp[%d, %d, %d, %s] Init Start...", u32CamId, enStrmType, port, path);
   RKADK_BUFINFO("enter rtsp[%d]", u32CamId);
 
   if (*ppHandle) {
@@ -469,10 +981,14 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
     return -1;
   }
 
-  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg =
-      RKADK_PARAM_GetStreamCfg(u32CamId, RKADK_STREAM_TYPE_LIVE);
-  if (!pstLiveCfg) {
-    RKADK_LOGE("Live RKADK_PARAM_GetStreamCfg Live failed");
+  pstVencAttr = RKADK_RTSP_GetVencAttr(u32CamId, enStrmType);
+  if (!pstVencAttr)
+    return -1;
+
+  RKADK_PARAM_STREAM_CFG_S *pstStreamCfg =
+      RKADK_PARAM_GetStreamCfg(u32CamId, enStrmType);
+  if (!pstStreamCfg) {
+    RKADK_LOGE("RKADK_PARAM_GetStreamCfg[%d] failed", enStrmType);
     return -1;
   }
 
@@ -495,10 +1011,11 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
   }
   memset(pHandle, 0, sizeof(RKADK_RTSP_HANDLE_S));
   pHandle->u32CamId = u32CamId;
+  pHandle->enStrmType = enStrmType;
+  pHandle->u32VencChn = pstVencAttr->venc_chn;
   pHandle->bFirstKeyFrame = true;
 
-  ret = RKADK_RTSP_InitService(pstLiveCfg->attribute.codec_type, port, path,
-                               pHandle);
+  ret = RKADK_RTSP_InitService(pstVencAttr, port, path, pHandle);
   if (ret) {
     RKADK_LOGE("RKADK_RTSP_InitService failed");
     free(pHandle);
@@ -509,6 +1026,7 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
   ret = RKADK_RTSP_EnableAudio(u32CamId, stAiChn, stAencChn, pstAudioCfg);
   if (ret) {
     RKADK_LOGE("RKADK_RTSP_EnableAudio failed[%d]", ret);
+    RKADK_RTSP_DeInitService(pHandle);
     free(pHandle);
     return ret;
   }
@@ -516,18 +1034,23 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
   ret = RKADK_RTSP_AencGetData(u32CamId, &stAencChn, pHandle);
   if (ret) {
     RKADK_LOGE("RKADK_RTSP_AencGetData failed(%d)", ret);
-    goto failed;
+    goto audio_failed;
   }
 
-  ret = pthread_mutex_init(&pHandle->mutex, NULL);
-  if (ret) {
-    RKADK_LOGE("mutex init failed[%d]", ret);
-    goto failed;
+  if (bRecStream) {
+    pHandle->bVencChnMux = true;
+    ret = RKADK_RTSP_RecStreamGetData(pHandle);
+    if (ret) {
+      RKADK_LOGE("RKADK_RTSP_RecStreamGetData failed(%d)", ret);
+      goto audio_failed;
+    }
+
+    goto bind_audio;
   }
 
-  RKADK_RTSP_SetVideoChn(pstLiveCfg, u32CamId, &stViChn, &stVencChn, &stSrcVpssChn, &stDstVpssChn);
+  RKADK_RTSP_SetVideoChn(pstStreamCfg, u32CamId, &stViChn, &stVencChn, &stSrcVpssChn, &stDstVpssChn);
   enType = RKADK_PARAM_VencChnMux(u32CamId, stVencChn.s32ChnId);
-  if (enType != RKADK_STREAM_TYPE_BUTT && enType != RKADK_STREAM_TYPE_LIVE) {
+  if (enType != RKADK_STREAM_TYPE_BUTT && enType != enStrmType) {
     switch (enType) {
     case RKADK_STREAM_TYPE_VIDEO_MAIN:
       RKADK_LOGI("Live and Record main venc[%d] mux", stVencChn.s32ChnId);
@@ -548,31 +1071,31 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
 
   // Create VI
   ret = RKADK_MPI_VI_Init(u32CamId, stViChn.s32ChnId,
-                          &(pstLiveCfg->vi_attr.stChnAttr));
+                          &(pstStreamCfg->vi_attr.stChnAttr));
   if (ret) {
     RKADK_LOGE("RKADK_MPI_VI_Init faled %d", ret);
     goto failed;
   }
   RKADK_BUFINFO("create vi[%d]", stViChn.s32ChnId);
 
-  bUseVpss = RKADK_MEDIA_VideoIsUseVpss(u32CamId, false, &u32VpssBufCnt, pstLiveCfg->vi_attr, pstLiveCfg->attribute);
+  bUseVpss = RKADK_MEDIA_VideoIsUseVpss(u32CamId, false, &u32VpssBufCnt, pstStreamCfg->vi_attr, pstStreamCfg->attribute);
   if (bUseVpss) {
     memset(&stGrpAttr, 0, sizeof(VPSS_GRP_ATTR_S));
     memset(&stChnAttr, 0, sizeof(VPSS_CHN_ATTR_S));
 
     stGrpAttr.u32MaxW = pstSensorCfg->max_width;
     stGrpAttr.u32MaxH = pstSensorCfg->max_height;
-    stGrpAttr.enPixelFormat = pstLiveCfg->vi_attr.stChnAttr.enPixelFormat;
+    stGrpAttr.enPixelFormat = pstStreamCfg->vi_attr.stChnAttr.enPixelFormat;
     stGrpAttr.enCompressMode = COMPRESS_MODE_NONE;
     stGrpAttr.stFrameRate.s32SrcFrameRate = -1;
     stGrpAttr.stFrameRate.s32DstFrameRate = -1;
     stChnAttr.enCompressMode = COMPRESS_MODE_NONE;
     stChnAttr.enDynamicRange = DYNAMIC_RANGE_SDR8;
-    stChnAttr.enPixelFormat = pstLiveCfg->vi_attr.stChnAttr.enPixelFormat;
+    stChnAttr.enPixelFormat = pstStreamCfg->vi_attr.stChnAttr.enPixelFormat;
     stChnAttr.stFrameRate.s32SrcFrameRate = -1;
     stChnAttr.stFrameRate.s32DstFrameRate = -1;
-    stChnAttr.u32Width = pstLiveCfg->attribute.max_width;
-    stChnAttr.u32Height = pstLiveCfg->attribute.max_height;
+    stChnAttr.u32Width = pstStreamCfg->attribute.max_width;
+    stChnAttr.u32Height = pstStreamCfg->attribute.max_height;
     stChnAttr.u32Depth = 0;
     stChnAttr.u32FrameBufCnt = u32VpssBufCnt;
     if (u32VpssBufCnt)
@@ -587,8 +1110,8 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
       goto failed;
     }
 
-    if (pstLiveCfg->attribute.max_width != pstLiveCfg->attribute.width
-        || pstLiveCfg->attribute.max_height != pstLiveCfg->attribute.height) {
+    if (pstStreamCfg->attribute.max_width != pstStreamCfg->attribute.width
+        || pstStreamCfg->attribute.max_height != pstStreamCfg->attribute.height) {
       ret = RK_MPI_VPSS_GetChnAttr(stSrcVpssChn.s32DevId, stSrcVpssChn.s32ChnId, &stChnAttr);
       if (ret) {
         RKADK_LOGE("RK_MPI_VPSS_GetChnAttr vpss_grp[%d] vpss_chn[%d] falied[%x]",
@@ -598,8 +1121,8 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
         return ret;
       }
 
-      stChnAttr.u32Width = pstLiveCfg->attribute.width;
-      stChnAttr.u32Height = pstLiveCfg->attribute.height;
+      stChnAttr.u32Width = pstStreamCfg->attribute.width;
+      stChnAttr.u32Height = pstStreamCfg->attribute.height;
       ret = RK_MPI_VPSS_SetChnAttr(stSrcVpssChn.s32DevId, stSrcVpssChn.s32ChnId, &stChnAttr);
       if (ret) {
         RKADK_LOGE("RK_MPI_VPSS_SetChnAttr vpss_grp[%d] vpss_chn[%d] falied[%x]",
@@ -615,7 +1138,7 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
 
   // Create VENC
   VENC_CHN_ATTR_S stVencChnAttr;
-  ret = RKADK_RTSP_SetVencAttr(u32CamId, pstLiveCfg, &stVencChnAttr);
+  ret = RKADK_RTSP_SetVencAttr(u32CamId, enStrmType, pstStreamCfg, &stVencChnAttr);
   if (ret) {
     RKADK_LOGE("RKADK_RTSP_SetVencAttr failed");
     goto failed;
@@ -629,11 +1152,10 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
   RKADK_BUFINFO("create venc[%d]", stVencChn.s32ChnId);
 
   RK_MPI_VENC_SetSceneMode(stVencChn.s32ChnId, RKADK_ENCODE_SENSE_CVR);
-  RKADK_PARAM_SetVAdvancedParam(pstLiveCfg->attribute);
+  RKADK_PARAM_SetVAdvancedParam(pstStreamCfg->attribute);
 
   //if use isp, set mirror/flip using aiq
   if (!pstSensorCfg->used_isp) {
-    RKADK_STREAM_TYPE_E enStrmType = RKADK_STREAM_TYPE_LIVE;
     if (pstSensorCfg->mirror)
       RKADK_MEDIA_ToggleVencMirror(u32CamId, enStrmType, pstSensorCfg->mirror);
     if (pstSensorCfg->flip)
@@ -674,11 +1196,20 @@ RKADK_S32 RKADK_RTSP_Init(RKADK_U32 u32CamId, RKADK_U32 port, const char *path,
   }
   RKADK_BUFINFO("rtsp bind[%d, %d, %d]", stViChn.s32ChnId, stSrcVpssChn.s32ChnId, stVencChn.s32ChnId);
 
+bind_audio:
   // Bind AI to AENC
   ret = RKADK_MPI_SYS_Bind(&stAiChn, &stAencChn);
   if (ret) {
     RKADK_LOGE("Bind AI[%d] and AENC[%d] failed[%d]", stAiChn.s32ChnId,
                stAencChn.s32ChnId, ret);
+    if (bRecStream) {
+      stVencChn.enModId = RK_ID_VENC;
+      stVencChn.s32DevId = 0;
+      stVencChn.s32ChnId = pHandle->u32VencChn;
+      RKADK_MEDIA_StopGetVencBuffer(u32CamId, &stVencChn, false,
+                                    RKADK_RTSP_VencOutCb, pHandle);
+      goto audio_failed;
+    }
     goto unbind;
   }
 
@@ -702,10 +1233,9 @@ failed:
 
   RKADK_MPI_VI_DeInit(u32CamId, stViChn.s32ChnId);
 
+audio_failed:
   RKADK_RTSP_DisableAudio(stAiChn, stAencChn, pstAudioCfg);
 
-  pthread_mutex_destroy(&pHandle->mutex);
-
   if (pHandle) {
     RKADK_RTSP_DeInitService((RKADK_RTSP_HANDLE_S *)pHandle);
     free(pHandle);
@@ -725,9 +1255,9 @@ RKADK_S32 RKADK_RTSP_DeInit(RKADK_MW_PTR pHandle) {
 
   RKADK_LOGI("Rtsp[%d] DeInit Start...", pstHandle->u32CamId);
 
-  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg =
-      RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
-  if (!pstLiveCfg) {
+  RKADK_PARAM_STREAM_CFG_S *pstStreamCfg =
+      RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, pstHandle->enStrmType);
+  if (!pstStreamCfg) {
     RKADK_LOGE("RKADK_PARAM_GetStreamCfg failed");
     return -1;
   }
@@ -738,8 +1268,9 @@ RKADK_S32 RKADK_RTSP_DeInit(RKADK_MW_PTR pHandle) {
     return -1;
   }
 
-  RKADK_RTSP_SetVideoChn(pstLiveCfg, pstHandle->u32CamId, &stViChn, &stVencChn,
+  RKADK_RTSP_SetVideoChn(pstStreamCfg, pstHandle->u32CamId, &stViChn, &stVencChn,
                          &stSrcVpssChn, &stDstVpssChn);
+  stVencChn.s32ChnId = pstHandle->u32VencChn;
 
   // exit get media buffer
   if (pstHandle->bVencChnMux)
@@ -749,7 +1280,11 @@ RKADK_S32 RKADK_RTSP_DeInit(RKADK_MW_PTR pHandle) {
   RKADK_RTSP_AudioSetChn(&stAiChn, &stAencChn);
   RKADK_MEDIA_StopGetAencBuffer(&stAencChn, RKADK_RTSP_AencOutCb, pstHandle);
 
-  bUseVpss = RKADK_MEDIA_VideoIsUseVpss(pstHandle->u32CamId, false, NULL, pstLiveCfg->vi_attr, pstLiveCfg->attribute);
+  // the record venc pipeline is destroyed by record
+  if (RKADK_RTSP_IsRecStream(pstHandle->enStrmType))
+    goto unbind_audio;
+
+  bUseVpss = RKADK_MEDIA_VideoIsUseVpss(pstHandle->u32CamId, false, NULL, pstStreamCfg->vi_attr, pstStreamCfg->attribute);
   if (bUseVpss){
     // VPSS UnBind VENC
     ret = RKADK_MPI_SYS_UnBind(&stSrcVpssChn, &stVencChn);
@@ -799,6 +1334,7 @@ RKADK_S32 RKADK_RTSP_DeInit(RKADK_MW_PTR pHandle) {
     return ret;
   }
 
+unbind_audio:
   ret = RKADK_MPI_SYS_UnBind(&stAiChn, &stAencChn);
   if (ret) {
     RKADK_LOGE("UnBind AI[%d] and AENC[%d] failed[%d]", stAiChn.s32ChnId,
@@ -812,11 +1348,11 @@ RKADK_S32 RKADK_RTSP_DeInit(RKADK_MW_PTR pHandle) {
     return ret;
   }
 
+  // venc and aenc callbacks are gone, release the queued packets
   RKADK_RTSP_DeInitService((RKADK_RTSP_HANDLE_S *)pHandle);
 
-  pthread_mutex_destroy(&pstHandle->mutex);
-
-  RKADK_LOGI("Rtsp[%d] DeInit End...", pstHandle->u32CamId);
+  RKADK_LOGI("Rtsp[%d] DeInit End, dropped frames: %d", pstHandle->u32CamId,
+             pstHandle->u32DropCnt);
   free(pHandle);
   return 0;
 }
@@ -828,16 +1364,11 @@ RKADK_S32 RKADK_RTSP_Start(RKADK_MW_PTR pHandle) {
   if (pstHandle->start)
     return 0;
 
-  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg =
-      RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
-  if (!pstLiveCfg) {
-    RKADK_LOGE("RKADK_PARAM_GetStreamCfg failed");
-    return -1;
-  }
-
+  // the service thread replays the gop cache or requests an idr frame
+  RKADK_MUTEX_LOCK(pstHandle->mutex);
   pstHandle->start = true;
-  pstHandle->bRequestIDR = false;
-  pstHandle->bWaitIDR = false;
+  RKADK_MUTEX_UNLOCK(pstHandle->mutex);
+  RKADK_THREAD_Wake(pstHandle->pstServer->pThread);
 
   // multiplex venc chn, thread get mediabuffer
   if (pstHandle->bVencChnMux)
@@ -845,8 +1376,7 @@ RKADK_S32 RKADK_RTSP_Start(RKADK_MW_PTR pHandle) {
 
   VENC_RECV_PIC_PARAM_S stRecvParam;
   stRecvParam.s32RecvPicNum = -1;
-  return RK_MPI_VENC_StartRecvFrame(pstLiveCfg->attribute.venc_chn,
-                                    &stRecvParam);
+  return RK_MPI_VENC_StartRecvFrame(pstHandle->u32VencChn, &stRecvParam);
 }
 
 RKADK_S32 RKADK_RTSP_Stop(RKADK_MW_PTR pHandle) {
@@ -856,14 +1386,10 @@ RKADK_S32 RKADK_RTSP_Stop(RKADK_MW_PTR pHandle) {
   if (!pstHandle->start)
     return 0;
 
-  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg =
-      RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
-  if (!pstLiveCfg) {
-    RKADK_LOGE("RKADK_PARAM_GetStreamCfg failed");
-    return -1;
-  }
-
+  RKADK_MUTEX_LOCK(pstHandle->mutex);
   pstHandle->start = false;
+  RKADK_MUTEX_UNLOCK(pstHandle->mutex);
+  RKADK_THREAD_Wake(pstHandle->pstServer->pThread);
 
   // multiplex venc chn, thread get mediabuffer
   if (pstHandle->bVencChnMux)
@@ -871,25 +1397,29 @@ RKADK_S32 RKADK_RTSP_Stop(RKADK_MW_PTR pHandle) {
 
   VENC_RECV_PIC_PARAM_S stRecvParam;
   stRecvParam.s32RecvPicNum = 0;
-  return RK_MPI_VENC_StartRecvFrame(pstLiveCfg->attribute.venc_chn,
-                                    &stRecvParam);
+  return RK_MPI_VENC_StartRecvFrame(pstHandle->u32VencChn, &stRecvParam);
 }
 
 RKADK_S32 RKADK_RTSP_VideoReset(RKADK_MW_PTR pHandle) {
   int ret = 0;
-  RKADK_PARAM_STREAM_CFG_S *pstLiveCfg = NULL;
+  RKADK_PARAM_STREAM_CFG_S *pstStreamCfg = NULL;
 
   RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
   RKADK_RTSP_HANDLE_S *pstHandle = (RKADK_RTSP_HANDLE_S *)pHandle;
   RKADK_CHECK_CAMERAID(pstHandle->u32CamId, RKADK_FAILURE);
 
-  pstLiveCfg = RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, RKADK_STREAM_TYPE_LIVE);
-  if (!pstLiveCfg) {
+  if (RKADK_RTSP_IsRecStream(pstHandle->enStrmType)) {
+    RKADK_LOGW("Record stream is reset by record");
+    return 0;
+  }
+
+  pstStreamCfg = RKADK_PARAM_GetStreamCfg(pstHandle->u32CamId, pstHandle->enStrmType);
+  if (!pstStreamCfg) {
     RKADK_LOGE("RKADK_PARAM_GetStreamCfg failed");
     return -1;
   }
 
-  ret = RKADK_MEDIA_VencResetCheck(pstHandle->u32CamId, pstLiveCfg->attribute);
+  ret = RKADK_MEDIA_VencResetCheck(pstHandle->u32CamId, pstStreamCfg->attribute);
   if (ret == 0) {
     RKADK_LOGW("Preview param is not changed");
     return 0;
@@ -899,5 +1429,26 @@ RKADK_S32 RKADK_RTSP_VideoReset(RKADK_MW_PTR pHandle) {
 
   RKADK_RTSP_Stop(pHandle);
 
-  return RKADK_MEDIA_VideoReset(pstHandle->u32CamId, pstLiveCfg->vi_attr, pstLiveCfg->attribute);
-}
\ No newline at end of file
+  return RKADK_MEDIA_VideoReset(pstHandle->u32CamId, pstStreamCfg->vi_attr, pstStreamCfg->attribute);
+}
+
+RKADK_S32 RKADK_RTSP_GetStats(RKADK_MW_PTR pHandle,
+                              RKADK_RTSP_STATS_S *pstStats) {
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+  RKADK_RTSP_HANDLE_S *pstHandle = (RKADK_RTSP_HANDLE_S *)pHandle;
+
+  // tx counters are updated by the server thread with the server mutex held
+  RKADK_MUTEX_LOCK(pstHandle->pstServer->mutex);
+  pstStats->u64TxBytes = pstHandle->u64TxBytes;
+  pstStats->u32TxVideoFrames = pstHandle->u32TxVideoCnt;
+  pstStats->u32TxAudioFrames = pstHandle->u32TxAudioCnt;
+  RKADK_MUTEX_UNLOCK(pstHandle->pstServer->mutex);
+
+  RKADK_MUTEX_LOCK(pstHandle->mutex);
+  pstStats->u32DropFrames = pstHandle->u32DropCnt;
+  pstStats->u32QueueLen = pstHandle->u32PktCnt;
+  RKADK_MUTEX_UNLOCK(pstHandle->mutex);
+
+  return 0;
+}
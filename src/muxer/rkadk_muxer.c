@@ -22,8 +22,12 @@
 #include "rkadk_signal.h"
 #include "rkadk_thread.h"
 #include "rkadk_msg.h"
+#include "rkadk_trace.h"
 #include "rkmuxer.h"
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 //#define RKADK_MUXER_TEST
 
@@ -77,11 +81,80 @@ typedef struct {
   pthread_mutex_t mutex;
 } MUXER_PRE_RECORD_PARAM;
 
+/* rkmuxer context ids, each stream alternates between two of them */
+#define RKADK_MUXER_ID_CNT (RKADK_MUXER_STREAM_MAX_CNT * RKADK_MAX_SENSOR_CNT)
+/* the alternate ids follow the rtmp ids, RKADK_MUXER_ID_CNT + u32CamId */
+#define RKADK_MUXER_ALT_ID_BASE (RKADK_MUXER_ID_CNT + RKADK_MAX_SENSOR_CNT)
+/* the next file is opened this long before the split */
+#define RKADK_MUXER_PRE_OPEN_MS 2000
+/* longest wait of the muxer thread for the next file at the split */
+#define RKADK_MUXER_OPEN_WAIT_MS 1000
+#define RKADK_MUXER_CLOSE_MAX_CNT 4
+/* write back of the current file, in aligned chunks */
+#define RKADK_MUXER_FLUSH_MS 500
+#define RKADK_MUXER_FLUSH_ALIGN (1024 * 1024)
+#define RKADK_MUXER_PREALLOC_MAX (1024LL * 1024 * 1024)
+/* longest wait of RKADK_MUXER_AovFlush for each stream */
+#define RKADK_MUXER_AOV_FLUSH_WAIT_MS 3000
+
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+
+typedef enum {
+  MUXER_NEXT_IDLE = 0,
+  MUXER_NEXT_OPENING,
+  MUXER_NEXT_READY,
+  MUXER_NEXT_FAILED,
+} MUXER_NEXT_STATE_E;
+
+typedef struct {
+  int id;
+  char cFileName[RKADK_MAX_FILE_PATH_LEN];
+  int32_t realDuration; // ms
+  bool bSplitRecord;
+  bool bDiscard;        // opened but never written
+  RKADK_U32 u32ParamSeq;
+  int fd;               // preallocation and write back, -1: none
+} MUXER_SEGMENT_S;
+
+/*
+ * The rollover thread opens the next file before the split and closes the
+ * previous one after it, so the muxer thread only swaps the context id at
+ * the key frame. Not used with file cache or aov lapse record, which keep
+ * opening and closing files on the muxer thread.
+ *
+ * rkmuxer owns the file writes, the rollover thread only holds a second fd
+ * of the file: the expected size is reserved beyond EOF at open, the data
+ * written is pushed to the card in aligned chunks and the reserve left is
+ * trimmed at close, which keeps files contiguous on FAT32/exFAT cards.
+ */
+typedef struct {
+  void *pThread;
+  void *pSignal; // given when an open is done
+  pthread_mutex_t mutex;
+  MUXER_NEXT_STATE_E enNextState;
+  int nextId;
+  bool bDropNext;
+  MUXER_SEGMENT_S stNext;
+  MUXER_SEGMENT_S stClose[RKADK_MUXER_CLOSE_MAX_CNT];
+  RKADK_U32 u32CloseHead;
+  RKADK_U32 u32CloseCnt;
+  int activeFd;
+  off_t flushOff;
+  pthread_mutex_t flushMutex; // held while the fd is written back or closed
+  bool bWriteSlow;
+  RKADK_MUXER_ROLLOVER_STATS_S stStats;
+} MUXER_ROLLOVER_PARAM;
+
 #ifdef ENABLE_AOV
 #define RKADK_IPCMSG_KEY 1030
 
 typedef struct {
   bool bIsSleep;
+  void *pSched;   // RAM cache of lapse frames, NULL: write every frame
+  bool bFlushReq; // write out the cache, set by RKADK_MUXER_AovFlush
+  void *pFlushDone; // given by the muxer thread once bFlushReq is served
 } AOV_PARAM_S;
 
 typedef struct {
@@ -114,6 +187,7 @@ typedef struct {
   RKADK_U32 u32ThumbVencChn; // thumb venc channel id
   bool bUseVpss;
   int muxerId;
+  int activeId; // rkmuxer context of the current file
   char cFileName[RKADK_MAX_FILE_PATH_LEN];
   const char *cOutputFmt;
   VideoParam stVideo;
@@ -134,6 +208,7 @@ typedef struct {
   RKADK_U32 u32FirstSeq;
   bool bIOError;
   pthread_mutex_t paramMutex;
+  RKADK_U32 u32ParamSeq; // changed with stVideo and stAudio
   RKADK_MUXER_REQUEST_FILE_NAME_CB pcbRequestFileNames;
   RKADK_MUXER_EVENT_CALLBACK_FN pfnEventCallback;
 
@@ -153,6 +228,7 @@ typedef struct {
   MUXER_THUMB_PARAM stThumbParam;
   MANUAL_SPLIT_ATTR stManualSplit;
   MUXER_PRE_RECORD_PARAM stPreRecParam;
+  MUXER_ROLLOVER_PARAM stRollover;
 
 #ifdef ENABLE_AOV
   AOV_PARAM_S stAovParam;
@@ -390,6 +466,8 @@ static int RKADK_MUXER_EnterSleep(RKADK_MW_PTR pHandle, RKADK_S32 s32VencChnId)
 
   if (bIsSleep) {
     RKADK_AOV_Notify(RKADK_AOV_ENTER_SLEEP, NULL);
+    // the wake cycles of all streams restart at resume
+    RKADK_AOV_SCHED_Resume();
     for (i = 0; i < RKADK_MAX_SENSOR_CNT; i++) {
       if (!g_pRecorder[i])
         continue;
@@ -616,6 +694,7 @@ void RKADK_MUXER_ListDropPFrame(MUXER_HANDLE_S *pstMuxerHandle) {
   }
   if (rst) {
     list_del_init(&rst->mark);
+    pstMuxerHandle->stRollover.stStats.u32DropFrameCnt++;
   }
   RKADK_MUTEX_UNLOCK(pstMuxerHandle->mutex);
 
@@ -693,8 +772,9 @@ static void RKADK_MUXER_PreRecPush(MUXER_HANDLE_S *pstMuxerHandle,
   RKADK_MUTEX_UNLOCK(pstMuxerHandle->stPreRecParam.mutex);
 }
 
-void RKADK_MUXER_ProcessEvent(MUXER_HANDLE_S *pstMuxerHandle,
-                              RKADK_MUXER_EVENT_E enEventType, int64_t value) {
+static void RKADK_MUXER_NotifyEvent(MUXER_HANDLE_S *pstMuxerHandle,
+                                    RKADK_MUXER_EVENT_E enEventType,
+                                    int64_t value, const char *pcFileName) {
   RKADK_MUXER_EVENT_INFO_S stEventInfo;
   memset(&stEventInfo, 0, sizeof(RKADK_MUXER_EVENT_INFO_S));
 
@@ -710,18 +790,24 @@ void RKADK_MUXER_ProcessEvent(MUXER_HANDLE_S *pstMuxerHandle,
     case RKADK_MUXER_EVENT_ERR_CARD_NONEXIST:
       stEventInfo.unEventInfo.stErrorInfo.s32ErrorCode = value;
       strncpy(stEventInfo.unEventInfo.stErrorInfo.asFileName,
-              pstMuxerHandle->cFileName, strlen(pstMuxerHandle->cFileName));
+              pcFileName, strlen(pcFileName));
       break;
     default:
       stEventInfo.unEventInfo.stFileInfo.u32Duration = value;
       strncpy(stEventInfo.unEventInfo.stFileInfo.asFileName,
-              pstMuxerHandle->cFileName, strlen(pstMuxerHandle->cFileName));
+              pcFileName, strlen(pcFileName));
       break;
   }
 
   pstMuxerHandle->pfnEventCallback(pstMuxerHandle->ptr, &stEventInfo);
 }
 
+void RKADK_MUXER_ProcessEvent(MUXER_HANDLE_S *pstMuxerHandle,
+                              RKADK_MUXER_EVENT_E enEventType, int64_t value) {
+  RKADK_MUXER_NotifyEvent(pstMuxerHandle, enEventType, value,
+                          pstMuxerHandle->cFileName);
+}
+
 static void RKADK_MUXER_CheckWriteSpeed(MUXER_HANDLE_S *pstMuxerHandle) {
   int size = 0;
   struct timeval curTime;
@@ -732,6 +818,14 @@ static void RKADK_MUXER_CheckWriteSpeed(MUXER_HANDLE_S *pstMuxerHandle) {
   if (pstMuxer->enableFileCache)
     return;
 
+  // reported by the rollover thread
+  if (__atomic_exchange_n(&pstMuxerHandle->stRollover.bWriteSlow, false, __ATOMIC_ACQ_REL)) {
+    RKADK_LOGW("Stream[%d] card write %d KB/s, below the bitrate, max flush %d us",
+               pstMuxerHandle->u32VencChn, pstMuxerHandle->stRollover.stStats.u32WriteKBps,
+               pstMuxerHandle->stRollover.stStats.u32MaxFlushUs);
+    RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_FILE_WRITING_SLOW, 0);
+  }
+
   gettimeofday(&curTime, NULL);
   size = RKADK_MUXER_GetListSize(&pstMuxerHandle->stVFree);
   if(size <= 5) {
@@ -788,6 +882,11 @@ int RKADK_MUXER_WriteVideoFrame(RKADK_MEDIA_VENC_DATA_S stData, void *handle) {
                 pstMuxerHandle->u32VencChn, enFrameMode, pstMuxer->enRecType);
     return 0;
   }
+
+  if (pstMuxer->enRecType == RKADK_REC_TYPE_AOV_LAPSE) {
+    RKADK_AOV_MarkStage(RKADK_AOV_STAGE_CAPTURE, stData.stFrame.pstPack->u64PTS);
+    RKADK_AOV_MarkStage(RKADK_AOV_STAGE_ENCODE, 0);
+  }
 #endif
 
   pts = stData.stFrame.pstPack->u64PTS;
@@ -870,6 +969,7 @@ int RKADK_MUXER_WriteVideoFrame(RKADK_MEDIA_VENC_DATA_S stData, void *handle) {
   RK_MPI_MB_AddUserCnt(stData.stFrame.pstPack->pMbBlk);
   RKADK_MUXER_CellPush(pstMuxerHandle, &pstMuxerHandle->stProcList, pstCell);
   RKADK_SIGNAL_Give(pstMuxerHandle->pSignal);
+  RKADK_TRACE_EVT(RKADK_TRACE_EVT_MUXER_QUEUE, pstMuxerHandle->u32VencChn, cell.seq, pts);
 
   return 0;
 }
@@ -940,12 +1040,589 @@ int RKADK_MUXER_WriteAudioFrame(void *pMbBlk, RKADK_U32 size, int64_t pts,
   return 0;
 }
 
-static void RKADK_MUXER_Close(MUXER_HANDLE_S *pstMuxerHandle) {
+static RKADK_U64 RKADK_MUXER_GetTimeUs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (RKADK_U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool RKADK_MUXER_UseRollover(MUXER_HANDLE_S *pstMuxerHandle) {
+  RKADK_MUXER_HANDLE_S *pstMuxer = (RKADK_MUXER_HANDLE_S *)pstMuxerHandle->ptr;
+
+  return pstMuxerHandle->stRollover.pThread &&
+         pstMuxer->enRecType != RKADK_REC_TYPE_AOV_LAPSE;
+}
+
+/* reserves size bytes beyond EOF, returns a second fd of the file or -1 */
+static int RKADK_MUXER_Prealloc(const char *pcFileName, off_t size) {
+#ifndef OS_RTT
+  int fd;
+
+  fd = open(pcFileName, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    RKADK_LOGW("open %s failed, errno = %d", pcFileName, errno);
+    return -1;
+  }
+
+  // vfat only supports FALLOC_FL_KEEP_SIZE, exfat none
+  if (size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size))
+    RKADK_LOGD("fallocate %s failed, errno = %d", pcFileName, errno);
+
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+/* pushes the aligned part written to the current file to the card */
+static void RKADK_MUXER_FlushActive(MUXER_HANDLE_S *pstMuxerHandle) {
+#ifndef OS_RTT
+  int fd;
+  off_t off, end;
+  struct stat st;
+  RKADK_U32 u32CostUs, u32KBps;
+  RKADK_U64 u64StartUs;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  RKADK_MUTEX_LOCK(pstRollover->flushMutex);
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  fd = pstRollover->activeFd;
+  off = pstRollover->flushOff;
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  if (fd < 0 || fstat(fd, &st))
+    goto exit;
+
+  end = st.st_size & ~((off_t)RKADK_MUXER_FLUSH_ALIGN - 1);
+  if (end <= off)
+    goto exit;
+
+  u64StartUs = RKADK_MUXER_GetTimeUs();
+  if (sync_file_range(fd, off, end - off, SYNC_FILE_RANGE_WAIT_BEFORE |
+                      SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER)) {
+    RKADK_LOGD("sync_file_range failed, errno = %d", errno);
+    goto exit;
+  }
+  u32CostUs = RKADK_MUXER_GetTimeUs() - u64StartUs;
+  u32KBps = (RKADK_U64)(end - off) * 1000000 / 1024 / (u32CostUs ? u32CostUs : 1);
+
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (pstRollover->activeFd == fd)
+    pstRollover->flushOff = end;
+
+  pstRollover->stStats.u32WriteKBps = u32KBps;
+  if (u32CostUs > pstRollover->stStats.u32MaxFlushUs)
+    pstRollover->stStats.u32MaxFlushUs = u32CostUs;
+
+  // slower than the stream, the cell list fills up soon
+  if ((RKADK_U64)u32KBps * 1024 * 8 < (RKADK_U64)pstMuxerHandle->stVideo.bit_rate)
+    __atomic_store_n(&pstRollover->bWriteSlow, true, __ATOMIC_RELEASE);
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+exit:
+  RKADK_MUTEX_UNLOCK(pstRollover->flushMutex);
+#endif
+}
+
+static void RKADK_MUXER_CloseFd(MUXER_HANDLE_S *pstMuxerHandle, int fd, bool bTrim) {
+  struct stat st;
+
+  if (fd < 0)
+    return;
+
+  // drop the reserve left beyond EOF
+  RKADK_MUTEX_LOCK(pstMuxerHandle->stRollover.flushMutex);
+  if (bTrim && !fstat(fd, &st) && ftruncate(fd, st.st_size))
+    RKADK_LOGD("ftruncate failed, errno = %d", errno);
+  close(fd);
+  RKADK_MUTEX_UNLOCK(pstMuxerHandle->stRollover.flushMutex);
+}
+
+static void RKADK_MUXER_CloseFile(MUXER_HANDLE_S *pstMuxerHandle,
+                                  MUXER_SEGMENT_S *pstSeg) {
+  RKADK_U32 u32CostUs;
+  RKADK_U64 u64StartUs = RKADK_MUXER_GetTimeUs();
+  RKADK_MUXER_HANDLE_S *pstMuxer = (RKADK_MUXER_HANDLE_S *)pstMuxerHandle->ptr;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  // Stop muxer
+  rkmuxer_deinit(pstSeg->id);
+  RKADK_MUXER_CloseFd(pstMuxerHandle, pstSeg->fd, !pstSeg->bDiscard);
+
+  if (pstSeg->bDiscard) {
+    RKADK_LOGI("Stream[%d] drop unused file[%s]", pstMuxerHandle->u32VencChn,
+               pstSeg->cFileName);
+    if (remove(pstSeg->cFileName))
+      RKADK_LOGW("remove %s failed, errno = %d", pstSeg->cFileName, errno);
+    return;
+  }
+
+  u32CostUs = RKADK_MUXER_GetTimeUs() - u64StartUs;
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (u32CostUs > pstRollover->stStats.u32MaxCloseUs)
+    pstRollover->stStats.u32MaxCloseUs = u32CostUs;
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  if (pstMuxer->enableFileCache)
+    return;
+
+  if (pstSeg->bSplitRecord)
+    RKADK_MUXER_NotifyEvent(pstMuxerHandle, RKADK_MUXER_EVENT_MANUAL_SPLIT_END,
+                            pstSeg->realDuration, pstSeg->cFileName);
+  else
+    RKADK_MUXER_NotifyEvent(pstMuxerHandle, RKADK_MUXER_EVENT_FILE_END,
+                            pstSeg->realDuration, pstSeg->cFileName);
+}
+
+static bool RKADK_MUXER_QueueClose(MUXER_HANDLE_S *pstMuxerHandle,
+                                   MUXER_SEGMENT_S *pstSeg) {
+  int index;
+  bool bQueued = false;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  if (!RKADK_MUXER_UseRollover(pstMuxerHandle))
+    return false;
+
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (pstRollover->u32CloseCnt < RKADK_MUXER_CLOSE_MAX_CNT) {
+    index = (pstRollover->u32CloseHead + pstRollover->u32CloseCnt) % RKADK_MUXER_CLOSE_MAX_CNT;
+    memcpy(&pstRollover->stClose[index], pstSeg, sizeof(MUXER_SEGMENT_S));
+    pstRollover->u32CloseCnt++;
+    bQueued = true;
+  }
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  if (bQueued)
+    RKADK_THREAD_Wake(pstRollover->pThread);
+  else
+    RKADK_LOGW("Stream[%d] close queue is full, close %s in place",
+               pstMuxerHandle->u32VencChn, pstSeg->cFileName);
+
+  return bQueued;
+}
+
+static void RKADK_MUXER_OpenFile(MUXER_HANDLE_S *pstMuxerHandle, int id) {
+  int ret;
+  bool bDiscard = false;
+  off_t size;
+  MUXER_SEGMENT_S stSeg;
+  MUXER_NEXT_STATE_E enState = MUXER_NEXT_READY;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  memset(&stSeg, 0, sizeof(MUXER_SEGMENT_S));
+  stSeg.id = id;
+  stSeg.fd = -1;
+  ret = pstMuxerHandle->pcbRequestFileNames(pstMuxerHandle->ptr, stSeg.cFileName,
+                                            pstMuxerHandle->muxerId);
+  if (ret) {
+    RKADK_LOGE("request file name failed");
+    RKADK_MUXER_NotifyEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_GET_FILENAME,
+                            0, stSeg.cFileName);
+    enState = MUXER_NEXT_FAILED;
+  } else {
+    RKADK_MUTEX_LOCK(pstMuxerHandle->paramMutex);
+    ret = rkmuxer_init(id, (char *)pstMuxerHandle->cOutputFmt, stSeg.cFileName,
+                       &pstMuxerHandle->stVideo, &pstMuxerHandle->stAudio);
+    stSeg.u32ParamSeq = pstMuxerHandle->u32ParamSeq;
+    // 10% over bit_rate * duration for audio and the index
+    size = (off_t)pstMuxerHandle->stVideo.bit_rate / 8 * pstMuxerHandle->duration * 11 / 10;
+    RKADK_MUTEX_UNLOCK(pstMuxerHandle->paramMutex);
+    if (ret) {
+      RKADK_LOGE("rkmuxer_init[%d] failed[%d]", id, ret);
+      RKADK_MUXER_NotifyEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_CREATE_FILE_FAIL,
+                              0, stSeg.cFileName);
+      enState = MUXER_NEXT_FAILED;
+    } else {
+      RKADK_LOGI("Stream[%d] next file[%s] is ready", pstMuxerHandle->u32VencChn,
+                 stSeg.cFileName);
+      if (size > RKADK_MUXER_PREALLOC_MAX)
+        size = RKADK_MUXER_PREALLOC_MAX;
+      stSeg.fd = RKADK_MUXER_Prealloc(stSeg.cFileName, size);
+    }
+  }
+
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (pstRollover->bDropNext) {
+    pstRollover->bDropNext = false;
+    bDiscard = enState == MUXER_NEXT_READY;
+    enState = MUXER_NEXT_IDLE;
+  }
+  memcpy(&pstRollover->stNext, &stSeg, sizeof(MUXER_SEGMENT_S));
+  pstRollover->enNextState = enState;
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  if (bDiscard) {
+    stSeg.bDiscard = true;
+    RKADK_MUXER_CloseFile(pstMuxerHandle, &stSeg);
+  }
+}
+
+static void RKADK_MUXER_RolloverFlush(MUXER_HANDLE_S *pstMuxerHandle) {
+  int id;
+  MUXER_SEGMENT_S stSeg;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  while (1) {
+    // closes go first, the next open may reuse the context
+    RKADK_MUTEX_LOCK(pstRollover->mutex);
+    if (pstRollover->u32CloseCnt) {
+      memcpy(&stSeg, &pstRollover->stClose[pstRollover->u32CloseHead], sizeof(MUXER_SEGMENT_S));
+      RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+      RKADK_MUXER_CloseFile(pstMuxerHandle, &stSeg);
+
+      // counted until done, see RKADK_MUXER_RolloverWaitIdle
+      RKADK_MUTEX_LOCK(pstRollover->mutex);
+      pstRollover->u32CloseHead = (pstRollover->u32CloseHead + 1) % RKADK_MUXER_CLOSE_MAX_CNT;
+      pstRollover->u32CloseCnt--;
+      RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+    } else if (pstRollover->enNextState == MUXER_NEXT_OPENING) {
+      id = pstRollover->nextId;
+      RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+      RKADK_MUXER_OpenFile(pstMuxerHandle, id);
+    } else {
+      RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+      break;
+    }
+
+    RKADK_SIGNAL_Give(pstRollover->pSignal);
+  }
+}
+
+static bool RKADK_MUXER_RolloverProc(void *params) {
+  int timeout;
+  MUXER_HANDLE_S *pstMuxerHandle = (MUXER_HANDLE_S *)params;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  timeout = pstRollover->activeFd >= 0 ? RKADK_MUXER_FLUSH_MS : -1;
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  RKADK_THREAD_Wait(timeout);
+  RKADK_MUXER_RolloverFlush(pstMuxerHandle);
+  RKADK_MUXER_FlushActive(pstMuxerHandle);
+  return true;
+}
+
+static void RKADK_MUXER_RequestNext(MUXER_HANDLE_S *pstMuxerHandle, bool bRetry) {
+  bool bRequest = false;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (pstRollover->enNextState == MUXER_NEXT_IDLE ||
+      (bRetry && pstRollover->enNextState == MUXER_NEXT_FAILED)) {
+    pstRollover->enNextState = MUXER_NEXT_OPENING;
+    if (pstMuxerHandle->activeId == pstMuxerHandle->muxerId)
+      pstRollover->nextId = pstMuxerHandle->muxerId + RKADK_MUXER_ALT_ID_BASE;
+    else
+      pstRollover->nextId = pstMuxerHandle->muxerId;
+    bRequest = true;
+  }
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  if (bRequest)
+    RKADK_THREAD_Wake(pstRollover->pThread);
+}
+
+static void RKADK_MUXER_PreOpen(MUXER_HANDLE_S *pstMuxerHandle,
+                                MUXER_BUF_CELL_S *cell) {
+  RKADK_U32 u32Duration;
+
+  if (!RKADK_MUXER_UseRollover(pstMuxerHandle) || pstMuxerHandle->duration <= 0)
+    return;
+
+  if (pstMuxerHandle->stManualSplit.bSplitRecord)
+    u32Duration = pstMuxerHandle->stManualSplit.u32SplitDurationSec;
+  else
+    u32Duration = pstMuxerHandle->duration;
+
+  if (pstMuxerHandle->stManualSplit.bEnableSplit ||
+      cell->pts - pstMuxerHandle->startTime >=
+      (int64_t)u32Duration * 1000000 - RKADK_MUXER_PRE_OPEN_MS * 1000)
+    RKADK_MUXER_RequestNext(pstMuxerHandle, false);
+}
+
+/* called at the key frame, switches to the file opened by the rollover thread */
+static int RKADK_MUXER_TakeNext(MUXER_HANDLE_S *pstMuxerHandle) {
+  int ret = -1;
+  bool bRequest = false, bWait = false;
+  RKADK_U32 u32WaitUs;
+  RKADK_U64 u64StartUs;
+  MUXER_SEGMENT_S stSeg;
+  MUXER_NEXT_STATE_E enState;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  u64StartUs = RKADK_MUXER_GetTimeUs();
+  while (1) {
+    RKADK_MUTEX_LOCK(pstRollover->mutex);
+    enState = pstRollover->enNextState;
+    if (enState == MUXER_NEXT_READY || enState == MUXER_NEXT_FAILED) {
+      memcpy(&stSeg, &pstRollover->stNext, sizeof(MUXER_SEGMENT_S));
+      pstRollover->enNextState = MUXER_NEXT_IDLE;
+    }
+    RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+    if (enState == MUXER_NEXT_READY) {
+      if (stSeg.u32ParamSeq ==
+          __atomic_load_n(&pstMuxerHandle->u32ParamSeq, __ATOMIC_ACQUIRE)) {
+        ret = 0;
+        break;
+      }
+
+      // stVideo or stAudio changed after the open
+      stSeg.bDiscard = true;
+      if (!RKADK_MUXER_QueueClose(pstMuxerHandle, &stSeg))
+        RKADK_MUXER_CloseFile(pstMuxerHandle, &stSeg);
+    } else if (enState == MUXER_NEXT_FAILED && bRequest) {
+      break;
+    }
+
+    if (enState != MUXER_NEXT_OPENING) {
+      RKADK_MUXER_RequestNext(pstMuxerHandle, true);
+      bRequest = true;
+    }
+
+    if (RKADK_MUXER_GetTimeUs() - u64StartUs >= RKADK_MUXER_OPEN_WAIT_MS * 1000) {
+      RKADK_LOGW("Stream[%d] wait next file timeout", pstMuxerHandle->u32VencChn);
+      break;
+    }
+
+    bWait = true;
+    RKADK_SIGNAL_Wait(pstRollover->pSignal, 20);
+  }
+
+  if (!ret) {
+    pstMuxerHandle->activeId = stSeg.id;
+    memcpy(pstMuxerHandle->cFileName, stSeg.cFileName, RKADK_MAX_FILE_PATH_LEN);
+  }
+
+  u32WaitUs = RKADK_MUXER_GetTimeUs() - u64StartUs;
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (!ret) {
+    pstRollover->activeFd = stSeg.fd;
+    pstRollover->flushOff = 0;
+  }
+
+  if (!ret && bWait)
+    pstRollover->stStats.u32LateOpenCnt++;
+  else if (!ret)
+    pstRollover->stStats.u32PreOpenCnt++;
+
+  if (u32WaitUs > pstRollover->stStats.u32MaxWaitUs)
+    pstRollover->stStats.u32MaxWaitUs = u32WaitUs;
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  // start the write back of the file
+  if (!ret && stSeg.fd >= 0)
+    RKADK_THREAD_Wake(pstRollover->pThread);
+
+  return ret;
+}
+
+/* drops the file opened ahead, used when the stream stops */
+static void RKADK_MUXER_DropNext(MUXER_HANDLE_S *pstMuxerHandle) {
+  bool bDrop = false;
+  MUXER_SEGMENT_S stSeg;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  if (!pstRollover->pThread)
+    return;
+
+  RKADK_MUTEX_LOCK(pstRollover->mutex);
+  if (pstRollover->enNextState == MUXER_NEXT_READY) {
+    memcpy(&stSeg, &pstRollover->stNext, sizeof(MUXER_SEGMENT_S));
+    pstRollover->enNextState = MUXER_NEXT_IDLE;
+    bDrop = true;
+  } else if (pstRollover->enNextState == MUXER_NEXT_OPENING) {
+    pstRollover->bDropNext = true;
+  } else {
+    pstRollover->enNextState = MUXER_NEXT_IDLE;
+  }
+  RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+  if (bDrop) {
+    stSeg.bDiscard = true;
+    if (!RKADK_MUXER_QueueClose(pstMuxerHandle, &stSeg))
+      RKADK_MUXER_CloseFile(pstMuxerHandle, &stSeg);
+  }
+}
+
+static void RKADK_MUXER_RolloverWaitIdle(MUXER_HANDLE_S *pstMuxerHandle) {
+  bool bBusy;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  if (!pstRollover->pThread)
+    return;
+
+  do {
+    RKADK_MUTEX_LOCK(pstRollover->mutex);
+    bBusy = pstRollover->u32CloseCnt || pstRollover->enNextState == MUXER_NEXT_OPENING;
+    RKADK_MUTEX_UNLOCK(pstRollover->mutex);
+
+    if (bBusy)
+      RKADK_SIGNAL_Wait(pstRollover->pSignal, 20);
+  } while (bBusy);
+}
+
+static int RKADK_MUXER_RolloverInit(MUXER_HANDLE_S *pstMuxerHandle) {
+  int ret;
+  char name[RKADK_THREAD_NAME_LEN];
+  RKADK_MUXER_HANDLE_S *pstMuxer = (RKADK_MUXER_HANDLE_S *)pstMuxerHandle->ptr;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  pstMuxerHandle->activeId = pstMuxerHandle->muxerId;
+  pstRollover->enNextState = MUXER_NEXT_IDLE;
+  pstRollover->activeFd = -1;
+  ret = pthread_mutex_init(&pstRollover->mutex, NULL);
+  if (ret) {
+    RKADK_LOGE("rollover mutex init failed[%d]", ret);
+    return -1;
+  }
+
+  ret = pthread_mutex_init(&pstRollover->flushMutex, NULL);
+  if (ret) {
+    RKADK_LOGE("flush mutex init failed[%d]", ret);
+    pthread_mutex_destroy(&pstRollover->mutex);
+    return -1;
+  }
+
+  // the file cache writes behind already
+  if (pstMuxer->enableFileCache)
+    return 0;
+
+  pstRollover->pSignal = RKADK_SIGNAL_Create(0, 1);
+  if (!pstRollover->pSignal) {
+    RKADK_LOGE("RKADK_SIGNAL_Create failed");
+    pthread_mutex_destroy(&pstRollover->mutex);
+    pthread_mutex_destroy(&pstRollover->flushMutex);
+    return -1;
+  }
+
+  snprintf(name, sizeof(name), "MuxerRoll_%d", pstMuxerHandle->u32VencChn);
+  pstRollover->pThread = RKADK_THREAD_Create(RKADK_MUXER_RolloverProc, pstMuxerHandle, name);
+  if (!pstRollover->pThread) {
+    RKADK_LOGE("RKADK_THREAD_Create failed");
+    RKADK_SIGNAL_Destroy(pstRollover->pSignal);
+    pstRollover->pSignal = NULL;
+    pthread_mutex_destroy(&pstRollover->mutex);
+    pthread_mutex_destroy(&pstRollover->flushMutex);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void RKADK_MUXER_RolloverDeinit(MUXER_HANDLE_S *pstMuxerHandle) {
+  MUXER_SEGMENT_S stSeg;
+  MUXER_ROLLOVER_PARAM *pstRollover = &pstMuxerHandle->stRollover;
+
+  if (pstRollover->pThread) {
+    RKADK_THREAD_Destory(pstRollover->pThread);
+    pstRollover->pThread = NULL;
+
+    // finish the closes left by the thread, an open not started is dropped
+    if (pstRollover->enNextState == MUXER_NEXT_OPENING)
+      pstRollover->enNextState = MUXER_NEXT_IDLE;
+    pstRollover->bDropNext = false;
+    RKADK_MUXER_RolloverFlush(pstMuxerHandle);
+
+    if (pstRollover->enNextState == MUXER_NEXT_READY) {
+      memcpy(&stSeg, &pstRollover->stNext, sizeof(MUXER_SEGMENT_S));
+      stSeg.bDiscard = true;
+      RKADK_MUXER_CloseFile(pstMuxerHandle, &stSeg);
+    }
+    pstRollover->enNextState = MUXER_NEXT_IDLE;
+
+    RKADK_SIGNAL_Destroy(pstRollover->pSignal);
+    pstRollover->pSignal = NULL;
+  }
+
+  // disabled while still muxering
+  RKADK_MUXER_CloseFd(pstMuxerHandle, pstRollover->activeFd, true);
+  pstRollover->activeFd = -1;
+
+  pthread_mutex_destroy(&pstRollover->mutex);
+  pthread_mutex_destroy(&pstRollover->flushMutex);
+}
+
+static int RKADK_MUXER_WriteVideo(MUXER_HANDLE_S *pstMuxerHandle, unsigned char *buf,
+                                  RKADK_U32 size, int64_t pts, int isKeyFrame,
+                                  RKADK_U32 seq) {
+  int ret;
+
+  RKADK_TRACE_EVT(RKADK_TRACE_EVT_MUXER_WRITE_BEGIN, pstMuxerHandle->u32VencChn, seq, pts);
+  ret = rkmuxer_write_video_frame(pstMuxerHandle->activeId, buf, size, pts, isKeyFrame);
+  RKADK_TRACE_EVT(RKADK_TRACE_EVT_MUXER_WRITE_END, pstMuxerHandle->u32VencChn, seq, pts);
+  if (ret) {
+    RKADK_LOGE("Muxer[%d] write video frame failed", pstMuxerHandle->muxerId);
+    RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_WRITE_FILE_FAIL, 0);
+    pstMuxerHandle->bIOError = true;
+  }
+
+  return ret;
+}
+
+#ifdef ENABLE_AOV
+static int RKADK_MUXER_AovWrite(void *pCtx, unsigned char *buf, uint32_t size,
+                                int64_t pts, int isKeyFrame, uint32_t seq) {
+  return RKADK_MUXER_WriteVideo((MUXER_HANDLE_S *)pCtx, buf, size, pts, isKeyFrame, seq);
+}
+
+static int RKADK_MUXER_AovSleep(void *pCtx) {
+  MUXER_HANDLE_S *pstMuxerHandle = (MUXER_HANDLE_S *)pCtx;
+
+  return RKADK_MUXER_EnterSleep(pstMuxerHandle->ptr, pstMuxerHandle->u32VencChn);
+}
+
+static void RKADK_MUXER_AovSchedCheck(MUXER_HANDLE_S *pstMuxerHandle) {
+  RKADK_AOV_SCHED_ATTR_S stAttr;
+  AOV_PARAM_S *pstAovParam = &pstMuxerHandle->stAovParam;
   RKADK_MUXER_HANDLE_S *pstMuxer = (RKADK_MUXER_HANDLE_S *)pstMuxerHandle->ptr;
 
+  if (pstMuxer->enRecType != RKADK_REC_TYPE_AOV_LAPSE || pstMuxer->enableFileCache) {
+    // left aov lapse, the file close has written the cache out
+    if (pstAovParam->pSched) {
+      RKADK_AOV_SCHED_Flush(pstAovParam->pSched);
+      RKADK_AOV_SCHED_Destroy(pstAovParam->pSched);
+      pstAovParam->pSched = NULL;
+    }
+  } else if (!pstAovParam->pSched && pstMuxer->stAovAttr.u32CacheSize) {
+    memset(&stAttr, 0, sizeof(RKADK_AOV_SCHED_ATTR_S));
+    stAttr.u32RingSize = pstMuxer->stAovAttr.u32CacheSize;
+    stAttr.u32FlushBytes = pstMuxer->stAovAttr.u32FlushSize;
+    stAttr.u32FlushIntervalS = pstMuxer->stAovAttr.u32FlushIntervalSec;
+    stAttr.pCtx = pstMuxerHandle;
+    stAttr.pfnWrite = RKADK_MUXER_AovWrite;
+    stAttr.pfnSleep = RKADK_MUXER_AovSleep;
+    pstAovParam->pSched = RKADK_AOV_SCHED_Create(&stAttr);
+    if (!pstAovParam->pSched)
+      RKADK_LOGW("Stream[%d] aov cache unavailable, write every frame",
+                 pstMuxerHandle->u32VencChn);
+  }
+
+  if (__atomic_load_n(&pstAovParam->bFlushReq, __ATOMIC_ACQUIRE)) {
+    if (pstAovParam->pSched)
+      RKADK_AOV_SCHED_Flush(pstAovParam->pSched);
+    __atomic_store_n(&pstAovParam->bFlushReq, false, __ATOMIC_RELEASE);
+    RKADK_SIGNAL_Give(pstAovParam->pFlushDone);
+  }
+}
+#endif
+
+static void RKADK_MUXER_Close(MUXER_HANDLE_S *pstMuxerHandle) {
+  MUXER_SEGMENT_S stSeg;
+
   if (!pstMuxerHandle->bMuxering)
     return;
 
+#ifdef ENABLE_AOV
+  // the cached frames belong to this file
+  if (pstMuxerHandle->stAovParam.pSched)
+    RKADK_AOV_SCHED_Flush(pstMuxerHandle->stAovParam.pSched);
+#endif
+
   RKADK_LOGI("File end: chn = %d, duration: %d, frameCnt = %d, keyFrameCnt: %d",
       pstMuxerHandle->u32VencChn, pstMuxerHandle->realDuration,
       pstMuxerHandle->frameCnt, pstMuxerHandle->keyFrameCnt);
@@ -964,21 +1641,21 @@ static void RKADK_MUXER_Close(MUXER_HANDLE_S *pstMuxerHandle) {
   strncpy(pstFileCachehandle->cFileName, pstMuxerHandle->cFileName, RKADK_MAX_FILE_PATH_LEN);
 #endif
 
-  // Stop muxer
-  rkmuxer_deinit(pstMuxerHandle->muxerId);
+  memset(&stSeg, 0, sizeof(MUXER_SEGMENT_S));
+  stSeg.id = pstMuxerHandle->activeId;
+  memcpy(stSeg.cFileName, pstMuxerHandle->cFileName, RKADK_MAX_FILE_PATH_LEN);
+  stSeg.realDuration = pstMuxerHandle->realDuration;
+  stSeg.bSplitRecord = pstMuxerHandle->stManualSplit.bSplitRecord;
+  pstMuxerHandle->stManualSplit.bSplitRecord = false;
 
-  if (!pstMuxer->enableFileCache) {
-    if (pstMuxerHandle->stManualSplit.bSplitRecord) {
-      RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_MANUAL_SPLIT_END,
-                               pstMuxerHandle->realDuration);
-      pstMuxerHandle->stManualSplit.bSplitRecord = false;
-    } else {
-      RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_FILE_END,
-                               pstMuxerHandle->realDuration);
-    }
-  } else {
-    pstMuxerHandle->stManualSplit.bSplitRecord = false;
-  }
+  RKADK_MUTEX_LOCK(pstMuxerHandle->stRollover.mutex);
+  stSeg.fd = pstMuxerHandle->stRollover.activeFd;
+  pstMuxerHandle->stRollover.activeFd = -1;
+  RKADK_MUTEX_UNLOCK(pstMuxerHandle->stRollover.mutex);
+
+  // the rollover thread finalizes the file while the next one is written
+  if (!RKADK_MUXER_QueueClose(pstMuxerHandle, &stSeg))
+    RKADK_MUXER_CloseFile(pstMuxerHandle, &stSeg);
 
   if (pstMuxerHandle->stThumbParam.bGetThumb)
     RKADK_LOGD("muxerId[%d] cFileName[%s] not get thumb", pstMuxerHandle->muxerId, pstMuxerHandle->cFileName);
@@ -1015,7 +1692,7 @@ static bool RKADK_MUXER_GetThumb(MUXER_HANDLE_S *pstMuxerHandle) {
     return false;
   }
 
-  position = rkmuxer_get_thumb_pos(pstMuxerHandle->muxerId);
+  position = rkmuxer_get_thumb_pos(pstMuxerHandle->activeId);
   if (pstMuxerHandle->bIOError || position > 0)
     bGetThumb = true;
 
@@ -1261,6 +1938,37 @@ static int RKADK_MUXER_PreRecProc(MUXER_HANDLE_S *pstMuxerHandle) {
   return 1;
 }
 
+/* opens the next file on the muxer thread, without the rollover thread */
+static int RKADK_MUXER_Open(MUXER_HANDLE_S *pstMuxerHandle) {
+  int ret;
+  RKADK_MUXER_HANDLE_S *pstMuxer = (RKADK_MUXER_HANDLE_S *)pstMuxerHandle->ptr;
+
+  ret = pstMuxerHandle->pcbRequestFileNames(pstMuxerHandle->ptr,
+                                            pstMuxerHandle->cFileName,
+                                            pstMuxerHandle->muxerId);
+  if (ret) {
+    RKADK_LOGE("request file name failed");
+    RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_GET_FILENAME, 0);
+    return ret;
+  }
+
+  RKADK_LOGI("Ready to recod new video file path:[%s]", pstMuxerHandle->cFileName);
+
+  RKADK_MUTEX_LOCK(pstMuxerHandle->paramMutex);
+  ret = rkmuxer_init(pstMuxerHandle->activeId,
+                     (char *)pstMuxerHandle->cOutputFmt,
+                     pstMuxerHandle->cFileName, &pstMuxerHandle->stVideo,
+                     &pstMuxerHandle->stAudio);
+  RKADK_MUTEX_UNLOCK(pstMuxerHandle->paramMutex);
+  if (ret) {
+    RKADK_LOGE("rkmuxer_init[%d] failed[%d]", pstMuxerHandle->activeId, ret);
+    if (!pstMuxer->enableFileCache)
+      RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_CREATE_FILE_FAIL, 0);
+  }
+
+  return ret;
+}
+
 static bool RKADK_MUXER_Proc(void *params) {
   int ret = 0;
   RKADK_U32 u32Duration;
@@ -1278,6 +1986,10 @@ static bool RKADK_MUXER_Proc(void *params) {
   RKADK_MUXER_HANDLE_S *pstMuxer = (RKADK_MUXER_HANDLE_S *)pstMuxerHandle->ptr;
   RKADK_SIGNAL_Wait(pstMuxerHandle->pSignal, pstMuxerHandle->duration * 1000);
 
+#ifdef ENABLE_AOV
+  RKADK_MUXER_AovSchedCheck(pstMuxerHandle);
+#endif
+
   cell = RKADK_MUXER_CellPop(pstMuxerHandle, &pstMuxerHandle->stProcList);
   while (cell) {
     // Create muxer
@@ -1301,47 +2013,32 @@ static bool RKADK_MUXER_Proc(void *params) {
         u32Duration = pstMuxerHandle->duration;
 
       if (!pstMuxerHandle->bMuxering && cell->isKeyFrame) {
-        ret = pstMuxerHandle->pcbRequestFileNames(pstMuxerHandle->ptr,
-                                                  pstMuxerHandle->cFileName,
-                                                  pstMuxerHandle->muxerId);
-        if (ret) {
-          RKADK_LOGE("request file name failed");
-          RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_GET_FILENAME, 0);
-        } else {
-          RKADK_LOGI("Ready to recod new video file path:[%s]", pstMuxerHandle->cFileName);
-
-          RKADK_MUTEX_LOCK(pstMuxerHandle->paramMutex);
-          ret = rkmuxer_init(pstMuxerHandle->muxerId,
-                            (char *)pstMuxerHandle->cOutputFmt,
-                            pstMuxerHandle->cFileName, &pstMuxerHandle->stVideo,
-                            &pstMuxerHandle->stAudio);
-          RKADK_MUTEX_UNLOCK(pstMuxerHandle->paramMutex);
-          if (ret) {
-            RKADK_LOGE("rkmuxer_init[%d] failed[%d]", pstMuxerHandle->muxerId, ret);
-            if (!pstMuxer->enableFileCache)
-              RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_CREATE_FILE_FAIL, 0);
-          } else {
-            if (!pstMuxer->enableFileCache)
-              RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_FILE_BEGIN, u32Duration);
-            if (RKADK_MUXER_PreRecProc(pstMuxerHandle)) {
-              MUXER_BUF_CELL_S *firstCell = RKADK_MUXER_CellPop(pstMuxerHandle, &pstMuxerHandle->stProcList);
-              if (firstCell) {
-                RKADK_MUXER_CellFree(pstMuxerHandle, cell);
-                cell = firstCell;
-              } else {
-                RKADK_LOGE("pre_record proc ok, but cell pop fialed");
-                RKADK_MUXER_ListRelease(pstMuxerHandle, &pstMuxerHandle->stProcList);
-              }
+        if (RKADK_MUXER_UseRollover(pstMuxerHandle))
+          ret = RKADK_MUXER_TakeNext(pstMuxerHandle);
+        else
+          ret = RKADK_MUXER_Open(pstMuxerHandle);
+
+        if (!ret) {
+          if (!pstMuxer->enableFileCache)
+            RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_FILE_BEGIN, u32Duration);
+          if (RKADK_MUXER_PreRecProc(pstMuxerHandle)) {
+            MUXER_BUF_CELL_S *firstCell = RKADK_MUXER_CellPop(pstMuxerHandle, &pstMuxerHandle->stProcList);
+            if (firstCell) {
+              RKADK_MUXER_CellFree(pstMuxerHandle, cell);
+              cell = firstCell;
+            } else {
+              RKADK_LOGE("pre_record proc ok, but cell pop fialed");
+              RKADK_MUXER_ListRelease(pstMuxerHandle, &pstMuxerHandle->stProcList);
             }
-
-            pstMuxerHandle->bMuxering = true;
-            pstMuxerHandle->startTime = cell->pts;
-            pstMuxerHandle->lapseTimeStamp = pstMuxerHandle->startTime;
-            pstMuxerHandle->stThumbParam.bGetThumb = true;
-            pstMuxerHandle->stThumbParam.bRequestThumb = true;
-            pstMuxerHandle->u32FirstSeq = cell->seq;
-            pts = cell->pts;
           }
+
+          pstMuxerHandle->bMuxering = true;
+          pstMuxerHandle->startTime = cell->pts;
+          pstMuxerHandle->lapseTimeStamp = pstMuxerHandle->startTime;
+          pstMuxerHandle->stThumbParam.bGetThumb = true;
+          pstMuxerHandle->stThumbParam.bRequestThumb = true;
+          pstMuxerHandle->u32FirstSeq = cell->seq;
+          pts = cell->pts;
         }
       } else if (!pstMuxerHandle->bMuxering) {
         if(cell->pool == &pstMuxerHandle->stVFree) {
@@ -1354,22 +2051,24 @@ static bool RKADK_MUXER_Proc(void *params) {
       if (pstMuxerHandle->bMuxering) {
         // Write
         if (cell->pool == &pstMuxerHandle->stVFree) {
-          ret = rkmuxer_write_video_frame(pstMuxerHandle->muxerId, cell->buf,
-                                    cell->size, cell->pts, cell->isKeyFrame);
-          if (ret) {
-            RKADK_LOGE("Muxer[%d] write video frame failed", pstMuxerHandle->muxerId);
-            RKADK_MUXER_ProcessEvent(pstMuxerHandle, RKADK_MUXER_EVENT_ERR_WRITE_FILE_FAIL, 0);
-            pstMuxerHandle->bIOError = true;
+#ifdef ENABLE_AOV
+          if (pstMuxerHandle->stAovParam.pSched)
+            ret = RKADK_AOV_SCHED_Push(pstMuxerHandle->stAovParam.pSched, cell->buf,
+                                       cell->size, cell->pts, cell->isKeyFrame, cell->seq);
+          else
+#endif
+          ret = RKADK_MUXER_WriteVideo(pstMuxerHandle, cell->buf, cell->size, cell->pts,
+                                       cell->isKeyFrame, cell->seq);
+          if (ret)
             continue;
-          } else {
-            if (pstMuxer->pfnPtsCallback) {
-              stPtsInfo.u32CamId = pstMuxer->u32CamId;
-              stPtsInfo.u32ChnId = pstMuxerHandle->u32VencChn;
-              stPtsInfo.u64PTS = pts;
-              stPtsInfo.u32Seq = cell->seq - pstMuxerHandle->u32FirstSeq;
-              stPtsInfo.pFileName = pstMuxerHandle->cFileName;
-              pstMuxer->pfnPtsCallback(&stPtsInfo);
-            }
+
+          if (pstMuxer->pfnPtsCallback) {
+            stPtsInfo.u32CamId = pstMuxer->u32CamId;
+            stPtsInfo.u32ChnId = pstMuxerHandle->u32VencChn;
+            stPtsInfo.u64PTS = pts;
+            stPtsInfo.u32Seq = cell->seq - pstMuxerHandle->u32FirstSeq;
+            stPtsInfo.pFileName = pstMuxerHandle->cFileName;
+            pstMuxer->pfnPtsCallback(&stPtsInfo);
           }
 
           if (pstMuxerHandle->bWriteFirstFrame) {
@@ -1387,6 +2086,7 @@ static bool RKADK_MUXER_Proc(void *params) {
           if(cell->isKeyFrame)
             pstMuxerHandle->keyFrameCnt++;
           RKADK_MUXER_RequestThumb(pstMuxerHandle, cell);
+          RKADK_MUXER_PreOpen(pstMuxerHandle, cell);
 
           if (pstMuxerHandle->stThumbParam.bGetThumb) {
             if (pstMuxer->enableFileCache) {
@@ -1397,7 +2097,7 @@ static bool RKADK_MUXER_Proc(void *params) {
             }
           }
         } else if (cell->pool == &pstMuxerHandle->stAFree) {
-          ret = rkmuxer_write_audio_frame(pstMuxerHandle->muxerId, cell->buf,
+          ret = rkmuxer_write_audio_frame(pstMuxerHandle->activeId, cell->buf,
                                     cell->size, cell->pts);
           if (ret) {
             RKADK_LOGE("Muxer[%d] write audio frame failed", pstMuxerHandle->muxerId);
@@ -1411,9 +2111,15 @@ static bool RKADK_MUXER_Proc(void *params) {
 
 #ifdef ENABLE_AOV
         if (pstMuxer->enRecType == RKADK_REC_TYPE_AOV_LAPSE) {
+          RKADK_AOV_MarkStage(RKADK_AOV_STAGE_MUX, 0);
           RKADK_MUTEX_LOCK(stAovHandle.mutex);
-          if (!pstMuxerHandle->stAovParam.bIsSleep)
-            RKADK_MUXER_EnterSleep(pstMuxer, pstMuxerHandle->u32VencChn);
+          if (!pstMuxerHandle->stAovParam.bIsSleep) {
+            // the scheduler writes the cache out when due, then sleeps
+            if (pstMuxerHandle->stAovParam.pSched)
+              RKADK_AOV_SCHED_Sleep(pstMuxerHandle->stAovParam.pSched, false);
+            else
+              RKADK_MUXER_EnterSleep(pstMuxer, pstMuxerHandle->u32VencChn);
+          }
           RKADK_MUTEX_UNLOCK(stAovHandle.mutex);
         }
 #endif
@@ -1427,8 +2133,10 @@ static bool RKADK_MUXER_Proc(void *params) {
   }
 
   // Check exit
-  if (!pstMuxerHandle->bEnableStream)
+  if (!pstMuxerHandle->bEnableStream) {
     RKADK_MUXER_Close(pstMuxerHandle);
+    RKADK_MUXER_DropNext(pstMuxerHandle);
+  }
 
   return pstMuxerHandle->bEnableStream;
 }
@@ -1525,6 +2233,7 @@ static RKADK_S32 RKADK_MUXER_SetAVParam(MUXER_HANDLE_S *pMuxerHandle,
   }
 
 exit:
+  __atomic_add_fetch(&pMuxerHandle->u32ParamSeq, 1, __ATOMIC_RELEASE);
   RKADK_MUTEX_UNLOCK(pMuxerHandle->paramMutex);
   return ret;
 }
@@ -1650,12 +2359,35 @@ RKADK_S32 RKADK_MUXER_Enable(RKADK_MUXER_ATTR_S *pstMuxerAttr,
       free(pMuxerHandle);
       return -1;
     }
+
+#ifdef ENABLE_AOV
+    pMuxerHandle->stAovParam.pFlushDone = RKADK_SIGNAL_Create(0, 1);
+    if (!pMuxerHandle->stAovParam.pFlushDone) {
+      RKADK_LOGE("RKADK_SIGNAL_Create failed");
+      RKADK_SIGNAL_Destroy(pMuxerHandle->pSignal);
+      free(pMuxerHandle);
+      return -1;
+    }
+#endif
     snprintf(name, sizeof(name), "Muxer_%d", pMuxerHandle->u32VencChn);
     pMuxerHandle->ptr = (RKADK_MW_PTR)pstMuxer;
 
+    if (RKADK_MUXER_RolloverInit(pMuxerHandle)) {
+#ifdef ENABLE_AOV
+      RKADK_SIGNAL_Destroy(pMuxerHandle->stAovParam.pFlushDone);
+#endif
+      RKADK_SIGNAL_Destroy(pMuxerHandle->pSignal);
+      free(pMuxerHandle);
+      return -1;
+    }
+
     pMuxerHandle->pThread = RKADK_THREAD_Create(RKADK_MUXER_Proc, pMuxerHandle, name);
     if (!pMuxerHandle->pThread) {
       RKADK_LOGE("RKADK_THREAD_Create failed");
+      RKADK_MUXER_RolloverDeinit(pMuxerHandle);
+#ifdef ENABLE_AOV
+      RKADK_SIGNAL_Destroy(pMuxerHandle->stAovParam.pFlushDone);
+#endif
       RKADK_SIGNAL_Destroy(pMuxerHandle->pSignal);
       free(pMuxerHandle);
       return -1;
@@ -1760,6 +2492,14 @@ RKADK_S32 RKADK_MUXER_Disable(RKADK_MW_PTR pHandle) {
     // Destroy thread
     RKADK_THREAD_Destory(pstMuxerHandle->pThread);
     pstMuxerHandle->pThread = NULL;
+    RKADK_MUXER_RolloverDeinit(pstMuxerHandle);
+
+#ifdef ENABLE_AOV
+    RKADK_AOV_SCHED_Destroy(pstMuxerHandle->stAovParam.pSched);
+    pstMuxerHandle->stAovParam.pSched = NULL;
+    RKADK_SIGNAL_Destroy(pstMuxerHandle->stAovParam.pFlushDone);
+    pstMuxerHandle->stAovParam.pFlushDone = NULL;
+#endif
 
     // Destroy signal
     RKADK_SIGNAL_Destroy(pstMuxerHandle->pSignal);
@@ -2107,6 +2847,10 @@ RKADK_S32 RKADK_MUXER_Reset(RKADK_MW_PTR pHandle) {
     RKADK_THREAD_Destory(pstMuxerHandle->pThread);
     pstMuxerHandle->pThread = NULL;
 
+    // the record type or the video param may change after reset
+    RKADK_MUXER_DropNext(pstMuxerHandle);
+    RKADK_MUXER_RolloverWaitIdle(pstMuxerHandle);
+
     snprintf(name, sizeof(name), "Muxer_%d", pstMuxerHandle->u32VencChn);
     pstMuxerHandle->pThread = RKADK_THREAD_Create(RKADK_MUXER_Proc, pstMuxerHandle, name);
     if (!pstMuxerHandle->pThread) {
@@ -2212,10 +2956,94 @@ RKADK_S32 RKADK_MUXER_UpdateRes(RKADK_MW_PTR pHandle, RKADK_U32 chnId,
   RKADK_MUTEX_LOCK(pstMuxerHandle->paramMutex);
   pstMuxerHandle->stVideo.width = u32Wdith;
   pstMuxerHandle->stVideo.height = u32Hieght;
+  __atomic_add_fetch(&pstMuxerHandle->u32ParamSeq, 1, __ATOMIC_RELEASE);
   RKADK_MUTEX_UNLOCK(pstMuxerHandle->paramMutex);
   return 0;
 }
 
+RKADK_S32 RKADK_MUXER_GetRolloverStats(RKADK_MW_PTR pHandle, RKADK_U32 chnId,
+                                       RKADK_MUXER_ROLLOVER_STATS_S *pstStats) {
+  MUXER_HANDLE_S *pstMuxerHandle = NULL;
+  RKADK_MUXER_HANDLE_S *pstRecorder = NULL;
+
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+
+  pstRecorder = (RKADK_MUXER_HANDLE_S *)pHandle;
+  pstMuxerHandle = RKADK_MUXER_FindHandle(pstRecorder, chnId);
+  if (!pstMuxerHandle) {
+    RKADK_LOGD("Muxer Handle is NULL");
+    return -1;
+  }
+
+  RKADK_MUTEX_LOCK(pstMuxerHandle->stRollover.mutex);
+  memcpy(pstStats, &pstMuxerHandle->stRollover.stStats, sizeof(RKADK_MUXER_ROLLOVER_STATS_S));
+  RKADK_MUTEX_UNLOCK(pstMuxerHandle->stRollover.mutex);
+  return 0;
+}
+
+RKADK_S32 RKADK_MUXER_AovFlush(RKADK_MW_PTR pHandle) {
+#ifdef ENABLE_AOV
+  int i, ret = 0;
+  MUXER_HANDLE_S *pstMuxerHandle = NULL;
+  RKADK_MUXER_HANDLE_S *pstMuxer = NULL;
+
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  pstMuxer = (RKADK_MUXER_HANDLE_S *)pHandle;
+
+  // the muxer threads own the files, let them write their cache out
+  for (i = 0; i < (int)pstMuxer->u32StreamCnt; i++) {
+    pstMuxerHandle = (MUXER_HANDLE_S *)pstMuxer->pMuxerHandle[i];
+    if (!pstMuxerHandle || !pstMuxerHandle->pThread || !pstMuxerHandle->stAovParam.pSched)
+      continue;
+
+    // drop the done signal of an earlier request that timed out
+    RKADK_SIGNAL_Reset(pstMuxerHandle->stAovParam.pFlushDone);
+    __atomic_store_n(&pstMuxerHandle->stAovParam.bFlushReq, true, __ATOMIC_RELEASE);
+    RKADK_SIGNAL_Give(pstMuxerHandle->pSignal);
+  }
+
+  for (i = 0; i < (int)pstMuxer->u32StreamCnt; i++) {
+    pstMuxerHandle = (MUXER_HANDLE_S *)pstMuxer->pMuxerHandle[i];
+    if (!pstMuxerHandle ||
+        !__atomic_load_n(&pstMuxerHandle->stAovParam.bFlushReq, __ATOMIC_ACQUIRE))
+      continue;
+
+    RKADK_SIGNAL_Wait(pstMuxerHandle->stAovParam.pFlushDone, RKADK_MUXER_AOV_FLUSH_WAIT_MS);
+    if (__atomic_load_n(&pstMuxerHandle->stAovParam.bFlushReq, __ATOMIC_ACQUIRE)) {
+      RKADK_LOGE("Stream[%d] aov flush timeout", pstMuxerHandle->u32VencChn);
+      ret = -1;
+    }
+  }
+
+  return ret;
+#else
+  RKADK_LOGE("aov is not enabled");
+  return -1;
+#endif
+}
+
+RKADK_S32 RKADK_MUXER_GetAovStats(RKADK_MW_PTR pHandle, RKADK_U32 chnId,
+                                  RKADK_AOV_SCHED_STATS_S *pstStats) {
+#ifdef ENABLE_AOV
+  MUXER_HANDLE_S *pstMuxerHandle = NULL;
+
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+
+  pstMuxerHandle = RKADK_MUXER_FindHandle((RKADK_MUXER_HANDLE_S *)pHandle, chnId);
+  if (!pstMuxerHandle || !pstMuxerHandle->stAovParam.pSched) {
+    RKADK_LOGD("Stream[%d] has no aov cache", chnId);
+    return -1;
+  }
+
+  RKADK_AOV_SCHED_GetStats(pstMuxerHandle->stAovParam.pSched, pstStats);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
 #ifdef FILE_CACHE
 static void RKADK_MUXER_NotifyCallback(int cmd, void *msg0, void *msg1) {
   int i = 0, j = 0;
@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2022 Rockchip, Inc. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "rkadk_osd.h"
+#include "rkadk_log.h"
+#include "linux_list.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RKADK_OSD_TEXT_REGION_MAX 8
+#define RKADK_OSD_TEXT_FMT_LEN 64
+
+/* built-in 8x16 font, covers the characters of date and time strings */
+#define RKADK_OSD_FONT_WIDTH 8
+#define RKADK_OSD_FONT_HEIGHT 16
+
+static const char g_osdFontChars[] = " -./0123456789:";
+
+static const RKADK_U8 g_osdFontData[][RKADK_OSD_FONT_HEIGHT] = {
+  /* ' ' */
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+  /* '-' */
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfe,
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+  /* '.' */
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+   0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},
+  /* '/' */
+  {0x00, 0x00, 0x00, 0x00, 0x02, 0x06, 0x0c, 0x18,
+   0x30, 0x60, 0xc0, 0x80, 0x00, 0x00, 0x00, 0x00},
+  /* '0' */
+  {0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xce, 0xde, 0xf6,
+   0xe6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00},
+  /* '1' */
+  {0x00, 0x00, 0x18, 0x38, 0x78, 0x18, 0x18, 0x18,
+   0x18, 0x18, 0x18, 0x7e, 0x00, 0x00, 0x00, 0x00},
+  /* '2' */
+  {0x00, 0x00, 0x7c, 0xc6, 0x06, 0x0c, 0x18, 0x30,
+   0x60, 0xc0, 0xc6, 0xfe, 0x00, 0x00, 0x00, 0x00},
+  /* '3' */
+  {0x00, 0x00, 0x7c, 0xc6, 0x06, 0x06, 0x3c, 0x06,
+   0x06, 0x06, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00},
+  /* '4' */
+  {0x00, 0x00, 0x0c, 0x1c, 0x3c, 0x6c, 0xcc, 0xfe,
+   0x0c, 0x0c, 0x0c, 0x1e, 0x00, 0x00, 0x00, 0x00},
+  /* '5' */
+  {0x00, 0x00, 0xfe, 0xc0, 0xc0, 0xc0, 0xfc, 0x06,
+   0x06, 0x06, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00},
+  /* '6' */
+  {0x00, 0x00, 0x38, 0x60, 0xc0, 0xc0, 0xfc, 0xc6,
+   0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00},
+  /* '7' */
+  {0x00, 0x00, 0xfe, 0xc6, 0x06, 0x06, 0x0c, 0x18,
+   0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00},
+  /* '8' */
+  {0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0x7c, 0xc6,
+   0xc6, 0xc6, 0xc6, 0x7c, 0x00, 0x00, 0x00, 0x00},
+  /* '9' */
+  {0x00, 0x00, 0x7c, 0xc6, 0xc6, 0xc6, 0x7e, 0x06,
+   0x06, 0x06, 0x0c, 0x78, 0x00, 0x00, 0x00, 0x00},
+  /* ':' */
+  {0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00,
+   0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/*
+ * Glyphs pre-rendered in the bitmap format with the text colors, a glyph
+ * cell is copied row by row into the text bitmap. Atlases are shared by
+ * all texts with the same font, size, format and colors.
+ */
+typedef struct {
+  struct list_head mark;
+  RKADK_U32 u32RefCnt;
+  const RKADK_OSD_FONT_S *pstFont;
+  RKADK_U32 u32Scale;
+  RKADK_FORMAT_E Format;
+  RKADK_U32 u32FgColor;
+  RKADK_U32 u32BgColor;
+  RKADK_U32 u32CellW;
+  RKADK_U32 u32CellH;
+  RKADK_U32 u32CellBytes;
+  RKADK_U8 *pData;
+} RKADK_OSD_ATLAS_S;
+
+typedef struct {
+  bool bUsed;
+  RKADK_U32 u32OsdId;
+  RKADK_U32 u32Gen;
+} RKADK_OSD_TEXT_REGION_S;
+
+typedef struct {
+  RKADK_OSD_ATLAS_S *pstAtlas;
+  RKADK_U32 u32MaxChars;
+  RKADK_U32 u32Width;
+  RKADK_U32 u32Height;
+  RKADK_U32 u32Stride;
+  RKADK_U32 u32Gen;
+  time_t lastTime;
+  char timeFmt[RKADK_OSD_TEXT_FMT_LEN];
+  char *pText;
+  RKADK_U8 *pBitmap;
+  RKADK_OSD_TEXT_REGION_S stRegion[RKADK_OSD_TEXT_REGION_MAX];
+  pthread_mutex_t mutex;
+} RKADK_OSD_TEXT_S;
+
+static const RKADK_OSD_FONT_S g_stOsdFont = {
+  .u32Width = RKADK_OSD_FONT_WIDTH,
+  .u32Height = RKADK_OSD_FONT_HEIGHT,
+  .pChars = g_osdFontChars,
+  .pData = (const RKADK_U8 *)g_osdFontData,
+};
+
+static struct list_head g_stOsdAtlasList = LIST_HEAD_INIT(g_stOsdAtlasList);
+static pthread_mutex_t g_osdAtlasMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static RKADK_U32 RKADK_OSD_GetBpp(RKADK_FORMAT_E Format) {
+  switch (Format) {
+  case RKADK_FMT_ARGB8888:
+    return 32;
+  case RKADK_FMT_ARGB1555:
+    return 16;
+  case RKADK_FMT_2BPP:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+static void RKADK_OSD_PutPixel(RKADK_U8 *pRow, RKADK_U32 x,
+                               RKADK_FORMAT_E Format, RKADK_U32 u32Color) {
+  RKADK_U32 u32Shift;
+
+  switch (Format) {
+  case RKADK_FMT_ARGB8888:
+    ((RKADK_U32 *)pRow)[x] = u32Color;
+    break;
+  case RKADK_FMT_ARGB1555:
+    ((RKADK_U16 *)pRow)[x] = ((u32Color >> 31) << 15) |
+                             (((u32Color >> 19) & 0x1f) << 10) |
+                             (((u32Color >> 11) & 0x1f) << 5) |
+                             ((u32Color >> 3) & 0x1f);
+    break;
+  case RKADK_FMT_2BPP:
+    // first pixel in the low bits, color is the palette index
+    u32Shift = (x % 4) * 2;
+    pRow[x / 4] &= ~(0x3 << u32Shift);
+    pRow[x / 4] |= (u32Color & 0x3) << u32Shift;
+    break;
+  default:
+    break;
+  }
+}
+
+static RKADK_U32 RKADK_OSD_GlyphIndex(const RKADK_OSD_FONT_S *pstFont,
+                                      char c) {
+  const char *p = strchr(pstFont->pChars, c);
+
+  // unknown characters are drawn with the first glyph
+  if (!p || c == '\0')
+    return 0;
+
+  return p - pstFont->pChars;
+}
+
+static void RKADK_OSD_AtlasRender(RKADK_OSD_ATLAS_S *pstAtlas) {
+  RKADK_U32 i, x, y, u32Color;
+  RKADK_U32 u32SrcStride, u32GlyphBytes;
+  const RKADK_U8 *pSrc;
+  RKADK_U8 *pDst;
+  const RKADK_OSD_FONT_S *pstFont = pstAtlas->pstFont;
+  RKADK_U32 u32Cnt = strlen(pstFont->pChars);
+
+  u32SrcStride = (pstFont->u32Width + 7) / 8;
+  u32GlyphBytes = pstAtlas->u32CellBytes * pstAtlas->u32CellH;
+  for (i = 0; i < u32Cnt; i++) {
+    for (y = 0; y < pstAtlas->u32CellH; y++) {
+      pSrc = pstFont->pData + (i * pstFont->u32Height + y / pstAtlas->u32Scale) *
+             u32SrcStride;
+      pDst = pstAtlas->pData + i * u32GlyphBytes + y * pstAtlas->u32CellBytes;
+      for (x = 0; x < pstAtlas->u32CellW; x++) {
+        RKADK_U32 u32SrcX = x / pstAtlas->u32Scale;
+
+        if (u32SrcX < pstFont->u32Width &&
+            (pSrc[u32SrcX / 8] & (0x80 >> (u32SrcX % 8))))
+          u32Color = pstAtlas->u32FgColor;
+        else
+          u32Color = pstAtlas->u32BgColor;
+
+        RKADK_OSD_PutPixel(pDst, x, pstAtlas->Format, u32Color);
+      }
+    }
+  }
+}
+
+static RKADK_OSD_ATLAS_S *RKADK_OSD_AtlasGet(RKADK_OSD_TEXT_ATTR_S *pstAttr) {
+  RKADK_U32 u32Bpp, u32Cnt;
+  RKADK_OSD_ATLAS_S *pstAtlas = NULL;
+  const RKADK_OSD_FONT_S *pstFont = pstAttr->pstFont ? pstAttr->pstFont : &g_stOsdFont;
+  RKADK_U32 u32Scale = pstAttr->u32FontSize / pstFont->u32Height;
+
+  if (!u32Scale)
+    u32Scale = 1;
+
+  RKADK_MUTEX_LOCK(g_osdAtlasMutex);
+  list_for_each_entry(pstAtlas, &g_stOsdAtlasList, mark) {
+    if (pstAtlas->pstFont == pstFont && pstAtlas->u32Scale == u32Scale &&
+        pstAtlas->Format == pstAttr->Format &&
+        pstAtlas->u32FgColor == pstAttr->u32FgColor &&
+        pstAtlas->u32BgColor == pstAttr->u32BgColor) {
+      pstAtlas->u32RefCnt++;
+      RKADK_MUTEX_UNLOCK(g_osdAtlasMutex);
+      return pstAtlas;
+    }
+  }
+
+  pstAtlas = (RKADK_OSD_ATLAS_S *)malloc(sizeof(RKADK_OSD_ATLAS_S));
+  if (!pstAtlas) {
+    RKADK_LOGE("malloc osd atlas failed");
+    goto failed;
+  }
+  memset(pstAtlas, 0, sizeof(RKADK_OSD_ATLAS_S));
+
+  // keep cells byte aligned for 2bpp
+  u32Bpp = RKADK_OSD_GetBpp(pstAttr->Format);
+  pstAtlas->pstFont = pstFont;
+  pstAtlas->u32Scale = u32Scale;
+  pstAtlas->Format = pstAttr->Format;
+  pstAtlas->u32FgColor = pstAttr->u32FgColor;
+  pstAtlas->u32BgColor = pstAttr->u32BgColor;
+  pstAtlas->u32CellW = UPALIGNTO(pstFont->u32Width * u32Scale, 4);
+  pstAtlas->u32CellH = pstFont->u32Height * u32Scale;
+  pstAtlas->u32CellBytes = pstAtlas->u32CellW * u32Bpp / 8;
+
+  u32Cnt = strlen(pstFont->pChars);
+  pstAtlas->pData = (RKADK_U8 *)calloc(u32Cnt, pstAtlas->u32CellBytes *
+                                                   pstAtlas->u32CellH);
+  if (!pstAtlas->pData) {
+    RKADK_LOGE("malloc osd atlas data failed");
+    free(pstAtlas);
+    goto failed;
+  }
+
+  RKADK_OSD_AtlasRender(pstAtlas);
+  pstAtlas->u32RefCnt = 1;
+  INIT_LIST_HEAD(&pstAtlas->mark);
+  list_add_tail(&pstAtlas->mark, &g_stOsdAtlasList);
+  RKADK_MUTEX_UNLOCK(g_osdAtlasMutex);
+
+  RKADK_LOGD("create osd atlas: cell[%d, %d], format[%d], glyph cnt[%d]",
+             pstAtlas->u32CellW, pstAtlas->u32CellH, pstAtlas->Format, u32Cnt);
+  return pstAtlas;
+
+failed:
+  RKADK_MUTEX_UNLOCK(g_osdAtlasMutex);
+  return NULL;
+}
+
+static void RKADK_OSD_AtlasPut(RKADK_OSD_ATLAS_S *pstAtlas) {
+  RKADK_MUTEX_LOCK(g_osdAtlasMutex);
+  if (--pstAtlas->u32RefCnt) {
+    RKADK_MUTEX_UNLOCK(g_osdAtlasMutex);
+    return;
+  }
+
+  list_del_init(&pstAtlas->mark);
+  RKADK_MUTEX_UNLOCK(g_osdAtlasMutex);
+
+  free(pstAtlas->pData);
+  free(pstAtlas);
+}
+
+static void RKADK_OSD_TextBlit(RKADK_OSD_TEXT_S *pstText, RKADK_U32 u32Cell,
+                               char c) {
+  RKADK_U32 y;
+  RKADK_OSD_ATLAS_S *pstAtlas = pstText->pstAtlas;
+  RKADK_U32 u32CellBytes = pstAtlas->u32CellBytes;
+  const RKADK_U8 *pSrc = pstAtlas->pData +
+      RKADK_OSD_GlyphIndex(pstAtlas->pstFont, c) * u32CellBytes * pstAtlas->u32CellH;
+  RKADK_U8 *pDst = pstText->pBitmap + u32Cell * u32CellBytes;
+
+  for (y = 0; y < pstAtlas->u32CellH; y++) {
+    memcpy(pDst, pSrc, u32CellBytes);
+    pSrc += u32CellBytes;
+    pDst += pstText->u32Stride;
+  }
+}
+
+// mutex must be held
+static RKADK_U32 RKADK_OSD_TextDraw(RKADK_OSD_TEXT_S *pstText, const char *pStr) {
+  RKADK_U32 i, u32DirtyCnt = 0;
+  char c;
+
+  for (i = 0; i < pstText->u32MaxChars; i++) {
+    c = *pStr ? *pStr++ : ' ';
+    if (pstText->pText[i] == c)
+      continue;
+
+    RKADK_OSD_TextBlit(pstText, i, c);
+    pstText->pText[i] = c;
+    u32DirtyCnt++;
+  }
+
+  if (u32DirtyCnt)
+    pstText->u32Gen++;
+
+  return u32DirtyCnt;
+}
+
+RKADK_S32 RKADK_OSD_TEXT_Create(RKADK_OSD_TEXT_ATTR_S *pstAttr,
+                                RKADK_MW_PTR *ppHandle) {
+  RKADK_U32 i, u32Bpp;
+  RKADK_OSD_TEXT_S *pstText = NULL;
+
+  RKADK_CHECK_POINTER(pstAttr, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(ppHandle, RKADK_FAILURE);
+
+  if (*ppHandle) {
+    RKADK_LOGE("osd text handle has been created");
+    return -1;
+  }
+
+  u32Bpp = RKADK_OSD_GetBpp(pstAttr->Format);
+  if (!u32Bpp) {
+    RKADK_LOGE("Unsupport osd text format: %d", pstAttr->Format);
+    return -1;
+  }
+
+  if (!pstAttr->u32MaxChars) {
+    RKADK_LOGE("Invalid osd text u32MaxChars: %d", pstAttr->u32MaxChars);
+    return -1;
+  }
+
+  if (pstAttr->pstFont && (!pstAttr->pstFont->pChars || !pstAttr->pstFont->pData ||
+      !pstAttr->pstFont->u32Width || !pstAttr->pstFont->u32Height)) {
+    RKADK_LOGE("Invalid osd text font");
+    return -1;
+  }
+
+  pstText = (RKADK_OSD_TEXT_S *)malloc(sizeof(RKADK_OSD_TEXT_S));
+  if (!pstText) {
+    RKADK_LOGE("malloc osd text failed");
+    return -1;
+  }
+  memset(pstText, 0, sizeof(RKADK_OSD_TEXT_S));
+
+  pstText->pstAtlas = RKADK_OSD_AtlasGet(pstAttr);
+  if (!pstText->pstAtlas)
+    goto failed;
+
+  // region size is 16 aligned, fill the padding with background
+  pstText->u32MaxChars = pstAttr->u32MaxChars;
+  pstText->u32Width = UPALIGNTO(pstText->u32MaxChars * pstText->pstAtlas->u32CellW, 16);
+  pstText->u32Height = UPALIGNTO(pstText->pstAtlas->u32CellH, 16);
+  pstText->u32Stride = pstText->u32Width * u32Bpp / 8;
+  pstText->u32MaxChars = pstText->u32Width / pstText->pstAtlas->u32CellW;
+
+  pstText->pText = (char *)malloc(pstText->u32MaxChars + 1);
+  pstText->pBitmap = (RKADK_U8 *)malloc(pstText->u32Stride * pstText->u32Height);
+  if (!pstText->pText || !pstText->pBitmap) {
+    RKADK_LOGE("malloc osd text buffer failed");
+    goto failed;
+  }
+
+  for (i = 0; i < pstText->u32Width; i++)
+    RKADK_OSD_PutPixel(pstText->pBitmap, i, pstAttr->Format, pstAttr->u32BgColor);
+  for (i = 1; i < pstText->u32Height; i++)
+    memcpy(pstText->pBitmap + i * pstText->u32Stride, pstText->pBitmap,
+           pstText->u32Stride);
+
+  // force the first draw of every cell
+  memset(pstText->pText, 0, pstText->u32MaxChars + 1);
+  RKADK_OSD_TextDraw(pstText, "");
+  pthread_mutex_init(&pstText->mutex, NULL);
+
+  *ppHandle = (RKADK_MW_PTR)pstText;
+  return 0;
+
+failed:
+  if (pstText->pstAtlas)
+    RKADK_OSD_AtlasPut(pstText->pstAtlas);
+  if (pstText->pText)
+    free(pstText->pText);
+  if (pstText->pBitmap)
+    free(pstText->pBitmap);
+  free(pstText);
+  return -1;
+}
+
+RKADK_S32 RKADK_OSD_TEXT_Destroy(RKADK_MW_PTR pHandle) {
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_OSD_TEXT_S *pstText = (RKADK_OSD_TEXT_S *)pHandle;
+
+  RKADK_OSD_AtlasPut(pstText->pstAtlas);
+  pthread_mutex_destroy(&pstText->mutex);
+  free(pstText->pText);
+  free(pstText->pBitmap);
+  free(pstText);
+  return 0;
+}
+
+RKADK_S32 RKADK_OSD_TEXT_GetAttr(RKADK_MW_PTR pHandle,
+                                 RKADK_OSD_ATTR_S *pstOsdAttr) {
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstOsdAttr, RKADK_FAILURE);
+  RKADK_OSD_TEXT_S *pstText = (RKADK_OSD_TEXT_S *)pHandle;
+
+  pstOsdAttr->Width = pstText->u32Width;
+  pstOsdAttr->Height = pstText->u32Height;
+  pstOsdAttr->Format = pstText->pstAtlas->Format;
+  pstOsdAttr->pData = pstText->pBitmap;
+  return 0;
+}
+
+RKADK_S32 RKADK_OSD_TEXT_SetString(RKADK_MW_PTR pHandle, const char *pStr) {
+  RKADK_U32 u32DirtyCnt;
+
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pStr, RKADK_FAILURE);
+  RKADK_OSD_TEXT_S *pstText = (RKADK_OSD_TEXT_S *)pHandle;
+
+  RKADK_MUTEX_LOCK(pstText->mutex);
+  u32DirtyCnt = RKADK_OSD_TextDraw(pstText, pStr);
+  RKADK_MUTEX_UNLOCK(pstText->mutex);
+
+  return u32DirtyCnt;
+}
+
+RKADK_S32 RKADK_OSD_TEXT_SetTime(RKADK_MW_PTR pHandle, const char *pFmt,
+                                 time_t time) {
+  struct tm stTm;
+  RKADK_U32 u32DirtyCnt;
+  char str[RKADK_OSD_TEXT_FMT_LEN * 2];
+
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pFmt, RKADK_FAILURE);
+  RKADK_OSD_TEXT_S *pstText = (RKADK_OSD_TEXT_S *)pHandle;
+
+  RKADK_MUTEX_LOCK(pstText->mutex);
+  if (pstText->lastTime == time && !strcmp(pstText->timeFmt, pFmt)) {
+    RKADK_MUTEX_UNLOCK(pstText->mutex);
+    return 0;
+  }
+
+  if (!localtime_r(&time, &stTm) || !strftime(str, sizeof(str), pFmt, &stTm)) {
+    RKADK_LOGE("format osd time failed, fmt: %s", pFmt);
+    RKADK_MUTEX_UNLOCK(pstText->mutex);
+    return -1;
+  }
+
+  pstText->lastTime = time;
+  strncpy(pstText->timeFmt, pFmt, sizeof(pstText->timeFmt) - 1);
+  u32DirtyCnt = RKADK_OSD_TextDraw(pstText, str);
+  RKADK_MUTEX_UNLOCK(pstText->mutex);
+
+  return u32DirtyCnt;
+}
+
+RKADK_S32 RKADK_OSD_TEXT_Update(RKADK_MW_PTR pHandle, RKADK_U32 u32OsdId) {
+  int i, ret, idx = -1;
+  RKADK_OSD_ATTR_S stOsdAttr;
+
+  RKADK_CHECK_POINTER(pHandle, RKADK_FAILURE);
+  RKADK_OSD_TEXT_S *pstText = (RKADK_OSD_TEXT_S *)pHandle;
+
+  RKADK_MUTEX_LOCK(pstText->mutex);
+  for (i = 0; i < RKADK_OSD_TEXT_REGION_MAX; i++) {
+    if (pstText->stRegion[i].bUsed && pstText->stRegion[i].u32OsdId == u32OsdId) {
+      idx = i;
+      break;
+    }
+
+    if (idx < 0 && !pstText->stRegion[i].bUsed)
+      idx = i;
+  }
+
+  if (idx >= 0 && pstText->stRegion[idx].bUsed &&
+      pstText->stRegion[idx].u32Gen == pstText->u32Gen) {
+    RKADK_MUTEX_UNLOCK(pstText->mutex);
+    return 0;
+  }
+
+  memset(&stOsdAttr, 0, sizeof(RKADK_OSD_ATTR_S));
+  RKADK_OSD_TEXT_GetAttr(pHandle, &stOsdAttr);
+  ret = RKADK_OSD_UpdateBitMap(u32OsdId, &stOsdAttr);
+  if (!ret && idx >= 0) {
+    pstText->stRegion[idx].bUsed = true;
+    pstText->stRegion[idx].u32OsdId = u32OsdId;
+    pstText->stRegion[idx].u32Gen = pstText->u32Gen;
+  }
+  RKADK_MUTEX_UNLOCK(pstText->mutex);
+
+  return ret;
+}
@@ -19,6 +19,7 @@
 #include "rkadk_signal.h"
 #include "rkadk_thread.h"
 #include "rkadk_media_comm.h"
+#include "rkadk_trace.h"
 #include "rkadk_player.h"
 #include "rkadk_demuxer.h"
 #include "rkadk_audio_decoder.h"
@@ -44,11 +45,19 @@
 #include <fcntl.h>
 #include <time.h>
 #include <sys/time.h>
+#ifndef OS_RTT
+#include <sys/eventfd.h>
+#endif
 
 #define PLAYER_SNAPSHOT_MAX_WIDTH 4096
 #define PLAYER_SNAPSHOT_MAX_HEIGHT 4096
 #define MAX_BUFFER_SZIE 4096
 
+// upper bound of a chnFd poll, only a safety net: state changes wake the poll
+#define PLAYER_VDEC_POLL_TIMEOUT_MS 1000
+// retry interval after a failed VDEC/ADEC send, interrupted by stop
+#define PLAYER_SEND_RETRY_WAIT_MS 10
+
 typedef enum {
   RKADK_PLAYER_PAUSE_FALSE = 0x0,
   RKADK_PLAYER_PAUSE_START,
@@ -192,6 +201,15 @@ typedef struct {
   RKADK_PPLAYER_SNAPSHOT_RECV_FN pfnDataCallback;
 } RKADK_PLAYER_SNAPSHOT_PARAM_S;
 
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  RKADK_U32 u32Seq;
+#ifndef OS_RTT
+  RKADK_S32 s32EventFd;
+#endif
+} RKADK_PLAYER_WAKE_S;
+
 typedef struct {
   RKADK_CHAR pFilePath[RKADK_PATH_LEN];
   RKADK_PLAYER_STATE_E enStatus;
@@ -233,6 +251,9 @@ typedef struct {
   RKADK_PLAYER_SNAPSHOT_PARAM_S stSnapshotParam;
 
   RKADK_U32 u32VdecWaterline; /* frames = left frames waiting for decode + pics waiting for output */
+
+  /* wakes the send data thread on state, seek, waterline and input changes */
+  RKADK_PLAYER_WAKE_S stWake;
 } RKADK_PLAYER_HANDLE_S;
 
 #ifdef OS_RTT
@@ -764,16 +785,139 @@ static RKADK_S32 DestoryDeviceAo(RKADK_PLAYER_AO_CTX_S *ctx) {
   return RKADK_SUCCESS;
 }
 
-//Query whether there is a vdec stream
-static RKADK_S32 VdecPollEvent(RKADK_S32 timeoutMsec, RKADK_S32 fd) {
+static RKADK_S32 PlayerWakeInit(RKADK_PLAYER_WAKE_S *pstWake) {
+  pthread_condattr_t attr;
+
+  memset(pstWake, 0, sizeof(RKADK_PLAYER_WAKE_S));
+  pthread_mutex_init(&pstWake->mutex, NULL);
+  pthread_condattr_init(&attr);
+#ifndef OS_RTT
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+  pthread_cond_init(&pstWake->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+#ifndef OS_RTT
+  pstWake->s32EventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (pstWake->s32EventFd < 0) {
+    RKADK_LOGE("create wake eventfd failed[%d]", errno);
+    pthread_cond_destroy(&pstWake->cond);
+    pthread_mutex_destroy(&pstWake->mutex);
+    return RKADK_FAILURE;
+  }
+#endif
+
+  return RKADK_SUCCESS;
+}
+
+static void PlayerWakeDeinit(RKADK_PLAYER_WAKE_S *pstWake) {
+#ifndef OS_RTT
+  if (pstWake->s32EventFd >= 0) {
+    close(pstWake->s32EventFd);
+    pstWake->s32EventFd = -1;
+  }
+#endif
+  pthread_cond_destroy(&pstWake->cond);
+  pthread_mutex_destroy(&pstWake->mutex);
+}
+
+static RKADK_U32 PlayerGetWakeSeq(RKADK_PLAYER_HANDLE_S *pstPlayer) {
+  RKADK_U32 u32Seq;
+
+  pthread_mutex_lock(&pstPlayer->stWake.mutex);
+  u32Seq = pstPlayer->stWake.u32Seq;
+  pthread_mutex_unlock(&pstPlayer->stWake.mutex);
+  return u32Seq;
+}
+
+// Wake the send data thread and any packet callback blocked in the player
+static void PlayerWakeup(RKADK_PLAYER_HANDLE_S *pstPlayer) {
+#ifndef OS_RTT
+  uint64_t u64Val = 1;
+#endif
+
+  pthread_mutex_lock(&pstPlayer->stWake.mutex);
+  pstPlayer->stWake.u32Seq++;
+  pthread_cond_broadcast(&pstPlayer->stWake.cond);
+  pthread_mutex_unlock(&pstPlayer->stWake.mutex);
+
+#ifndef OS_RTT
+  if (pstPlayer->stWake.s32EventFd >= 0)
+    if (write(pstPlayer->stWake.s32EventFd, &u64Val, sizeof(u64Val)) < 0 && errno != EAGAIN)
+      RKADK_LOGW("write wake eventfd failed[%d]", errno);
+#endif
+}
+
+static void PlayerGetDeadline(struct timespec *pstDeadline, RKADK_S64 s64TimeoutUs) {
+#ifndef OS_RTT
+  clock_gettime(CLOCK_MONOTONIC, pstDeadline);
+#else
+  clock_gettime(CLOCK_REALTIME, pstDeadline);
+#endif
+
+  pstDeadline->tv_sec += s64TimeoutUs / 1000000;
+  pstDeadline->tv_nsec += (s64TimeoutUs % 1000000) * 1000;
+  if (pstDeadline->tv_nsec >= 1000000000) {
+    pstDeadline->tv_sec++;
+    pstDeadline->tv_nsec -= 1000000000;
+  }
+}
+
+/*
+ * Block until PlayerWakeup() is called after u32Seq was read, or timeout.
+ * s32TimeoutMs < 0 waits forever, stop always wakes the waiter.
+ */
+static void PlayerWaitWakeup(RKADK_PLAYER_HANDLE_S *pstPlayer, RKADK_U32 u32Seq,
+                             RKADK_S32 s32TimeoutMs) {
+  RKADK_S32 ret = 0;
+  struct timespec stDeadline;
+
+  if (s32TimeoutMs >= 0)
+    PlayerGetDeadline(&stDeadline, (RKADK_S64)s32TimeoutMs * 1000);
+
+  pthread_mutex_lock(&pstPlayer->stWake.mutex);
+  while (pstPlayer->stWake.u32Seq == u32Seq && !pstPlayer->bStopSendStream && ret != ETIMEDOUT) {
+    if (s32TimeoutMs < 0)
+      pthread_cond_wait(&pstPlayer->stWake.cond, &pstPlayer->stWake.mutex);
+    else
+      ret = pthread_cond_timedwait(&pstPlayer->stWake.cond, &pstPlayer->stWake.mutex, &stDeadline);
+  }
+  pthread_mutex_unlock(&pstPlayer->stWake.mutex);
+}
+
+// Pace the output for s32TimeUs, returns early only when the player stops
+static void PlayerSleep(RKADK_PLAYER_HANDLE_S *pstPlayer, RKADK_S32 s32TimeUs) {
+  RKADK_S32 ret = 0;
+  struct timespec stDeadline;
+
+  if (s32TimeUs <= 0)
+    return;
+
+  PlayerGetDeadline(&stDeadline, s32TimeUs);
+  pthread_mutex_lock(&pstPlayer->stWake.mutex);
+  while (!pstPlayer->bStopSendStream && ret != ETIMEDOUT)
+    ret = pthread_cond_timedwait(&pstPlayer->stWake.cond, &pstPlayer->stWake.mutex, &stDeadline);
+  pthread_mutex_unlock(&pstPlayer->stWake.mutex);
+}
+
+//Query whether there is a vdec stream, a player wakeup interrupts the poll
+static RKADK_S32 VdecPollEvent(RKADK_PLAYER_HANDLE_S *pstPlayer, RKADK_S32 timeoutMsec) {
   RKADK_S32 num_fds = 1;
-  struct pollfd pollFds[num_fds];
+  struct pollfd pollFds[2];
   RKADK_S32 ret = 0;
+  RKADK_S32 fd = pstPlayer->stVdecCtx.chnFd;
 
   RK_ASSERT(fd > 0);
   memset(pollFds, 0, sizeof(pollFds));
   pollFds[0].fd = fd;
   pollFds[0].events = (POLLPRI | POLLIN | POLLERR | POLLNVAL | POLLHUP);
+#ifndef OS_RTT
+  if (timeoutMsec != 0 && pstPlayer->stWake.s32EventFd >= 0) {
+    pollFds[1].fd = pstPlayer->stWake.s32EventFd;
+    pollFds[1].events = POLLIN;
+    num_fds++;
+  }
+#endif
 
   ret = poll(pollFds, num_fds, timeoutMsec);
   if (ret > 0 && (pollFds[0].revents & (POLLERR | POLLNVAL | POLLHUP))) {
@@ -781,6 +925,18 @@ static RKADK_S32 VdecPollEvent(RKADK_S32 timeoutMsec, RKADK_S32 fd) {
     return -1;
   }
 
+#ifndef OS_RTT
+  if (ret > 0 && num_fds > 1 && (pollFds[1].revents & POLLIN)) {
+    uint64_t u64Val;
+
+    if (read(pollFds[1].fd, &u64Val, sizeof(u64Val)) < 0 && errno != EAGAIN)
+      RKADK_LOGW("read wake eventfd failed[%d]", errno);
+
+    if (!(pollFds[0].revents & (POLLPRI | POLLIN)))
+      return 0;
+  }
+#endif
+
   return ret;
 }
 
@@ -1095,6 +1251,26 @@ static void AoVolumeControl(RKADK_PLAYER_HANDLE_S *pstPlayer) {
   RK_MPI_AO_SetVolume(pstPlayer->stAoCtx.devId, pstPlayer->stAoCtx.u32SpeakerVolume);
 }
 
+/*
+ * Wrap a period of decoded pcm in a MB without copying. The view borrows the
+ * adec frame memory, so it must be released before RK_MPI_ADEC_ReleaseFrame.
+ */
+static RKADK_S32 CreateAoViewMb(MB_BLK *pMbBlk, RK_U8 *pu8Addr, RK_U32 u32Len) {
+  RKADK_S32 ret;
+  MB_EXT_CONFIG_S stExtConfig;
+
+  memset(&stExtConfig, 0, sizeof(MB_EXT_CONFIG_S));
+  stExtConfig.pu8VirAddr = pu8Addr;
+  stExtConfig.u64Size = u32Len;
+  ret = RK_MPI_SYS_CreateMB(pMbBlk, &stExtConfig);
+  if (ret != RK_SUCCESS) {
+    RKADK_LOGW("RK_MPI_SYS_CreateMB failed[%x], fall back to copy", ret);
+    return RKADK_FAILURE;
+  }
+
+  return RKADK_SUCCESS;
+}
+
 static void SendVideoData(RKADK_VOID *ptr) {
   RKADK_PLAYER_HANDLE_S *pstPlayer = (RKADK_PLAYER_HANDLE_S *)ptr;
   VIDEO_FRAME_INFO_S sFrame;
@@ -1111,6 +1287,7 @@ static void SendVideoData(RKADK_VOID *ptr) {
   RKADK_S32 voSendTime = 0, frameTime = 0, costtime = 0;
   VDEC_CHN_STATUS_S stStatus;
   bool bWaterline = true;
+  RKADK_U32 u32WakeSeq;
 
   if (pstPlayer->stDemuxerParam.videoAvgFrameRate <= 0) {
     RKADK_LOGE("Invalid video framerate[%d]", pstPlayer->stDemuxerParam.videoAvgFrameRate);
@@ -1122,6 +1299,7 @@ static void SendVideoData(RKADK_VOID *ptr) {
   memset(&tFrame, 0, sizeof(VIDEO_FRAME_INFO_S));
 
   while (!pstPlayer->bStopSendStream) {
+    u32WakeSeq = PlayerGetWakeSeq(pstPlayer);
     ret = RK_MPI_VDEC_QueryStatus(pstPlayer->stVdecCtx.chnIndex, &stStatus);
     if (ret == RK_SUCCESS) {
       if ((stStatus.u32LeftStreamFrames + stStatus.u32LeftPics) < pstPlayer->u32VdecWaterline)
@@ -1134,16 +1312,20 @@ static void SendVideoData(RKADK_VOID *ptr) {
 
     if ((pstPlayer->enStatus != RKADK_PLAYER_STATE_PAUSE && bWaterline) || pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DONE) {
       if (pstPlayer->stVdecCtx.chnFd > 0) {
-        ret = VdecPollEvent(MAX_TIME_OUT_MS, pstPlayer->stVdecCtx.chnFd);
+        ret = VdecPollEvent(pstPlayer, PLAYER_VDEC_POLL_TIMEOUT_MS);
         if (ret < 0)
           continue;
       }
 
       ret = RK_MPI_VDEC_GetFrame(pstPlayer->stVdecCtx.chnIndex, &sFrame, MAX_TIME_OUT_MS);
       if (ret == 0) {
+        RKADK_TRACE_EVT(RKADK_TRACE_EVT_VDEC_GET, pstPlayer->stVdecCtx.chnIndex,
+                        pstPlayer->frameCount, sFrame.stVFrame.u64PTS);
         pstPlayer->frameCount++;
-        if (pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DONE)
+        if (pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DONE) {
           pstPlayer->enSeekStatus = RKADK_PLAYER_SEEK_DONE;
+          PlayerWakeup(pstPlayer);
+        }
 
         if (pstPlayer->bEnableBlackBackground) {
           if (!flagGetTframe) {
@@ -1183,13 +1365,8 @@ static void SendVideoData(RKADK_VOID *ptr) {
           if ((RKADK_S64)sFrame.stVFrame.u64PTS - pstPlayer->videoTimeStamp > (RKADK_S64)costtime) {
             voSendTime = sFrame.stVFrame.u64PTS - pstPlayer->videoTimeStamp - costtime;
 
-            if (!pstPlayer->bIsRtsp) {
-#ifndef OS_RTT
-              usleep(voSendTime);
-#else
-              rkos_msleep(voSendTime / 1000);
-#endif
-            }
+            if (!pstPlayer->bIsRtsp)
+              PlayerSleep(pstPlayer, voSendTime);
           }
           voSendTime = frameTime;
         } else {
@@ -1203,6 +1380,8 @@ static void SendVideoData(RKADK_VOID *ptr) {
         ret = RKADK_PLAYER_SendVoFrame(pstPlayer, &sFrame, -1);
         if (ret != RK_SUCCESS)
           RKADK_LOGE("send vo failed[%x]", ret);
+        RKADK_TRACE_EVT(RKADK_TRACE_EVT_VO_SEND, pstPlayer->stVdecCtx.chnIndex,
+                        pstPlayer->frameCount - 1, sFrame.stVFrame.u64PTS);
 
 #ifndef OS_RTT
         clock_gettime(CLOCK_MONOTONIC, &t_begin);
@@ -1210,24 +1389,16 @@ static void SendVideoData(RKADK_VOID *ptr) {
         rkadk_gettime(&t_begin);
 #endif
 
-        if (!pstPlayer->bIsRtsp) {
-#ifndef OS_RTT
-          usleep(voSendTime);
-#else
-          rkos_msleep(voSendTime / 1000);
-#endif
-        }
+        if (!pstPlayer->bIsRtsp)
+          PlayerSleep(pstPlayer, voSendTime);
 
         RK_MPI_VDEC_ReleaseFrame(pstPlayer->stVdecCtx.chnIndex, &sFrame);
       } else {
         //RKADK_LOGW("RK_MPI_VDEC_GetFrame timeout[%x]", ret);
       }
     } else {
-#ifndef OS_RTT
-      usleep(1000);
-#else
-      rkos_msleep(1);
-#endif
+      // paused or below the waterline: Play/Seek/Stop or a new packet wakes us
+      PlayerWaitWakeup(pstPlayer, u32WakeSeq, -1);
     }
   }
 
@@ -1386,15 +1557,19 @@ static void SendData(RKADK_VOID *ptr) {
   RKADK_S32 enableSendDataDebug = 0;
   RKADK_S32 voSendTime = 0;
   RK_U64 debugCount = 0;
-  RK_U32 cacheBufferLen = 0, copySize = 0, secondPartLen = 0;
-  RK_U32 bufferOffset = 0, originOffset = 0;
+  RK_U32 cacheBufferLen = 0, copySize = 0, remainLen = 0;
+  RK_U32 originOffset = 0;
+  AUDIO_FRAME_S stFrmView;
+  bool bSendView = false;
   RK_U64 firstAudioTimeStamp = -1;
   RK_U8 *cacheFrame = RK_NULL, *originFrame = RK_NULL;
   VDEC_CHN_STATUS_S stStatus;
   bool bWaterline = true;
+  RKADK_U32 u32WakeSeq;
 
   memset(&stFrmInfo, 0, sizeof(AUDIO_FRAME_INFO_S));
   memset(&stFrmInfoCache, 0, sizeof(AUDIO_FRAME_INFO_S));
+  memset(&stFrmView, 0, sizeof(AUDIO_FRAME_S));
   memset(&sFrame, 0, sizeof(VIDEO_FRAME_INFO_S));
   memset(&tFrame, 0, sizeof(VIDEO_FRAME_INFO_S));
 
@@ -1449,6 +1624,7 @@ static void SendData(RKADK_VOID *ptr) {
   RK_MPI_SYS_CreateMB(&(stFrmCache.pMbBlk), &extConfig);
 
   while (!pstPlayer->bStopSendStream) {
+    u32WakeSeq = PlayerGetWakeSeq(pstPlayer);
     if (enableSendDataDebug == 1) {
       SendDataDebugLevel1(pstPlayer, sFrame);
       break;
@@ -1503,10 +1679,12 @@ static void SendData(RKADK_VOID *ptr) {
 
           RK_MPI_VDEC_ReleaseFrame(pstPlayer->stVdecCtx.chnIndex, &sFrame);
           pstPlayer->enSeekStatus = RKADK_PLAYER_SEEK_DONE;
+          PlayerWakeup(pstPlayer);
           flagGetFirstframe = 0;
           continue;
         } else {
           pstPlayer->enSeekStatus = RKADK_PLAYER_SEEK_DONE;
+          PlayerWakeup(pstPlayer);
         }
       }
 
@@ -1555,24 +1733,45 @@ static void SendData(RKADK_VOID *ptr) {
           stFrmInfoCache.pstFrame->bBypassMbBlk = false;
 
           originFrame = (RK_U8 *)RK_MPI_MB_Handle2VirAddr(stFrmInfo.pstFrame->pMbBlk);
-          copySize  = cacheBufferLen - stFrmInfoCache.pstFrame->u32Len;
-          secondPartLen = stFrmInfo.pstFrame->u32Len - copySize;
-          if (copySize >= stFrmInfo.pstFrame->u32Len) {
-            copySize = stFrmInfo.pstFrame->u32Len;
-            secondPartLen = 0;
-          }
-
-          memcpy(cacheFrame + bufferOffset, originFrame, copySize);
-          bufferOffset += copySize;
-          stFrmInfoCache.pstFrame->u32Len += copySize;
-          originOffset = copySize;
+          originOffset = 0;
+          while (originOffset < stFrmInfo.pstFrame->u32Len) {
+            remainLen = stFrmInfo.pstFrame->u32Len - originOffset;
+
+            // aligned chunk: send a view into the adec frame without copying
+            bSendView = false;
+            if (stFrmInfoCache.pstFrame->u32Len == 0 && remainLen >= cacheBufferLen)
+              bSendView = !CreateAoViewMb(&stFrmView.pMbBlk, originFrame + originOffset, cacheBufferLen);
+
+            if (bSendView) {
+              originOffset += cacheBufferLen;
+            } else {
+              // straddling tail: gather it in the bounce buffer
+              copySize = cacheBufferLen - stFrmInfoCache.pstFrame->u32Len;
+              if (copySize > remainLen)
+                copySize = remainLen;
+
+              memcpy(cacheFrame + stFrmInfoCache.pstFrame->u32Len, originFrame + originOffset, copySize);
+              stFrmInfoCache.pstFrame->u32Len += copySize;
+              originOffset += copySize;
+              if (stFrmInfoCache.pstFrame->u32Len < cacheBufferLen)
+                break;
+            }
 
-__RETRY:
-          if (stFrmInfoCache.pstFrame->u32Len == cacheBufferLen) {
             stFrmInfoCache.pstFrame->u64TimeStamp += frameTime;
             stFrmInfoCache.pstFrame->u32Seq++;
+            if (bSendView) {
+              stFrmView.u32Len = cacheBufferLen;
+              stFrmView.u64TimeStamp = stFrmInfoCache.pstFrame->u64TimeStamp;
+              stFrmView.u32Seq = stFrmInfoCache.pstFrame->u32Seq;
+              stFrmView.enBitWidth = stFrmInfoCache.pstFrame->enBitWidth;
+              stFrmView.enSoundMode = stFrmInfoCache.pstFrame->enSoundMode;
+              stFrmView.s32SampleRate = stFrmInfoCache.pstFrame->s32SampleRate;
+              stFrmView.bBypassMbBlk = false;
+            }
+
             if (pstPlayer->enStatus != RKADK_PLAYER_STATE_STOP) {
-              result = RK_MPI_AO_SendFrame(pstPlayer->stAoCtx.devId, pstPlayer->stAoCtx.chnIndex, stFrmInfoCache.pstFrame, s32MilliSec);
+              result = RK_MPI_AO_SendFrame(pstPlayer->stAoCtx.devId, pstPlayer->stAoCtx.chnIndex,
+                                           bSendView ? &stFrmView : stFrmInfoCache.pstFrame, s32MilliSec);
               if (pstPlayer->positionTimeStamp == 0)
                 pstPlayer->positionTimeStamp = firstAudioTimeStamp + frameTime;
               else
@@ -1582,14 +1781,17 @@ __RETRY:
                 RKADK_LOGE("send frame failed[%x], TimeStamp[%lld], s32MilliSec[%d]",
                           result, stFrmInfo.pstFrame->u64TimeStamp, s32MilliSec);
             }
-            bufferOffset = 0;
-            stFrmInfoCache.pstFrame->u32Len = 0;
+
+            if (bSendView)
+              RK_MPI_MB_ReleaseMB(stFrmView.pMbBlk);
+            else
+              stFrmInfoCache.pstFrame->u32Len = 0;
 
             // video process start
             if (!flagGetFirstframe) {
               if (flagVideoEnd == 0) {
                 if (pstPlayer->stVdecCtx.chnFd > 0) {
-                  ret = VdecPollEvent(0, pstPlayer->stVdecCtx.chnFd);
+                  ret = VdecPollEvent(pstPlayer, 0);
                   if (ret < 0)
                     continue;
                 }
@@ -1652,20 +1854,6 @@ __GETVDEC:
             }
             // video process end
           }
-
-          if (secondPartLen > 0 && secondPartLen < cacheBufferLen) {
-            memcpy(cacheFrame, originFrame + originOffset, secondPartLen);
-            bufferOffset += secondPartLen;
-            stFrmInfoCache.pstFrame->u32Len += secondPartLen;
-          } else if(secondPartLen >= cacheBufferLen) {
-            originOffset = stFrmInfo.pstFrame->u32Len - secondPartLen;
-            memcpy(cacheFrame, originFrame + originOffset, cacheBufferLen);
-            stFrmInfoCache.pstFrame->u32Len += cacheBufferLen;
-            originOffset += cacheBufferLen;
-            secondPartLen -= cacheBufferLen;
-            goto __RETRY;
-          }
-
         }
 
         if (size <= 0) {
@@ -1727,7 +1915,7 @@ __GETVDEC:
                   voSendTime = sFrame.stVFrame.u64PTS - pstPlayer->videoTimeStamp - costtime;
 
                   if (!pstPlayer->bIsRtsp)
-                    usleep(voSendTime);
+                    PlayerSleep(pstPlayer, voSendTime);
                 }
                 voSendTime = frameTime;
               } else {
@@ -1745,7 +1933,7 @@ __GETVDEC:
 
               clock_gettime(CLOCK_MONOTONIC, &t_begin);
               if (!pstPlayer->bIsRtsp)
-                usleep(voSendTime);
+                PlayerSleep(pstPlayer, voSendTime);
             }
 
             RK_MPI_VDEC_ReleaseFrame(pstPlayer->stVdecCtx.chnIndex, &sFrame);
@@ -1754,11 +1942,11 @@ __GETVDEC:
           if (flagAudioEnd == 1 && flagVideoEnd == 1)
             pstPlayer->bStopSendStream = true;
         } else {
-#ifndef OS_RTT
-          usleep(1000);
-#else
-          rkos_msleep(1);
-#endif
+          /*
+           * adec has nothing decoded yet, ao still holds periodCount periods,
+           * so half a video frame is a safe upper bound for the wait
+           */
+          PlayerWaitWakeup(pstPlayer, u32WakeSeq, frameTime / 2000);
         }
       }
 
@@ -1766,11 +1954,8 @@ __GETVDEC:
         flagGetFirstframe = 0;
       }
     } else {
-#ifndef OS_RTT
-      usleep(1000);
-#else
-      rkos_msleep(1);
-#endif
+      // paused or below the waterline: Play/Seek/Stop or a new packet wakes us
+      PlayerWaitWakeup(pstPlayer, u32WakeSeq, -1);
     }
   }
 
@@ -1930,6 +2115,7 @@ static RKADK_VOID DoPullDemuxerVideoPacket(RKADK_VOID* pHandle) {
         || (pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DOING)) {
     if (pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DOING) {
       pstPlayer->enSeekStatus = RKADK_PLAYER_SEEK_VIDEO_DONE;
+      PlayerWakeup(pstPlayer);
     }
 
     if (!pstPlayer->bAudioExist && pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_DONE) {
@@ -1964,6 +2150,7 @@ __RETRY:
       } else {
         pstPlayer->bVideoSendStreamFail = false;
         pstPlayer->videoStreamCount++;
+        PlayerWakeup(pstPlayer);
       }
       RK_MPI_MB_ReleaseMB(stStream.pMbBlk);
 
@@ -1976,15 +2163,11 @@ __RETRY:
         }
 
         RKADK_LOGE("RK_MPI_VDEC_SendStream failed[%x]", ret);
-
-#ifndef OS_RTT
-        usleep(1000llu);
-#else
-        rkos_msleep(1llu);
-#endif
+        PlayerWaitWakeup(pstPlayer, PlayerGetWakeSeq(pstPlayer), PLAYER_SEND_RETRY_WAIT_MS);
         goto  __RETRY;
       }
       RK_MPI_MB_ReleaseMB(stStream.pMbBlk);
+      PlayerWakeup(pstPlayer);
     }
   } else {
     if (pstDemuxerPacket->s8PacketData) {
@@ -2027,16 +2210,15 @@ static RKADK_VOID DoPullDemuxerAudioPacket(RKADK_VOID* pHandle) {
   if (pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DOING || pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_VIDEO_DONE
        || pstPlayer->enSeekStatus == RKADK_PLAYER_SEEK_DONE) {
     pstPlayer->positionTimeStamp = pstDemuxerPacket->s64Pts;
-    while(pstPlayer->enSeekStatus != RKADK_PLAYER_SEEK_DONE) {
-#ifndef OS_RTT
-      usleep(1000);
-#else
-      rkos_msleep(1);
-#endif
+    while (pstPlayer->enSeekStatus != RKADK_PLAYER_SEEK_DONE) {
+      RKADK_U32 u32WakeSeq = PlayerGetWakeSeq(pstPlayer);
 
-      if (pstPlayer->bStopSendStream) {
+      if (pstPlayer->bStopSendStream)
         break;
-      }
+
+      // the send data thread wakes us when the video seek is done
+      if (pstPlayer->enSeekStatus != RKADK_PLAYER_SEEK_DONE)
+        PlayerWaitWakeup(pstPlayer, u32WakeSeq, -1);
     }
   }
 
@@ -2072,10 +2254,14 @@ __RETRY:
       ret = RK_MPI_ADEC_SendStream(pstPlayer->stAdecCtx.chnIndex, &stAudioStream, RK_TRUE);
       if (ret != RK_SUCCESS) {
         RKADK_LOGE("RK_MPI_ADEC_SendStream failed[%x]", ret);
-        goto __RETRY;
+        if (pstPlayer->enStatus != RKADK_PLAYER_STATE_STOP) {
+          PlayerWaitWakeup(pstPlayer, PlayerGetWakeSeq(pstPlayer), PLAYER_SEND_RETRY_WAIT_MS);
+          goto __RETRY;
+        }
       }
     }
     RK_MPI_MB_ReleaseMB(stAudioStream.pMbBlk);
+    PlayerWakeup(pstPlayer);
   }
 
   return;
@@ -2276,9 +2462,11 @@ __RETRY:
       }
 
       RKADK_LOGE("RK_MPI_ADEC_SendStream failed[%x]", ret);
+      PlayerWaitWakeup(pstPlayer, PlayerGetWakeSeq(pstPlayer), PLAYER_SEND_RETRY_WAIT_MS);
       goto __RETRY;
     }
     RK_MPI_MB_ReleaseMB(stAudioStream.pMbBlk);
+    PlayerWakeup(pstPlayer);
   }
 
   return 0;
@@ -2324,15 +2512,12 @@ __RETRY:
     }
 
     RKADK_LOGE("RK_MPI_VDEC_SendStream failed[%x]", ret);
-#ifndef OS_RTT
-    usleep(1000llu);
-#else
-    rkos_msleep(1llu);
-#endif
+    PlayerWaitWakeup(pstPlayer, PlayerGetWakeSeq(pstPlayer), PLAYER_SEND_RETRY_WAIT_MS);
     goto  __RETRY;
   }
 
   RK_MPI_MB_ReleaseMB(stStream.pMbBlk);
+  PlayerWakeup(pstPlayer);
   return 0;
 }
 
@@ -2488,9 +2673,17 @@ RKADK_S32 RKADK_PLAYER_Create(RKADK_MW_PTR *pPlayer,
 
   pthread_mutex_init(&(pstPlayer->mutex), NULL);
 
+  if (PlayerWakeInit(&pstPlayer->stWake)) {
+    RKADK_LOGE("Init player wake failed");
+    pthread_mutex_destroy(&(pstPlayer->mutex));
+    goto __FAILED;
+  }
+
   if (pstPlayCfg->stSnapshotCfg.pfnDataCallback) {
     if (SnapshotEnable(pstPlayer, pstPlayCfg->stSnapshotCfg)) {
       RKADK_LOGE("Enable snapshot failed");
+      PlayerWakeDeinit(&pstPlayer->stWake);
+      pthread_mutex_destroy(&(pstPlayer->mutex));
       goto __FAILED;
     }
   }
@@ -2548,6 +2741,7 @@ RKADK_S32 RKADK_PLAYER_Destroy(RKADK_MW_PTR pPlayer) {
     RKADK_DEMUXER_Destroy(&pstPlayer->pDemuxerCfg);
 
   pthread_mutex_destroy(&(pstPlayer->mutex));
+  PlayerWakeDeinit(&pstPlayer->stWake);
 
   if (pstPlayer->stSnapshotParam.pfnDataCallback)
     if (SnapshotDisable(pstPlayer))
@@ -3055,6 +3249,7 @@ RKADK_S32 RKADK_PLAYER_Play(RKADK_MW_PTR pPlayer) {
   }
 
   pstPlayer->enStatus = RKADK_PLAYER_STATE_PLAY;
+  PlayerWakeup(pstPlayer);
   pthread_mutex_unlock(&pstPlayer->mutex);
 
   RKADK_PLAYER_ProcessEvent(pPlayer, RKADK_PLAYER_EVENT_PLAY, NULL);
@@ -3119,6 +3314,7 @@ RKADK_S32 RKADK_PLAYER_Stop(RKADK_MW_PTR pPlayer) {
   if (pstPlayer->pDemuxerCfg)
     RKADK_DEMUXER_ReadPacketStop(pstPlayer->pDemuxerCfg);
   pstPlayer->bStopSendStream = true;
+  PlayerWakeup(pstPlayer);
 
   if (pstPlayer->tidDataSend) {
 #ifndef OS_RTT
@@ -3203,6 +3399,7 @@ RKADK_S32 RKADK_PLAYER_Pause(RKADK_MW_PTR pPlayer) {
 
   pstPlayer->enStatus = RKADK_PLAYER_STATE_PAUSE;
   pstPlayer->frameCount = 0;
+  PlayerWakeup(pstPlayer);
   pthread_mutex_unlock(&pstPlayer->mutex);
   RKADK_PLAYER_ProcessEvent(pPlayer, RKADK_PLAYER_EVENT_PAUSED, NULL);
   return RKADK_SUCCESS;
@@ -3307,6 +3504,7 @@ RKADK_S32 RKADK_PLAYER_Seek(RKADK_MW_PTR pPlayer, RKADK_S64 s64TimeInMs) {
   if (pstPlayer->bAudioExist && !pstPlayer->bVideoExist)
       pstPlayer->enSeekStatus = RKADK_PLAYER_SEEK_DONE;
 
+  PlayerWakeup(pstPlayer);
   return RKADK_SUCCESS;
 
 __FAILED:
@@ -3458,6 +3656,7 @@ RKADK_S32 RKADK_PLAYER_SetVdecWaterline(RKADK_MW_PTR pPlayer, RKADK_U32 u32VdecW
   }
 
   pstPlayer->u32VdecWaterline = u32VdecWaterline;
+  PlayerWakeup(pstPlayer);
   return 0;
 }
 
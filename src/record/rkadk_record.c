@@ -20,6 +20,8 @@
 #include "rkadk_media_comm.h"
 #include "rkadk_param.h"
 #include "rkadk_audio_encoder.h"
+#include "rkadk_thread.h"
+#include "rkadk_audio_clock.h"
 #include "linux_list.h"
 #include "file_cache.h"
 #include <pthread.h>
@@ -38,145 +40,331 @@
 #define RKADK_AVS_HEIGHT_ALIGN 4
 #endif
 
-typedef struct {
-  struct list_head mark;
-  char filename[RKADK_MAX_FILE_PATH_LEN];
-} FILE_NAME_CELL_S;
+/*
+ * File names are prefetched per camera by a refill thread, so the muxer
+ * thread does not wait for the app callback at file split. Each stream
+ * owns a ring filled by the refill thread and drained by its muxer thread,
+ * both under the ctx mutex; the count is also read without it as a hint.
+ */
+#define RKADK_REC_FILE_NAME_DEPTH 2
+#define RKADK_REC_FILE_NAME_DEPTH_MAX 16
+/* wait for the refill thread at split before generating a name locally */
+#define RKADK_REC_FILE_NAME_WAIT_MS 200
+/* no previous name to derive a local one from, wait longer */
+#define RKADK_REC_FILE_NAME_FIRST_WAIT_MS 3000
 
-static RKADK_REC_REQUEST_FILE_NAMES_FN
-    g_pfnRequestFileNames[RKADK_MAX_SENSOR_CNT] = {NULL};
-static struct list_head
-    g_fileNameList[RKADK_MUXER_STREAM_MAX_CNT * RKADK_MAX_SENSOR_CNT];
-static pthread_mutex_t g_fileNameMutexLock = PTHREAD_MUTEX_INITIALIZER;
+typedef struct {
+  RKADK_U32 u32Head; // pushed by the refill thread
+  RKADK_U32 u32Tail; // popped by the muxer thread, reset by a flush
+  RKADK_U32 u32RequestCnt;
+  RKADK_U32 u32FallbackCnt;
+  RKADK_U32 u32LastUs;
+  RKADK_U32 u32MaxUs;
+  char lastName[RKADK_MAX_FILE_PATH_LEN];
+  char name[RKADK_REC_FILE_NAME_DEPTH_MAX][RKADK_MAX_FILE_PATH_LEN];
+} FILE_NAME_RING_S;
 
-static int GetFileNameListSize(struct list_head *head) {
-  int size = 0;
-  FILE_NAME_CELL_S *cell = NULL;
+typedef struct {
+  RKADK_MUXER_HANDLE_S *pstRecorder;
+  RKADK_REC_REQUEST_FILE_NAMES_FN pfnRequestFileNames;
+  RKADK_U32 u32Depth;
+  void *pThread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;    // a refill has been done or failed
+  RKADK_U32 u32RefillSeq;
+  RKADK_U32 u32Gen;       // bumped by a flush, older refills are dropped
+  bool bRefillFailed;
+  char scratch[RKADK_MUXER_STREAM_MAX_CNT][RKADK_MAX_FILE_PATH_LEN];
+  FILE_NAME_RING_S stRing[RKADK_MUXER_STREAM_MAX_CNT];
+} FILE_NAME_CTX_S;
+
+static FILE_NAME_CTX_S *g_pstFileNameCtx[RKADK_MAX_SENSOR_CNT] = {NULL};
+
+static RKADK_U32 FileNameRingCnt(FILE_NAME_RING_S *pstRing) {
+  return __atomic_load_n(&pstRing->u32Head, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&pstRing->u32Tail, __ATOMIC_ACQUIRE);
+}
 
-  list_for_each_entry(cell, head, mark) {
-    size++;
-  }
+static RKADK_U64 FileNameGetTimeUs() {
+  struct timespec ts;
 
-  return size;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (RKADK_U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-static void FileNameListInit(RKADK_MUXER_HANDLE_S *stRecorder) {
-  int index;
+// true if a stream is below half depth and every stream has room for a set
+static bool FileNameNeedRefill(FILE_NAME_CTX_S *pstCtx, RKADK_U32 u32StreamCnt) {
+  bool bNeed = false;
+  RKADK_U32 u32Cnt;
+
+  for (RKADK_U32 i = 0; i < u32StreamCnt; i++) {
+    u32Cnt = FileNameRingCnt(&pstCtx->stRing[i]);
+    if (u32Cnt >= pstCtx->u32Depth)
+      return false;
 
-  for (int i = 0; i < (int)stRecorder->u32StreamCnt; i++) {
-    index = i + (RKADK_MUXER_STREAM_MAX_CNT * stRecorder->u32CamId);
-    INIT_LIST_HEAD(&g_fileNameList[index]);
+    if (u32Cnt <= pstCtx->u32Depth / 2)
+      bNeed = true;
   }
+
+  return bNeed;
 }
 
-static FILE_NAME_CELL_S *FileNameCellPop(struct list_head *head) {
-  FILE_NAME_CELL_S *rst = NULL;
-  FILE_NAME_CELL_S *cell = NULL;
-  FILE_NAME_CELL_S *cell_n = NULL;
+static bool FileNameRefillProc(void *params) {
+  int ret;
+  RKADK_U32 u32StreamCnt, u32Head, u32Gen, len;
+  FILE_NAME_RING_S *pstRing;
+  FILE_NAME_CTX_S *pstCtx = (FILE_NAME_CTX_S *)params;
 
-  do {
-    list_for_each_entry_safe(cell, cell_n, head, mark) {
-      list_del_init(&cell->mark);
-      rst = cell;
+  RKADK_THREAD_Wait(-1);
+
+  u32StreamCnt = pstCtx->pstRecorder->u32StreamCnt;
+  if (u32StreamCnt > RKADK_MUXER_STREAM_MAX_CNT)
+    u32StreamCnt = RKADK_MUXER_STREAM_MAX_CNT;
+
+  while (!RKADK_THREAD_IsExit() && FileNameNeedRefill(pstCtx, u32StreamCnt)) {
+    u32Gen = __atomic_load_n(&pstCtx->u32Gen, __ATOMIC_ACQUIRE);
+    memset(pstCtx->scratch, 0, sizeof(pstCtx->scratch));
+    ret = pstCtx->pfnRequestFileNames(pstCtx->pstRecorder, u32StreamCnt,
+                                      pstCtx->scratch);
+    if (ret) {
+      RKADK_LOGE("Record[%d]: get file name failed(%d)",
+                 pstCtx->pstRecorder->u32CamId, ret);
+      RKADK_MUTEX_LOCK(pstCtx->mutex);
+      pstCtx->bRefillFailed = true;
+      pthread_cond_broadcast(&pstCtx->cond);
+      RKADK_MUTEX_UNLOCK(pstCtx->mutex);
       break;
     }
-  } while (0);
-  return rst;
+
+    RKADK_MUTEX_LOCK(pstCtx->mutex);
+    if (pstCtx->u32Gen != u32Gen) {
+      // flushed during the request, the names are for the old settings
+      RKADK_MUTEX_UNLOCK(pstCtx->mutex);
+      continue;
+    }
+
+    for (RKADK_U32 i = 0; i < u32StreamCnt; i++) {
+      pstRing = &pstCtx->stRing[i];
+      u32Head = pstRing->u32Head;
+      len = strnlen(pstCtx->scratch[i], RKADK_MAX_FILE_PATH_LEN - 1);
+      memcpy(pstRing->name[u32Head % pstCtx->u32Depth], pstCtx->scratch[i], len);
+      pstRing->name[u32Head % pstCtx->u32Depth][len] = '\0';
+      __atomic_store_n(&pstRing->u32Head, u32Head + 1, __ATOMIC_RELEASE);
+    }
+
+    pstCtx->u32RefillSeq++;
+    pstCtx->bRefillFailed = false;
+    pthread_cond_broadcast(&pstCtx->cond);
+    RKADK_MUTEX_UNLOCK(pstCtx->mutex);
+  }
+
+  return true;
 }
 
-static void FileNameListRelease(RKADK_MUXER_HANDLE_S *stRecorder) {
-  int index;
-  FILE_NAME_CELL_S *cell = NULL;
-  FILE_NAME_CELL_S *cell_n = NULL;
+// ring empty and the app late: same folder and extension as the last name
+static int FileNameGenerate(FILE_NAME_RING_S *pstRing, RKADK_CHAR *pcFileName,
+                            RKADK_U32 u32Stream) {
+  int len;
+  time_t now;
+  struct tm tm;
+  char *pcSlash, *pcDot;
+  const char *pcExt = "";
+
+  pcSlash = strrchr(pstRing->lastName, '/');
+  if (!pcSlash)
+    return -1;
 
-  for (int i = 0; i < (int)stRecorder->u32StreamCnt; i++) {
-    index = i + (RKADK_MUXER_STREAM_MAX_CNT * stRecorder->u32CamId);
+  pcDot = strrchr(pcSlash, '.');
+  if (pcDot)
+    pcExt = pcDot;
+
+  now = time(NULL);
+  localtime_r(&now, &tm);
+  len = snprintf(pcFileName, RKADK_MAX_FILE_PATH_LEN,
+                 "%.*s%04d%02d%02d_%02d%02d%02d_%d_%d%s",
+                 (int)(pcSlash - pstRing->lastName + 1), pstRing->lastName,
+                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+                 tm.tm_min, tm.tm_sec, u32Stream, pstRing->u32FallbackCnt, pcExt);
+  if (len < 0 || len >= RKADK_MAX_FILE_PATH_LEN)
+    return -1;
 
-    list_for_each_entry_safe(cell, cell_n, &g_fileNameList[index], mark) {
-      list_del_init(&cell->mark);
-      free(cell);
-    }
+  return 0;
+}
+
+static void FileNameListInit(RKADK_MUXER_HANDLE_S *stRecorder,
+                             RKADK_RECORD_ATTR_S *pstRecAttr) {
+  char name[RKADK_THREAD_NAME_LEN];
+  RKADK_U32 u32Depth = RKADK_REC_FILE_NAME_DEPTH;
+  FILE_NAME_CTX_S *pstCtx;
+  pthread_condattr_t attr;
+
+  if (g_pstFileNameCtx[stRecorder->u32CamId]) {
+    RKADK_LOGE("Record[%d]: file name ctx exists", stRecorder->u32CamId);
+    return;
+  }
+
+  pstCtx = (FILE_NAME_CTX_S *)malloc(sizeof(FILE_NAME_CTX_S));
+  if (!pstCtx) {
+    RKADK_LOGE("Record[%d]: malloc file name ctx failed", stRecorder->u32CamId);
+    return;
   }
+  memset(pstCtx, 0, sizeof(FILE_NAME_CTX_S));
+
+  if (pstRecAttr->u32FileNameDepth)
+    u32Depth = pstRecAttr->u32FileNameDepth;
+  if (u32Depth > RKADK_REC_FILE_NAME_DEPTH_MAX)
+    u32Depth = RKADK_REC_FILE_NAME_DEPTH_MAX;
+
+  pstCtx->pstRecorder = stRecorder;
+  pstCtx->pfnRequestFileNames = pstRecAttr->pfnRequestFileNames;
+  pstCtx->u32Depth = u32Depth;
+  pthread_mutex_init(&pstCtx->mutex, NULL);
+  pthread_condattr_init(&attr);
+#ifndef OS_RTT
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+  pthread_cond_init(&pstCtx->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pstCtx->pfnRequestFileNames) {
+    snprintf(name, sizeof(name), "RecName_%d", stRecorder->u32CamId);
+    pstCtx->pThread = RKADK_THREAD_Create(FileNameRefillProc, pstCtx, name);
+    if (!pstCtx->pThread)
+      RKADK_LOGE("Record[%d]: create file name thread failed", stRecorder->u32CamId);
+    else
+      RKADK_THREAD_Wake(pstCtx->pThread);
+  }
+
+  g_pstFileNameCtx[stRecorder->u32CamId] = pstCtx;
+}
+
+static void FileNameListRelease(RKADK_MUXER_HANDLE_S *stRecorder) {
+  FILE_NAME_CTX_S *pstCtx = g_pstFileNameCtx[stRecorder->u32CamId];
+
+  if (!pstCtx)
+    return;
+
+  g_pstFileNameCtx[stRecorder->u32CamId] = NULL;
+  if (pstCtx->pThread)
+    RKADK_THREAD_Destory(pstCtx->pThread);
+
+  pthread_cond_destroy(&pstCtx->cond);
+  pthread_mutex_destroy(&pstCtx->mutex);
+  free(pstCtx);
+}
+
+// drops the prefetched names and any request still in the app callback
+static void FileNameListFlush(RKADK_U32 u32CamId) {
+  FILE_NAME_CTX_S *pstCtx = g_pstFileNameCtx[u32CamId];
+
+  if (!pstCtx)
+    return;
+
+  RKADK_MUTEX_LOCK(pstCtx->mutex);
+  __atomic_store_n(&pstCtx->u32Gen, pstCtx->u32Gen + 1, __ATOMIC_RELEASE);
+  for (int i = 0; i < RKADK_MUXER_STREAM_MAX_CNT; i++)
+    __atomic_store_n(&pstCtx->stRing[i].u32Tail, pstCtx->stRing[i].u32Head,
+                     __ATOMIC_RELEASE);
+  RKADK_MUTEX_UNLOCK(pstCtx->mutex);
+
+  if (pstCtx->pThread)
+    RKADK_THREAD_Wake(pstCtx->pThread);
 }
 
 static int GetRecordFileName(RKADK_VOID *pHandle, RKADK_CHAR *pcFileName,
                              RKADK_U32 muxerId) {
-  int index, ret, size = 0;
-  int len = 0;
-  ARRAY_FILE_NAME fileName = NULL;
-  FILE_NAME_CELL_S *cell = NULL;
-  FILE_NAME_CELL_S *rst = NULL;
+  int ret = 0, waitMs;
+  bool bFailed = false, bGot = false;
+  RKADK_U32 u32Stream, u32Tail, u32Seq;
+  RKADK_U64 u64StartUs, u64CostUs;
+  struct timespec stDeadline;
+  FILE_NAME_CTX_S *pstCtx;
+  FILE_NAME_RING_S *pstRing;
   RKADK_MUXER_HANDLE_S *pstRecorder;
 
-  RKADK_MUTEX_LOCK(g_fileNameMutexLock);
-
   if (muxerId >= RKADK_MUXER_STREAM_MAX_CNT * RKADK_MAX_SENSOR_CNT) {
     RKADK_LOGE("Incorrect file index: %d", muxerId);
-    goto failed;
+    return -1;
   }
 
   pstRecorder = (RKADK_MUXER_HANDLE_S *)pHandle;
   if (!pstRecorder) {
     RKADK_LOGE("pstRecorder is null");
-    goto failed;
+    return -1;
   }
 
-  if (!g_pfnRequestFileNames[pstRecorder->u32CamId]) {
+  pstCtx = g_pstFileNameCtx[pstRecorder->u32CamId];
+  if (!pstCtx || !pstCtx->pThread) {
     RKADK_LOGE("Not Registered request name callback");
-    goto failed;
+    return -1;
   }
 
-  size = GetFileNameListSize(&g_fileNameList[muxerId]);
-  if (!size) {
-    fileName = (ARRAY_FILE_NAME)malloc(pstRecorder->u32StreamCnt *
-                                       RKADK_MAX_FILE_PATH_LEN);
-    if (!fileName) {
-      RKADK_LOGE("Stream[%d]: malloc fileName failed", muxerId);
-      goto failed;
-    }
-
-    ret = g_pfnRequestFileNames[pstRecorder->u32CamId](
-        pHandle, pstRecorder->u32StreamCnt, fileName);
-    if (ret) {
-      RKADK_LOGE("Stream[%d]: get file name failed(%d)", muxerId, ret);
-      goto failed;
-    }
+  u64StartUs = FileNameGetTimeUs();
+  u32Stream = muxerId % RKADK_MUXER_STREAM_MAX_CNT;
+  pstRing = &pstCtx->stRing[u32Stream];
 
-    for (int i = 0; i < (int)pstRecorder->u32StreamCnt; i++) {
-      cell = (FILE_NAME_CELL_S *)malloc(sizeof(FILE_NAME_CELL_S));
-      if (NULL == cell) {
-        RKADK_LOGE("Stream[%d]: malloc file name cell failed", muxerId);
-        goto failed;
-      }
-      memset(cell->filename, 0, RKADK_MAX_FILE_PATH_LEN);
-      INIT_LIST_HEAD(&cell->mark);
+  if (!FileNameRingCnt(pstRing)) {
+    RKADK_THREAD_Wake(pstCtx->pThread);
 
-      len = strlen(fileName[i]) > RKADK_MAX_FILE_PATH_LEN ? RKADK_MAX_FILE_PATH_LEN : strlen(fileName[i]);
-      memcpy(cell->filename, fileName[i], len);
+    RKADK_MUTEX_LOCK(pstCtx->mutex);
+    u32Seq = pstCtx->u32RefillSeq;
+    pstCtx->bRefillFailed = false;
+    waitMs = pstRing->lastName[0] ? RKADK_REC_FILE_NAME_WAIT_MS
+                                  : RKADK_REC_FILE_NAME_FIRST_WAIT_MS;
+#ifndef OS_RTT
+    clock_gettime(CLOCK_MONOTONIC, &stDeadline);
+#else
+    clock_gettime(CLOCK_REALTIME, &stDeadline);
+#endif
+    stDeadline.tv_sec += waitMs / 1000;
+    stDeadline.tv_nsec += (long)(waitMs % 1000) * 1000000;
+    if (stDeadline.tv_nsec >= 1000000000) {
+      stDeadline.tv_sec++;
+      stDeadline.tv_nsec -= 1000000000;
+    }
 
-      index = i + (RKADK_MUXER_STREAM_MAX_CNT * pstRecorder->u32CamId);
-      list_add_tail(&cell->mark, &g_fileNameList[index]);
+    while (!FileNameRingCnt(pstRing) && !pstCtx->bRefillFailed && !ret) {
+      ret = pthread_cond_timedwait(&pstCtx->cond, &pstCtx->mutex, &stDeadline);
+      if (pstCtx->u32RefillSeq != u32Seq)
+        ret = 0;
     }
-    free(fileName);
+    RKADK_MUTEX_UNLOCK(pstCtx->mutex);
   }
 
-  rst = FileNameCellPop(&g_fileNameList[muxerId]);
-  if (!rst) {
-    RKADK_LOGE("Stream[%d]: cell pop failed", muxerId);
-    goto failed;
+  RKADK_MUTEX_LOCK(pstCtx->mutex);
+  if (FileNameRingCnt(pstRing)) {
+    u32Tail = pstRing->u32Tail;
+    strncpy(pcFileName, pstRing->name[u32Tail % pstCtx->u32Depth], RKADK_MAX_FILE_PATH_LEN);
+    __atomic_store_n(&pstRing->u32Tail, u32Tail + 1, __ATOMIC_RELEASE);
+    bGot = true;
+  } else {
+    bFailed = pstCtx->bRefillFailed;
   }
-  strncpy(pcFileName, rst->filename, RKADK_MAX_FILE_PATH_LEN);
-  free(rst);
+  RKADK_MUTEX_UNLOCK(pstCtx->mutex);
 
-  RKADK_MUTEX_UNLOCK(g_fileNameMutexLock);
-  return 0;
+  if (bGot) {
+    RKADK_THREAD_Wake(pstCtx->pThread);
+  } else if (bFailed) {
+    // the app refused, e.g. the card is full or gone: stop, don't make one up
+    RKADK_LOGE("Stream[%d]: app get file name failed", muxerId);
+    return -1;
+  } else if (FileNameGenerate(pstRing, pcFileName, u32Stream)) {
+    RKADK_LOGE("Stream[%d]: no file name", muxerId);
+    return -1;
+  } else {
+    RKADK_LOGW("Stream[%d]: app file name is late, use %s", muxerId, pcFileName);
+    pstRing->u32FallbackCnt++;
+  }
 
-failed:
-  if (fileName)
-    free(fileName);
+  snprintf(pstRing->lastName, RKADK_MAX_FILE_PATH_LEN, "%s", pcFileName);
 
-  RKADK_MUTEX_UNLOCK(g_fileNameMutexLock);
-  return -1;
+  u64CostUs = FileNameGetTimeUs() - u64StartUs;
+  pstRing->u32RequestCnt++;
+  pstRing->u32LastUs = (RKADK_U32)u64CostUs;
+  if (u64CostUs > pstRing->u32MaxUs)
+    pstRing->u32MaxUs = (RKADK_U32)u64CostUs;
+
+  return 0;
 }
 
 static RKADK_U32 GetPreRecordCacheTime(RKADK_PARAM_REC_CFG_S *pstRecCfg,
@@ -958,27 +1146,29 @@ static int RKADK_RECORD_DestoryAudioChn() {
 
 static void RKADK_RECORD_AencOutCb(AUDIO_STREAM_S stFrame,
                                    RKADK_VOID *pHandle) {
-  // current rockit audio timestamp inaccurate, use fake time
-  int duration = 0;
-  RKADK_PARAM_AUDIO_CFG_S *pstAudioCfg = NULL;
   RKADK_MUXER_HANDLE_S *pstMuxer = NULL;
 
   RKADK_CHECK_POINTER_N(pHandle);
 
+  // current rockit audio timestamp inaccurate, count frames from the first one
   pstMuxer = (RKADK_MUXER_HANDLE_S *)pHandle;
-  pstAudioCfg = RKADK_PARAM_GetAudioCfg();
-  if (!pstAudioCfg) {
-    RKADK_LOGE("RKADK_PARAM_GetAudioCfg failed");
-    return;
-  }
+  pstMuxer->u64AudioPts = RKADK_AUDIO_CLOCK_Stamp(pstMuxer->pAudioClock, stFrame.u64TimeStamp);
+  RKADK_MUXER_WriteAudioFrame(stFrame.pMbBlk, stFrame.u32Len, pstMuxer->u64AudioPts, pHandle);
+}
 
-  duration = 1000000 / (double)pstAudioCfg->samplerate * pstAudioCfg->samples_per_frame / pstAudioCfg->channels;
+static int RKADK_RECORD_CreateAudioClock(RKADK_MUXER_HANDLE_S *pstRecorder) {
+  pstRecorder->pAudioClock = RKADK_AUDIO_CLOCK_Create();
+  if (!pstRecorder->pAudioClock) {
+    RKADK_LOGE("RKADK_AUDIO_CLOCK_Create failed");
+    return -1;
+  }
 
-  if (!pstMuxer->u64AudioPts)
-    pstMuxer->u64AudioPts = stFrame.u64TimeStamp;
+  return 0;
+}
 
-  RKADK_MUXER_WriteAudioFrame(stFrame.pMbBlk, stFrame.u32Len, stFrame.u64TimeStamp, pHandle);
-  pstMuxer->u64AudioPts += duration;
+static void RKADK_RECORD_DestroyAudioClock(RKADK_MUXER_HANDLE_S *pstRecorder) {
+  RKADK_AUDIO_CLOCK_Destroy(pstRecorder->pAudioClock);
+  pstRecorder->pAudioClock = NULL;
 }
 
 static void RKADK_RECORD_VencOutCb(RKADK_MEDIA_VENC_DATA_S stData,
@@ -1696,6 +1886,8 @@ static RKADK_S32 RKADK_RECORD_ResetAudio(RKADK_PARAM_REC_CFG_S *pstRecCfg,
   MPP_CHN_S stSrcChn, stDestChn;
 
   pstRecorder->u64AudioPts = 0;
+  RKADK_AUDIO_CLOCK_Reset(pstRecorder->pAudioClock);
+
   if (pstRecCfg->record_type == pstRecorder->enRecType) {
     RKADK_LOGI("Record type has not changed, no need to reset the audio");
     return 0;
@@ -1795,8 +1987,6 @@ RKADK_S32 RKADK_RECORD_Create(RKADK_RECORD_ATTR_S *pstRecAttr,
     }
   }
 
-  g_pfnRequestFileNames[pstRecAttr->s32CamID] = pstRecAttr->pfnRequestFileNames;
-
   RKADK_MUXER_ATTR_S stMuxerAttr;
   ret = RKADK_RECORD_SetMuxerAttr(pstRecAttr->s32CamID, bUseVpss, &stMuxerAttr);
   if (ret) {
@@ -1813,16 +2003,24 @@ RKADK_S32 RKADK_RECORD_Create(RKADK_RECORD_ATTR_S *pstRecAttr,
   if (RKADK_MUXER_Create(&stMuxerAttr, ppRecorder))
     goto failed;
 
+  if (bEnableAudio && RKADK_RECORD_CreateAudioClock(*ppRecorder)) {
+    RKADK_MUXER_Destroy(*ppRecorder);
+    goto failed;
+  }
+
   if (RKADK_MUXER_Enable(&stMuxerAttr, *ppRecorder)) {
     RKADK_LOGE("RKADK_MUXER_Enable failed");
+    RKADK_RECORD_DestroyAudioClock(*ppRecorder);
     RKADK_MUXER_Destroy(*ppRecorder);
     goto failed;
   }
 
-  FileNameListInit(*ppRecorder);
+  FileNameListInit(*ppRecorder, pstRecAttr);
 
   if (RKADK_RECORD_BindChn(pstRecAttr, *ppRecorder)) {
     RKADK_MUXER_Disable(*ppRecorder);
+    FileNameListRelease(*ppRecorder);
+    RKADK_RECORD_DestroyAudioClock(*ppRecorder);
     RKADK_MUXER_Destroy(*ppRecorder);
     goto failed;
   }
@@ -1869,8 +2067,6 @@ RKADK_S32 RKADK_RECORD_Destroy(RKADK_MW_PTR pRecorder) {
   for (int index = 0; index < pstRecCfg->file_num; index++)
     bUseVpss[index] = RKADK_MUXER_IsUseVpss(pRecorder, pstRecCfg->attribute[index].venc_chn);
 
-  FileNameListRelease(stRecorder);
-
   ret = RKADK_RECORD_UnBindChn(u32CamId, stRecorder);
   if (ret) {
     RKADK_LOGE("RKADK_RECORD_UnBindChn failed, ret = %d", ret);
@@ -1879,6 +2075,9 @@ RKADK_S32 RKADK_RECORD_Destroy(RKADK_MW_PTR pRecorder) {
 
   RKADK_MUXER_Disable(pRecorder);
 
+  // the muxer and rollover threads request file names until disabled
+  FileNameListRelease(stRecorder);
+
   ret = RKADK_RECORD_DestoryVideoChn(u32CamId, bUseVpss, pRecorder, stRecorder->stPipAttr);
   if (ret) {
     RKADK_LOGE("RKADK_RECORD_DestoryVideoChn failed[%x]", ret);
@@ -1894,13 +2093,13 @@ RKADK_S32 RKADK_RECORD_Destroy(RKADK_MW_PTR pRecorder) {
     }
   }
 
+  RKADK_RECORD_DestroyAudioClock(stRecorder);
   ret = RKADK_MUXER_Destroy(pRecorder);
   if (ret) {
     RKADK_LOGE("RK_REC_Destroy failed, ret = %d", ret);
     return ret;
   }
 
-  g_pfnRequestFileNames[u32CamId] = NULL;
   RKADK_LOGI("Destory Record[%d, %d] End...", u32CamId, stRecorder->enRecType);
   return 0;
 }
@@ -2070,6 +2269,8 @@ RKADK_S32 RKADK_RECORD_Reset(RKADK_MW_PTR *pRecorder) {
     goto failed;
   }
 
+  // the app may name files by record type
+  FileNameListFlush(u32CamId);
   RKADK_MUXER_SetResetState(*pRecorder, false);
   RKADK_LOGI("Record[%d] reset end...", u32CamId);
 
@@ -2093,6 +2294,38 @@ RKADK_RECORD_ManualSplit(RKADK_MW_PTR pRecorder,
 
 RKADK_S32 RKADK_RECORD_GetAencChn() { return RECORD_AENC_CHN; }
 
+RKADK_S32 RKADK_RECORD_AovFlush(RKADK_MW_PTR pRecorder) {
+  return RKADK_MUXER_AovFlush(pRecorder);
+}
+
+RKADK_S32 RKADK_RECORD_GetFileNameStats(RKADK_MW_PTR pRecorder,
+                                        RKADK_REC_FILE_NAME_STATS_S *pstStats) {
+  FILE_NAME_CTX_S *pstCtx;
+  FILE_NAME_RING_S *pstRing;
+  RKADK_MUXER_HANDLE_S *pstRecorder = (RKADK_MUXER_HANDLE_S *)pRecorder;
+
+  RKADK_CHECK_POINTER(pstRecorder, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+  RKADK_CHECK_CAMERAID(pstRecorder->u32CamId, RKADK_FAILURE);
+
+  pstCtx = g_pstFileNameCtx[pstRecorder->u32CamId];
+  if (!pstCtx)
+    return RKADK_FAILURE;
+
+  memset(pstStats, 0, sizeof(RKADK_REC_FILE_NAME_STATS_S));
+  for (int i = 0; i < RKADK_MUXER_STREAM_MAX_CNT; i++) {
+    pstRing = &pstCtx->stRing[i];
+    pstStats->u32RequestCnt += pstRing->u32RequestCnt;
+    pstStats->u32FallbackCnt += pstRing->u32FallbackCnt;
+    if (pstRing->u32MaxUs > pstStats->u32MaxUs)
+      pstStats->u32MaxUs = pstRing->u32MaxUs;
+    if (pstRing->u32LastUs > pstStats->u32LastUs)
+      pstStats->u32LastUs = pstRing->u32LastUs;
+  }
+
+  return RKADK_SUCCESS;
+}
+
 RKADK_S32 RKADK_RECORD_ToggleMirror(RKADK_MW_PTR pRecorder,
                                     RKADK_STREAM_TYPE_E enStrmType,
                                     int mirror) {
@@ -645,6 +645,153 @@ static RKADK_S32 RKADK_STORAGE_FileListLoad(RKADK_STR_FOLDER *pstFolder,
   return 0;
 }
 
+#define RKADK_MP4_TYPE(a, b, c, d)                                             \
+  (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) |      \
+   (uint32_t)(d))
+
+static uint32_t RKADK_STORAGE_ReadBe32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// blocks allocated beyond EOF, past the rounding of the last block
+static bool RKADK_STORAGE_HasReserve(struct stat *pstStat) {
+  off_t blkSize = pstStat->st_blksize > 0 ? pstStat->st_blksize : 512;
+  off_t used = (pstStat->st_size + blkSize - 1) / blkSize * blkSize;
+
+  return (off_t)pstStat->st_blocks * 512 > used;
+}
+
+/*
+ * A fragmented mp4 (ftyp, moov, then moof + mdat per fragment) stays
+ * playable up to its last complete fragment, so the tail is cut instead of
+ * rebuilding the index. Only the box headers are read.
+ * return: 0 playable, 1 not a fragmented mp4, -1 no complete fragment
+ */
+static RKADK_S32 RKADK_STORAGE_TruncateFragMp4(RKADK_CHAR *file) {
+  int fd;
+  uint8_t hdr[16];
+  uint32_t type;
+  uint64_t boxSize;
+  off_t pos = 0, goodEnd = 0, fileSize;
+  bool bMoov = false, bMoof = false;
+  struct stat st;
+
+  fd = open(file, O_RDWR);
+  if (fd < 0)
+    return 1;
+
+  if (fstat(fd, &st)) {
+    close(fd);
+    return 1;
+  }
+
+  fileSize = st.st_size;
+  while (pos + 8 <= fileSize) {
+    if (pread(fd, hdr, sizeof(hdr), pos) < 8)
+      break;
+
+    boxSize = RKADK_STORAGE_ReadBe32(hdr);
+    type = RKADK_STORAGE_ReadBe32(hdr + 4);
+    if (boxSize == 1) {
+      if (pos + 16 > fileSize)
+        break;
+      boxSize = ((uint64_t)RKADK_STORAGE_ReadBe32(hdr + 8) << 32) |
+                RKADK_STORAGE_ReadBe32(hdr + 12);
+    } else if (boxSize == 0) {
+      boxSize = fileSize - pos;
+    }
+
+    if (!pos && type != RKADK_MP4_TYPE('f', 't', 'y', 'p'))
+      break;
+
+    // the box was being written
+    if (boxSize < 8 || boxSize > (uint64_t)(fileSize - pos))
+      break;
+
+    pos += boxSize;
+    if (type == RKADK_MP4_TYPE('m', 'o', 'o', 'v'))
+      bMoov = true;
+    else if (type == RKADK_MP4_TYPE('m', 'o', 'o', 'f'))
+      bMoof = true;
+    else if ((type == RKADK_MP4_TYPE('m', 'd', 'a', 't') && bMoof) ||
+             type == RKADK_MP4_TYPE('m', 'f', 'r', 'a'))
+      goodEnd = pos;
+  }
+
+  if (!bMoof) {
+    close(fd);
+    return 1;
+  }
+
+  if (!bMoov || !goodEnd) {
+    close(fd);
+    return -1;
+  }
+
+  // healthy file: no metadata write, which would also touch the mtime
+  if (goodEnd == fileSize && !RKADK_STORAGE_HasReserve(&st)) {
+    close(fd);
+    return 0;
+  }
+
+  if (goodEnd < fileSize)
+    RKADK_LOGI("Truncate %s from %lld to %lld", file, (long long)fileSize,
+               (long long)goodEnd);
+
+  // also drops the reserve the muxer preallocated beyond EOF
+  if (ftruncate(fd, goodEnd)) {
+    RKADK_LOGE("Truncate %s failed, errno = %d", file, errno);
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+  return 0;
+}
+
+// drops the reserve the muxer preallocated beyond EOF
+static void RKADK_STORAGE_TrimFile(RKADK_CHAR *file) {
+  int fd;
+  struct stat st;
+
+  fd = open(file, O_RDWR);
+  if (fd < 0)
+    return;
+
+  if (!fstat(fd, &st) && RKADK_STORAGE_HasReserve(&st) && ftruncate(fd, st.st_size))
+    RKADK_LOGW("Trim %s failed, errno = %d", file, errno);
+
+  close(fd);
+}
+
+static bool RKADK_STORAGE_RepairFile(RKADK_STR_FOLDER *folder,
+                                     struct RKADK_STR_FILE *pstFile,
+                                     RKADK_CHAR *file) {
+  RKADK_S32 ret;
+  struct stat st;
+
+  ret = RKADK_STORAGE_TruncateFragMp4(file);
+  if (ret > 0) {
+    if (repair_mp4(file) == REPA_FAIL)
+      return false;
+
+    RKADK_STORAGE_TrimFile(file);
+  } else if (ret < 0) {
+    return false;
+  }
+
+  // a file left by a power loss still counts its reserve in st_blocks
+  if (!stat(file, &st)) {
+    folder->totalSize += st.st_size - pstFile->stSize;
+    folder->totalSpace += (st.st_blocks << 9) - pstFile->stSpace;
+    pstFile->stSize = st.st_size;
+    pstFile->stSpace = st.st_blocks << 9;
+  }
+
+  return true;
+}
+
 static RKADK_S32 RKADK_STORAGE_Repair(RKADK_STORAGE_HANDLE *pHandle, RKADK_STR_DEV_ATTR *pdevAttr)
 {
   int i;
@@ -666,7 +813,7 @@ again:
       snprintf(file, 3 * RKADK_MAX_FILE_PATH_LEN, "%s%s%s", pdevAttr->cMountPath,
               pdevAttr->pstFolderAttr[i].cFolderPath,
               current->filename);
-      if ((current->stSize == 0) || (repair_mp4(file) == REPA_FAIL)) {
+      if ((current->stSize == 0) || !RKADK_STORAGE_RepairFile(folder, current, file)) {
         RKADK_LOGE("Delete %s file. %lld", file, current->stSize);
         if (remove(file))
           RKADK_LOGE("Delete %s file error.", file);
@@ -689,7 +836,8 @@ again:
       snprintf(file, 3 * RKADK_MAX_FILE_PATH_LEN, "%s%s%s", pdevAttr->cMountPath,
               pdevAttr->pstFolderAttr[i].cFolderPath,
               current->next->filename);
-      if ((current->next->stSize == 0) || (repair_mp4(file) == REPA_FAIL)) {
+      if ((current->next->stSize == 0) ||
+          !RKADK_STORAGE_RepairFile(folder, current->next, file)) {
         RKADK_LOGE("Delete %s file. %lld", file, current->next->stSize);
         if (remove(file))
           RKADK_LOGE("Delete %s file error.", file);
@@ -17,13 +17,73 @@
 #include "rkadk_ui.h"
 #include "rkadk_media_comm.h"
 #include "rkadk_log.h"
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+/* dirty rects kept per submit, more are merged into their bounds */
+#define RKADK_UI_DIRTY_RECT_MAX 8
+
+#ifndef OS_RTT
+#define RKADK_UI_CLOCK CLOCK_MONOTONIC
+#else
+#define RKADK_UI_CLOCK CLOCK_REALTIME
+#endif
+
+#define UI_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define UI_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+typedef enum {
+  RKADK_UI_BUF_FREE = 0,
+  RKADK_UI_BUF_ACQUIRED, // drawn by the app
+  RKADK_UI_BUF_QUEUED,   // submitted, waiting for vo
+  RKADK_UI_BUF_SENDING,
+  RKADK_UI_BUF_FRONT,    // on screen
+  RKADK_UI_BUF_RETIRING, // replaced on screen at the next vsync
+} RKADK_UI_BUF_STATE_E;
+
+typedef struct {
+  RKADK_VOID *pMblk;
+  RKADK_U8 *pVirAddr;
+  RKADK_UI_BUF_STATE_E enState;
+  RKADK_U32 u32Seq; // submit the content is up to date with, 0: none
+  RKADK_U64 u64SubmitUs;
+  RKADK_U64 u64FreeUs; // retiring until
+} RKADK_UI_SURFACE_BUF_S;
+
+typedef struct {
+  RKADK_U32 u32RectCnt;
+  RKADK_RECT_S astRect[RKADK_UI_DIRTY_RECT_MAX];
+} RKADK_UI_SURFACE_HIST_S;
+
+typedef struct {
+  RKADK_UI_SURFACE_ATTR_S stAttr;
+  RKADK_U32 u32Stride;
+  RKADK_U32 u32Size;
+  RKADK_U32 u32PeriodUs; // display refresh period
+  RKADK_UI_SURFACE_BUF_S astBuf[RKADK_UI_SURFACE_BUF_MAX];
+  RKADK_UI_SURFACE_HIST_S astHist[RKADK_UI_SURFACE_BUF_MAX]; // dirty rects by submit
+  RKADK_U32 u32Seq;
+  RKADK_S32 s32QueuedIdx;
+  RKADK_S32 s32LatestIdx; // last submitted
+  pthread_t tid;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool bRun;
+  RKADK_U64 u64PresentUs;
+  RKADK_U64 u64LatencySumUs;
+  RKADK_U64 u64IntervalSumUs;
+  RKADK_UI_SURFACE_STATS_S stStats;
+} RKADK_UI_SURFACE_S;
 
 typedef struct {
   RKADK_U32 u32VoLay;
   RKADK_U32 u32VoDev;
   RKADK_U32 u32VoChn;
+  RKADK_U32 u32DispFrmRt;
+  RKADK_UI_SURFACE_S *pstSurface;
 } RKADK_UI_HANDLE_S;
 
 RKADK_S32 RKADK_UI_Create(RKADK_UI_ATTR_S *pstUiAttr, RKADK_MW_PTR *ppUi) {
@@ -104,6 +164,7 @@ RKADK_S32 RKADK_UI_Create(RKADK_UI_ATTR_S *pstUiAttr, RKADK_MW_PTR *ppUi) {
   pstHandle->u32VoLay = pstUiAttr->u32VoLay;
   pstHandle->u32VoDev = pstUiAttr->u32VoDev;
   pstHandle->u32VoChn = pstUiAttr->u32VoChn;
+  pstHandle->u32DispFrmRt = pstUiAttr->u32DispFrmRt;
 
   ret = RKADK_MPI_VO_Init(pstUiAttr->u32VoLay, pstUiAttr->u32VoDev, pstUiAttr->u32VoChn,
                           &stVoPubAttr, &stLayerAttr, &stChnAttr, pstUiAttr->enVoSpliceMode);
@@ -134,6 +195,7 @@ RKADK_S32 RKADK_UI_Destroy(RKADK_MW_PTR pUi) {
 
   RKADK_CHECK_POINTER(pUi, RKADK_FAILURE);
   pstHandle = (RKADK_UI_HANDLE_S *)pUi;
+  RKADK_UI_DestroySurface(pUi);
 
   ret = RKADK_MPI_VO_DeInit(pstHandle->u32VoLay, pstHandle->u32VoDev, pstHandle->u32VoChn);
   if (ret) {
@@ -180,4 +242,501 @@ RKADK_S32 RKADK_UI_Update(RKADK_MW_PTR pUi, RKADK_UI_FRAME_INFO *pstUiFrameInfo)
   }
 
   return 0;
-}
\ No newline at end of file
+}
+
+static RKADK_U64 RKADK_UI_GetUs(void) {
+  struct timespec ts;
+
+  clock_gettime(RKADK_UI_CLOCK, &ts);
+  return (RKADK_U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void RKADK_UI_AddTime(RKADK_U64 *pu64SumUs, RKADK_U32 u32Cnt, RKADK_U64 u64Us,
+                             RKADK_U32 *pu32LastUs, RKADK_U32 *pu32AvgUs,
+                             RKADK_U32 *pu32MaxUs) {
+  if (u64Us > UINT32_MAX)
+    u64Us = UINT32_MAX;
+
+  *pu64SumUs += u64Us;
+  *pu32LastUs = (RKADK_U32)u64Us;
+  *pu32AvgUs = (RKADK_U32)(*pu64SumUs / u32Cnt);
+  if (u64Us > *pu32MaxUs)
+    *pu32MaxUs = (RKADK_U32)u64Us;
+}
+
+/* bytes per pixel, yuv420sp is copied as a luma and a half height chroma plane */
+static RKADK_U32 RKADK_UI_GetBpp(RKADK_FORMAT_E enFormat) {
+  switch (enFormat) {
+  case RKADK_FMT_ARGB8888:
+  case RKADK_FMT_ABGR8888:
+  case RKADK_FMT_RGBA8888:
+  case RKADK_FMT_BGRA8888:
+    return 4;
+  case RKADK_FMT_ARGB1555:
+  case RKADK_FMT_ABGR1555:
+  case RKADK_FMT_RGBA5551:
+  case RKADK_FMT_BGRA5551:
+  case RKADK_FMT_ARGB4444:
+  case RKADK_FMT_ABGR4444:
+  case RKADK_FMT_RGBA4444:
+  case RKADK_FMT_BGRA4444:
+  case RKADK_FMT_RGB565:
+  case RKADK_FMT_BGR565:
+    return 2;
+  case RKADK_FMT_YUV420SP:
+  case RKADK_FMT_YUV420SP_VU:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static bool RKADK_UI_IsYuv(RKADK_FORMAT_E enFormat) {
+  return enFormat == RKADK_FMT_YUV420SP || enFormat == RKADK_FMT_YUV420SP_VU;
+}
+
+/* returns the bytes copied */
+static RKADK_U64 RKADK_UI_CopyRect(RKADK_UI_SURFACE_S *pstSurface, RKADK_U8 *pDst,
+                                   RKADK_U8 *pSrc, RKADK_RECT_S *pstRect) {
+  RKADK_U32 i, u32Offset, u32Len, u32Y, u32H;
+  RKADK_U64 u64Bytes;
+  RKADK_U32 u32Stride = pstSurface->u32Stride;
+  RKADK_U32 u32Bpp = RKADK_UI_GetBpp(pstSurface->stAttr.Format);
+
+  u32Len = pstRect->u32Width * u32Bpp;
+  for (i = 0; i < pstRect->u32Height; i++) {
+    u32Offset = (pstRect->u32Y + i) * u32Stride + pstRect->u32X * u32Bpp;
+    memcpy(pDst + u32Offset, pSrc + u32Offset, u32Len);
+  }
+  u64Bytes = (RKADK_U64)u32Len * pstRect->u32Height;
+
+  if (!RKADK_UI_IsYuv(pstSurface->stAttr.Format))
+    return u64Bytes;
+
+  // interleaved chroma of the 2x2 blocks the rect touches
+  pDst += u32Stride * pstSurface->stAttr.u32Height;
+  pSrc += u32Stride * pstSurface->stAttr.u32Height;
+  u32Offset = pstRect->u32X & ~1U;
+  u32Len = ((pstRect->u32X + pstRect->u32Width + 1) & ~1U) - u32Offset;
+  u32Y = pstRect->u32Y / 2;
+  u32H = (pstRect->u32Y + pstRect->u32Height + 1) / 2 - u32Y;
+  for (i = 0; i < u32H; i++)
+    memcpy(pDst + (u32Y + i) * u32Stride + u32Offset,
+           pSrc + (u32Y + i) * u32Stride + u32Offset, u32Len);
+  return u64Bytes + (RKADK_U64)u32Len * u32H;
+}
+
+static void *RKADK_UI_SurfaceProc(void *arg) {
+  int i, ret;
+  RKADK_U64 u64NowUs;
+  RKADK_UI_SURFACE_BUF_S *pstBuf;
+  VIDEO_FRAME_INFO_S stVoVFrame;
+  RKADK_UI_HANDLE_S *pstHandle = (RKADK_UI_HANDLE_S *)arg;
+  RKADK_UI_SURFACE_S *pstSurface = pstHandle->pstSurface;
+  RKADK_UI_SURFACE_STATS_S *pstStats = &pstSurface->stStats;
+
+  pthread_mutex_lock(&pstSurface->mutex);
+  while (pstSurface->bRun) {
+    if (pstSurface->s32QueuedIdx < 0) {
+      pthread_cond_wait(&pstSurface->cond, &pstSurface->mutex);
+      continue;
+    }
+
+    pstBuf = &pstSurface->astBuf[pstSurface->s32QueuedIdx];
+    pstBuf->enState = RKADK_UI_BUF_SENDING;
+    pstSurface->s32QueuedIdx = -1;
+    pthread_mutex_unlock(&pstSurface->mutex);
+
+    memset(&stVoVFrame, 0, sizeof(VIDEO_FRAME_INFO_S));
+    stVoVFrame.stVFrame.u32Width = pstSurface->stAttr.u32Width;
+    stVoVFrame.stVFrame.u32Height = pstSurface->stAttr.u32Height;
+    stVoVFrame.stVFrame.u32VirWidth = pstSurface->stAttr.u32Width;
+    stVoVFrame.stVFrame.u32VirHeight = pstSurface->stAttr.u32Height;
+    stVoVFrame.stVFrame.enPixelFormat = RKADK_MEDIA_GetRkPixelFormat(pstSurface->stAttr.Format);
+    stVoVFrame.stVFrame.pMbBlk = pstBuf->pMblk;
+    ret = RK_MPI_VO_SendFrame(pstHandle->u32VoLay, pstHandle->u32VoChn, &stVoVFrame, 1000);
+
+    pthread_mutex_lock(&pstSurface->mutex);
+    u64NowUs = RKADK_UI_GetUs();
+    if (ret) {
+      RKADK_LOGE("RK_MPI_VO_SendFrame timeout: ret[%x]", ret);
+      pstStats->u32SendFailCnt++;
+      pstBuf->enState = RKADK_UI_BUF_FREE;
+      pthread_cond_broadcast(&pstSurface->cond);
+      continue;
+    }
+
+    // vo scans the old front until the next vsync
+    for (i = 0; i < (int)pstSurface->stAttr.u32BufCnt; i++) {
+      if (pstSurface->astBuf[i].enState == RKADK_UI_BUF_FRONT) {
+        pstSurface->astBuf[i].enState = RKADK_UI_BUF_RETIRING;
+        pstSurface->astBuf[i].u64FreeUs = u64NowUs + pstSurface->u32PeriodUs;
+      }
+    }
+    pstBuf->enState = RKADK_UI_BUF_FRONT;
+
+    pstStats->u32PresentCnt++;
+    RKADK_UI_AddTime(&pstSurface->u64LatencySumUs, pstStats->u32PresentCnt,
+                     u64NowUs - pstBuf->u64SubmitUs, &pstStats->u32SubmitLatencyLastUs,
+                     &pstStats->u32SubmitLatencyAvgUs, &pstStats->u32SubmitLatencyMaxUs);
+    if (pstSurface->u64PresentUs)
+      RKADK_UI_AddTime(&pstSurface->u64IntervalSumUs, pstStats->u32PresentCnt - 1,
+                       u64NowUs - pstSurface->u64PresentUs, &pstStats->u32FrameIntervalLastUs,
+                       &pstStats->u32FrameIntervalAvgUs, &pstStats->u32FrameIntervalMaxUs);
+    pstSurface->u64PresentUs = u64NowUs;
+    pthread_cond_broadcast(&pstSurface->cond);
+  }
+  pthread_mutex_unlock(&pstSurface->mutex);
+
+  RKADK_LOGD("Exit!");
+  return NULL;
+}
+
+static void RKADK_UI_SurfaceRelease(RKADK_UI_SURFACE_S *pstSurface) {
+  int i;
+
+  for (i = 0; i < RKADK_UI_SURFACE_BUF_MAX; i++) {
+    if (pstSurface->astBuf[i].pMblk)
+      RK_MPI_MMZ_Free(pstSurface->astBuf[i].pMblk);
+  }
+
+  pthread_cond_destroy(&pstSurface->cond);
+  pthread_mutex_destroy(&pstSurface->mutex);
+  free(pstSurface);
+}
+
+RKADK_S32 RKADK_UI_CreateSurface(RKADK_MW_PTR pUi, RKADK_UI_SURFACE_ATTR_S *pstAttr) {
+  int i, ret;
+  RKADK_U32 u32Bpp;
+  pthread_condattr_t stCondAttr;
+  RKADK_UI_HANDLE_S *pstHandle = NULL;
+  RKADK_UI_SURFACE_S *pstSurface = NULL;
+
+  RKADK_CHECK_POINTER(pUi, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstAttr, RKADK_FAILURE);
+  pstHandle = (RKADK_UI_HANDLE_S *)pUi;
+
+  if (pstHandle->pstSurface) {
+    RKADK_LOGE("Ui surface has been created!");
+    return -1;
+  }
+
+  u32Bpp = RKADK_UI_GetBpp(pstAttr->Format);
+  if (!u32Bpp || !pstAttr->u32Width || !pstAttr->u32Height) {
+    RKADK_LOGE("Invalid surface [%d x %d, format: %d]", pstAttr->u32Width,
+               pstAttr->u32Height, pstAttr->Format);
+    return -1;
+  }
+
+  if (RKADK_UI_IsYuv(pstAttr->Format) && ((pstAttr->u32Width | pstAttr->u32Height) & 1)) {
+    RKADK_LOGE("Yuv surface [%d x %d] must be even", pstAttr->u32Width, pstAttr->u32Height);
+    return -1;
+  }
+
+  pstSurface = (RKADK_UI_SURFACE_S *)calloc(1, sizeof(RKADK_UI_SURFACE_S));
+  if (!pstSurface) {
+    RKADK_LOGE("malloc ui surface failed!");
+    return -1;
+  }
+
+  memcpy(&pstSurface->stAttr, pstAttr, sizeof(RKADK_UI_SURFACE_ATTR_S));
+  if (!pstSurface->stAttr.u32BufCnt || pstSurface->stAttr.u32BufCnt > RKADK_UI_SURFACE_BUF_MAX)
+    pstSurface->stAttr.u32BufCnt = RKADK_UI_SURFACE_BUF_MAX;
+  else if (pstSurface->stAttr.u32BufCnt < 2)
+    pstSurface->stAttr.u32BufCnt = 2;
+
+  pstSurface->u32Stride = pstAttr->u32Width * u32Bpp;
+  pstSurface->u32Size = pstSurface->u32Stride * pstAttr->u32Height;
+  if (RKADK_UI_IsYuv(pstAttr->Format))
+    pstSurface->u32Size = pstSurface->u32Size * 3 / 2;
+  pstSurface->u32PeriodUs = 1000000 / (pstHandle->u32DispFrmRt ? pstHandle->u32DispFrmRt : 60);
+  pstSurface->s32QueuedIdx = -1;
+  pstSurface->s32LatestIdx = -1;
+
+  pthread_mutex_init(&pstSurface->mutex, NULL);
+  pthread_condattr_init(&stCondAttr);
+#ifndef OS_RTT
+  pthread_condattr_setclock(&stCondAttr, RKADK_UI_CLOCK);
+#endif
+  pthread_cond_init(&pstSurface->cond, &stCondAttr);
+  pthread_condattr_destroy(&stCondAttr);
+
+  for (i = 0; i < (int)pstSurface->stAttr.u32BufCnt; i++) {
+    ret = RK_MPI_MMZ_Alloc(&pstSurface->astBuf[i].pMblk, pstSurface->u32Size,
+                           RK_MMZ_ALLOC_CACHEABLE);
+    if (ret) {
+      RKADK_LOGE("alloc ui surface buffer[%d] failed[%x]", i, ret);
+      pstSurface->astBuf[i].pMblk = NULL;
+      RKADK_UI_SurfaceRelease(pstSurface);
+      return -1;
+    }
+
+    pstSurface->astBuf[i].pVirAddr = (RKADK_U8 *)RK_MPI_MMZ_Handle2VirAddr(pstSurface->astBuf[i].pMblk);
+    memset(pstSurface->astBuf[i].pVirAddr, 0, pstSurface->u32Size);
+    RK_MPI_SYS_MmzFlushCache(pstSurface->astBuf[i].pMblk, RK_FALSE);
+  }
+
+  pstSurface->bRun = true;
+  pstHandle->pstSurface = pstSurface;
+  ret = pthread_create(&pstSurface->tid, NULL, RKADK_UI_SurfaceProc, pstHandle);
+  if (ret) {
+    RKADK_LOGE("Create ui surface thread failed %d", ret);
+    pstHandle->pstSurface = NULL;
+    RKADK_UI_SurfaceRelease(pstSurface);
+    return -1;
+  }
+  pthread_setname_np(pstSurface->tid, "UiSurface");
+
+  RKADK_LOGI("UI surface [%d x %d, format: %d, buffers: %d] created", pstAttr->u32Width,
+             pstAttr->u32Height, pstAttr->Format, pstSurface->stAttr.u32BufCnt);
+  return 0;
+}
+
+RKADK_S32 RKADK_UI_DestroySurface(RKADK_MW_PTR pUi) {
+  RKADK_UI_HANDLE_S *pstHandle = NULL;
+  RKADK_UI_SURFACE_S *pstSurface = NULL;
+
+  RKADK_CHECK_POINTER(pUi, RKADK_FAILURE);
+  pstHandle = (RKADK_UI_HANDLE_S *)pUi;
+  pstSurface = pstHandle->pstSurface;
+  if (!pstSurface)
+    return 0;
+
+  pthread_mutex_lock(&pstSurface->mutex);
+  pstSurface->bRun = false;
+  pthread_cond_broadcast(&pstSurface->cond);
+  pthread_mutex_unlock(&pstSurface->mutex);
+  pthread_join(pstSurface->tid, NULL);
+
+  RKADK_LOGI("UI surface submit: %d, present: %d, replace: %d, latency avg: %dus, "
+             "max: %dus, interval avg: %dus, max: %dus, copy: %lld bytes",
+             pstSurface->stStats.u32SubmitCnt, pstSurface->stStats.u32PresentCnt,
+             pstSurface->stStats.u32ReplaceCnt, pstSurface->stStats.u32SubmitLatencyAvgUs,
+             pstSurface->stStats.u32SubmitLatencyMaxUs, pstSurface->stStats.u32FrameIntervalAvgUs,
+             pstSurface->stStats.u32FrameIntervalMaxUs,
+             (long long)pstSurface->stStats.u64CopyBytes);
+
+  // vo keeps its own reference of the front buffer
+  pstHandle->pstSurface = NULL;
+  RKADK_UI_SurfaceRelease(pstSurface);
+  return 0;
+}
+
+/* a free buffer with the newest content, or the soonest retiring one */
+static int RKADK_UI_FindFree(RKADK_UI_SURFACE_S *pstSurface, RKADK_U64 u64NowUs,
+                             RKADK_U64 *pu64FreeUs) {
+  int i, s32Idx = -1;
+  RKADK_UI_SURFACE_BUF_S *pstBuf;
+
+  *pu64FreeUs = 0;
+  for (i = 0; i < (int)pstSurface->stAttr.u32BufCnt; i++) {
+    pstBuf = &pstSurface->astBuf[i];
+    if (pstBuf->enState == RKADK_UI_BUF_RETIRING) {
+      if (pstBuf->u64FreeUs > u64NowUs) {
+        if (!*pu64FreeUs || pstBuf->u64FreeUs < *pu64FreeUs)
+          *pu64FreeUs = pstBuf->u64FreeUs;
+        continue;
+      }
+
+      pstBuf->enState = RKADK_UI_BUF_FREE;
+    }
+
+    if (pstBuf->enState == RKADK_UI_BUF_FREE &&
+        (s32Idx < 0 || pstBuf->u32Seq > pstSurface->astBuf[s32Idx].u32Seq))
+      s32Idx = i;
+  }
+
+  return s32Idx;
+}
+
+RKADK_S32 RKADK_UI_AcquireBuffer(RKADK_MW_PTR pUi, RKADK_UI_BUFFER_S *pstBuffer,
+                                 RKADK_S32 s32TimeoutMs) {
+  int i, j, s32Idx, s32SrcIdx;
+  RKADK_U32 u32Seq, u32RectCnt = 0;
+  RKADK_U64 u64NowUs, u64FreeUs, u64DeadlineUs, u64Bytes = 0;
+  RKADK_RECT_S astRect[RKADK_UI_SURFACE_BUF_MAX * RKADK_UI_DIRTY_RECT_MAX];
+  RKADK_UI_SURFACE_HIST_S *pstHist;
+  RKADK_UI_SURFACE_BUF_S *pstBuf;
+  RKADK_UI_SURFACE_S *pstSurface;
+  struct timespec ts;
+  bool bWait = false;
+
+  RKADK_CHECK_POINTER(pUi, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstBuffer, RKADK_FAILURE);
+  pstSurface = ((RKADK_UI_HANDLE_S *)pUi)->pstSurface;
+  RKADK_CHECK_POINTER(pstSurface, RKADK_FAILURE);
+
+  u64DeadlineUs = RKADK_UI_GetUs() + (RKADK_U64)s32TimeoutMs * 1000;
+  pthread_mutex_lock(&pstSurface->mutex);
+  while (1) {
+    u64NowUs = RKADK_UI_GetUs();
+    s32Idx = RKADK_UI_FindFree(pstSurface, u64NowUs, &u64FreeUs);
+    if (s32Idx >= 0)
+      break;
+
+    if (s32TimeoutMs == 0 || (s32TimeoutMs > 0 && u64NowUs >= u64DeadlineUs)) {
+      pthread_mutex_unlock(&pstSurface->mutex);
+      return -1;
+    }
+
+    bWait = true;
+    if (s32TimeoutMs > 0 && (!u64FreeUs || u64DeadlineUs < u64FreeUs))
+      u64FreeUs = u64DeadlineUs;
+
+    if (u64FreeUs) {
+      ts.tv_sec = u64FreeUs / 1000000;
+      ts.tv_nsec = (u64FreeUs % 1000000) * 1000;
+      pthread_cond_timedwait(&pstSurface->cond, &pstSurface->mutex, &ts);
+    } else {
+      pthread_cond_wait(&pstSurface->cond, &pstSurface->mutex);
+    }
+  }
+
+  if (bWait)
+    pstSurface->stStats.u32AcquireWaitCnt++;
+
+  // regions drawn since this buffer's content, copied from the newest buffer
+  pstBuf = &pstSurface->astBuf[s32Idx];
+  pstBuf->enState = RKADK_UI_BUF_ACQUIRED;
+  s32SrcIdx = pstSurface->s32LatestIdx;
+  u32Seq = s32SrcIdx >= 0 ? pstSurface->astBuf[s32SrcIdx].u32Seq : 0;
+  if (s32SrcIdx >= 0 && s32SrcIdx != s32Idx && pstBuf->u32Seq != u32Seq) {
+    if (!pstBuf->u32Seq || u32Seq - pstBuf->u32Seq > RKADK_UI_SURFACE_BUF_MAX) {
+      astRect[0].u32X = 0;
+      astRect[0].u32Y = 0;
+      astRect[0].u32Width = pstSurface->stAttr.u32Width;
+      astRect[0].u32Height = pstSurface->stAttr.u32Height;
+      u32RectCnt = 1;
+    } else {
+      for (i = pstBuf->u32Seq + 1; i <= (int)u32Seq; i++) {
+        pstHist = &pstSurface->astHist[i % RKADK_UI_SURFACE_BUF_MAX];
+        for (j = 0; j < (int)pstHist->u32RectCnt; j++)
+          astRect[u32RectCnt++] = pstHist->astRect[j];
+      }
+    }
+  } else {
+    s32SrcIdx = -1;
+  }
+  pthread_mutex_unlock(&pstSurface->mutex);
+
+  // the source is queued or on screen, no one writes it meanwhile
+  if (s32SrcIdx >= 0) {
+    for (i = 0; i < (int)u32RectCnt; i++)
+      u64Bytes += RKADK_UI_CopyRect(pstSurface, pstBuf->pVirAddr,
+                                    pstSurface->astBuf[s32SrcIdx].pVirAddr, &astRect[i]);
+
+    pthread_mutex_lock(&pstSurface->mutex);
+    pstBuf->u32Seq = u32Seq;
+    pstSurface->stStats.u64CopyBytes += u64Bytes;
+    pthread_mutex_unlock(&pstSurface->mutex);
+  }
+
+  pstBuffer->u32Index = s32Idx;
+  pstBuffer->u32Width = pstSurface->stAttr.u32Width;
+  pstBuffer->u32Height = pstSurface->stAttr.u32Height;
+  pstBuffer->u32Stride = pstSurface->u32Stride;
+  pstBuffer->pVirAddr = pstBuf->pVirAddr;
+  pstBuffer->pMblk = pstBuf->pMblk;
+  return 0;
+}
+
+RKADK_S32 RKADK_UI_SubmitBuffer(RKADK_MW_PTR pUi, RKADK_UI_BUFFER_S *pstBuffer,
+                                RKADK_RECT_S *pstDirtyRect, RKADK_U32 u32RectCnt) {
+  int i;
+  RKADK_U32 u32Right, u32Bottom, u32MaxRight = 0, u32MaxBottom = 0;
+  RKADK_RECT_S stRect;
+  RKADK_UI_SURFACE_HIST_S stHist;
+  RKADK_UI_SURFACE_BUF_S *pstBuf;
+  RKADK_UI_SURFACE_S *pstSurface;
+
+  RKADK_CHECK_POINTER(pUi, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstBuffer, RKADK_FAILURE);
+  pstSurface = ((RKADK_UI_HANDLE_S *)pUi)->pstSurface;
+  RKADK_CHECK_POINTER(pstSurface, RKADK_FAILURE);
+
+  if (pstBuffer->u32Index >= pstSurface->stAttr.u32BufCnt) {
+    RKADK_LOGE("Invalid ui surface buffer[%d]", pstBuffer->u32Index);
+    return -1;
+  }
+  pstBuf = &pstSurface->astBuf[pstBuffer->u32Index];
+
+  // clipped to the surface, too many rects are merged into their bounds
+  memset(&stHist, 0, sizeof(RKADK_UI_SURFACE_HIST_S));
+  stHist.astRect[0].u32X = pstSurface->stAttr.u32Width;
+  stHist.astRect[0].u32Y = pstSurface->stAttr.u32Height;
+  for (i = 0; pstDirtyRect && i < (int)u32RectCnt; i++) {
+    stRect = pstDirtyRect[i];
+    if (stRect.u32X >= pstSurface->stAttr.u32Width || stRect.u32Y >= pstSurface->stAttr.u32Height)
+      continue;
+
+    u32Right = stRect.u32X + UI_MIN(stRect.u32Width, pstSurface->stAttr.u32Width - stRect.u32X);
+    u32Bottom = stRect.u32Y + UI_MIN(stRect.u32Height, pstSurface->stAttr.u32Height - stRect.u32Y);
+    if (u32Right == stRect.u32X || u32Bottom == stRect.u32Y)
+      continue;
+
+    stRect.u32Width = u32Right - stRect.u32X;
+    stRect.u32Height = u32Bottom - stRect.u32Y;
+    if (u32RectCnt <= RKADK_UI_DIRTY_RECT_MAX) {
+      stHist.astRect[stHist.u32RectCnt++] = stRect;
+    } else {
+      stHist.astRect[0].u32X = UI_MIN(stHist.astRect[0].u32X, stRect.u32X);
+      stHist.astRect[0].u32Y = UI_MIN(stHist.astRect[0].u32Y, stRect.u32Y);
+      u32MaxRight = UI_MAX(u32MaxRight, u32Right);
+      u32MaxBottom = UI_MAX(u32MaxBottom, u32Bottom);
+    }
+  }
+
+  if (u32MaxRight) {
+    stHist.astRect[0].u32Width = u32MaxRight - stHist.astRect[0].u32X;
+    stHist.astRect[0].u32Height = u32MaxBottom - stHist.astRect[0].u32Y;
+    stHist.u32RectCnt = 1;
+  } else if (!pstDirtyRect || !u32RectCnt) {
+    stHist.astRect[0].u32X = 0;
+    stHist.astRect[0].u32Y = 0;
+    stHist.astRect[0].u32Width = pstSurface->stAttr.u32Width;
+    stHist.astRect[0].u32Height = pstSurface->stAttr.u32Height;
+    stHist.u32RectCnt = 1;
+  }
+
+  RK_MPI_SYS_MmzFlushCache(pstBuf->pMblk, RK_FALSE);
+
+  pthread_mutex_lock(&pstSurface->mutex);
+  if (pstBuf->enState != RKADK_UI_BUF_ACQUIRED) {
+    pthread_mutex_unlock(&pstSurface->mutex);
+    RKADK_LOGE("Ui surface buffer[%d] not acquired", pstBuffer->u32Index);
+    return -1;
+  }
+
+  pstBuf->u32Seq = ++pstSurface->u32Seq;
+  memcpy(&pstSurface->astHist[pstBuf->u32Seq % RKADK_UI_SURFACE_BUF_MAX], &stHist,
+         sizeof(RKADK_UI_SURFACE_HIST_S));
+
+  // latest wins, vo has not taken the previous one yet
+  if (pstSurface->s32QueuedIdx >= 0) {
+    pstSurface->astBuf[pstSurface->s32QueuedIdx].enState = RKADK_UI_BUF_FREE;
+    pstSurface->stStats.u32ReplaceCnt++;
+  }
+
+  pstBuf->enState = RKADK_UI_BUF_QUEUED;
+  pstBuf->u64SubmitUs = RKADK_UI_GetUs();
+  pstSurface->s32QueuedIdx = pstBuffer->u32Index;
+  pstSurface->s32LatestIdx = pstBuffer->u32Index;
+  pstSurface->stStats.u32SubmitCnt++;
+  pthread_cond_broadcast(&pstSurface->cond);
+  pthread_mutex_unlock(&pstSurface->mutex);
+  return 0;
+}
+
+RKADK_S32 RKADK_UI_GetSurfaceStats(RKADK_MW_PTR pUi, RKADK_UI_SURFACE_STATS_S *pstStats) {
+  RKADK_UI_SURFACE_S *pstSurface;
+
+  RKADK_CHECK_POINTER(pUi, RKADK_FAILURE);
+  RKADK_CHECK_POINTER(pstStats, RKADK_FAILURE);
+  pstSurface = ((RKADK_UI_HANDLE_S *)pUi)->pstSurface;
+  RKADK_CHECK_POINTER(pstSurface, RKADK_FAILURE);
+
+  pthread_mutex_lock(&pstSurface->mutex);
+  memcpy(pstStats, &pstSurface->stStats, sizeof(RKADK_UI_SURFACE_STATS_S));
+  pthread_mutex_unlock(&pstSurface->mutex);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Rockchip, Inc. All Rights Reserved.
+#
+#  Licensed under the Apache License, Version 2.0 (the "License");
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an "AS IS" BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+# Converts a RKADK_TRACE_Dump file to the Chrome trace event format, open
+# the output with chrome://tracing or https://ui.perfetto.dev.
+#
+# usage: rkadk_trace2json.py trace.bin [trace.json]
+
+import json
+import struct
+import sys
+
+MAGIC = 0x52544b52
+VERSION = 1
+
+# keep in sync with RKADK_TRACE_EVT_E
+EVT_NAME = [
+    'venc_get',
+    'venc_release',
+    'muxer_queue',
+    'muxer_write_begin',
+    'muxer_write_end',
+    'rtsp_queue',
+    'rtsp_send',
+    'vdec_get',
+    'vo_send',
+]
+
+# async spans, begin event -> (end event, span name)
+SPANS = {
+    'venc_get': ('venc_release', 'venc_consumers'),
+    'muxer_queue': ('muxer_write_begin', 'muxer_wait'),
+    'muxer_write_begin': ('muxer_write_end', 'muxer_write'),
+    'rtsp_queue': ('rtsp_send', 'rtsp_wait'),
+    'vdec_get': ('vo_send', 'player_render'),
+}
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, buf_cnt, rec_size = struct.unpack_from('<4I', data, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('%s: not a rkadk trace v%d' % (path, VERSION))
+
+    off = 16
+    threads = []
+    for _ in range(buf_cnt):
+        tid, rec_cnt, name = struct.unpack_from('<2I16s', data, off)
+        off += 24
+        recs = []
+        for i in range(rec_cnt):
+            recs.append(struct.unpack_from('<QQIHH', data, off + i * rec_size))
+        off += rec_cnt * rec_size
+        threads.append((tid, name.split(b'\0')[0].decode(errors='replace'), recs))
+
+    return threads
+
+
+def convert(threads):
+    events = []
+    base = min((r[0][0] for _, _, r in threads if r), default=0)
+
+    for tid, name, recs in threads:
+        if name:
+            events.append({'ph': 'M', 'name': 'thread_name', 'pid': 1,
+                           'tid': tid, 'args': {'name': name}})
+
+        for ts_ns, pts, seq, evt, chn in recs:
+            evt_name = EVT_NAME[evt] if evt < len(EVT_NAME) else 'evt_%d' % evt
+            ts = (ts_ns - base) / 1000.0
+            args = {'chn': chn, 'seq': seq, 'pts': pts}
+            events.append({'ph': 'i', 's': 't', 'name': evt_name, 'pid': 1,
+                           'tid': tid, 'ts': ts, 'args': args})
+
+            # a frame is identified by its channel and pts across threads
+            for begin, (end, span) in SPANS.items():
+                if evt_name == begin:
+                    events.append({'ph': 'b', 'cat': 'frame', 'name': span,
+                                   'id': '%d:%d' % (chn, pts), 'pid': 1,
+                                   'tid': tid, 'ts': ts, 'args': args})
+                elif evt_name == end:
+                    events.append({'ph': 'e', 'cat': 'frame', 'name': span,
+                                   'id': '%d:%d' % (chn, pts), 'pid': 1,
+                                   'tid': tid, 'ts': ts})
+
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: %s trace.bin [trace.json]' % sys.argv[0])
+        return 1
+
+    out = sys.argv[2] if len(sys.argv) > 2 else sys.argv[1] + '.json'
+    with open(out, 'w') as f:
+        json.dump(convert(load(sys.argv[1])), f)
+
+    print('write %s' % out)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())